@@ -0,0 +1,335 @@
+/**
+ * @file ambra_bench.cpp
+ * @brief Throughput of every compiler stage and of both VM engines
+ *
+ * Each stage is timed on its own: whatever it consumes is produced once,
+ * outside the timed loop, by running the stages before it. Every benchmark
+ * reports source bytes per second and AST nodes per second, so stages and
+ * inputs of different sizes compare directly.
+ *
+ * Benchmarks are named <Stage>/<input>, for example Parse/statements_100k;
+ * select a subset with --benchmark_filter.
+ */
+
+#include "inputs.h"
+
+#include "cli/pipeline.h"
+#include "ir/lowering.h"
+#include "ir/optimizer.h"
+#include "ir/slot_allocator.h"
+#include "ir/validator.h"
+#include "parser/parser.h"
+#include "sema/analyzer.h"
+#include "vm/register_vm.h"
+#include "vm/vm.h"
+
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+/** @brief Output stream that discards what the programs print */
+class NullBuffer : public std::streambuf
+{
+  protected:
+    int overflow(int c) override
+    {
+        return c;
+    }
+
+    std::streamsize xsputn(const char*, std::streamsize count) override
+    {
+        return count;
+    }
+};
+
+/**
+ * @brief One input with the result of every stage, for feeding the next
+ */
+struct Prepared
+{
+    BenchInput         input;
+    std::vector<Token> tokens;
+    Program            program{{}, false, {1, 1}, {1, 1}};
+    Program            scratch{{}, false, {1, 1}, {1, 1}}; ///< Second parse, for Resolve
+    SemanticResult     sema;
+    TypeCheckerResults types;
+    IrProgram          lowered;   ///< Before optimization
+    IrProgram          optimized; ///< What the VM runs
+    size_t             nodes = 0; ///< AST nodes in `program`
+    std::string        error;     ///< Why the input could not be prepared, if it could not
+};
+
+static std::unique_ptr<Prepared> prepare(BenchInput input)
+{
+    auto prepared = std::make_unique<Prepared>();
+    prepared->input = std::move(input);
+    const std::string& source = prepared->input.source;
+
+    Lexer lexer(source);
+    prepared->tokens = lexer.scanTokens();
+
+    Parser parser(prepared->tokens);
+    prepared->program = parser.parseProgram();
+    if (prepared->program.hadError())
+    {
+        prepared->error = "parse failed";
+        return prepared;
+    }
+    prepared->nodes = prepared->program.getArena()->nodeCount();
+
+    // Resolving points each summon at a symbol of that run; the runs of the
+    // Resolve benchmark must not leave `program` pointing into freed scopes.
+    Parser scratchParser(prepared->tokens);
+    prepared->scratch = scratchParser.parseProgram();
+
+    Resolver resolver;
+    prepared->sema = resolver.resolve(prepared->program);
+    TypeChecker checker(prepared->sema.resolutionTable, prepared->sema.rootScope.get());
+    prepared->types = checker.typeCheck(prepared->program);
+
+    std::ostringstream diagnostics;
+    if (!compileSource(prepared->input.name, source, prepared->optimized, &diagnostics))
+    {
+        prepared->error = diagnostics.str();
+        return prepared;
+    }
+
+    LoweringContext lowering{nullptr, nullptr, {}, &prepared->types.typeTable,
+                             &prepared->sema.resolutionTable};
+    prepared->lowered = lowering.lowerProgram(&prepared->program);
+    return prepared;
+}
+
+/** @brief Record bytes/s and nodes/s for one run of `state` over `prepared` */
+static void reportThroughput(benchmark::State& state, const Prepared& prepared)
+{
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                            static_cast<int64_t>(prepared.input.source.size()));
+    state.counters["nodes/s"] = benchmark::Counter(static_cast<double>(prepared.nodes),
+                                                   benchmark::Counter::kIsIterationInvariantRate);
+}
+
+// ==================================================================================
+// STAGES
+// ==================================================================================
+
+static void lex(benchmark::State& state, const Prepared& prepared)
+{
+    for (auto _ : state)
+    {
+        Lexer              lexer(prepared.input.source);
+        std::vector<Token> tokens = lexer.scanTokens();
+        benchmark::DoNotOptimize(tokens.data());
+    }
+}
+
+static void parse(benchmark::State& state, const Prepared& prepared)
+{
+    for (auto _ : state)
+    {
+        Parser  parser(prepared.tokens);
+        Program program = parser.parseProgram();
+        benchmark::DoNotOptimize(&program);
+    }
+}
+
+static void resolve(benchmark::State& state, const Prepared& prepared)
+{
+    for (auto _ : state)
+    {
+        Resolver       resolver;
+        SemanticResult sema = resolver.resolve(prepared.scratch);
+        benchmark::DoNotOptimize(&sema);
+    }
+}
+
+static void typeCheck(benchmark::State& state, const Prepared& prepared)
+{
+    for (auto _ : state)
+    {
+        TypeChecker        checker(prepared.sema.resolutionTable, prepared.sema.rootScope.get());
+        TypeCheckerResults types = checker.typeCheck(prepared.program);
+        benchmark::DoNotOptimize(&types);
+    }
+}
+
+static void lower(benchmark::State& state, const Prepared& prepared)
+{
+    for (auto _ : state)
+    {
+        LoweringContext lowering{nullptr, nullptr, {}, &prepared.types.typeTable,
+                                 &prepared.sema.resolutionTable};
+        IrProgram       ir = lowering.lowerProgram(&prepared.program);
+        benchmark::DoNotOptimize(&ir);
+    }
+}
+
+/** @brief lower() as a batch compiler runs it: one context and IrProgram, reused */
+static void lowerReused(benchmark::State& state, const Prepared& prepared)
+{
+    LoweringContext lowering{nullptr, nullptr, {}, &prepared.types.typeTable,
+                             &prepared.sema.resolutionTable};
+    IrProgram       ir;
+    for (auto _ : state)
+    {
+        lowering.lowerProgram(&prepared.program, ir);
+        benchmark::DoNotOptimize(&ir);
+    }
+}
+
+static void optimize(benchmark::State& state, const Prepared& prepared)
+{
+    for (auto _ : state)
+    {
+        // The optimizer rewrites in place, so each run needs a fresh copy.
+        state.PauseTiming();
+        IrProgram ir = prepared.lowered;
+        state.ResumeTiming();
+
+        IrOptimizer{ir, ir.main}.optimize();
+        benchmark::DoNotOptimize(&ir);
+    }
+}
+
+static void validate(benchmark::State& state, const Prepared& prepared)
+{
+    for (auto _ : state)
+    {
+        IrValidator        validator{prepared.optimized, prepared.optimized.main};
+        IrValidatorResults results = validator.validate();
+        benchmark::DoNotOptimize(&results);
+    }
+}
+
+static void allocateSlots(benchmark::State& state, const Prepared& prepared)
+{
+    for (auto _ : state)
+    {
+        // The allocator writes the slot table, so each run needs a fresh copy.
+        state.PauseTiming();
+        IrFunction function = prepared.optimized.main;
+        state.ResumeTiming();
+
+        SlotAllocator{function}.allocate();
+        benchmark::DoNotOptimize(&function);
+    }
+}
+
+/** @brief Load and run on the stack VM; output is discarded */
+static void executeStack(benchmark::State& state, const Prepared& prepared)
+{
+    NullBuffer   buffer;
+    std::ostream sink(&buffer);
+    for (auto _ : state)
+    {
+        VM       vm(sink);
+        VmResult result = vm.load(prepared.optimized);
+        if (!result.hadError())
+        {
+            result = vm.run();
+        }
+        if (result.hadError())
+        {
+            state.SkipWithError("program failed at runtime");
+            break;
+        }
+    }
+}
+
+/** @brief Load and run on the register VM; output is discarded */
+static void executeRegister(benchmark::State& state, const Prepared& prepared)
+{
+    NullBuffer   buffer;
+    std::ostream sink(&buffer);
+    for (auto _ : state)
+    {
+        RegisterVM vm(sink);
+        VmResult   result = vm.load(prepared.optimized);
+        if (!result.hadError())
+        {
+            result = vm.run();
+        }
+        if (result.hadError())
+        {
+            state.SkipWithError("program failed at runtime");
+            break;
+        }
+    }
+}
+
+// ==================================================================================
+// REGISTRATION
+// ==================================================================================
+
+using Stage = void (*)(benchmark::State&, const Prepared&);
+
+struct StageEntry
+{
+    const char* name;
+    Stage       run;
+};
+
+static const StageEntry STAGES[] = {
+    {"Lex", lex},
+    {"Parse", parse},
+    {"Resolve", resolve},
+    {"TypeCheck", typeCheck},
+    {"Lower", lower},
+    {"LowerReused", lowerReused},
+    {"Optimize", optimize},
+    {"Validate", validate},
+    {"AllocateSlots", allocateSlots},
+    {"ExecuteStack", executeStack},
+    {"ExecuteRegister", executeRegister},
+};
+
+static void runStage(benchmark::State& state, Stage stage, const Prepared* prepared)
+{
+    if (!prepared->error.empty())
+    {
+        state.SkipWithError(prepared->error.c_str());
+        return;
+    }
+    stage(state, *prepared);
+    reportThroughput(state, *prepared);
+}
+
+int main(int argc, char** argv)
+{
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+
+    std::vector<BenchInput> inputs = sampleInputs(AMBRA_SAMPLE_DIR);
+    inputs.push_back({"statements_100k", manyStatements(100000)});
+    inputs.push_back({"nesting_500", deepNesting(500)});
+    inputs.push_back({"interpolation_5000", longInterpolation(5000)});
+
+    // Registered benchmarks refer to these until the run is over.
+    std::vector<std::unique_ptr<Prepared>> prepared;
+    for (BenchInput& input : inputs)
+    {
+        prepared.push_back(prepare(std::move(input)));
+    }
+
+    for (const StageEntry& stage : STAGES)
+    {
+        for (const auto& input : prepared)
+        {
+            std::string name = std::string(stage.name) + "/" + input->input.name;
+            benchmark::RegisterBenchmark(name.c_str(), runStage, stage.run, input.get())
+                ->Unit(benchmark::kMicrosecond);
+        }
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
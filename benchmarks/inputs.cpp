@@ -0,0 +1,110 @@
+/**
+ * @file inputs.cpp
+ * @brief Sample loading and synthetic program generators.
+ */
+
+#include "inputs.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+std::vector<BenchInput> sampleInputs(const std::string& directory)
+{
+    std::vector<BenchInput> inputs;
+    std::error_code         error;
+    for (std::filesystem::directory_iterator it(directory, error), end; !error && it != end;
+         it.increment(error))
+    {
+        if (it->path().extension() != ".ara")
+        {
+            continue;
+        }
+        std::ifstream      file(it->path(), std::ios::binary);
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        if (!contents.str().empty())
+        {
+            inputs.push_back({it->path().filename().string(), contents.str()});
+        }
+    }
+    std::sort(inputs.begin(), inputs.end(),
+              [](const BenchInput& a, const BenchInput& b) { return a.name < b.name; });
+    return inputs;
+}
+
+std::string manyStatements(size_t count)
+{
+    // Values stay small so nothing overflows however long the program is.
+    std::string source = "summon v0 = 1;\n";
+    size_t      statements = 1;
+    for (size_t i = 1; statements < count; i++)
+    {
+        std::string name = "v" + std::to_string(i);
+        std::string previous = "v" + std::to_string(i - 1);
+        switch (i % 4)
+        {
+        case 0:
+        case 1:
+            source += "summon " + name + " = " + std::to_string(i % 100) + " * 3 - " + previous +
+                      " / 7;\n";
+            statements++;
+            break;
+        case 2:
+            source += "summon " + name + " = " + previous + ";\nsay \"step " + std::to_string(i) +
+                      " is {" + name + "}!\";\n";
+            statements += 2;
+            break;
+        default:
+            source += "summon " + name + " = " + previous + " + 1;\nshould (" + name +
+                      " > 50) { say " + name + "; } otherwise { say \"small\"; }\n";
+            statements += 2;
+            break;
+        }
+    }
+    return source;
+}
+
+std::string deepNesting(size_t depth)
+{
+    std::string source = "summon x0 = 0;\n";
+    for (size_t level = 1; level <= depth; level++)
+    {
+        std::string previous = "x" + std::to_string(level - 1);
+        // Every third block is a loop whose condition is false from the start.
+        if (level % 3 == 0)
+        {
+            source += "aslongas (" + previous + " < 0) { say \"unreachable\"; }\n";
+        }
+        source += "should (" + previous + " < " + std::to_string(depth) + ") {\n";
+        source += "summon x" + std::to_string(level) + " = " + previous + " + 1;\n";
+    }
+    for (size_t level = depth; level >= 1; level--)
+    {
+        source += "say x" + std::to_string(level) + ";\n}\n";
+    }
+    return source;
+}
+
+std::string longInterpolation(size_t parts)
+{
+    std::string source = "summon a = 7;\nsummon b = affirmative;\nsummon c = \"text\";\nsay \"";
+    for (size_t i = 0; i < parts; i++)
+    {
+        switch (i % 3)
+        {
+        case 0:
+            source += "a plus " + std::to_string(i) + " is {a + " + std::to_string(i) + "}, ";
+            break;
+        case 1:
+            source += "b is {b}, ";
+            break;
+        default:
+            source += "c is {c}; ";
+            break;
+        }
+    }
+    source += "done\";\n";
+    return source;
+}
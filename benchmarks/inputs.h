@@ -0,0 +1,45 @@
+/**
+ * @file inputs.h
+ * @brief Programs the benchmarks are run on
+ *
+ * Besides the sample programs shipped with the tests, the generators below
+ * build synthetic sources that stress one dimension each: statement count,
+ * block nesting depth, and the number of parts in one interpolated string.
+ * Every generated program is valid and terminates, so it can be run by the
+ * VM as well as compiled.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * @brief One named source program
+ */
+struct BenchInput
+{
+    std::string name;   ///< Shown in benchmark names, e.g. "fib.ara"
+    std::string source; ///< Program text
+};
+
+/**
+ * @brief Every non-empty .ara file in `directory`, sorted by name
+ */
+std::vector<BenchInput> sampleInputs(const std::string& directory);
+
+/**
+ * @brief `count` top-level statements: declarations, prints and small ifs
+ */
+std::string manyStatements(size_t count);
+
+/**
+ * @brief `depth` nested `should` / `aslongas` blocks, each declaring a variable
+ */
+std::string deepNesting(size_t depth);
+
+/**
+ * @brief One `say` whose interpolated string has `parts` embedded expressions
+ */
+std::string longInterpolation(size_t parts);
@@ -0,0 +1,104 @@
+/**
+ * @file arena.cpp
+ * @brief Implementation of the AST arena.
+ */
+
+#include "ast/arena.h"
+
+#include <cstdint>
+#include <new>
+
+static thread_local AstArena* activeArena = nullptr;
+
+/// Ids of nodes created while no arena is active.
+static thread_local NodeId heapNodes = 0;
+
+void* AstArena::allocate(size_t size, size_t align)
+{
+    // new[] storage is aligned for any fundamental type, so oversized requests
+    // can use the start of a dedicated chunk. It goes in front of the current
+    // chunk, which keeps serving small nodes.
+    if (size + align > CHUNK_SIZE)
+    {
+        std::unique_ptr<char[]> chunk(new char[size]);
+        char*                   start = chunk.get();
+        chunks.insert(chunks.empty() ? chunks.end() : chunks.end() - 1, std::move(chunk));
+        used += size;
+        return start;
+    }
+
+    uintptr_t address = reinterpret_cast<uintptr_t>(cursor);
+    uintptr_t aligned = (address + align - 1) & ~static_cast<uintptr_t>(align - 1);
+
+    if (cursor == nullptr || aligned + size > reinterpret_cast<uintptr_t>(limit))
+    {
+        chunks.emplace_back(new char[CHUNK_SIZE]);
+        cursor = chunks.back().get();
+        limit = cursor + CHUNK_SIZE;
+
+        address = reinterpret_cast<uintptr_t>(cursor);
+        aligned = (address + align - 1) & ~static_cast<uintptr_t>(align - 1);
+    }
+
+    used += size + (aligned - address);
+    cursor = reinterpret_cast<char*>(aligned + size);
+    return reinterpret_cast<void*>(aligned);
+}
+
+AstArena* AstArena::active()
+{
+    return activeArena;
+}
+
+NodeId AstArena::nextNodeId()
+{
+    return activeArena != nullptr ? activeArena->nodes++ : heapNodes++;
+}
+
+AstArena::Scope::Scope(AstArena& arena) : previous(activeArena)
+{
+    activeArena = &arena;
+}
+
+AstArena::Scope::~Scope()
+{
+    activeArena = previous;
+}
+
+// Nodes need no more than pointer alignment, which the header keeps.
+static constexpr size_t HEADER_SIZE = sizeof(AstArena*);
+
+static AstArena*& headerOf(const void* node)
+{
+    return *reinterpret_cast<AstArena**>(const_cast<char*>(static_cast<const char*>(node)) -
+                                         HEADER_SIZE);
+}
+
+void* AstAllocated::operator new(size_t size)
+{
+    AstArena* arena = activeArena;
+    char*     block = arena != nullptr
+                          ? static_cast<char*>(arena->allocate(size + HEADER_SIZE, HEADER_SIZE))
+                          : static_cast<char*>(::operator new(size + HEADER_SIZE));
+    *reinterpret_cast<AstArena**>(block) = arena;
+    return block + HEADER_SIZE;
+}
+
+void AstAllocated::operator delete(void* ptr)
+{
+    if (ptr != nullptr && headerOf(ptr) == nullptr)
+    {
+        ::operator delete(static_cast<char*>(ptr) - HEADER_SIZE);
+    }
+}
+
+PackedLoc AstAllocated::packLoc(int line, int col)
+{
+    return activeArena != nullptr ? activeArena->getLines().pack(line, col)
+                                  : SourceLines::packDirect(line, col);
+}
+
+const AstArena* AstAllocated::owningArena() const
+{
+    return headerOf(this);
+}
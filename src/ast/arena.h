@@ -0,0 +1,161 @@
+/**
+ * @file arena.h
+ * @brief Bump-pointer arena that backs AST nodes
+ *
+ * The parser creates one AstArena per Program and makes it active for the
+ * duration of parseProgram(). While an arena is active on a thread, every
+ * Expr and Stmt created with `new` (including through std::make_unique) is
+ * carved out of the arena's chunks instead of going through malloc.
+ *
+ * Ownership in the tree is unchanged: nodes are still held by
+ * std::unique_ptr and their destructors still run, so members such as
+ * std::string are released normally. Only the node storage itself is
+ * deferred: deleting an arena node is a no-op, and the chunks are freed in
+ * one shot when the arena is destroyed together with its Program.
+ *
+ * Nodes created while no arena is active (for example by tests that build
+ * expected trees by hand) fall back to the global heap, so both kinds can be
+ * mixed and compared freely.
+ *
+ * Every node also receives a NodeId when it is constructed: the next number
+ * of the active arena, so the nodes of one parsed Program are numbered densely
+ * from 0 and later phases can keep per-node data in flat vectors (see
+ * node_table.h). Nodes created with no arena active are numbered from a
+ * per-thread counter instead, which keeps them distinct from one another.
+ *
+ * The arena also holds the SourceLines of the text its nodes were parsed
+ * from, through which nodes turn their packed locations back into lines and
+ * columns (see source_loc.h).
+ */
+
+#pragma once
+
+#include "ast/source_loc.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/** @brief Dense number of an AST node, unique among the nodes of one arena */
+using NodeId = uint32_t;
+
+class AstArena
+{
+  public:
+    AstArena() = default;
+
+    AstArena(const AstArena&) = delete;
+    AstArena& operator=(const AstArena&) = delete;
+
+    /**
+     * @brief Allocate `size` bytes aligned to `align` (a power of two)
+     *
+     * Requests larger than a chunk get a chunk of their own so the current
+     * chunk keeps serving small nodes.
+     */
+    void* allocate(size_t size, size_t align);
+
+    /** @brief Bytes handed out so far, including alignment padding */
+    size_t bytesUsed() const
+    {
+        return used;
+    }
+
+    /** @brief Number of chunks obtained from the global heap */
+    size_t chunkCount() const
+    {
+        return chunks.size();
+    }
+
+    /** @brief Number of nodes created in this arena; their ids are 0 to nodeCount() - 1 */
+    NodeId nodeCount() const
+    {
+        return nodes;
+    }
+
+    /** @brief Lines of the source this arena's nodes come from; empty if unknown */
+    const SourceLines& getLines() const
+    {
+        return lines;
+    }
+
+    /** @brief Set the lines that nodes created from now on pack their locations against */
+    void setLines(SourceLines table)
+    {
+        lines = std::move(table);
+    }
+
+    /**
+     * @brief Take the id of a node being constructed
+     *
+     * Numbers from the active arena, or from the current thread's heap
+     * counter when none is active.
+     */
+    static NodeId nextNodeId();
+
+    /**
+     * @brief Arena that AST node allocations on this thread currently use
+     * @return nullptr when node allocations go to the global heap
+     */
+    static AstArena* active();
+
+    /**
+     * @brief Makes an arena active for the lifetime of the scope
+     *
+     * Scopes nest: the previously active arena is restored on exit.
+     */
+    class Scope
+    {
+      public:
+        explicit Scope(AstArena& arena);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+      private:
+        AstArena* previous; ///< Arena to restore on exit
+    };
+
+  private:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> chunks;           ///< Owned storage
+    char*                                cursor = nullptr; ///< Next free byte of the last chunk
+    char*                                limit = nullptr;  ///< End of the last chunk
+    size_t                               used = 0;         ///< Bytes handed out
+    NodeId                               nodes = 0;        ///< Ids handed out
+    SourceLines                          lines;            ///< See getLines()
+};
+
+/**
+ * @brief Base of AST node classes whose storage may come from an AstArena
+ *
+ * Every allocation carries a one-pointer header recording the arena it came
+ * from, or null for the global heap. `delete` uses it to tell arena nodes
+ * (nothing to free) from heap nodes, and nodes use it to find the SourceLines
+ * their locations are packed against. Node classes must therefore be created
+ * with `new`, and may not require more than pointer alignment.
+ */
+struct AstAllocated
+{
+    static void* operator new(size_t size);
+    static void  operator delete(void* ptr);
+
+  protected:
+    /** @brief Pack a location against the active arena's lines, if any */
+    static PackedLoc packLoc(int line, int col);
+
+    /** @brief Line and column of a location this node packed with packLoc() */
+    SourceLoc unpackLoc(PackedLoc loc) const
+    {
+        return SourceLines::isDirect(loc) ? SourceLines::unpackDirect(loc)
+                                        : owningArena()->getLines().unpack(loc);
+    }
+
+  private:
+    /** @brief Arena this node was allocated from, or nullptr */
+    const AstArena* owningArena() const;
+};
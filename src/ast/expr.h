@@ -7,14 +7,20 @@
  * with an ExprKind enum value.
  */
 #pragma once
+#include "ast/arena.h"
+#include "utils/interner.h"
+
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 /**
  * @brief Enumeration of all expression node types.
  */
-enum ExprKind
+enum ExprKind : uint8_t
 {
     IntLiteral,         ///< Integer literal expression
     BoolLiteral,        ///< Boolean literal expression
@@ -28,7 +34,7 @@ enum ExprKind
 /**
  * @brief Enumeration of unary operator types.
  */
-enum UnaryOpKind
+enum UnaryOpKind : uint8_t
 {
     LogicalNot,      ///< Logical negation (not)
     ArithmeticNegate ///< Arithmetic negation (-)
@@ -37,7 +43,7 @@ enum UnaryOpKind
 /**
  * @brief Enumeration of binary operator types.
  */
-enum BinaryOpKind
+enum BinaryOpKind : uint8_t
 {
     EqualEqual,   ///< Equality comparison (==)
     NotEqual,     ///< Inequality comparison (!=)
@@ -48,60 +54,86 @@ enum BinaryOpKind
     Add,          ///< Addition (+)
     Subtract,     ///< Subtraction (-)
     Multiply,     ///< Multiplication (*)
-    Divide        ///< Division (/)
-};
-
-/**
- * @brief Represents a position in the source code.
- *
- * Used to track the source location of AST nodes for error reporting.
- */
-struct SourceLoc
-{
-    int line; ///< Line number
-    int col;  ///< Column number
-
-    bool operator==(const SourceLoc& other) const
-    {
-        return line == other.line && col == other.col;
-    }
+    Divide,       ///< Division (/)
+    LogicalAnd,   ///< Conjunction (and); the right operand only runs if the left is true
+    LogicalOr     ///< Disjunction (or); the right operand only runs if the left is false
 };
 
 /**
  * @brief Base class for all expression AST nodes.
  *
  * All concrete expression types (IntLiteralExpr, BinaryExpr, etc.)
- * inherit from this class. The kind member indicates the concrete type.
+ * inherit from this class. The kind member indicates the concrete type,
+ * and is what operations on an Expr dispatch on: there are no virtual
+ * functions, so nodes carry no vtable pointer. Deleting an Expr through a
+ * std::unique_ptr<Expr> destroys the concrete node (see the
+ * std::default_delete<Expr> specialization below).
+ * Storage comes from the active AstArena, if any (see arena.h).
  */
-class Expr
+class Expr : public AstAllocated
 {
   public:
-    ExprKind  kind; ///< The concrete type of this expression
-    SourceLoc loc;
+    ExprKind kind;                        ///< The concrete type of this expression
+    NodeId   id = AstArena::nextNodeId(); ///< Index into per-node side tables
 
-    /// Virtual destructor for polymorphic deletion
-    virtual ~Expr() = default;
+    /** @brief Line and column of the node's first token */
+    SourceLoc getLoc() const
+    {
+        return unpackLoc(loc);
+    }
 
     /**
      * @brief Compare two expressions for structural equality.
      *
-     * Derived classes must implement this to perform a deep, structural
-     * comparison of the expression subtree. Implementations should first
-     * check the concrete `kind` and the source location when relevant,
-     * then compare any fields and recursively compare child expressions.
+     * Calls the concrete type's operator==, which performs a deep,
+     * structural comparison of the expression subtree: it first checks the
+     * `kind` and the source location when relevant, then compares any
+     * fields and recursively compares child expressions.
      *
      * @param other Expression to compare against
      * @return true if expressions are structurally equal, false otherwise
      */
-    virtual bool operator==(const Expr& other) const = 0;
+    bool operator==(const Expr& other) const;
+
     /**
      * @brief Return a human-readable representation of this expression.
      *
-     * Used by tests and debugging output. Derived classes must implement a
-     * concise serialization suitable for debugging (not necessarily reversible).
+     * Used by tests and debugging output. Calls the concrete type's
+     * toString(), a concise serialization suitable for debugging (not
+     * necessarily reversible).
      */
-    virtual std::string toString() const = 0;
+    std::string toString() const;
+
+  protected:
+    Expr() = default;
+    ~Expr() = default;
+
+    void setLoc(int line, int col)
+    {
+        loc = packLoc(line, col);
+    }
+
+  private:
+    PackedLoc loc; ///< See getLoc()
+};
+
+namespace std
+{
+/**
+ * @brief Deletes an Expr as its concrete type, found from its kind
+ */
+template <> struct default_delete<Expr>
+{
+    default_delete() = default;
+
+    template <class Node, class = enable_if_t<is_convertible<Node*, Expr*>::value>>
+    default_delete(const default_delete<Node>&) noexcept
+    {
+    }
+
+    void operator()(Expr* expr) const;
 };
+} // namespace std
 
 /**
  * @brief Represents a part of an interpolated string.
@@ -159,7 +191,7 @@ class IntLiteralExpr : public Expr
      */
     IntLiteralExpr(int value, int line, int col) : value(value)
     {
-        loc = {line, col};
+        setLoc(line, col);
         kind = IntLiteral;
     };
 
@@ -168,15 +200,15 @@ class IntLiteralExpr : public Expr
         return value;
     }
 
-    bool operator==(const Expr& other) const override
+    bool operator==(const Expr& other) const
     {
         if (other.kind != kind)
             return false;
         auto& o = static_cast<const IntLiteralExpr&>(other);
-        return value == o.value && loc == o.loc;
+        return value == o.value && getLoc() == o.getLoc();
     }
 
-    std::string toString() const override
+    std::string toString() const
     {
         return std::string("Int(") + std::to_string(value) + ")";
     }
@@ -200,18 +232,18 @@ class BoolLiteralExpr : public Expr
     BoolLiteralExpr(bool value, int line, int col) : value(value)
     {
         kind = BoolLiteral;
-        loc = {line, col};
+        setLoc(line, col);
     };
 
-    bool operator==(const Expr& other) const override
+    bool operator==(const Expr& other) const
     {
         if (other.kind != kind)
             return false;
         auto& o = static_cast<const BoolLiteralExpr&>(other);
-        return value == o.value && loc == o.loc;
+        return value == o.value && getLoc() == o.getLoc();
     }
 
-    std::string toString() const override
+    std::string toString() const
     {
         return std::string("Bool(") + (value ? "true" : "false") + ")";
     }
@@ -236,32 +268,40 @@ class IdentifierExpr : public Expr
      * @param name The identifier name
      * @param loc Source location
      */
-    IdentifierExpr(std::string name, int line, int col) : name(name)
+    IdentifierExpr(std::string name, int line, int col)
+        : nameId(internName(name)), name(std::move(name))
     {
         kind = Identifier;
-        loc = {line, col};
+        setLoc(line, col);
     };
 
-    bool operator==(const Expr& other) const override
+    bool operator==(const Expr& other) const
     {
         if (other.kind != kind)
             return false;
         auto& o = static_cast<const IdentifierExpr&>(other);
-        return name == o.name && loc == o.loc;
+        return name == o.name && getLoc() == o.getLoc();
     }
 
-    std::string toString() const override
+    std::string toString() const
     {
         return std::string("Ident(") + name + ")";
     }
 
-    std::string getName() const
+    const std::string& getName() const
     {
         return name;
     }
 
+    /** @brief The name's interned id; equal names have equal ids */
+    NameId getNameId() const
+    {
+        return nameId;
+    }
+
   private:
-    std::string name; ///< The identifier name
+    NameId      nameId; ///< `name`, interned
+    std::string name;   ///< The identifier name
 };
 
 /**
@@ -282,15 +322,15 @@ class UnaryExpr : public Expr
         : op(op), operand(std::move(operand))
     {
         kind = Unary;
-        loc = {line, col};
+        setLoc(line, col);
     };
 
-    bool operator==(const Expr& other) const override
+    bool operator==(const Expr& other) const
     {
         if (other.kind != kind)
             return false;
         auto& o = static_cast<const UnaryExpr&>(other);
-        if (op != o.op || !(loc == o.loc))
+        if (op != o.op || !(getLoc() == o.getLoc()))
         {
             return false;
         };
@@ -301,7 +341,7 @@ class UnaryExpr : public Expr
         return *operand == *o.operand;
     }
 
-    std::string toString() const override
+    std::string toString() const
     {
         std::string opName = (op == LogicalNot) ? "Not" : "Neg";
         return std::string("Unary(") + opName + ", " + (operand ? operand->toString() : "null") +
@@ -344,18 +384,18 @@ class BinaryExpr : public Expr
      */
     BinaryExpr(std::unique_ptr<Expr> left, BinaryOpKind op, std::unique_ptr<Expr> right, int line,
                int col)
-        : left(std::move(left)), op(op), right(std::move(right))
+        : op(op), left(std::move(left)), right(std::move(right))
     {
         kind = Binary;
-        loc = {line, col};
+        setLoc(line, col);
     };
 
-    bool operator==(const Expr& other) const override
+    bool operator==(const Expr& other) const
     {
         if (other.kind != kind)
             return false;
         auto& o = static_cast<const BinaryExpr&>(other);
-        if (op != o.op || !(loc == o.loc))
+        if (op != o.op || !(getLoc() == o.getLoc()))
         {
             return false;
         };
@@ -366,7 +406,7 @@ class BinaryExpr : public Expr
         return *left == *o.left && *right == *o.right;
     }
 
-    std::string toString() const override
+    std::string toString() const
     {
         std::string opName;
         switch (op)
@@ -401,6 +441,12 @@ class BinaryExpr : public Expr
         case Divide:
             opName = "/";
             break;
+        case LogicalAnd:
+            opName = "and";
+            break;
+        case LogicalOr:
+            opName = "or";
+            break;
         default:
             opName = "?";
         }
@@ -432,8 +478,8 @@ class BinaryExpr : public Expr
     }
 
   private:
-    std::unique_ptr<Expr> left;  ///< The left operand
     BinaryOpKind          op;    ///< The binary operator
+    std::unique_ptr<Expr> left;  ///< The left operand
     std::unique_ptr<Expr> right; ///< The right operand
 };
 
@@ -454,15 +500,15 @@ class GroupingExpr : public Expr
         : expression(std::move(expression))
     {
         kind = Grouping;
-        loc = {line, col};
+        setLoc(line, col);
     };
 
-    bool operator==(const Expr& other) const override
+    bool operator==(const Expr& other) const
     {
         if (other.kind != kind)
             return false;
         auto& o = static_cast<const GroupingExpr&>(other);
-        if (!(loc == o.loc))
+        if (!(getLoc() == o.getLoc()))
             return false;
         if (!expression && !o.expression)
             return true;
@@ -471,7 +517,7 @@ class GroupingExpr : public Expr
         return *expression == *o.expression;
     }
 
-    std::string toString() const override
+    std::string toString() const
     {
         return std::string("Group(") + (expression ? expression->toString() : "null") + ")";
     }
@@ -510,18 +556,18 @@ class StringExpr : public Expr
     StringExpr(std::vector<StringPart>&& parts, int line, int col) : parts(std::move(parts))
     {
         kind = InterpolatedString;
-        loc = {line, col};
+        setLoc(line, col);
     };
 
-    bool operator==(const Expr& other) const override
+    bool operator==(const Expr& other) const
     {
         if (other.kind != kind)
             return false;
         auto& o = static_cast<const StringExpr&>(other);
-        return parts == o.parts && loc == o.loc;
+        return parts == o.parts && getLoc() == o.getLoc();
     }
 
-    std::string toString() const override
+    std::string toString() const
     {
         std::string out = "String(\"";
         for (const auto& p : parts)
@@ -568,4 +614,80 @@ class StringExpr : public Expr
 
   private:
     std::vector<StringPart> parts; ///< Sequence of string parts
-};
\ No newline at end of file
+};
+
+inline bool Expr::operator==(const Expr& other) const
+{
+    switch (kind)
+    {
+    case IntLiteral:
+        return static_cast<const IntLiteralExpr&>(*this) == other;
+    case BoolLiteral:
+        return static_cast<const BoolLiteralExpr&>(*this) == other;
+    case InterpolatedString:
+        return static_cast<const StringExpr&>(*this) == other;
+    case Identifier:
+        return static_cast<const IdentifierExpr&>(*this) == other;
+    case Unary:
+        return static_cast<const UnaryExpr&>(*this) == other;
+    case Binary:
+        return static_cast<const BinaryExpr&>(*this) == other;
+    case Grouping:
+        return static_cast<const GroupingExpr&>(*this) == other;
+    }
+    return false;
+}
+
+inline std::string Expr::toString() const
+{
+    switch (kind)
+    {
+    case IntLiteral:
+        return static_cast<const IntLiteralExpr&>(*this).toString();
+    case BoolLiteral:
+        return static_cast<const BoolLiteralExpr&>(*this).toString();
+    case InterpolatedString:
+        return static_cast<const StringExpr&>(*this).toString();
+    case Identifier:
+        return static_cast<const IdentifierExpr&>(*this).toString();
+    case Unary:
+        return static_cast<const UnaryExpr&>(*this).toString();
+    case Binary:
+        return static_cast<const BinaryExpr&>(*this).toString();
+    case Grouping:
+        return static_cast<const GroupingExpr&>(*this).toString();
+    }
+    return "?";
+}
+
+inline void std::default_delete<Expr>::operator()(Expr* expr) const
+{
+    if (expr == nullptr)
+    {
+        return;
+    }
+    switch (expr->kind)
+    {
+    case IntLiteral:
+        delete static_cast<IntLiteralExpr*>(expr);
+        break;
+    case BoolLiteral:
+        delete static_cast<BoolLiteralExpr*>(expr);
+        break;
+    case InterpolatedString:
+        delete static_cast<StringExpr*>(expr);
+        break;
+    case Identifier:
+        delete static_cast<IdentifierExpr*>(expr);
+        break;
+    case Unary:
+        delete static_cast<UnaryExpr*>(expr);
+        break;
+    case Binary:
+        delete static_cast<BinaryExpr*>(expr);
+        break;
+    case Grouping:
+        delete static_cast<GroupingExpr*>(expr);
+        break;
+    }
+}
@@ -0,0 +1,171 @@
+/**
+ * @file node_table.h
+ * @brief Side table of per-node data, stored flat by NodeId
+ *
+ * Semantic analysis and lowering attach facts to AST nodes (the symbol an
+ * identifier resolves to, the type of an expression) without touching the
+ * tree. Because the nodes of a Program are numbered densely (see arena.h), a
+ * NodeTable keeps those facts in a vector indexed by the node's id: a lookup
+ * is one bounds check and one load, and there are no per-entry allocations.
+ *
+ * The table covers a window of ids that grows on demand to take in every id
+ * stored; reserve() with the arena's node count up front to avoid regrowing.
+ * A table filled for one subtree only (a shard, see merge()) thus stays about
+ * as large as that subtree, wherever its ids lie.
+ */
+
+#pragma once
+
+#include "ast/arena.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+template <typename Node, typename T> class NodeTable
+{
+  public:
+    /** @brief Value stored for `node`, or nullptr if there is none */
+    const T* find(const Node* node) const
+    {
+        size_t slot = static_cast<size_t>(node->id) - base; // wraps for ids below the window
+        if (slot >= slots.size() || !slots[slot])
+        {
+            return nullptr;
+        }
+        return &*slots[slot];
+    }
+
+    /** @brief Value stored for `node`; throws std::out_of_range if there is none */
+    const T& at(const Node* node) const
+    {
+        const T* value = find(node);
+        if (value == nullptr)
+        {
+            throw std::out_of_range("NodeTable::at: no entry for node");
+        }
+        return *value;
+    }
+
+    /** @brief 1 if `node` has a value, otherwise 0 */
+    size_t count(const Node* node) const
+    {
+        return find(node) != nullptr ? 1 : 0;
+    }
+
+    /**
+     * @brief Store a value for `node` unless it already has one
+     * @return True if the value was stored
+     */
+    bool emplace(const Node* node, T value)
+    {
+        return emplaceAt(node->id, std::move(value));
+    }
+
+    /** @brief Store a value for `node`, replacing any previous one */
+    void assign(const Node* node, T value)
+    {
+        if (!emplace(node, value))
+        {
+            slots[node->id - base] = std::move(value);
+        }
+    }
+
+    /** @brief Drop the value for `node`, if any */
+    void erase(const Node* node)
+    {
+        size_t slot = static_cast<size_t>(node->id) - base;
+        if (slot < slots.size() && slots[slot])
+        {
+            slots[slot].reset();
+            entries--;
+        }
+    }
+
+    /** @brief Make room for nodes with ids below `nodeCount` */
+    void reserve(size_t nodeCount)
+    {
+        if (nodeCount == 0)
+        {
+            return;
+        }
+        cover(0);
+        if (nodeCount > slots.size())
+        {
+            slots.resize(nodeCount);
+        }
+    }
+
+    /**
+     * @brief Copy in the values of `shard` for nodes that have none here
+     *
+     * Lets several threads each fill a table of their own for disjoint parts
+     * of the tree, and the results be combined afterwards.
+     */
+    void merge(const NodeTable& shard)
+    {
+        for (size_t i = 0; i < shard.slots.size(); i++)
+        {
+            if (shard.slots[i])
+            {
+                emplaceAt(static_cast<NodeId>(shard.base + i), *shard.slots[i]);
+            }
+        }
+    }
+
+    void clear()
+    {
+        slots.clear();
+        base = 0;
+        entries = 0;
+    }
+
+    /** @brief Number of nodes with a value */
+    size_t size() const
+    {
+        return entries;
+    }
+
+  private:
+    bool emplaceAt(NodeId id, T value)
+    {
+        size_t slot = cover(id);
+        if (slots[slot])
+        {
+            return false;
+        }
+        slots[slot] = std::move(value);
+        entries++;
+        return true;
+    }
+
+    /** @brief Widen the window to take in `id`; returns the slot of `id` */
+    size_t cover(NodeId id)
+    {
+        if (slots.empty())
+        {
+            base = id;
+        }
+        else if (id < base)
+        {
+            // At least double the window, so ids arriving in decreasing order stay cheap.
+            NodeId grown = base > slots.size() ? static_cast<NodeId>(base - slots.size()) : 0;
+            NodeId first = std::min(id, grown);
+            slots.insert(slots.begin(), base - first, std::nullopt);
+            base = first;
+        }
+        size_t slot = static_cast<size_t>(id) - base;
+        if (slot >= slots.size())
+        {
+            slots.resize(slot + 1);
+        }
+        return slot;
+    }
+
+    std::vector<std::optional<T>> slots;       ///< Slot i holds the value of node `base + i`
+    NodeId                        base = 0;    ///< Smallest id in the window
+    size_t                        entries = 0; ///< Engaged slots
+};
@@ -7,6 +7,7 @@
  */
 #pragma once
 
+#include "ast/arena.h"
 #include "ast/expr.h"
 #include "ast/stmt.h"
 
@@ -19,6 +20,9 @@
  * A Program consists of a sequence of statements at the top level,
  * along with error tracking and source location information. It serves
  * as the root of the entire AST.
+ *
+ * A program produced by the parser also owns the AstArena its nodes were
+ * allocated from; the arena is released after the statements.
  */
 class Program
 {
@@ -29,17 +33,71 @@ class Program
      * @param hasError Whether a parse error was encountered
      * @param startLoc Source location of the program start
      * @param endLoc Source location of the program end
+     * @param arena Arena the statements were allocated from, if any
      */
     Program(std::vector<std::unique_ptr<Stmt>> statements, bool hasError, SourceLoc startLoc,
-            SourceLoc endLoc)
-        : statements(std::move(statements)), hasError(hasError), startLoc(startLoc),
-          endLoc(endLoc) {};
+            SourceLoc endLoc, std::unique_ptr<AstArena> arena = nullptr)
+        : arena(std::move(arena)), statements(std::move(statements)), startLoc(startLoc),
+          endLoc(endLoc), hasError(hasError) {};
+
+    Program(Program&&) = default;
+
+    /**
+     * @brief Replace this program, releasing the old nodes before their arena.
+     */
+    Program& operator=(Program&& other)
+    {
+        statements = std::move(other.statements);
+        arena = std::move(other.arena);
+        startLoc = other.startLoc;
+        endLoc = other.endLoc;
+        hasError = other.hasError;
+        return *this;
+    }
 
     bool hadError() const
     {
         return hasError;
     }
 
+    /**
+     * @brief Returns the arena backing this program's nodes.
+     * @return The arena, or nullptr if the nodes live on the global heap
+     */
+    const AstArena* getArena() const
+    {
+        return arena.get();
+    }
+
+    /**
+     * @brief Take ownership of the arena backing this program's nodes.
+     *
+     * The caller must keep the arena alive for as long as any of the
+     * statements (see releaseStatements()) are.
+     */
+    std::unique_ptr<AstArena> releaseArena()
+    {
+        return std::move(arena);
+    }
+
+    /**
+     * @brief Take ownership of the top-level statements, leaving the program empty.
+     */
+    std::vector<std::unique_ptr<Stmt>> releaseStatements()
+    {
+        return std::move(statements);
+    }
+
+    SourceLoc getStartLoc() const
+    {
+        return startLoc;
+    }
+
+    SourceLoc getEndLoc() const
+    {
+        return endLoc;
+    }
+
     /**
      * @brief Returns the vector of top-level statements.
      * @return Const reference to the statements vector
@@ -148,6 +206,8 @@ class Program
     }
 
   private:
+    // Declared first so it is destroyed after the nodes it holds.
+    std::unique_ptr<AstArena>          arena;      ///< Storage for the nodes, if any
     std::vector<std::unique_ptr<Stmt>> statements; ///< The top-level statements
     SourceLoc                          startLoc;   ///< Source location of program start
     SourceLoc                          endLoc;     ///< Source location of program end
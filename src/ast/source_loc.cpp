@@ -0,0 +1,88 @@
+/**
+ * @file source_loc.cpp
+ * @brief Implementation of packed source locations.
+ */
+
+#include "ast/source_loc.h"
+
+#include <algorithm>
+#include <cstring>
+
+/// Largest offset a PackedLoc can hold.
+static constexpr uint32_t MAX_OFFSET = SourceLines::DIRECT - 1;
+
+static constexpr int COLUMN_BITS = 12;
+static constexpr int MAX_DIRECT_COLUMN = (1 << COLUMN_BITS) - 1;
+static constexpr int MAX_DIRECT_LINE = (1 << (31 - COLUMN_BITS)) - 1;
+
+SourceLines::SourceLines(std::string_view source)
+{
+    if (source.size() > MAX_OFFSET)
+    {
+        return;
+    }
+    starts.push_back(0);
+    const char* begin = source.data();
+    const char* end = begin + source.size();
+    for (const char* p = begin; p < end;)
+    {
+        const void* newline = std::memchr(p, '\n', static_cast<size_t>(end - p));
+        if (newline == nullptr)
+        {
+            break;
+        }
+        p = static_cast<const char*>(newline) + 1;
+        starts.push_back(static_cast<uint32_t>(p - begin));
+    }
+}
+
+PackedLoc SourceLines::pack(int line, int col) const
+{
+    if (line < 1 || col < 1 || static_cast<size_t>(line) > starts.size())
+    {
+        return packDirect(line, col);
+    }
+    // The last line extends past the end of the text, for the EOF position.
+    uint32_t limit = static_cast<size_t>(line) < starts.size() ? starts[line] : MAX_OFFSET + 1;
+    uint64_t offset = static_cast<uint64_t>(starts[line - 1]) + static_cast<uint64_t>(col - 1);
+    if (offset >= limit)
+    {
+        return packDirect(line, col);
+    }
+    return static_cast<PackedLoc>(offset);
+}
+
+SourceLoc SourceLines::unpack(PackedLoc loc) const
+{
+    if (isDirect(loc))
+    {
+        return unpackDirect(loc);
+    }
+    // Lookups mostly walk the source in order (lowering asks for every
+    // node's location in turn), so try the line found last time first. It
+    // is checked against this table, so a stale guess only costs the search.
+    static thread_local size_t lastLine = 0;
+    size_t                     index = lastLine;
+    if (index >= starts.size() || starts[index] > loc ||
+        (index + 1 < starts.size() && starts[index + 1] <= loc))
+    {
+        index = static_cast<size_t>(std::upper_bound(starts.begin(), starts.end(), loc) -
+                                    starts.begin()) -
+                1;
+        lastLine = index;
+    }
+    return {static_cast<int>(index) + 1, static_cast<int>(loc - starts[index]) + 1};
+}
+
+PackedLoc SourceLines::packDirect(int line, int col)
+{
+    auto l = static_cast<uint32_t>(std::clamp(line, 0, MAX_DIRECT_LINE));
+    auto c = static_cast<uint32_t>(std::clamp(col, 0, MAX_DIRECT_COLUMN));
+    return DIRECT | (l << COLUMN_BITS) | c;
+}
+
+SourceLoc SourceLines::unpackDirect(PackedLoc loc)
+{
+    return {static_cast<int>((loc & ~DIRECT) >> COLUMN_BITS),
+            static_cast<int>(loc & MAX_DIRECT_COLUMN)};
+}
@@ -0,0 +1,92 @@
+/**
+ * @file source_loc.h
+ * @brief Source positions and their packed 32-bit form
+ *
+ * Diagnostics, IR instructions and bytecode line tables carry a SourceLoc:
+ * a line and a column. AST nodes are far more numerous, so each keeps a
+ * PackedLoc instead, half the size.
+ *
+ * For parsed source a PackedLoc is the byte offset of the position. It is
+ * turned back into a line and column only when asked for, by a binary
+ * search in the SourceLines of the program's arena (see arena.h). Positions
+ * the table cannot express, and nodes built with no table at all (e.g.
+ * expected trees in tests), keep the line and column directly in 19 and 12
+ * bits; larger values saturate.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Represents a position in the source code.
+ *
+ * Used to track the source location of AST nodes for error reporting.
+ */
+struct SourceLoc
+{
+    int line; ///< Line number
+    int col;  ///< Column number
+
+    bool operator==(const SourceLoc& other) const
+    {
+        return line == other.line && col == other.col;
+    }
+};
+
+/** @brief A SourceLoc in 32 bits: a byte offset, or a direct line and column */
+using PackedLoc = uint32_t;
+
+/**
+ * @brief Offsets at which the lines of one source text start
+ */
+class SourceLines
+{
+  public:
+    /** @brief Flag of a PackedLoc holding the line and column directly */
+    static constexpr PackedLoc DIRECT = 0x80000000u;
+
+    /** @brief An empty table: every location is packed directly */
+    SourceLines() = default;
+
+    /** @brief Table of the lines of `source`; empty if offsets into it do not fit 31 bits */
+    explicit SourceLines(std::string_view source);
+
+    bool empty() const
+    {
+        return starts.empty();
+    }
+
+    /** @brief Number of lines; the last one has no newline after it */
+    size_t lineCount() const
+    {
+        return starts.size();
+    }
+
+    /**
+     * @brief Pack a position
+     *
+     * Positions inside a line of the table become its offset, so pack() and
+     * unpack() round-trip exactly. Anything else is packed directly.
+     */
+    PackedLoc pack(int line, int col) const;
+
+    /** @brief Line and column of a location packed by pack() on this table */
+    SourceLoc unpack(PackedLoc loc) const;
+
+    /** @brief Pack `line` and `col` into the location itself, saturating */
+    static PackedLoc packDirect(int line, int col);
+
+    /** @brief Line and column of a location packed by packDirect() */
+    static SourceLoc unpackDirect(PackedLoc loc);
+
+    static bool isDirect(PackedLoc loc)
+    {
+        return (loc & DIRECT) != 0;
+    }
+
+  private:
+    std::vector<uint32_t> starts; ///< starts[i] is the offset of line i + 1
+};
@@ -22,7 +22,7 @@ struct Symbol;
 /**
  * @brief Enumeration of all statement node types.
  */
-enum StmtKind
+enum StmtKind : uint8_t
 {
     Summon,  ///< Variable declaration statement
     Say,     ///< Print statement
@@ -35,34 +35,70 @@ enum StmtKind
  * @brief Base class for all statement AST nodes.
  *
  * All concrete statement types (SummonStmt, SayStmt, etc.)
- * inherit from this class. The kind member indicates the concrete type.
+ * inherit from this class. The kind member indicates the concrete type and
+ * is what operations on a Stmt dispatch on, as for Expr (see expr.h).
+ * Storage comes from the active AstArena, if any (see arena.h).
  */
-class Stmt
+class Stmt : public AstAllocated
 {
   public:
-    StmtKind  kind; ///< The concrete type of this statement
-    SourceLoc loc;  ///< The source location of this statement
+    StmtKind kind;                        ///< The concrete type of this statement
+    NodeId   id = AstArena::nextNodeId(); ///< Index into per-node side tables
 
-    /// Virtual destructor for polymorphic deletion
-    virtual ~Stmt() {};
+    /** @brief Line and column of the statement's first token */
+    SourceLoc getLoc() const
+    {
+        return unpackLoc(loc);
+    }
 
     /**
-     * @brief Compares two Stmt nodes for equality.
+     * @brief Compares two Stmt nodes for equality, as their concrete types.
      * @param other The other statement to compare with
      * @return True if both statements are equivalent
      */
-    virtual bool operator==(const Stmt& other) const = 0;
+    bool operator==(const Stmt& other) const;
 
     /**
      * @brief Return a human-readable representation of this statement.
      *
-     * Used by tests and debugging output. Derived classes must implement a
-     * concise serialization suitable for debugging (not necessarily reversible).
+     * Used by tests and debugging output. Calls the concrete type's
+     * toString(), a concise serialization suitable for debugging (not
+     * necessarily reversible).
      *
      * @return String representation of this statement
      */
-    virtual std::string toString() const = 0;
+    std::string toString() const;
+
+  protected:
+    Stmt() = default;
+    ~Stmt() = default;
+
+    void setLoc(int line, int col)
+    {
+        loc = packLoc(line, col);
+    }
+
+  private:
+    PackedLoc loc; ///< See getLoc()
+};
+
+namespace std
+{
+/**
+ * @brief Deletes a Stmt as its concrete type, found from its kind
+ */
+template <> struct default_delete<Stmt>
+{
+    default_delete() = default;
+
+    template <class Node, class = enable_if_t<is_convertible<Node*, Stmt*>::value>>
+    default_delete(const default_delete<Node>&) noexcept
+    {
+    }
+
+    void operator()(Stmt* stmt) const;
 };
+} // namespace std
 
 /**
  * @brief Represents a variable declaration statement.
@@ -85,7 +121,7 @@ class SummonStmt : public Stmt
         : identifier(std::move(identifier)), initializer(std::move(initializer))
     {
         kind = Summon;
-        loc = {line, col};
+        setLoc(line, col);
     }
 
     /**
@@ -93,17 +129,26 @@ class SummonStmt : public Stmt
      * @param other The other statement to compare with
      * @return True if both have the same name, initializer, and source location
      */
-    bool operator==(const Stmt& other) const override
+    bool operator==(const Stmt& other) const
     {
 
         if (other.kind != kind)
             return false;
         auto& o = static_cast<const SummonStmt&>(other);
-        if (!identifier && !o.identifier)
-            return true;
+        if (!(o.getLoc() == getLoc()))
+        {
+            return false;
+        }
+
         if (!identifier || !o.identifier)
+        {
+            if (identifier || o.identifier)
+                return false;
+        }
+        else if (!(*identifier == *o.identifier))
+        {
             return false;
-        return *identifier == *o.identifier;
+        }
 
         if (!initializer && !o.initializer)
             return true;
@@ -116,7 +161,7 @@ class SummonStmt : public Stmt
      * @brief Return a human-readable representation of this statement.
      * @return String representation of this statement
      */
-    std::string toString() const override
+    std::string toString() const
     {
         std::string out = "Summon(";
         out += identifier->toString();
@@ -169,7 +214,7 @@ class SayStmt : public Stmt
     SayStmt(std::unique_ptr<Expr> expression, int line, int col) : expression(std::move(expression))
     {
         kind = Say;
-        loc = {line, col};
+        setLoc(line, col);
     };
 
     /**
@@ -177,13 +222,13 @@ class SayStmt : public Stmt
      * @param other The other statement to compare with
      * @return True if both have the same expression and source location
      */
-    bool operator==(const Stmt& other) const override
+    bool operator==(const Stmt& other) const
     {
 
         if (other.kind != kind)
             return false;
         auto& o = static_cast<const SayStmt&>(other);
-        if (!(o.loc == loc))
+        if (!(o.getLoc() == getLoc()))
         {
             return false;
         }
@@ -212,7 +257,7 @@ class SayStmt : public Stmt
      * @brief Return a human-readable representation of this statement.
      * @return String representation of this statement
      */
-    std::string toString() const override
+    std::string toString() const
     {
         return std::string("Say(") + (expression ? expression->toString() : std::string("null")) +
                ")";
@@ -238,7 +283,7 @@ class BlockStmt : public Stmt
         : statements(std::move(statements))
     {
         kind = Block;
-        loc = {line, col};
+        setLoc(line, col);
     };
 
     /**
@@ -246,13 +291,13 @@ class BlockStmt : public Stmt
      * @param other The other statement to compare with
      * @return True if both have the same statements in the same order and source location
      */
-    bool operator==(const Stmt& other) const override
+    bool operator==(const Stmt& other) const
     {
 
         if (other.kind != kind)
             return false;
         auto& o = static_cast<const BlockStmt&>(other);
-        if (!(o.loc == loc))
+        if (!(o.getLoc() == getLoc()))
         {
             return false;
         }
@@ -318,7 +363,7 @@ class BlockStmt : public Stmt
      * @brief Return a human-readable representation of this statement.
      * @return String representation of this statement
      */
-    std::string toString() const override
+    std::string toString() const
     {
         std::string out = "Block([";
         bool        first = true;
@@ -365,7 +410,7 @@ class IfChainStmt : public Stmt
         : branches(std::move(branches)), elseBranch(std::move(elseBranch))
     {
         kind = IfChain;
-        loc = {line, col};
+        setLoc(line, col);
     };
 
     /**
@@ -374,13 +419,13 @@ class IfChainStmt : public Stmt
      * @return True if both have the same branches and else branch in the same order and source
      * location
      */
-    bool operator==(const Stmt& other) const override
+    bool operator==(const Stmt& other) const
     {
 
         if (other.kind != kind)
             return false;
         auto& o = static_cast<const IfChainStmt&>(other);
-        if (!(o.loc == loc))
+        if (!(o.getLoc() == getLoc()))
         {
             return false;
         }
@@ -424,7 +469,7 @@ class IfChainStmt : public Stmt
      * @brief Return a human-readable representation of this statement.
      * @return String representation of this statement
      */
-    std::string toString() const override
+    std::string toString() const
     {
         std::string out = "IfChain([";
         for (size_t i = 0; i < branches.size(); ++i)
@@ -527,46 +572,32 @@ class WhileStmt : public Stmt
         : condition(std::move(condition)), body(std::move(body))
     {
         kind = While;
-        loc = {line, col};
+        setLoc(line, col);
     };
 
     /**
      * @brief Return a human-readable representation of this statement.
      * @return String representation of this statement
      */
-    std::string toString() const override
+    std::string toString() const
     {
         return std::string("While(") + (condition ? condition->toString() : std::string("null")) +
                ", " + (body ? body->toString() : std::string("null")) + ")";
     }
 
-    const Expr& getCondition() const
-    {
-        return *condition;
-    }
-
-    const BlockStmt& getBody() const
-    {
-        return *body;
-    }
-
-  private:
-    std::unique_ptr<Expr>      condition; ///< The loop condition
-    std::unique_ptr<BlockStmt> body;      ///< The loop body
-
     /**
      * @brief Compares two WhileStmt nodes for equality.
      * @param other The other statement to compare with
      * @return True if both have the same condition and body and source location
      */
-    bool operator==(const Stmt& other) const override
+    bool operator==(const Stmt& other) const
     {
         if (kind != other.kind)
             return false;
 
         const auto& o = static_cast<const WhileStmt&>(other);
 
-        if (!(loc == o.loc))
+        if (!(getLoc() == o.getLoc()))
             return false;
 
         if (!condition && !o.condition && !body && !o.body)
@@ -577,4 +608,80 @@ class WhileStmt : public Stmt
 
         return *condition == *o.condition && *body == *o.body;
     }
-};
\ No newline at end of file
+
+    const Expr& getCondition() const
+    {
+        return *condition;
+    }
+
+    const BlockStmt& getBody() const
+    {
+        return *body;
+    }
+
+  private:
+    std::unique_ptr<Expr>      condition; ///< The loop condition
+    std::unique_ptr<BlockStmt> body;      ///< The loop body
+};
+
+inline bool Stmt::operator==(const Stmt& other) const
+{
+    switch (kind)
+    {
+    case Summon:
+        return static_cast<const SummonStmt&>(*this) == other;
+    case Say:
+        return static_cast<const SayStmt&>(*this) == other;
+    case Block:
+        return static_cast<const BlockStmt&>(*this) == other;
+    case IfChain:
+        return static_cast<const IfChainStmt&>(*this) == other;
+    case While:
+        return static_cast<const WhileStmt&>(*this) == other;
+    }
+    return false;
+}
+
+inline std::string Stmt::toString() const
+{
+    switch (kind)
+    {
+    case Summon:
+        return static_cast<const SummonStmt&>(*this).toString();
+    case Say:
+        return static_cast<const SayStmt&>(*this).toString();
+    case Block:
+        return static_cast<const BlockStmt&>(*this).toString();
+    case IfChain:
+        return static_cast<const IfChainStmt&>(*this).toString();
+    case While:
+        return static_cast<const WhileStmt&>(*this).toString();
+    }
+    return "?";
+}
+
+inline void std::default_delete<Stmt>::operator()(Stmt* stmt) const
+{
+    if (stmt == nullptr)
+    {
+        return;
+    }
+    switch (stmt->kind)
+    {
+    case Summon:
+        delete static_cast<SummonStmt*>(stmt);
+        break;
+    case Say:
+        delete static_cast<SayStmt*>(stmt);
+        break;
+    case Block:
+        delete static_cast<BlockStmt*>(stmt);
+        break;
+    case IfChain:
+        delete static_cast<IfChainStmt*>(stmt);
+        break;
+    case While:
+        delete static_cast<WhileStmt*>(stmt);
+        break;
+    }
+}
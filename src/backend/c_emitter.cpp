@@ -0,0 +1,681 @@
+/**
+ * @file c_emitter.cpp
+ * @brief Implementation of the IR-to-C backend.
+ */
+
+#include "backend/c_emitter.h"
+
+#include <cctype>
+#include <cstdio>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+/// Runtime support shared by every emitted program; inline so unused parts draw no warnings.
+static const char* const RUNTIME = R"(#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Who frees a string's characters. Static is 0, so constants can leave it out. */
+enum
+{
+    AMBRA_STATIC,  /* literal text, never freed */
+    AMBRA_OWNED,   /* built at runtime; freed by whoever consumes the value */
+    AMBRA_BORROWED /* a view of an owned string held by a local */
+};
+
+typedef struct
+{
+    const char* chars;
+    uint32_t    length;
+    uint32_t    owner;
+} ambra_str;
+
+static inline void ambra_say(ambra_str s)
+{
+    fwrite(s.chars, 1, s.length, stdout);
+    fputc('\n', stdout);
+}
+
+static inline bool ambra_str_eq(ambra_str a, ambra_str b)
+{
+    return a.length == b.length && memcmp(a.chars, b.chars, a.length) == 0;
+}
+
+static inline void ambra_release(ambra_str s)
+{
+    if (s.owner == AMBRA_OWNED)
+    {
+        free((char*)s.chars);
+    }
+}
+
+static inline ambra_str ambra_view(ambra_str s)
+{
+    if (s.owner == AMBRA_OWNED)
+    {
+        s.owner = AMBRA_BORROWED;
+    }
+    return s;
+}
+
+static inline char* ambra_alloc(uint32_t length)
+{
+    char* chars = (char*)malloc(length == 0 ? 1 : length);
+    if (chars == NULL)
+    {
+        fputs("out of memory\n", stderr);
+        exit(1);
+    }
+    return chars;
+}
+
+static inline ambra_str ambra_from_i32(int32_t value)
+{
+    char      buffer[12];
+    int       length = snprintf(buffer, sizeof buffer, "%" PRId32, value);
+    ambra_str s = {ambra_alloc((uint32_t)length), (uint32_t)length, AMBRA_OWNED};
+    memcpy((char*)s.chars, buffer, (size_t)length);
+    return s;
+}
+
+static inline ambra_str ambra_from_bool(bool value)
+{
+    ambra_str s = {value ? "affirmative" : "negative", value ? 11u : 8u, AMBRA_STATIC};
+    return s;
+}
+
+/* A value a local can own: borrowed text is copied, anything else is kept as is. */
+static inline ambra_str ambra_keep(ambra_str s)
+{
+    if (s.owner == AMBRA_BORROWED)
+    {
+        char* chars = ambra_alloc(s.length);
+        memcpy(chars, s.chars, s.length);
+        s.chars = chars;
+        s.owner = AMBRA_OWNED;
+    }
+    return s;
+}
+
+static inline ambra_str ambra_concat(uint32_t count, const ambra_str* parts)
+{
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        total += parts[i].length;
+    }
+    char* chars = ambra_alloc(total);
+    char* at = chars;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        memcpy(at, parts[i].chars, parts[i].length);
+        at += parts[i].length;
+    }
+    ambra_str s = {chars, total, AMBRA_OWNED};
+    return s;
+}
+
+static inline int32_t ambra_div(int32_t a, int32_t b, int line, int col)
+{
+    if (b == 0)
+    {
+        fflush(stdout);
+        fprintf(stderr, "%s:%d:%d: runtime error: Division by zero\n", ambra_source, line, col);
+        exit(1);
+    }
+    return (a == INT32_MIN && b == -1) ? INT32_MIN : a / b;
+}
+
+static inline int ambra_finish(void)
+{
+    fflush(stdout);
+    return 0;
+}
+)";
+
+static const char* cType(IrType type)
+{
+    switch (type)
+    {
+    case I32:
+        return "int32_t";
+    case Bool32:
+        return "bool";
+    case String32:
+    default:
+        return "ambra_str";
+    }
+}
+
+/** @brief `text` as a C string literal, with everything but printable ASCII escaped */
+static std::string cStringLiteral(const std::string& text)
+{
+    std::string literal = "\"";
+    for (unsigned char c : text)
+    {
+        if (c == '"' || c == '\\' || c == '?')
+        {
+            // '?' too, so no trigraph can form.
+            literal += '\\';
+            literal += static_cast<char>(c);
+        }
+        else if (c >= 0x20 && c < 0x7F)
+        {
+            literal += static_cast<char>(c);
+        }
+        else
+        {
+            // Always three digits, so a following digit is never absorbed.
+            char escape[5];
+            std::snprintf(escape, sizeof(escape), "\\%03o", c);
+            literal += escape;
+        }
+    }
+    return literal + "\"";
+}
+
+static std::string cIntLiteral(int32_t value)
+{
+    return value == INT32_MIN ? "INT32_MIN" : std::to_string(value);
+}
+
+static std::string cIdentifier(const std::string& name)
+{
+    std::string identifier;
+    for (unsigned char c : name)
+    {
+        identifier += std::isalnum(c) ? static_cast<char>(c) : '_';
+    }
+    return identifier;
+}
+
+/**
+ * @brief Translates one function, tracking which C expression holds each stack slot
+ *
+ * Instructions are visited in order. Code after an unconditional jump is
+ * skipped until a label that some jump or fallthrough has already reached;
+ * a label only reached by a later, backward jump starts with an empty stack,
+ * which the lowering always produces there.
+ *
+ * Strings built at runtime are owned by the one slot or local holding them:
+ * consuming a slot releases it, loading a local pushes a borrowed view, and
+ * storing to a string local first copies any view still on the stack.
+ */
+class CFunctionWriter
+{
+  public:
+    CFunctionWriter(const IrProgram& program, const IrFunction& function,
+                    std::vector<CEmitterDiagnostic>& diagnostics)
+        : program(program), function(function), diagnostics(diagnostics)
+    {
+    }
+
+    /** @brief The body of main(), after its variable declarations */
+    std::string write()
+    {
+        for (const Instruction& inst : function.instructions)
+        {
+            if (isJump(inst.opcode))
+            {
+                jumpedTo.insert(std::get<LabelId>(inst.operand));
+            }
+        }
+
+        for (size_t ip = 0; ip < function.instructions.size(); ip++)
+        {
+            const Instruction& inst = function.instructions[ip];
+            if (inst.opcode == JLabel)
+            {
+                enterLabel(std::get<LabelId>(inst.operand), ip);
+            }
+            else if (live)
+            {
+                emit(inst, ip);
+            }
+        }
+        if (live)
+        {
+            line("return ambra_finish();");
+        }
+        return declarations.str() + body.str();
+    }
+
+  private:
+    /** @brief A value on the operand stack: the C expression that holds it */
+    struct Slot
+    {
+        std::string expr;
+        IrType      type;
+        bool        owns = false;    ///< May hold characters this slot must release
+        bool        borrows = false; ///< May be a view of a string local's characters
+    };
+
+    static bool isJump(Opcode op)
+    {
+        return op == Jump || op == JumpIfFalse || op == JumpIfTrue;
+    }
+
+    void line(const std::string& text)
+    {
+        body << "    " << text << "\n";
+    }
+
+    void fail(const std::string& message, size_t ip)
+    {
+        diagnostics.push_back({message, ip});
+        live = false;
+    }
+
+    /** @brief Declare a new temporary holding `value` and push it */
+    void define(IrType type, const std::string& value, bool owns = false, bool borrows = false)
+    {
+        std::string name = "t" + std::to_string(nextTemp++);
+        line(std::string(cType(type)) + " " + name + " = " + value + ";");
+        stack.push_back({name, type, owns, borrows});
+    }
+
+    /** @brief Free what a consumed slot owns; a no-op at runtime for anything else */
+    void release(const Slot& slot)
+    {
+        if (slot.owns)
+        {
+            line("ambra_release(" + slot.expr + ");");
+        }
+    }
+
+    Slot pop()
+    {
+        Slot top = stack.back();
+        stack.pop_back();
+        return top;
+    }
+
+    static std::string joinName(LabelId label, size_t depth)
+    {
+        return "j" + std::to_string(label.value) + "d" + std::to_string(depth);
+    }
+
+    /** @brief Copy the stack into the variables `label` is entered with */
+    bool flowTo(LabelId label, size_t ip)
+    {
+        auto [join, first] = joins.try_emplace(label);
+        if (first)
+        {
+            for (size_t depth = 0; depth < stack.size(); depth++)
+            {
+                join->second.push_back(stack[depth].type);
+                declarations << "    " << cType(stack[depth].type) << " "
+                             << joinName(label, depth) << ";\n";
+            }
+        }
+        else
+        {
+            bool same = join->second.size() == stack.size();
+            for (size_t depth = 0; same && depth < stack.size(); depth++)
+            {
+                same = join->second[depth] == stack[depth].type;
+            }
+            if (!same)
+            {
+                fail("Stack mismatch at control-flow merge", ip);
+                return false;
+            }
+        }
+        for (size_t depth = 0; depth < stack.size(); depth++)
+        {
+            line(joinName(label, depth) + " = " + stack[depth].expr + ";");
+        }
+        return true;
+    }
+
+    void enterLabel(LabelId label, size_t ip)
+    {
+        if (live && !flowTo(label, ip))
+        {
+            return;
+        }
+        joins.try_emplace(label);
+
+        // Unused labels would only draw warnings from the C compiler.
+        if (jumpedTo.count(label) > 0)
+        {
+            body << "L" << label.value << ":;\n";
+        }
+
+        // Label variables are reassigned by every edge into the label, so the
+        // stack takes copies that stay fixed, like every other slot.
+        stack.clear();
+        live = true;
+        // Edges may disagree on who owns a string, so the runtime tag decides.
+        const std::vector<IrType>& types = joins[label];
+        for (size_t depth = 0; depth < types.size(); depth++)
+        {
+            bool string = types[depth] == String32;
+            define(types[depth], joinName(label, depth), string, string);
+        }
+    }
+
+    std::string constant(ConstId id) const
+    {
+        const Constant& c = program.constants[id.value];
+        switch (c.type)
+        {
+        case I32:
+            return cIntLiteral(std::get<int>(c.value));
+        case Bool32:
+            return std::get<bool>(c.value) ? "true" : "false";
+        case String32:
+        default:
+            return "k" + std::to_string(id.value);
+        }
+    }
+
+    void emit(const Instruction& inst, size_t ip)
+    {
+        static const std::unordered_map<Opcode, const char*> comparisons = {
+            {CmpEqI32, "=="},   {CmpNEqI32, "!="},   {CmpLtI32, "<"},
+            {CmpLtEqI32, "<="}, {CmpGtI32, ">"},     {CmpGtEqI32, ">="},
+            {CmpEqBool32, "=="}, {CmpNEqBool32, "!="},
+        };
+
+        Opcode op = inst.opcode;
+        size_t needed = 0;
+        switch (op)
+        {
+        case Pop:
+        case StoreLocal:
+        case NotBool:
+        case NegI32:
+        case JumpIfFalse:
+        case JumpIfTrue:
+        case PrintString:
+        case ToString:
+            needed = 1;
+            break;
+        case ConcatN:
+            needed = std::get<Arity>(inst.operand).value;
+            break;
+        case PushConst:
+        case LoadLocal:
+        case Jump:
+        case JLabel:
+        case Nop:
+        case Halt:
+            break;
+        default:
+            needed = 2;
+            break;
+        }
+        if (stack.size() < needed)
+        {
+            fail("Stack underflow", ip);
+            return;
+        }
+
+        switch (op)
+        {
+        case PushConst:
+        {
+            ConstId id = std::get<ConstId>(inst.operand);
+            if (id.value >= program.constants.size())
+            {
+                fail("Invalid ConstId", ip);
+                return;
+            }
+            stack.push_back({constant(id), program.constants[id.value].type});
+            break;
+        }
+        case Pop:
+        {
+            Slot value = pop();
+            if (value.owns)
+            {
+                release(value);
+            }
+            else
+            {
+                line("(void)" + value.expr + ";"); // an unused temporary would draw a warning
+            }
+            break;
+        }
+        case LoadLocal:
+        {
+            LocalId id = std::get<LocalId>(inst.operand);
+            if (id.value >= function.localTable.locals.size())
+            {
+                fail("Invalid LocalId", ip);
+                return;
+            }
+            // Copied, so a later store to the local cannot change the pushed value.
+            IrType type = function.localTable.locals[id.value].type;
+            if (type == String32)
+            {
+                define(type, "ambra_view(" + localName(id) + ")", false, true);
+            }
+            else
+            {
+                define(type, localName(id));
+            }
+            break;
+        }
+        case StoreLocal:
+        {
+            LocalId id = std::get<LocalId>(inst.operand);
+            if (id.value >= function.localTable.locals.size())
+            {
+                fail("Invalid LocalId", ip);
+                return;
+            }
+            if (function.localTable.locals[id.value].type == String32)
+            {
+                // The old value is about to be freed, so no view of it may outlive the store.
+                for (Slot& slot : stack)
+                {
+                    if (slot.borrows)
+                    {
+                        line(slot.expr + " = ambra_keep(" + slot.expr + ");");
+                        slot.owns = true;
+                        slot.borrows = false;
+                    }
+                }
+                line("ambra_release(" + localName(id) + ");");
+            }
+            line(localName(id) + " = " + pop().expr + ";");
+            break;
+        }
+        case AddI32:
+        case SubI32:
+        case MulI32:
+        {
+            // Through uint32_t, so overflow wraps as in the VM.
+            const char* symbol = op == AddI32 ? " + " : op == SubI32 ? " - " : " * ";
+            Slot        b = pop();
+            Slot        a = pop();
+            define(I32, "(int32_t)((uint32_t)" + a.expr + symbol + "(uint32_t)" + b.expr + ")");
+            break;
+        }
+        case DivI32:
+        {
+            Slot b = pop();
+            Slot a = pop();
+            define(I32, "ambra_div(" + a.expr + ", " + b.expr + ", " +
+                            std::to_string(inst.loc.line) + ", " + std::to_string(inst.loc.col) +
+                            ")");
+            break;
+        }
+        case NotBool:
+            define(Bool32, "!" + pop().expr);
+            break;
+        case NegI32:
+            define(I32, "(int32_t)(0u - (uint32_t)" + pop().expr + ")");
+            break;
+        case CmpEqI32:
+        case CmpNEqI32:
+        case CmpLtI32:
+        case CmpLtEqI32:
+        case CmpGtI32:
+        case CmpGtEqI32:
+        case CmpEqBool32:
+        case CmpNEqBool32:
+        {
+            Slot b = pop();
+            Slot a = pop();
+            define(Bool32, a.expr + " " + comparisons.at(op) + " " + b.expr);
+            break;
+        }
+        case CmpEqString32:
+        case CmpNEqString32:
+        {
+            Slot b = pop();
+            Slot a = pop();
+            define(Bool32, std::string(op == CmpNEqString32 ? "!" : "") + "ambra_str_eq(" +
+                               a.expr + ", " + b.expr + ")");
+            release(a);
+            release(b);
+            break;
+        }
+        case Jump:
+        {
+            LabelId label = std::get<LabelId>(inst.operand);
+            if (flowTo(label, ip))
+            {
+                line("goto L" + std::to_string(label.value) + ";");
+                live = false;
+            }
+            break;
+        }
+        case JumpIfFalse:
+        case JumpIfTrue:
+        {
+            LabelId label = std::get<LabelId>(inst.operand);
+            Slot    condition = pop();
+            if (flowTo(label, ip))
+            {
+                line(std::string("if (") + (op == JumpIfFalse ? "!" : "") + condition.expr +
+                     ") goto L" + std::to_string(label.value) + ";");
+            }
+            break;
+        }
+        case PrintString:
+        {
+            Slot value = pop();
+            line("ambra_say(" + value.expr + ");");
+            release(value);
+            break;
+        }
+        case ToString:
+        {
+            Slot value = pop();
+            if (value.type == I32)
+            {
+                define(String32, "ambra_from_i32(" + value.expr + ")", true);
+            }
+            else if (value.type == Bool32)
+            {
+                define(String32, "ambra_from_bool(" + value.expr + ")");
+            }
+            else
+            {
+                stack.push_back(value);
+            }
+            break;
+        }
+        case ConcatString:
+        case ConcatN:
+        {
+            size_t            count = op == ConcatString ? 2 : std::get<Arity>(inst.operand).value;
+            std::vector<Slot> consumed(stack.end() - count, stack.end());
+            std::string       parts;
+            for (const Slot& part : consumed)
+            {
+                parts += (parts.empty() ? "" : ", ") + part.expr;
+            }
+            stack.resize(stack.size() - count);
+            define(String32,
+                   "ambra_concat(" + std::to_string(count) + ", (const ambra_str[]){" + parts +
+                       "})",
+                   true);
+            for (const Slot& part : consumed)
+            {
+                release(part);
+            }
+            break;
+        }
+        case Nop:
+            break;
+        case Halt:
+            line("return ambra_finish();");
+            live = false;
+            break;
+        default:
+            fail(std::string("Unsupported opcode ") + std::to_string(op), ip);
+            break;
+        }
+    }
+
+    std::string localName(LocalId id) const
+    {
+        return "v" + std::to_string(id.value) + "_" +
+               cIdentifier(function.localTable.locals[id.value].debugName);
+    }
+
+    const IrProgram&                                 program;
+    const IrFunction&                                function;
+    std::vector<CEmitterDiagnostic>&                 diagnostics;
+    std::vector<Slot>                                stack;
+    bool                                             live = true;
+    uint32_t                                         nextTemp = 0;
+    std::unordered_set<LabelId>                      jumpedTo;
+    std::unordered_map<LabelId, std::vector<IrType>> joins; ///< Entry stack types by label
+    std::ostringstream                               declarations; ///< Label variables
+    std::ostringstream                               body;
+};
+
+std::string CEmitter::emit(const IrFunction& function)
+{
+    diagnostics.clear();
+
+    std::ostringstream out;
+    out << "/* Generated by ambra_compiler --emit=c from " << sourceName << ". */\n\n";
+    out << "static const char ambra_source[] = " << cStringLiteral(sourceName) << ";\n\n";
+    out << RUNTIME << "\n";
+
+    // Only the strings the function pushes; unused ones would draw warnings.
+    std::vector<bool> pushed(program.constants.size(), false);
+    for (const Instruction& inst : function.instructions)
+    {
+        if (inst.opcode == PushConst && std::get<ConstId>(inst.operand).value < pushed.size())
+        {
+            pushed[std::get<ConstId>(inst.operand).value] = true;
+        }
+    }
+    for (size_t i = 0; i < program.constants.size(); i++)
+    {
+        const Constant& c = program.constants[i];
+        if (c.type == String32 && pushed[i])
+        {
+            const std::string& text = std::get<std::string>(c.value);
+            out << "static const ambra_str k" << i << " = {" << cStringLiteral(text) << ", "
+                << text.size() << "};\n";
+        }
+    }
+
+    out << "\nint main(void)\n{\n";
+    for (size_t i = 0; i < function.localTable.locals.size(); i++)
+    {
+        const LocalInfo& local = function.localTable.locals[i];
+        const char*      initial = local.type == I32      ? "0"
+                                   : local.type == Bool32 ? "false"
+                                                          : "{\"\", 0}";
+        out << "    " << cType(local.type) << " v" << i << "_" << cIdentifier(local.debugName)
+            << " = " << initial << ";\n";
+    }
+
+    CFunctionWriter writer(program, function, diagnostics);
+    out << writer.write() << "}\n";
+    return out.str();
+}
@@ -0,0 +1,72 @@
+/**
+ * @file c_emitter.h
+ * @brief Ahead-of-time translation of IR to C
+ *
+ * CEmitter turns a validated IrFunction into one self-contained C99 file
+ * whose main() behaves like running the program on the VM: the same `say`
+ * output on stdout, and the same "file:line:col: runtime error: ..." message
+ * and exit status for a division by zero. Build it with any C compiler,
+ * e.g. `cc -O2 program.c`.
+ *
+ * - Each value pushed on the operand stack becomes a fresh C temporary that
+ *   is assigned once, so the C compiler sees plain data flow rather than a
+ *   stack. A value still on the stack at a jump or label is copied into a
+ *   variable owned by that label.
+ * - Locals become C variables and labels become `goto` targets.
+ * - I32 is int32_t with the VM's wrapping arithmetic, Bool32 is bool and
+ *   String32 is a pointer, a length and an ownership tag. The few runtime
+ *   functions the code needs are written at the top of the file.
+ * - A string built at runtime is freed once the say, comparison or
+ *   concatenation that consumes it is done, or when the local holding it is
+ *   overwritten, so a loop runs in constant memory.
+ */
+
+#pragma once
+
+#include "ir/program.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Error found while emitting C
+ */
+struct CEmitterDiagnostic
+{
+    std::string message;
+    size_t      ip; ///< Index of the offending IR instruction
+};
+
+/**
+ * @brief Lowers IR functions to a C translation unit
+ *
+ * Example usage:
+ * @code
+ * CEmitter    emitter{program, "program.ara"};
+ * std::string c = emitter.emit(program.main);
+ * if (emitter.hadError()) { ... }
+ * @endcode
+ */
+struct CEmitter
+{
+    /** @brief Program whose constant pool the emitted code refers to */
+    const IrProgram& program;
+
+    /** @brief Source file name printed in runtime errors, as ambra_vm does */
+    std::string sourceName;
+
+    /** @brief Problems found during the last emit() call */
+    std::vector<CEmitterDiagnostic> diagnostics;
+
+    bool hadError() const
+    {
+        return diagnostics.size() > 0;
+    }
+
+    /**
+     * @brief Emit one function as the main() of a C program
+     * @param function Function to emit (usually program.main)
+     * @return Complete C source; incomplete if hadError()
+     */
+    std::string emit(const IrFunction& function);
+};
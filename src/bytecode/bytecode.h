@@ -0,0 +1,420 @@
+/**
+ * @file bytecode.h
+ * @brief Packed bytecode representation executed by the Ambra VM
+ *
+ * The IR keeps every instruction as a full Instruction struct (opcode,
+ * operand variant and source location). That is convenient for lowering and
+ * validation but wasteful to execute. BytecodeEmitter flattens an IrFunction
+ * into the dense form defined here:
+ *
+ * - Each instruction is a 1-byte BytecodeOp followed by an inline operand of
+ *   0, 1, 2 or 4 bytes. The width is implied by the opcode, so decoding never
+ *   branches on a separate width field.
+ * - Constant, local and count operands pick the narrowest encoding that
+ *   fits (e.g. OP_PUSH_CONST, OP_PUSH_CONST_W, OP_PUSH_CONST_L).
+ * - Jump operands are always u32 absolute byte offsets into the code array.
+ * - A few superinstructions fuse a common IR sequence into one opcode with
+ *   several operand fields (see OP_ADD_LOCAL_CONST).
+ * - Source locations live out of line in a compressed LineTable and are only
+ *   decoded when a diagnostic needs them.
+ *
+ * Multi-byte operands are stored little-endian.
+ */
+
+#pragma once
+
+#include "ir/types.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief One-byte bytecode opcodes
+ *
+ * Suffixes encode the operand width: none = u8, `_W` = u16, `_L` = u32.
+ * Opcodes without a listed operand take none.
+ */
+enum BytecodeOp : uint8_t
+{
+    // Stack
+    OP_PUSH_CONST,   ///< u8 constant index
+    OP_PUSH_CONST_W, ///< u16 constant index
+    OP_PUSH_CONST_L, ///< u32 constant index
+    OP_POP,
+
+    // Locals
+    OP_LOAD_LOCAL,    ///< u8 local slot
+    OP_LOAD_LOCAL_W,  ///< u16 local slot
+    OP_LOAD_LOCAL_L,  ///< u32 local slot
+    OP_STORE_LOCAL,   ///< u8 local slot
+    OP_STORE_LOCAL_W, ///< u16 local slot
+    OP_STORE_LOCAL_L, ///< u32 local slot
+
+    // Arithmetic
+    OP_ADD_I32,
+    OP_SUB_I32,
+    OP_MUL_I32,
+    OP_DIV_I32,
+
+    // Unary
+    OP_NOT_BOOL,
+    OP_NEG_I32,
+
+    // Comparison
+    OP_CMP_EQ_I32,
+    OP_CMP_NEQ_I32,
+    OP_CMP_LT_I32,
+    OP_CMP_LTEQ_I32,
+    OP_CMP_GT_I32,
+    OP_CMP_GTEQ_I32,
+    OP_CMP_EQ_BOOL,
+    OP_CMP_NEQ_BOOL,
+    OP_CMP_EQ_STRING,
+    OP_CMP_NEQ_STRING,
+
+    // Control flow
+    OP_JUMP,          ///< u32 absolute byte offset
+    OP_JUMP_IF_FALSE, ///< u32 absolute byte offset
+    OP_JUMP_IF_TRUE,  ///< u32 absolute byte offset
+
+    // Side effects
+    OP_PRINT_STRING,
+
+    // Strings (to-string is typed, so the VM never inspects a value's tag)
+    OP_TO_STRING_I32,
+    OP_TO_STRING_BOOL,
+    OP_CONCAT_STRING,
+    OP_CONCAT_N,   ///< u8 part count
+    OP_CONCAT_N_W, ///< u16 part count
+    OP_CONCAT_N_L, ///< u32 part count
+
+    // Superinstructions (selected by the emitter for common IR sequences)
+    OP_PRINT_CONST,           ///< u8 constant index: PushConst + PrintString
+    OP_PRINT_CONST_W,         ///< u16 constant index
+    OP_PRINT_CONST_L,         ///< u32 constant index
+    OP_ADD_LOCAL_CONST,       ///< u8 src, u8 const, u8 dst: dst = src + const
+    OP_JUMP_IF_NOT_LT_LOCALS, ///< u8 a, u8 b, u32 offset: jump unless a < b
+    OP_PRINT_I32,             ///< TO_STRING_I32 + PRINT_STRING, with no string built
+
+    // Structural
+    OP_NOP,
+    OP_HALT,
+
+    /// Number of opcodes; not a valid instruction.
+    OP_COUNT
+};
+
+/**
+ * @brief Size in bytes of the inline operand that follows an opcode
+ */
+inline size_t operandWidth(BytecodeOp op)
+{
+    switch (op)
+    {
+    case OP_PUSH_CONST:
+    case OP_LOAD_LOCAL:
+    case OP_STORE_LOCAL:
+    case OP_CONCAT_N:
+    case OP_PRINT_CONST:
+        return 1;
+    case OP_PUSH_CONST_W:
+    case OP_LOAD_LOCAL_W:
+    case OP_STORE_LOCAL_W:
+    case OP_CONCAT_N_W:
+    case OP_PRINT_CONST_W:
+        return 2;
+    case OP_ADD_LOCAL_CONST:
+        return 3;
+    case OP_PUSH_CONST_L:
+    case OP_LOAD_LOCAL_L:
+    case OP_STORE_LOCAL_L:
+    case OP_CONCAT_N_L:
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_JUMP_IF_TRUE:
+    case OP_PRINT_CONST_L:
+        return 4;
+    case OP_JUMP_IF_NOT_LT_LOCALS:
+        return 6;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Read a little-endian u16 operand
+ */
+inline uint16_t readU16(const uint8_t* p)
+{
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+/**
+ * @brief Read a little-endian u32 operand
+ */
+inline uint32_t readU32(const uint8_t* p)
+{
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+/**
+ * @brief The operand of a single-operand instruction, decoded
+ * @return 0 for opcodes with no operand or with several fields
+ */
+inline uint32_t decodeOperand(const uint8_t* ip)
+{
+    switch (operandWidth(static_cast<BytecodeOp>(*ip)))
+    {
+    case 1:
+        return ip[1];
+    case 2:
+        return readU16(ip + 1);
+    case 4:
+        return readU32(ip + 1);
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Operand stack values an instruction pops and pushes
+ * @return False for bytes that are not opcodes
+ */
+inline bool stackEffect(const uint8_t* ip, int& pops, int& pushes)
+{
+    pops = 0;
+    pushes = 0;
+    switch (*ip)
+    {
+    case OP_PUSH_CONST:
+    case OP_PUSH_CONST_W:
+    case OP_PUSH_CONST_L:
+    case OP_LOAD_LOCAL:
+    case OP_LOAD_LOCAL_W:
+    case OP_LOAD_LOCAL_L:
+        pushes = 1;
+        return true;
+    case OP_POP:
+    case OP_STORE_LOCAL:
+    case OP_STORE_LOCAL_W:
+    case OP_STORE_LOCAL_L:
+    case OP_JUMP_IF_FALSE:
+    case OP_JUMP_IF_TRUE:
+    case OP_PRINT_STRING:
+    case OP_PRINT_I32:
+        pops = 1;
+        return true;
+    case OP_ADD_I32:
+    case OP_SUB_I32:
+    case OP_MUL_I32:
+    case OP_DIV_I32:
+    case OP_CMP_EQ_I32:
+    case OP_CMP_NEQ_I32:
+    case OP_CMP_LT_I32:
+    case OP_CMP_LTEQ_I32:
+    case OP_CMP_GT_I32:
+    case OP_CMP_GTEQ_I32:
+    case OP_CMP_EQ_BOOL:
+    case OP_CMP_NEQ_BOOL:
+    case OP_CMP_EQ_STRING:
+    case OP_CMP_NEQ_STRING:
+    case OP_CONCAT_STRING:
+        pops = 2;
+        pushes = 1;
+        return true;
+    case OP_NOT_BOOL:
+    case OP_NEG_I32:
+    case OP_TO_STRING_I32:
+    case OP_TO_STRING_BOOL:
+        pops = 1;
+        pushes = 1;
+        return true;
+    case OP_CONCAT_N:
+    case OP_CONCAT_N_W:
+    case OP_CONCAT_N_L:
+        pops = static_cast<int>(decodeOperand(ip));
+        pushes = 1;
+        return pops >= 0;
+    case OP_JUMP:
+    case OP_PRINT_CONST:
+    case OP_PRINT_CONST_W:
+    case OP_PRINT_CONST_L:
+    case OP_ADD_LOCAL_CONST:
+    case OP_JUMP_IF_NOT_LT_LOCALS:
+    case OP_NOP:
+    case OP_HALT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief How large a frame the code can use, read off the code itself
+ *
+ * Instructions are decoded from the start until one is invalid or truncated;
+ * every byte after that counts as an instruction of its own.
+ */
+struct CodeLimits
+{
+    uint32_t instructions = 0;  ///< No instruction pushes more than one value
+    uint32_t localOperands = 0; ///< Operand fields that name a local slot
+    uint32_t localsNamed = 0;   ///< One more than the highest local slot named, or 0
+
+    /** @brief Most local slots the code can use: each is named by some operand */
+    uint32_t maxLocals() const
+    {
+        return localOperands < localsNamed ? localOperands : localsNamed;
+    }
+};
+
+/**
+ * @brief Scan `size` bytes of code for its CodeLimits
+ */
+inline CodeLimits codeLimits(const uint8_t* code, uint32_t size)
+{
+    CodeLimits limits;
+    auto       name = [&](uint32_t slot)
+    {
+        limits.localOperands++;
+        if (slot >= limits.localsNamed)
+        {
+            limits.localsNamed = slot + 1;
+        }
+    };
+
+    uint32_t offset = 0;
+    while (offset < size && code[offset] < OP_COUNT)
+    {
+        const uint8_t* ip = code + offset;
+        uint64_t       next = uint64_t{offset} + 1 + operandWidth(static_cast<BytecodeOp>(*ip));
+        if (next > size)
+        {
+            break;
+        }
+        switch (*ip)
+        {
+        case OP_LOAD_LOCAL:
+        case OP_LOAD_LOCAL_W:
+        case OP_LOAD_LOCAL_L:
+        case OP_STORE_LOCAL:
+        case OP_STORE_LOCAL_W:
+        case OP_STORE_LOCAL_L:
+            name(decodeOperand(ip));
+            break;
+        case OP_ADD_LOCAL_CONST:
+            name(ip[1]);
+            name(ip[3]);
+            break;
+        case OP_JUMP_IF_NOT_LT_LOCALS:
+            name(ip[1]);
+            name(ip[2]);
+            break;
+        default:
+            break;
+        }
+        limits.instructions++;
+        offset = static_cast<uint32_t>(next);
+    }
+    limits.instructions += size - offset;
+    return limits;
+}
+
+/**
+ * @brief Compressed mapping from bytecode offsets to source locations
+ *
+ * Only offsets where the location changes get an entry. Each entry is three
+ * LEB128 varints: the byte distance from the previous entry, the zigzag-encoded
+ * line delta, and the absolute column. Straight-line code on one source line
+ * therefore costs nothing, and a typical statement costs three bytes.
+ *
+ * Lookups decode from the start; they only happen on the error path.
+ */
+struct LineTable
+{
+    /** @brief Encoded entries */
+    std::vector<uint8_t> data;
+
+    /** @brief Offset of the last entry added */
+    uint32_t lastOffset = 0;
+
+    /** @brief Location of the last entry added */
+    SourceLoc lastLoc{0, 0};
+
+    /**
+     * @brief Record that code starting at `offset` comes from `loc`
+     * @param offset Byte offset of the instruction; must not decrease
+     * @param loc Source location of that instruction
+     */
+    void add(uint32_t offset, SourceLoc loc);
+
+    /**
+     * @brief Find the source location of the instruction at `offset`
+     * @return Location of the closest entry at or before offset, or {0, 0}
+     */
+    SourceLoc lookup(uint32_t offset) const;
+};
+
+/**
+ * @brief Decode an encoded line table in place
+ * @param data Start of LineTable::data (possibly inside a mapped image)
+ * @param size Number of encoded bytes
+ * @param offset Code offset to look up
+ * @return Location of the closest entry at or before offset, or {0, 0}
+ */
+SourceLoc lookupLine(const uint8_t* data, size_t size, uint32_t offset);
+
+/**
+ * @brief One decoded line table entry: code from `offset` up to the next
+ *        entry's offset comes from `loc`
+ */
+struct LineEntry
+{
+    uint32_t  offset;
+    SourceLoc loc;
+};
+
+/**
+ * @brief Decode a whole line table at once, for callers that look up many offsets
+ * @return Entries in increasing offset order
+ */
+std::vector<LineEntry> decodeLines(const uint8_t* data, size_t size);
+
+/**
+ * @brief A function lowered to packed bytecode
+ *
+ * Self-contained: the constant pool is copied from the IrProgram so the
+ * bytecode can be executed or serialized without the IR.
+ */
+struct Bytecode
+{
+    /** @brief Packed instruction stream, terminated by OP_HALT */
+    std::vector<uint8_t> code;
+
+    /** @brief Constant pool indexed by constant operands */
+    std::vector<Constant> constants;
+
+    /** @brief Source locations for code offsets */
+    LineTable lines;
+
+    /** @brief Number of local slots the function needs */
+    uint32_t localCount = 0;
+
+    /** @brief Maximum operand stack depth reached by the code */
+    uint32_t maxStack = 0;
+};
+
+/**
+ * @brief Printable mnemonic for a bytecode opcode (e.g. "PUSH_CONST_W")
+ */
+const char* opcodeName(BytecodeOp op);
+
+/**
+ * @brief Render bytecode as a human-readable listing
+ *
+ * One instruction per line: byte offset, source line, mnemonic and decoded
+ * operand. Constant operands are followed by the constant's value.
+ */
+std::string disassemble(const Bytecode& bytecode);
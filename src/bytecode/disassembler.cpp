@@ -0,0 +1,176 @@
+/**
+ * @file disassembler.cpp
+ * @brief Human-readable listings of packed bytecode.
+ */
+
+#include "bytecode/bytecode.h"
+
+#include <iomanip>
+#include <sstream>
+
+const char* opcodeName(BytecodeOp op)
+{
+    switch (op)
+    {
+    case OP_PUSH_CONST:
+        return "PUSH_CONST";
+    case OP_PUSH_CONST_W:
+        return "PUSH_CONST_W";
+    case OP_PUSH_CONST_L:
+        return "PUSH_CONST_L";
+    case OP_POP:
+        return "POP";
+    case OP_LOAD_LOCAL:
+        return "LOAD_LOCAL";
+    case OP_LOAD_LOCAL_W:
+        return "LOAD_LOCAL_W";
+    case OP_LOAD_LOCAL_L:
+        return "LOAD_LOCAL_L";
+    case OP_STORE_LOCAL:
+        return "STORE_LOCAL";
+    case OP_STORE_LOCAL_W:
+        return "STORE_LOCAL_W";
+    case OP_STORE_LOCAL_L:
+        return "STORE_LOCAL_L";
+    case OP_ADD_I32:
+        return "ADD_I32";
+    case OP_SUB_I32:
+        return "SUB_I32";
+    case OP_MUL_I32:
+        return "MUL_I32";
+    case OP_DIV_I32:
+        return "DIV_I32";
+    case OP_NOT_BOOL:
+        return "NOT_BOOL";
+    case OP_NEG_I32:
+        return "NEG_I32";
+    case OP_CMP_EQ_I32:
+        return "CMP_EQ_I32";
+    case OP_CMP_NEQ_I32:
+        return "CMP_NEQ_I32";
+    case OP_CMP_LT_I32:
+        return "CMP_LT_I32";
+    case OP_CMP_LTEQ_I32:
+        return "CMP_LTEQ_I32";
+    case OP_CMP_GT_I32:
+        return "CMP_GT_I32";
+    case OP_CMP_GTEQ_I32:
+        return "CMP_GTEQ_I32";
+    case OP_CMP_EQ_BOOL:
+        return "CMP_EQ_BOOL";
+    case OP_CMP_NEQ_BOOL:
+        return "CMP_NEQ_BOOL";
+    case OP_CMP_EQ_STRING:
+        return "CMP_EQ_STRING";
+    case OP_CMP_NEQ_STRING:
+        return "CMP_NEQ_STRING";
+    case OP_JUMP:
+        return "JUMP";
+    case OP_JUMP_IF_FALSE:
+        return "JUMP_IF_FALSE";
+    case OP_JUMP_IF_TRUE:
+        return "JUMP_IF_TRUE";
+    case OP_PRINT_STRING:
+        return "PRINT_STRING";
+    case OP_TO_STRING_I32:
+        return "TO_STRING_I32";
+    case OP_TO_STRING_BOOL:
+        return "TO_STRING_BOOL";
+    case OP_CONCAT_STRING:
+        return "CONCAT_STRING";
+    case OP_CONCAT_N:
+        return "CONCAT_N";
+    case OP_CONCAT_N_W:
+        return "CONCAT_N_W";
+    case OP_CONCAT_N_L:
+        return "CONCAT_N_L";
+    case OP_PRINT_CONST:
+        return "PRINT_CONST";
+    case OP_PRINT_CONST_W:
+        return "PRINT_CONST_W";
+    case OP_PRINT_CONST_L:
+        return "PRINT_CONST_L";
+    case OP_ADD_LOCAL_CONST:
+        return "ADD_LOCAL_CONST";
+    case OP_JUMP_IF_NOT_LT_LOCALS:
+        return "JUMP_IF_NOT_LT_LOCALS";
+    case OP_PRINT_I32:
+        return "PRINT_I32";
+    case OP_NOP:
+        return "NOP";
+    case OP_HALT:
+        return "HALT";
+    default:
+        return "<unknown>";
+    }
+}
+
+static void printConstant(std::ostringstream& out, const Constant& c)
+{
+    if (auto s = std::get_if<std::string>(&c.value))
+    {
+        out << '"' << *s << '"';
+    }
+    else if (auto b = std::get_if<bool>(&c.value))
+    {
+        out << (*b ? "affirmative" : "negative");
+    }
+    else
+    {
+        out << std::get<int>(c.value);
+    }
+}
+
+std::string disassemble(const Bytecode& bytecode)
+{
+    std::ostringstream out;
+    const auto&        code = bytecode.code;
+
+    size_t offset = 0;
+    while (offset < code.size())
+    {
+        auto   op = static_cast<BytecodeOp>(code[offset]);
+        size_t width = operandWidth(op);
+
+        out << std::setw(4) << std::setfill('0') << offset << std::setfill(' ') << "  line "
+            << std::setw(4) << bytecode.lines.lookup(static_cast<uint32_t>(offset)).line << "  "
+            << opcodeName(op);
+
+        if (offset + width >= code.size())
+        {
+            if (width > 0)
+            {
+                out << " <truncated>\n";
+            }
+            break;
+        }
+
+        const uint8_t* p = code.data() + offset + 1;
+        if (op == OP_ADD_LOCAL_CONST)
+        {
+            out << ' ' << +p[0] << ' ' << +p[1] << ' ' << +p[2];
+        }
+        else if (op == OP_JUMP_IF_NOT_LT_LOCALS)
+        {
+            out << ' ' << +p[0] << ' ' << +p[1] << ' ' << readU32(p + 2);
+        }
+        else if (width > 0)
+        {
+            uint32_t operand = width == 1 ? p[0] : width == 2 ? readU16(p) : readU32(p);
+            out << ' ' << operand;
+
+            bool isConst = op == OP_PUSH_CONST || op == OP_PUSH_CONST_W || op == OP_PUSH_CONST_L ||
+                           op == OP_PRINT_CONST || op == OP_PRINT_CONST_W || op == OP_PRINT_CONST_L;
+            if (isConst && operand < bytecode.constants.size())
+            {
+                out << "  ; ";
+                printConstant(out, bytecode.constants[operand]);
+            }
+        }
+
+        out << '\n';
+        offset += 1 + width;
+    }
+
+    return out.str();
+}
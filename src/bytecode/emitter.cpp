@@ -0,0 +1,561 @@
+/**
+ * @file emitter.cpp
+ * @brief Implementation of IR-to-bytecode emission and the line table.
+ */
+
+#include "bytecode/emitter.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+// ==================================================================================
+// LINE TABLE
+// ==================================================================================
+
+static void writeVarint(std::vector<uint8_t>& out, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static uint32_t readVarint(const uint8_t* in, size_t size, size_t& pos)
+{
+    uint32_t value = 0;
+    int      shift = 0;
+    while (pos < size && shift < 32)
+    {
+        uint8_t byte = in[pos++];
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            break;
+        }
+        shift += 7;
+    }
+    return value;
+}
+
+static uint32_t zigzag(int32_t value)
+{
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value)
+{
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+void LineTable::add(uint32_t offset, SourceLoc loc)
+{
+    if (!data.empty() && loc == lastLoc)
+    {
+        return;
+    }
+    writeVarint(data, offset - lastOffset);
+    writeVarint(data, zigzag(loc.line - lastLoc.line));
+    writeVarint(data, static_cast<uint32_t>(loc.col));
+    lastOffset = offset;
+    lastLoc = loc;
+}
+
+SourceLoc LineTable::lookup(uint32_t offset) const
+{
+    return lookupLine(data.data(), data.size(), offset);
+}
+
+SourceLoc lookupLine(const uint8_t* data, size_t size, uint32_t offset)
+{
+    SourceLoc found{0, 0};
+    SourceLoc current{0, 0};
+    uint32_t  at = 0;
+    size_t    pos = 0;
+
+    while (pos < size)
+    {
+        at += readVarint(data, size, pos);
+        if (at > offset)
+        {
+            break;
+        }
+        current.line += unzigzag(readVarint(data, size, pos));
+        current.col = static_cast<int>(readVarint(data, size, pos));
+        found = current;
+    }
+    return found;
+}
+
+std::vector<LineEntry> decodeLines(const uint8_t* data, size_t size)
+{
+    std::vector<LineEntry> entries;
+    SourceLoc              current{0, 0};
+    uint32_t               at = 0;
+    size_t                 pos = 0;
+
+    while (pos < size)
+    {
+        at += readVarint(data, size, pos);
+        current.line += unzigzag(readVarint(data, size, pos));
+        current.col = static_cast<int>(readVarint(data, size, pos));
+        entries.push_back({at, current});
+    }
+    return entries;
+}
+
+// ==================================================================================
+// EMITTER
+// ==================================================================================
+
+/**
+ * @brief Number of operand-stack values an opcode pops and pushes
+ */
+struct StackEffect
+{
+    int pops;
+    int pushes;
+};
+
+static StackEffect stackEffect(const Instruction& inst)
+{
+    switch (inst.opcode)
+    {
+    case PushConst:
+    case LoadLocal:
+        return {0, 1};
+    case Pop:
+    case StoreLocal:
+    case JumpIfFalse:
+    case JumpIfTrue:
+    case PrintString:
+        return {1, 0};
+    case AddI32:
+    case SubI32:
+    case MulI32:
+    case DivI32:
+    case CmpEqI32:
+    case CmpNEqI32:
+    case CmpLtI32:
+    case CmpLtEqI32:
+    case CmpGtI32:
+    case CmpGtEqI32:
+    case CmpEqBool32:
+    case CmpNEqBool32:
+    case CmpEqString32:
+    case CmpNEqString32:
+    case ConcatString:
+        return {2, 1};
+    case NotBool:
+    case NegI32:
+    case ToString:
+        return {1, 1};
+    case ConcatN:
+        return {static_cast<int>(std::get<Arity>(inst.operand).value), 1};
+    case Jump:
+    case JLabel:
+    case Nop:
+    case Halt:
+    default:
+        return {0, 0};
+    }
+}
+
+/**
+ * @brief Type of the value an IR instruction pushes
+ * @return Void32 for instructions that push nothing, or an invalid operand
+ */
+static IrType resultType(const IrProgram& program, const IrFunction& function,
+                         const Instruction& inst)
+{
+    switch (inst.opcode)
+    {
+    case PushConst:
+    {
+        uint32_t index = std::get<ConstId>(inst.operand).value;
+        return index < program.constants.size() ? program.constants[index].type : Void32;
+    }
+    case LoadLocal:
+    {
+        uint32_t index = std::get<LocalId>(inst.operand).value;
+        const auto& locals = function.localTable.locals;
+        return index < locals.size() ? locals[index].type : Void32;
+    }
+    case AddI32:
+    case SubI32:
+    case MulI32:
+    case DivI32:
+    case NegI32:
+        return I32;
+    case NotBool:
+    case CmpEqI32:
+    case CmpNEqI32:
+    case CmpLtI32:
+    case CmpLtEqI32:
+    case CmpGtI32:
+    case CmpGtEqI32:
+    case CmpEqBool32:
+    case CmpNEqBool32:
+    case CmpEqString32:
+    case CmpNEqString32:
+        return Bool32;
+    case ToString:
+    case ConcatString:
+    case ConcatN:
+        return String32;
+    default:
+        return Void32;
+    }
+}
+
+/**
+ * @brief Bytecode opcode for IR opcodes that take no operand
+ */
+static BytecodeOp simpleOp(Opcode op)
+{
+    switch (op)
+    {
+    case Pop:
+        return OP_POP;
+    case AddI32:
+        return OP_ADD_I32;
+    case SubI32:
+        return OP_SUB_I32;
+    case MulI32:
+        return OP_MUL_I32;
+    case DivI32:
+        return OP_DIV_I32;
+    case NotBool:
+        return OP_NOT_BOOL;
+    case NegI32:
+        return OP_NEG_I32;
+    case CmpEqI32:
+        return OP_CMP_EQ_I32;
+    case CmpNEqI32:
+        return OP_CMP_NEQ_I32;
+    case CmpLtI32:
+        return OP_CMP_LT_I32;
+    case CmpLtEqI32:
+        return OP_CMP_LTEQ_I32;
+    case CmpGtI32:
+        return OP_CMP_GT_I32;
+    case CmpGtEqI32:
+        return OP_CMP_GTEQ_I32;
+    case CmpEqBool32:
+        return OP_CMP_EQ_BOOL;
+    case CmpNEqBool32:
+        return OP_CMP_NEQ_BOOL;
+    case CmpEqString32:
+        return OP_CMP_EQ_STRING;
+    case CmpNEqString32:
+        return OP_CMP_NEQ_STRING;
+    case PrintString:
+        return OP_PRINT_STRING;
+    case ConcatString:
+        return OP_CONCAT_STRING;
+    case Halt:
+        return OP_HALT;
+    case Nop:
+    default:
+        return OP_NOP;
+    }
+}
+
+static void writeU16(std::vector<uint8_t>& code, uint16_t value)
+{
+    code.push_back(static_cast<uint8_t>(value));
+    code.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+static void writeU32(std::vector<uint8_t>& code, uint32_t value)
+{
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        code.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+/**
+ * @brief Emit an instruction with an integer operand in its narrowest form
+ * @param narrow The u8 variant; the `_W` and `_L` variants must follow it
+ */
+static void emitIndexed(std::vector<uint8_t>& code, BytecodeOp narrow, uint32_t index)
+{
+    if (index <= UINT8_MAX)
+    {
+        code.push_back(narrow);
+        code.push_back(static_cast<uint8_t>(index));
+    }
+    else if (index <= UINT16_MAX)
+    {
+        code.push_back(static_cast<uint8_t>(narrow + 1));
+        writeU16(code, static_cast<uint16_t>(index));
+    }
+    else
+    {
+        code.push_back(static_cast<uint8_t>(narrow + 2));
+        writeU32(code, index);
+    }
+}
+
+/**
+ * @brief A superinstruction chosen for a run of IR instructions
+ */
+struct Fused
+{
+    size_t count = 0;         ///< IR instructions covered; 0 if nothing matched
+    size_t jumpOperandAt = 0; ///< Code offset of the u32 jump operand, if any
+};
+
+/**
+ * @brief Try to emit a superinstruction for the IR sequence starting at `ip`
+ * @param top Type of the value on top of the stack before `ip`
+ *
+ * Only sequences whose operands are valid and fit the fused encoding are
+ * matched; anything else is left to the one-op-at-a-time path, which also
+ * reports invalid operands. The sequences are taken from instruction traces
+ * of loop and printing code:
+ *
+ * - `PushConst k; PrintString` -> PRINT_CONST k
+ * - `ToString; PrintString` of an I32 -> PRINT_I32
+ * - `LoadLocal a; PushConst k; AddI32; StoreLocal d` -> ADD_LOCAL_CONST a k d
+ * - `LoadLocal a; LoadLocal b; CmpLtI32; JumpIfFalse L` -> JUMP_IF_NOT_LT_LOCALS a b L
+ *
+ * JLabel is a separate instruction, so a matched run never contains a jump
+ * target: jumps can only land on its first instruction.
+ */
+static Fused emitFused(std::vector<uint8_t>& code, const IrProgram& program,
+                       const IrFunction& function, size_t ip, IrType top)
+{
+    const auto& instrs = function.instructions;
+    const auto& locals = function.localTable.locals;
+
+    auto is = [&](size_t k, Opcode op)
+    { return ip + k < instrs.size() && instrs[ip + k].opcode == op; };
+    auto i32Local = [&](size_t k, uint32_t& slot)
+    {
+        LocalId id = std::get<LocalId>(instrs[ip + k].operand);
+        if (id.value >= locals.size() || locals[id.value].type != I32)
+            return false;
+        slot = function.slotOf(id);
+        return slot <= UINT8_MAX;
+    };
+    auto constant = [&](size_t k, IrType type, uint32_t& index)
+    {
+        index = std::get<ConstId>(instrs[ip + k].operand).value;
+        return index < program.constants.size() && program.constants[index].type == type;
+    };
+
+    Fused    fused;
+    uint32_t a = 0, b = 0, k = 0;
+
+    if (is(0, PushConst) && is(1, PrintString) && constant(0, String32, k))
+    {
+        emitIndexed(code, OP_PRINT_CONST, k);
+        fused.count = 2;
+    }
+    else if (is(0, ToString) && is(1, PrintString) && top == I32)
+    {
+        code.push_back(OP_PRINT_I32);
+        fused.count = 2;
+    }
+    else if (is(0, LoadLocal) && is(1, PushConst) && is(2, AddI32) && is(3, StoreLocal) &&
+             i32Local(0, a) && constant(1, I32, k) && k <= UINT8_MAX && i32Local(3, b))
+    {
+        code.insert(code.end(), {OP_ADD_LOCAL_CONST, static_cast<uint8_t>(a),
+                                 static_cast<uint8_t>(k), static_cast<uint8_t>(b)});
+        fused.count = 4;
+    }
+    else if (is(0, LoadLocal) && is(1, LoadLocal) && is(2, CmpLtI32) && is(3, JumpIfFalse) &&
+             i32Local(0, a) && i32Local(1, b))
+    {
+        code.insert(code.end(),
+                    {OP_JUMP_IF_NOT_LT_LOCALS, static_cast<uint8_t>(a), static_cast<uint8_t>(b)});
+        fused.jumpOperandAt = code.size();
+        writeU32(code, 0);
+        fused.count = 4;
+    }
+    return fused;
+}
+
+Bytecode BytecodeEmitter::emit(const IrFunction& function)
+{
+    diagnostics.clear();
+
+    Bytecode       bytecode;
+    const uint32_t frameSlots = function.frameSlots();
+    bytecode.constants = program.constants;
+
+    const auto& instrs = function.instructions;
+    auto&       code = bytecode.code;
+    code.reserve(instrs.size() * 2 + 1);
+
+    // Jump operands whose target offset is patched in once all labels are placed.
+    struct Fixup
+    {
+        size_t  ip;
+        size_t  at;
+        LabelId target;
+    };
+    std::vector<Fixup>                    fixups;
+    std::unordered_map<LabelId, uint32_t> labelOffset;
+
+    // Operand stack types recorded at each label by the jumps that target it.
+    // Lowering never leaves a label reachable only by fallthrough with a
+    // different stack, so one linear pass is enough to find the maximum depth
+    // and the operand type of every ToString.
+    std::unordered_map<LabelId, std::vector<IrType>> labelTypes;
+    std::vector<IrType>                              types;
+    size_t                                           maxDepth = 0;
+    bool                                             fallsThrough = true;
+
+    for (size_t ip = 0; ip < instrs.size(); ip++)
+    {
+        const Instruction& inst = instrs[ip];
+        uint32_t           offset = static_cast<uint32_t>(code.size());
+
+        IrType top = types.empty() ? Void32 : types.back();
+        Fused  fused = superinstructions ? emitFused(code, program, function, ip, top) : Fused{};
+        if (fused.count > 0)
+        {
+            if (fused.jumpOperandAt != 0)
+            {
+                LabelId target = std::get<LabelId>(instrs[ip + 3].operand);
+                fixups.push_back({ip, fused.jumpOperandAt, target});
+            }
+        }
+        else
+        {
+            switch (inst.opcode)
+            {
+            case PushConst:
+            {
+                uint32_t index = std::get<ConstId>(inst.operand).value;
+                if (index >= program.constants.size())
+                {
+                    diagnostics.push_back({"Invalid ConstId", ip});
+                }
+                emitIndexed(code, OP_PUSH_CONST, index);
+                break;
+            }
+            case LoadLocal:
+            case StoreLocal:
+            {
+                LocalId  id = std::get<LocalId>(inst.operand);
+                uint32_t index = id.value < function.localTable.locals.size()
+                                     ? function.slotOf(id)
+                                     : frameSlots;
+                if (index >= frameSlots)
+                {
+                    diagnostics.push_back({"Invalid LocalId", ip});
+                }
+                emitIndexed(code, inst.opcode == LoadLocal ? OP_LOAD_LOCAL : OP_STORE_LOCAL, index);
+                break;
+            }
+            case Jump:
+            case JumpIfFalse:
+            case JumpIfTrue:
+            {
+                LabelId target = std::get<LabelId>(inst.operand);
+                code.push_back(inst.opcode == Jump          ? OP_JUMP
+                               : inst.opcode == JumpIfFalse ? OP_JUMP_IF_FALSE
+                                                            : OP_JUMP_IF_TRUE);
+                fixups.push_back({ip, code.size(), target});
+                writeU32(code, 0);
+                break;
+            }
+            case JLabel:
+            {
+                // Labels occupy no space: they name the offset of the next instruction.
+                LabelId id = std::get<LabelId>(inst.operand);
+                labelOffset[id] = offset;
+                auto known = labelTypes.find(id);
+                if (!fallsThrough && known != labelTypes.end())
+                {
+                    types = known->second;
+                }
+                break;
+            }
+            case ToString:
+            {
+                // The conversion is typed, so the VM never looks at the value's tag.
+                IrType type = types.empty() ? Void32 : types.back();
+                if (type == I32)
+                {
+                    code.push_back(OP_TO_STRING_I32);
+                }
+                else if (type == Bool32)
+                {
+                    code.push_back(OP_TO_STRING_BOOL);
+                }
+                else if (type != String32)
+                {
+                    diagnostics.push_back({"ToString of a value of unknown type", ip});
+                }
+                break;
+            }
+            case ConcatN:
+                emitIndexed(code, OP_CONCAT_N, std::get<Arity>(inst.operand).value);
+                break;
+            case Nop:
+                break;
+            default:
+                code.push_back(simpleOp(inst.opcode));
+                break;
+            }
+        }
+
+        if (code.size() > offset)
+        {
+            bytecode.lines.add(offset, inst.loc);
+        }
+
+        // Stack bookkeeping still follows the individual IR instructions of a
+        // fused run, which can only overestimate the depth the VM needs.
+        size_t last = ip + std::max<size_t>(fused.count, 1) - 1;
+        for (; ip <= last; ip++)
+        {
+            const Instruction& covered = instrs[ip];
+            StackEffect        effect = stackEffect(covered);
+            types.resize(types.size() - std::min<size_t>(effect.pops, types.size()));
+            if (effect.pushes > 0)
+            {
+                types.push_back(resultType(program, function, covered));
+            }
+            maxDepth = std::max(maxDepth, types.size());
+            if (covered.opcode != JLabel && covered.opcode != Nop)
+            {
+                fallsThrough = covered.opcode != Jump;
+            }
+
+            if (covered.opcode == Jump || covered.opcode == JumpIfFalse ||
+                covered.opcode == JumpIfTrue)
+            {
+                labelTypes[std::get<LabelId>(covered.operand)] = types;
+            }
+        }
+        ip = last;
+    }
+
+    code.push_back(OP_HALT);
+
+    for (const Fixup& fixup : fixups)
+    {
+        auto it = labelOffset.find(fixup.target);
+        if (it == labelOffset.end())
+        {
+            diagnostics.push_back({"Jump to undefined label", fixup.ip});
+            continue;
+        }
+        for (int i = 0; i < 4; i++)
+        {
+            code[fixup.at + i] = static_cast<uint8_t>(it->second >> (8 * i));
+        }
+    }
+
+    // Trailing slots no instruction names need no storage; images may not declare them.
+    bytecode.localCount = codeLimits(code.data(), static_cast<uint32_t>(code.size())).localsNamed;
+    bytecode.maxStack = static_cast<uint32_t>(maxDepth);
+    return bytecode;
+}
@@ -0,0 +1,61 @@
+/**
+ * @file emitter.h
+ * @brief IR-to-bytecode emission for the Ambra compiler
+ *
+ * BytecodeEmitter flattens a validated IrFunction into the packed encoding
+ * described in bytecode.h. Labels are resolved to byte offsets with a
+ * backpatching pass, JLabel markers disappear, and the maximum operand stack
+ * depth is computed so the VM can size its stack once. Common short
+ * sequences are fused into superinstructions to cut dispatch count.
+ */
+
+#pragma once
+
+#include "bytecode/bytecode.h"
+#include "ir/program.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Error found while emitting bytecode
+ */
+struct EmitterDiagnostic
+{
+    std::string message;
+    size_t      ip; ///< Index of the offending IR instruction
+};
+
+/**
+ * @brief Lowers IR functions to packed bytecode
+ *
+ * Example usage:
+ * @code
+ * BytecodeEmitter emitter{program};
+ * Bytecode        bytecode = emitter.emit(program.main);
+ * if (emitter.hadError()) { ... }
+ * @endcode
+ */
+struct BytecodeEmitter
+{
+    /** @brief Program whose constant pool the emitted code refers to */
+    const IrProgram& program;
+
+    /** @brief Problems found during the last emit() call */
+    std::vector<EmitterDiagnostic> diagnostics;
+
+    /** @brief Fuse common instruction sequences into single opcodes */
+    bool superinstructions = true;
+
+    bool hadError() const
+    {
+        return diagnostics.size() > 0;
+    }
+
+    /**
+     * @brief Emit one function as packed bytecode
+     * @param function Function to emit (usually program.main)
+     * @return Bytecode ending in OP_HALT; incomplete if hadError()
+     */
+    Bytecode emit(const IrFunction& function);
+};
@@ -0,0 +1,327 @@
+/**
+ * @file image.cpp
+ * @brief Serialization, mapping and validation of .ambc images.
+ */
+
+#include "bytecode/image.h"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define AMBRA_HAVE_MMAP 1
+#else
+#define AMBRA_HAVE_MMAP 0
+#endif
+
+// ==================================================================================
+// SERIALIZATION
+// ==================================================================================
+
+static void padToAlignment(std::vector<uint8_t>& out)
+{
+    while (out.size() % AMBC_ALIGN != 0)
+    {
+        out.push_back(0);
+    }
+}
+
+template <typename T> static void appendRaw(std::vector<uint8_t>& out, const T& value)
+{
+    const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+std::vector<uint8_t> serializeImage(const Bytecode& bytecode)
+{
+    // String objects are laid out first so constant entries can refer to them.
+    std::vector<uint8_t>      strings;
+    std::vector<AmbcConstant> constants;
+    constants.reserve(bytecode.constants.size());
+    std::unordered_map<std::string_view, uint32_t> stringOffsets;
+
+    for (const Constant& c : bytecode.constants)
+    {
+        AmbcConstant entry{static_cast<uint32_t>(c.type), 0};
+        switch (c.type)
+        {
+        case I32:
+            entry.value = static_cast<uint32_t>(std::get<int>(c.value));
+            break;
+        case Bool32:
+            entry.value = std::get<bool>(c.value) ? 1 : 0;
+            break;
+        case String32:
+        default:
+        {
+            const std::string& s = std::get<std::string>(c.value);
+            auto [known, added] =
+                stringOffsets.emplace(s, static_cast<uint32_t>(strings.size()));
+            entry.value = known->second;
+            if (!added)
+            {
+                break;
+            }
+            appendRaw(strings, AmbcString{static_cast<uint32_t>(s.size()), AMBC_STRING_INTERNED});
+            strings.insert(strings.end(), s.begin(), s.end());
+            strings.push_back('\0');
+            padToAlignment(strings);
+            break;
+        }
+        }
+        constants.push_back(entry);
+    }
+
+    AmbcHeader header{};
+    std::memcpy(header.magic, AMBC_MAGIC, sizeof(header.magic));
+    header.version = AMBC_VERSION;
+    header.headerSize = sizeof(AmbcHeader);
+    header.localCount = bytecode.localCount;
+    header.maxStack = bytecode.maxStack;
+    header.constCount = static_cast<uint32_t>(constants.size());
+
+    std::vector<uint8_t> out(sizeof(AmbcHeader), 0);
+
+    header.constants = {static_cast<uint32_t>(out.size()),
+                        static_cast<uint32_t>(constants.size() * sizeof(AmbcConstant))};
+    for (const AmbcConstant& entry : constants)
+    {
+        appendRaw(out, entry);
+    }
+    padToAlignment(out);
+
+    header.strings = {static_cast<uint32_t>(out.size()), static_cast<uint32_t>(strings.size())};
+    out.insert(out.end(), strings.begin(), strings.end());
+    padToAlignment(out);
+
+    header.code = {static_cast<uint32_t>(out.size()), static_cast<uint32_t>(bytecode.code.size())};
+    out.insert(out.end(), bytecode.code.begin(), bytecode.code.end());
+    padToAlignment(out);
+
+    const auto& lines = bytecode.lines.data;
+    header.lines = {static_cast<uint32_t>(out.size()), static_cast<uint32_t>(lines.size())};
+    out.insert(out.end(), lines.begin(), lines.end());
+    padToAlignment(out);
+
+    header.fileSize = static_cast<uint32_t>(out.size());
+    std::memcpy(out.data(), &header, sizeof(header));
+    return out;
+}
+
+// ==================================================================================
+// BYTECODE IMAGE
+// ==================================================================================
+
+BytecodeImage::~BytecodeImage()
+{
+    release();
+}
+
+BytecodeImage::BytecodeImage(BytecodeImage&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+BytecodeImage& BytecodeImage::operator=(BytecodeImage&& other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        base = std::exchange(other.base, nullptr);
+        size = std::exchange(other.size, 0);
+        mapping = std::exchange(other.mapping, nullptr);
+        owned = std::move(other.owned);
+        other.owned.clear();
+    }
+    return *this;
+}
+
+void BytecodeImage::release()
+{
+#if AMBRA_HAVE_MMAP
+    if (mapping != nullptr)
+    {
+        munmap(mapping, size);
+    }
+#endif
+    mapping = nullptr;
+    owned.clear();
+    base = nullptr;
+    size = 0;
+}
+
+bool BytecodeImage::fromBytes(std::vector<uint8_t> bytes, std::string& error)
+{
+    release();
+    owned = std::move(bytes);
+    base = owned.data();
+    size = owned.size();
+    if (!validate(error))
+    {
+        release();
+        return false;
+    }
+    return true;
+}
+
+bool BytecodeImage::mapFile(const std::string& path, std::string& error)
+{
+    release();
+
+#if AMBRA_HAVE_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        close(fd);
+        error = "cannot read " + path;
+        return false;
+    }
+
+    void* region = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED)
+    {
+        error = "cannot map " + path;
+        return false;
+    }
+
+    mapping = region;
+    base = static_cast<const uint8_t*>(region);
+    size = static_cast<size_t>(st.st_size);
+    if (!validate(error))
+    {
+        release();
+        return false;
+    }
+    return true;
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)),
+                               std::istreambuf_iterator<char>());
+    return fromBytes(std::move(bytes), error);
+#endif
+}
+
+static bool sectionInBounds(const AmbcSection& section, uint32_t fileSize)
+{
+    return section.offset % AMBC_ALIGN == 0 &&
+           static_cast<uint64_t>(section.offset) + section.size <= fileSize;
+}
+
+bool BytecodeImage::validate(std::string& error)
+{
+    if (size < sizeof(AmbcHeader) || reinterpret_cast<uintptr_t>(base) % AMBC_ALIGN != 0)
+    {
+        error = "not an Ambra bytecode file";
+        return false;
+    }
+
+    const AmbcHeader& h = header();
+    if (std::memcmp(h.magic, AMBC_MAGIC, sizeof(h.magic)) != 0)
+    {
+        error = "not an Ambra bytecode file";
+        return false;
+    }
+    if (h.version != AMBC_VERSION || h.headerSize != sizeof(AmbcHeader))
+    {
+        std::ostringstream msg;
+        msg << "unsupported bytecode version " << h.version << " (expected " << AMBC_VERSION
+            << ")";
+        error = msg.str();
+        return false;
+    }
+    if (h.fileSize > size || !sectionInBounds(h.constants, h.fileSize) ||
+        !sectionInBounds(h.strings, h.fileSize) || !sectionInBounds(h.code, h.fileSize) ||
+        !sectionInBounds(h.lines, h.fileSize))
+    {
+        error = "truncated or corrupt bytecode file";
+        return false;
+    }
+    if (static_cast<uint64_t>(h.constCount) * sizeof(AmbcConstant) != h.constants.size)
+    {
+        error = "constant table size mismatch";
+        return false;
+    }
+    if (h.code.size == 0 || base[h.code.offset + h.code.size - 1] != OP_HALT)
+    {
+        error = "code section does not end with HALT";
+        return false;
+    }
+
+    // The VM and the verifier size their frames from these before running any code.
+    CodeLimits limits = codeLimits(base + h.code.offset, h.code.size);
+    if (h.localCount > limits.maxLocals())
+    {
+        error = "header localCount " + std::to_string(h.localCount) +
+                " is more than the code can use";
+        return false;
+    }
+    if (h.maxStack > limits.instructions)
+    {
+        error = "header maxStack " + std::to_string(h.maxStack) +
+                " is deeper than the code can reach";
+        return false;
+    }
+
+    for (uint32_t i = 0; i < h.constCount; i++)
+    {
+        const AmbcConstant& c = constant(i);
+        if (c.type == I32 || c.type == Bool32)
+        {
+            continue;
+        }
+        if (c.type != String32 || c.value % AMBC_ALIGN != 0 ||
+            static_cast<uint64_t>(c.value) + sizeof(AmbcString) > h.strings.size)
+        {
+            error = "invalid constant " + std::to_string(i);
+            return false;
+        }
+        const AmbcString* object = stringObject(i);
+        const char*       chars = reinterpret_cast<const char*>(object + 1);
+        if (static_cast<uint64_t>(c.value) + sizeof(AmbcString) + object->length + 1 >
+                h.strings.size ||
+            chars[object->length] != '\0' || object->flags != AMBC_STRING_INTERNED)
+        {
+            error = "invalid string constant " + std::to_string(i);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::string_view BytecodeImage::stringConstant(uint32_t index) const
+{
+    const AmbcString* object = stringObject(index);
+    return std::string_view(reinterpret_cast<const char*>(object + 1), object->length);
+}
+
+SourceLoc BytecodeImage::lookupLine(uint32_t offset) const
+{
+    return ::lookupLine(base + header().lines.offset, header().lines.size, offset);
+}
+
+std::vector<LineEntry> BytecodeImage::lineEntries() const
+{
+    return decodeLines(base + header().lines.offset, header().lines.size);
+}
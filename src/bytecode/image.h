@@ -0,0 +1,209 @@
+/**
+ * @file image.h
+ * @brief The .ambc bytecode file format and its zero-copy loader
+ *
+ * An .ambc file is laid out so it can be mapped into memory and executed
+ * where it lies. All fields are little-endian and every section starts on an
+ * 8-byte boundary:
+ *
+ * @code
+ * AmbcHeader                       64 bytes
+ * constants   AmbcConstant[N]      8 bytes each
+ * strings     string objects       { u32 length; u32 flags; chars[length]; '\0' }, 8-aligned
+ * code        packed bytecode      ends with OP_HALT
+ * lines       LineTable::data
+ * @endcode
+ *
+ * A String32 constant's value is the offset of its string object inside the
+ * strings section, so string constants are read in place as views. Constants
+ * with the same text share one object, and every object is marked interned,
+ * so the VM adopts them into its string table as they are.
+ *
+ * BytecodeImage is the read-only view the VM executes. It is backed either by
+ * a file mapping (mapFile) or by an owned buffer (fromBytes), and checks that
+ * every offset in the header stays inside the image before it is used.
+ */
+
+#pragma once
+
+#include "bytecode/bytecode.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/** @brief File magic: "AMBRA" followed by "BC\0" */
+constexpr char AMBC_MAGIC[8] = {'A', 'M', 'B', 'R', 'A', 'B', 'C', '\0'};
+
+/** @brief Format version; bump on any layout change */
+constexpr uint32_t AMBC_VERSION = 7;
+
+/** @brief Flags of every string object in an image: interned (STRING_INTERNED) */
+constexpr uint32_t AMBC_STRING_INTERNED = 1u << 2;
+
+/** @brief Alignment of every section and string object */
+constexpr uint32_t AMBC_ALIGN = 8;
+
+/**
+ * @brief Location of one section, relative to the start of the file
+ */
+struct AmbcSection
+{
+    uint32_t offset;
+    uint32_t size;
+};
+
+/**
+ * @brief Fixed-size header at offset 0 of an .ambc file
+ */
+struct AmbcHeader
+{
+    char        magic[8];   ///< AMBC_MAGIC
+    uint32_t    version;    ///< AMBC_VERSION
+    uint32_t    headerSize; ///< sizeof(AmbcHeader)
+    uint32_t    fileSize;   ///< Total size including padding
+    uint32_t    localCount; ///< Local slots needed by main
+    uint32_t    maxStack;   ///< Maximum operand stack depth of main
+    uint32_t    constCount; ///< Number of AmbcConstant entries
+    AmbcSection constants;  ///< AmbcConstant[constCount]
+    AmbcSection strings;    ///< String objects referenced by String32 constants
+    AmbcSection code;       ///< Packed bytecode
+    AmbcSection lines;      ///< LineTable::data
+};
+
+static_assert(sizeof(AmbcHeader) == 64, "AmbcHeader layout is part of the file format");
+
+/**
+ * @brief One constant pool entry
+ *
+ * - I32: value is the integer bit pattern
+ * - Bool32: value is 0 or 1
+ * - String32: value is the string object's offset in the strings section
+ */
+struct AmbcConstant
+{
+    uint32_t type; ///< IrType
+    uint32_t value;
+};
+
+static_assert(sizeof(AmbcConstant) == 8, "AmbcConstant layout is part of the file format");
+
+/**
+ * @brief Header of a string object in the strings section
+ *
+ * `length` bytes of character data and a terminating NUL follow directly.
+ */
+struct AmbcString
+{
+    uint32_t length;
+    uint32_t flags; ///< Always AMBC_STRING_INTERNED
+};
+
+/**
+ * @brief Serialize bytecode into the .ambc layout
+ * @param bytecode Bytecode produced by BytecodeEmitter
+ * @return File contents, ready to be written or passed to fromBytes()
+ */
+std::vector<uint8_t> serializeImage(const Bytecode& bytecode);
+
+/**
+ * @brief Read-only, executable view of an .ambc image
+ *
+ * Move-only. Accessors are only meaningful after a successful mapFile() or
+ * fromBytes().
+ */
+class BytecodeImage
+{
+  public:
+    BytecodeImage() = default;
+    ~BytecodeImage();
+
+    BytecodeImage(BytecodeImage&& other) noexcept;
+    BytecodeImage& operator=(BytecodeImage&& other) noexcept;
+
+    BytecodeImage(const BytecodeImage&) = delete;
+    BytecodeImage& operator=(const BytecodeImage&) = delete;
+
+    /**
+     * @brief Map an .ambc file read-only and validate it
+     * @param path File to map
+     * @param error Set to a description of the problem on failure
+     * @return True if the image is ready to execute
+     */
+    bool mapFile(const std::string& path, std::string& error);
+
+    /**
+     * @brief Take ownership of an in-memory image and validate it
+     * @param bytes Image contents (e.g. from serializeImage())
+     * @param error Set to a description of the problem on failure
+     * @return True if the image is ready to execute
+     */
+    bool fromBytes(std::vector<uint8_t> bytes, std::string& error);
+
+    bool empty() const
+    {
+        return base == nullptr;
+    }
+
+    const AmbcHeader& header() const
+    {
+        return *reinterpret_cast<const AmbcHeader*>(base);
+    }
+
+    const uint8_t* code() const
+    {
+        return base + header().code.offset;
+    }
+
+    uint32_t codeSize() const
+    {
+        return header().code.size;
+    }
+
+    uint32_t constantCount() const
+    {
+        return header().constCount;
+    }
+
+    const AmbcConstant& constant(uint32_t index) const
+    {
+        return reinterpret_cast<const AmbcConstant*>(base + header().constants.offset)[index];
+    }
+
+    /**
+     * @brief Characters of a String32 constant, viewed in place
+     */
+    std::string_view stringConstant(uint32_t index) const;
+
+    /**
+     * @brief Header of a String32 constant's string object, in place
+     */
+    const AmbcString* stringObject(uint32_t index) const
+    {
+        return reinterpret_cast<const AmbcString*>(base + header().strings.offset +
+                                                   constant(index).value);
+    }
+
+    /**
+     * @brief Source location of the instruction at a code offset
+     */
+    SourceLoc lookupLine(uint32_t offset) const;
+
+    /**
+     * @brief The whole line table, decoded
+     */
+    std::vector<LineEntry> lineEntries() const;
+
+  private:
+    /** @brief Check the header and constant table against the image size */
+    bool validate(std::string& error);
+
+    /** @brief Drop the current mapping or buffer */
+    void release();
+
+    const uint8_t*       base = nullptr;    ///< Start of the image
+    size_t               size = 0;          ///< Size of the image in bytes
+    void*                mapping = nullptr; ///< mmap'd region, if file-backed
+    std::vector<uint8_t> owned;             ///< Backing store, if buffer-backed
+};
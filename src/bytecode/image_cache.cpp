@@ -0,0 +1,242 @@
+/**
+ * @file image_cache.cpp
+ * @brief Implementation of the content-addressed image cache.
+ */
+
+#include "bytecode/image_cache.h"
+
+#include "bytecode/image.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <system_error>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+/// Entries are named <key>.ambcc
+static constexpr const char* ENTRY_EXTENSION = ".ambcc";
+
+/** @brief Prefix of every entry file, before the .ambc image itself */
+struct EntryHeader
+{
+    char     magic[8]; ///< "AMBRACC\0"
+    uint64_t high;     ///< Key, repeated so a renamed or colliding file is caught
+    uint64_t low;
+};
+
+static constexpr char ENTRY_MAGIC[8] = {'A', 'M', 'B', 'R', 'A', 'C', 'C', '\0'};
+
+// ==================================================================================
+// KEYS
+// ==================================================================================
+
+// Two independent 64-bit streams: FNV-1a, and a multiply-rotate hash with a
+// different constant; each is finished with the splitmix64 mixer.
+struct KeyHasher
+{
+    uint64_t fnv = 0xcbf29ce484222325ull;
+    uint64_t mix = 0x9e3779b97f4a7c15ull;
+
+    void update(std::string_view bytes)
+    {
+        for (unsigned char c : bytes)
+        {
+            fnv = (fnv ^ c) * 0x100000001b3ull;
+            mix = (mix ^ c) * 0xff51afd7ed558ccdull;
+            mix = (mix << 31) | (mix >> 33);
+        }
+    }
+
+    static uint64_t finish(uint64_t x)
+    {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ull;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebull;
+        x ^= x >> 31;
+        return x;
+    }
+};
+
+std::string ImageCacheKey::hex() const
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string       out(32, '0');
+    for (int i = 0; i < 16; i++)
+    {
+        out[15 - i] = digits[(high >> (4 * i)) & 0xF];
+        out[31 - i] = digits[(low >> (4 * i)) & 0xF];
+    }
+    return out;
+}
+
+ImageCacheKey contentKey(std::string_view salt, std::string_view bytes)
+{
+    KeyHasher hasher;
+    hasher.update(salt);
+    hasher.update(bytes);
+    return {KeyHasher::finish(hasher.fnv), KeyHasher::finish(hasher.mix ^ bytes.size())};
+}
+
+ImageCache::ImageCache(std::string directory, std::string compilerId, uint64_t maxBytes)
+    : directory(std::move(directory)), compilerId(std::move(compilerId)), maxBytes(maxBytes)
+{
+}
+
+ImageCacheKey ImageCache::keyFor(std::string_view source) const
+{
+    // Lengths go in first so the identity/source boundary is unambiguous.
+    std::string lengths = std::to_string(AMBC_VERSION) + ":" + std::to_string(compilerId.size()) +
+                          ":" + std::to_string(source.size()) + ":";
+
+    return contentKey(lengths + compilerId, source);
+}
+
+std::string ImageCache::entryPath(const ImageCacheKey& key) const
+{
+    return (fs::path(directory) / (key.hex() + ENTRY_EXTENSION)).string();
+}
+
+// ==================================================================================
+// ENTRIES
+// ==================================================================================
+
+bool ImageCache::lookup(const ImageCacheKey& key, std::vector<uint8_t>& image) const
+{
+    std::string   path = entryPath(key);
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        return false;
+    }
+    std::streamoff size = file.tellg();
+    if (size < static_cast<std::streamoff>(sizeof(EntryHeader) + sizeof(AmbcHeader)))
+    {
+        return false;
+    }
+    file.seekg(0);
+
+    EntryHeader entry;
+    file.read(reinterpret_cast<char*>(&entry), sizeof(entry));
+    if (!file || std::memcmp(entry.magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC)) != 0 ||
+        entry.high != key.high || entry.low != key.low)
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> bytes(static_cast<size_t>(size) - sizeof(EntryHeader));
+    file.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    if (!file)
+    {
+        return false;
+    }
+
+    // A full check happens when the VM loads the image; catching a partial or
+    // outdated entry here is enough to fall back to compiling.
+    AmbcHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (std::memcmp(header.magic, AMBC_MAGIC, sizeof(AMBC_MAGIC)) != 0 ||
+        header.version != AMBC_VERSION || header.fileSize != bytes.size())
+    {
+        return false;
+    }
+
+    // Mark the entry as recently used for eviction.
+    std::error_code ignored;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ignored);
+
+    image = std::move(bytes);
+    return true;
+}
+
+bool ImageCache::store(const ImageCacheKey& key, const std::vector<uint8_t>& image) const
+{
+    std::error_code error;
+    fs::create_directories(directory, error);
+    if (error)
+    {
+        return false;
+    }
+
+    // A unique temporary name, so concurrent writers of the same entry never
+    // interleave; the last rename wins and every version is complete.
+    std::random_device random;
+    std::string        path = entryPath(key);
+    std::string        temp = path + "." + std::to_string(random()) + ".tmp";
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        EntryHeader   entry;
+        std::memcpy(entry.magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC));
+        entry.high = key.high;
+        entry.low = key.low;
+        file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+        file.write(reinterpret_cast<const char*>(image.data()),
+                   static_cast<std::streamsize>(image.size()));
+        if (!file)
+        {
+            file.close();
+            fs::remove(temp, error);
+            return false;
+        }
+    }
+
+    fs::rename(temp, path, error);
+    if (error)
+    {
+        fs::remove(temp, error);
+        return false;
+    }
+    return true;
+}
+
+size_t ImageCache::evict() const
+{
+    struct Entry
+    {
+        fs::path           path;
+        uint64_t           size;
+        fs::file_time_type used;
+    };
+    std::vector<Entry> entries;
+    uint64_t           total = 0;
+
+    std::error_code error;
+    for (fs::directory_iterator it(directory, error), end; !error && it != end;
+         it.increment(error))
+    {
+        if (it->path().extension() != ENTRY_EXTENSION)
+        {
+            continue;
+        }
+        std::error_code    statError;
+        uint64_t           size = it->file_size(statError);
+        fs::file_time_type used = it->last_write_time(statError);
+        if (statError)
+        {
+            continue;
+        }
+        entries.push_back({it->path(), size, used});
+        total += size;
+    }
+
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return a.used < b.used; });
+
+    size_t removed = 0;
+    for (const Entry& entry : entries)
+    {
+        if (total <= maxBytes)
+        {
+            break;
+        }
+        // Another process may have removed it already; the space is gone either way.
+        fs::remove(entry.path, error);
+        total -= entry.size;
+        removed++;
+    }
+    return removed;
+}
@@ -0,0 +1,94 @@
+/**
+ * @file image_cache.h
+ * @brief On-disk cache of compiled .ambc images, addressed by source content
+ *
+ * An entry is keyed on a 128-bit hash of the compiler's identity and the
+ * source bytes, so an unchanged file maps to the same entry on every build
+ * and the whole frontend can be skipped. Entries are written to a temporary
+ * name and renamed into place, which lets several compiler processes (and
+ * the threads of one) share a directory.
+ *
+ * Eviction is least-recently-used by file modification time: a hit refreshes
+ * the entry's timestamp, and evict() deletes the oldest entries until the
+ * directory fits in its size budget.
+ *
+ * lookup() and store() are safe to call concurrently; evict() should run
+ * once no other thread is using the cache.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Content hash naming a cache entry
+ */
+struct ImageCacheKey
+{
+    uint64_t high = 0;
+    uint64_t low = 0;
+
+    /** @brief 32 lowercase hex digits */
+    std::string hex() const;
+
+    bool operator==(const ImageCacheKey& other) const
+    {
+        return high == other.high && low == other.low;
+    }
+};
+
+/**
+ * @brief 128-bit hash of `salt` followed by `bytes`
+ *
+ * Spreads well enough to name cache entries; it is not cryptographic.
+ */
+ImageCacheKey contentKey(std::string_view salt, std::string_view bytes);
+
+class ImageCache
+{
+  public:
+    /** @brief Size budget used when none is given */
+    static constexpr uint64_t DEFAULT_MAX_BYTES = 256ull * 1024 * 1024;
+
+    /**
+     * @param directory Where entries live; created on first store
+     * @param compilerId Anything that changes when the compiler's output may
+     *        change (version, build); part of every key
+     * @param maxBytes Total entry size evict() trims the directory to
+     */
+    ImageCache(std::string directory, std::string compilerId,
+               uint64_t maxBytes = DEFAULT_MAX_BYTES);
+
+    /** @brief Key of the image compiled from `source` by this compiler */
+    ImageCacheKey keyFor(std::string_view source) const;
+
+    /**
+     * @brief Fetch a cached image
+     * @param image Receives the .ambc bytes on a hit
+     * @return False on a miss, or if the entry is unreadable or stale
+     */
+    bool lookup(const ImageCacheKey& key, std::vector<uint8_t>& image) const;
+
+    /**
+     * @brief Add an image to the cache
+     * @return False if the entry could not be written (the cache is best-effort)
+     */
+    bool store(const ImageCacheKey& key, const std::vector<uint8_t>& image) const;
+
+    /**
+     * @brief Delete least recently used entries until the budget is met
+     * @return Number of entries removed
+     */
+    size_t evict() const;
+
+    /** @brief File that holds the entry for `key` */
+    std::string entryPath(const ImageCacheKey& key) const;
+
+  private:
+    std::string directory;  ///< Cache directory
+    std::string compilerId; ///< Mixed into every key
+    uint64_t    maxBytes;   ///< Budget enforced by evict()
+};
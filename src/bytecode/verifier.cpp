@@ -0,0 +1,436 @@
+/**
+ * @file verifier.cpp
+ * @brief Implementation of the load-time bytecode verifier.
+ */
+
+#include "bytecode/verifier.h"
+
+#include "ir/validator.h"
+
+#include <deque>
+
+/// Marks code offsets and instructions that do not start an instruction or block.
+static constexpr uint32_t NONE = UINT32_MAX;
+
+/**
+ * @brief Operand and result types of the opcodes that only work on the stack
+ * @param operand Type of each of the `count` values popped
+ * @param result Type pushed, or Void32 if nothing is
+ * @return False for opcodes with operands in the code or effects on locals or control flow
+ */
+static bool stackSignature(uint8_t op, IrType& operand, int& count, IrType& result)
+{
+    switch (op)
+    {
+    case OP_ADD_I32:
+    case OP_SUB_I32:
+    case OP_MUL_I32:
+    case OP_DIV_I32:
+        operand = I32, count = 2, result = I32;
+        return true;
+    case OP_CMP_EQ_I32:
+    case OP_CMP_NEQ_I32:
+    case OP_CMP_LT_I32:
+    case OP_CMP_LTEQ_I32:
+    case OP_CMP_GT_I32:
+    case OP_CMP_GTEQ_I32:
+        operand = I32, count = 2, result = Bool32;
+        return true;
+    case OP_CMP_EQ_BOOL:
+    case OP_CMP_NEQ_BOOL:
+        operand = Bool32, count = 2, result = Bool32;
+        return true;
+    case OP_CMP_EQ_STRING:
+    case OP_CMP_NEQ_STRING:
+        operand = String32, count = 2, result = Bool32;
+        return true;
+    case OP_CONCAT_STRING:
+        operand = String32, count = 2, result = String32;
+        return true;
+    case OP_NOT_BOOL:
+        operand = Bool32, count = 1, result = Bool32;
+        return true;
+    case OP_NEG_I32:
+        operand = I32, count = 1, result = I32;
+        return true;
+    case OP_TO_STRING_I32:
+        operand = I32, count = 1, result = String32;
+        return true;
+    case OP_TO_STRING_BOOL:
+        operand = Bool32, count = 1, result = String32;
+        return true;
+    case OP_PRINT_STRING:
+        operand = String32, count = 1, result = Void32;
+        return true;
+    case OP_PRINT_I32:
+        operand = I32, count = 1, result = Void32;
+        return true;
+    default:
+        return false;
+    }
+}
+
+/** @brief Whether control never falls through `op` to the next instruction */
+static bool endsBlock(uint8_t op)
+{
+    return op == OP_JUMP || op == OP_JUMP_IF_FALSE || op == OP_JUMP_IF_TRUE ||
+           op == OP_JUMP_IF_NOT_LT_LOCALS || op == OP_HALT;
+}
+
+/** @brief Target offset of a branch instruction */
+static uint32_t branchTarget(const uint8_t* ip)
+{
+    return readU32(ip + (*ip == OP_JUMP_IF_NOT_LT_LOCALS ? 3 : 1));
+}
+
+bool BytecodeVerifier::verify()
+{
+    diagnostics.clear();
+
+    const uint8_t* code = image.code();
+    const uint32_t size = image.codeSize();
+    const uint32_t localCount = image.header().localCount;
+    const uint32_t maxStack = image.header().maxStack;
+
+    auto fail = [&](const std::string& message, uint32_t offset)
+    {
+        diagnostics.push_back({message, offset});
+        return false;
+    };
+
+    // Decode every instruction; instructionAt[offset] is its index, if one starts there.
+    std::vector<uint32_t> instructionAt(size, NONE);
+    std::vector<uint32_t> start;
+    for (uint32_t offset = 0; offset < size;)
+    {
+        uint8_t op = code[offset];
+        if (op >= OP_COUNT)
+        {
+            return fail("Invalid opcode " + std::to_string(op), offset);
+        }
+        uint64_t next = uint64_t{offset} + 1 + operandWidth(static_cast<BytecodeOp>(op));
+        if (next > size)
+        {
+            return fail("Truncated instruction", offset);
+        }
+        instructionAt[offset] = static_cast<uint32_t>(start.size());
+        start.push_back(offset);
+        offset = static_cast<uint32_t>(next);
+    }
+    if (start.empty())
+    {
+        return fail("Empty code section", 0);
+    }
+
+    // Blocks start at the entry, at every jump target and after every jump or HALT.
+    std::vector<uint32_t> blockAt(start.size(), NONE);
+    blockAt[0] = 0;
+    for (size_t i = 0; i < start.size(); i++)
+    {
+        const uint8_t* ip = code + start[i];
+        if (!endsBlock(*ip))
+        {
+            continue;
+        }
+        if (*ip != OP_HALT)
+        {
+            uint32_t target = branchTarget(ip);
+            if (target >= size || instructionAt[target] == NONE)
+            {
+                return fail("Jump target is not an instruction", start[i]);
+            }
+            blockAt[instructionAt[target]] = 0;
+        }
+        if (i + 1 < start.size())
+        {
+            blockAt[i + 1] = 0;
+        }
+    }
+    uint32_t blocks = 0;
+    for (uint32_t& block : blockAt)
+    {
+        if (block != NONE)
+        {
+            block = blocks++;
+        }
+    }
+    std::vector<uint32_t> blockStart(blocks);
+    for (uint32_t i = 0; i < start.size(); i++)
+    {
+        if (blockAt[i] != NONE)
+        {
+            blockStart[blockAt[i]] = i;
+        }
+    }
+
+    // Entry state of each block: the operand stack, and the type each local
+    // holds on every path into the block (Void32 if any path may not store it).
+    struct State
+    {
+        IrTypeStack::State  stack;
+        std::vector<IrType> locals;
+    };
+    IrTypeStack          stack;
+    std::vector<IrType>  locals(localCount, Void32);
+    std::vector<State>   entry(blocks);
+    std::vector<bool>    reached(blocks, false);
+    std::vector<bool>    queued(blocks, false);
+    std::deque<uint32_t> work;
+
+    // Worse-typed locals can requeue a block, but each local only ever goes
+    // from a type to Void32, so the walk terminates.
+    auto flowTo = [&](uint32_t instruction, uint32_t fromOffset)
+    {
+        uint32_t block = blockAt[instruction];
+        State&   state = entry[block];
+        if (!reached[block])
+        {
+            reached[block] = true;
+            state = State{stack.state, locals};
+        }
+        else if (!stack.same(state.stack, stack.state))
+        {
+            return fail("Stack mismatch at control-flow merge", fromOffset);
+        }
+        else
+        {
+            bool changed = false;
+            for (uint32_t i = 0; i < localCount; i++)
+            {
+                if (state.locals[i] != Void32 && state.locals[i] != locals[i])
+                {
+                    state.locals[i] = Void32;
+                    changed = true;
+                }
+            }
+            if (!changed)
+            {
+                return true;
+            }
+        }
+        if (!queued[block])
+        {
+            queued[block] = true;
+            work.push_back(block);
+        }
+        return true;
+    };
+
+    auto pop = [&](IrType expected, uint8_t op, uint32_t offset)
+    {
+        if (stack.empty())
+        {
+            return fail(std::string(opcodeName(static_cast<BytecodeOp>(op))) + ": stack underflow",
+                        offset);
+        }
+        if (stack.back() != expected)
+        {
+            return fail(std::string(opcodeName(static_cast<BytecodeOp>(op))) + ": expected " +
+                            getTypeName(expected) + ", got " + getTypeName(stack.back()),
+                        offset);
+        }
+        stack.pop_back();
+        return true;
+    };
+    auto push = [&](IrType type, uint32_t offset)
+    {
+        stack.push_back(type);
+        if (stack.size() > maxStack)
+        {
+            return fail("Stack depth exceeds the header's maxStack", offset);
+        }
+        return true;
+    };
+    auto constant = [&](uint32_t index, uint32_t offset, IrType& type)
+    {
+        if (index >= image.constantCount())
+        {
+            return fail("Constant index out of range", offset);
+        }
+        type = static_cast<IrType>(image.constant(index).type);
+        return true;
+    };
+    auto local = [&](uint32_t index, uint32_t offset)
+    {
+        return index < localCount || fail("Local index out of range", offset);
+    };
+    auto load = [&](uint32_t index, uint32_t offset)
+    {
+        if (!local(index, offset))
+        {
+            return false;
+        }
+        return locals[index] != Void32 ||
+               fail("Load of local " + std::to_string(index) + " before it is stored", offset);
+    };
+
+    reached[0] = true;
+    entry[0] = State{stack.state, locals};
+    queued[0] = true;
+    work.push_back(0);
+
+    while (!work.empty())
+    {
+        uint32_t block = work.front();
+        work.pop_front();
+        queued[block] = false;
+
+        stack.state = entry[block].stack;
+        locals = entry[block].locals;
+
+        for (uint32_t i = blockStart[block];; i++)
+        {
+            uint32_t       offset = start[i];
+            const uint8_t* ip = code + offset;
+            uint8_t        op = *ip;
+            uint32_t       operand = decodeOperand(ip);
+            IrType         type = Void32;
+            IrType         result = Void32;
+            int            count = 0;
+
+            if (stackSignature(op, type, count, result))
+            {
+                for (int k = 0; k < count; k++)
+                {
+                    if (!pop(type, op, offset))
+                    {
+                        return false;
+                    }
+                }
+                if (result != Void32 && !push(result, offset))
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                switch (op)
+                {
+                case OP_PUSH_CONST:
+                case OP_PUSH_CONST_W:
+                case OP_PUSH_CONST_L:
+                    if (!constant(operand, offset, type) || !push(type, offset))
+                    {
+                        return false;
+                    }
+                    break;
+                case OP_POP:
+                    if (stack.empty())
+                    {
+                        return fail("POP: stack underflow", offset);
+                    }
+                    stack.pop_back();
+                    break;
+                case OP_LOAD_LOCAL:
+                case OP_LOAD_LOCAL_W:
+                case OP_LOAD_LOCAL_L:
+                    if (!load(operand, offset) || !push(locals[operand], offset))
+                    {
+                        return false;
+                    }
+                    break;
+                case OP_STORE_LOCAL:
+                case OP_STORE_LOCAL_W:
+                case OP_STORE_LOCAL_L:
+                    if (!local(operand, offset))
+                    {
+                        return false;
+                    }
+                    if (stack.empty())
+                    {
+                        return fail("STORE_LOCAL: stack underflow", offset);
+                    }
+                    locals[operand] = stack.back();
+                    stack.pop_back();
+                    break;
+                case OP_CONCAT_N:
+                case OP_CONCAT_N_W:
+                case OP_CONCAT_N_L:
+                    for (uint32_t k = 0; k < operand; k++)
+                    {
+                        if (!pop(String32, op, offset))
+                        {
+                            return false;
+                        }
+                    }
+                    if (!push(String32, offset))
+                    {
+                        return false;
+                    }
+                    break;
+                case OP_PRINT_CONST:
+                case OP_PRINT_CONST_W:
+                case OP_PRINT_CONST_L:
+                    if (!constant(operand, offset, type))
+                    {
+                        return false;
+                    }
+                    if (type != String32)
+                    {
+                        return fail("PRINT_CONST of a constant that is not a string", offset);
+                    }
+                    break;
+                case OP_ADD_LOCAL_CONST:
+                    if (!load(ip[1], offset) || !constant(ip[2], offset, type) ||
+                        !local(ip[3], offset))
+                    {
+                        return false;
+                    }
+                    if (locals[ip[1]] != I32 || type != I32)
+                    {
+                        return fail("ADD_LOCAL_CONST: expected I32 operands", offset);
+                    }
+                    locals[ip[3]] = I32;
+                    break;
+                case OP_JUMP_IF_NOT_LT_LOCALS:
+                    if (!load(ip[1], offset) || !load(ip[2], offset))
+                    {
+                        return false;
+                    }
+                    if (locals[ip[1]] != I32 || locals[ip[2]] != I32)
+                    {
+                        return fail("JUMP_IF_NOT_LT_LOCALS: expected I32 operands", offset);
+                    }
+                    break;
+                case OP_JUMP_IF_FALSE:
+                case OP_JUMP_IF_TRUE:
+                    if (!pop(Bool32, op, offset))
+                    {
+                        return false;
+                    }
+                    break;
+                case OP_JUMP:
+                case OP_NOP:
+                case OP_HALT:
+                default:
+                    break;
+                }
+            }
+
+            // Successors: the branch target, then the next instruction unless
+            // control cannot fall through to it.
+            if (endsBlock(op) && op != OP_HALT &&
+                !flowTo(instructionAt[branchTarget(ip)], offset))
+            {
+                return false;
+            }
+            if (op == OP_JUMP || op == OP_HALT)
+            {
+                break;
+            }
+            if (i + 1 == start.size())
+            {
+                return fail("Code falls off the end of the code section", offset);
+            }
+            if (blockAt[i + 1] != NONE)
+            {
+                if (!flowTo(i + 1, offset))
+                {
+                    return false;
+                }
+                break;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,69 @@
+/**
+ * @file verifier.h
+ * @brief Load-time check that a bytecode image is safe to run unchecked
+ *
+ * Bytecode opcodes are typed (ADD_I32, CMP_EQ_BOOL, TO_STRING_I32, ...), so
+ * once an image is known to be well formed the VM can execute it without
+ * looking at a single value tag or bounds-checking a single operand.
+ * BytecodeVerifier establishes that, once, before the first run. It repeats
+ * IrValidator's abstract stack typing on the packed code, where the input may
+ * come from a file rather than from our own emitter:
+ *
+ * - Every byte of the code section decodes to a known opcode with all of its
+ *   operand bytes, and the last instruction cannot fall off the end.
+ * - Constant and local operands are in range, constants have the type their
+ *   opcode needs, and every jump lands on the start of an instruction.
+ * - On every path, each instruction finds operands of the types it expects,
+ *   the stack never exceeds the header's maxStack, and no local is loaded
+ *   before it is stored on every path that reaches the load.
+ *
+ * The image has no local type table, so the type of each local is inferred
+ * along with the stack: a local stored with different types on two paths,
+ * or stored on only one of them, cannot be loaded after they join.
+ */
+
+#pragma once
+
+#include "bytecode/image.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Reason an image was rejected
+ */
+struct VerifierDiagnostic
+{
+    std::string message;
+    uint32_t    offset; ///< Code offset of the offending instruction
+};
+
+/**
+ * @brief Checks a loaded image before it is run without checks
+ *
+ * Example usage:
+ * @code
+ * BytecodeVerifier verifier{image};
+ * if (!verifier.verify()) { ... verifier.diagnostics ... }
+ * @endcode
+ */
+struct BytecodeVerifier
+{
+    /** @brief Image to check; its container layout is already validated */
+    const BytecodeImage& image;
+
+    /** @brief The first problem found by the last verify() call, if any */
+    std::vector<VerifierDiagnostic> diagnostics;
+
+    bool hadError() const
+    {
+        return diagnostics.size() > 0;
+    }
+
+    /**
+     * @brief Check every instruction on every path
+     * @return True if the image can run on the unchecked fast path
+     */
+    bool verify();
+};
@@ -1,7 +1,349 @@
+#include "backend/c_emitter.h"
+#include "bytecode/emitter.h"
+#include "bytecode/image.h"
+#include "bytecode/image_cache.h"
+#include "cli/pipeline.h"
+#include "utils/stats.h"
+#include "utils/thread_pool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/// What ambra_compiler writes for each input (--emit=).
+enum class OutputKind
+{
+    Image, ///< .ambc bytecode image, run by ambra_vm
+    C,     ///< C source, built by the system compiler
+};
+
+static std::string defaultOutputPath(const std::string& input, OutputKind kind)
+{
+    const char*            extension = kind == OutputKind::C ? ".c" : ".ambc";
+    std::string::size_type dot = input.rfind('.');
+    std::string::size_type slash = input.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+        return input + extension;
+    }
+    return input.substr(0, dot) + extension;
+}
+
+/**
+ * @brief Write the output next to its destination and rename it into place
+ *
+ * VM processes may map the output while it is being rebuilt; renaming means
+ * they see either the old file or the complete new one, never a partial write.
+ */
+template <typename Bytes> static bool writeOutput(const std::string& path, const Bytes& bytes)
+{
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(bytes.data()),
+                   static_cast<std::streamsize>(bytes.size()));
+        if (!file)
+        {
+            return false;
+        }
+    }
+    return std::rename(temp.c_str(), path.c_str()) == 0;
+}
+
+/**
+ * @brief Identity of this compiler build, for cache keys
+ *
+ * Uses the size and timestamp of the running executable, so rebuilding the
+ * compiler invalidates everything it cached.
+ */
+static std::string compilerIdentity(const char* argv0)
+{
+    namespace fs = std::filesystem;
+
+    std::error_code error;
+    fs::path        self = fs::exists("/proc/self/exe", error) ? fs::path("/proc/self/exe")
+                                                               : fs::path(argv0);
+    self = fs::canonical(self, error);
+
+    std::string identity = "ambra_compiler:" + self.string();
+    uintmax_t   size = fs::file_size(self, error);
+    if (!error)
+    {
+        auto stamp = fs::last_write_time(self, error).time_since_epoch().count();
+        identity += ":" + std::to_string(size) + ":" + std::to_string(stamp);
+    }
+    return identity;
+}
+
+/** @brief Translate lowered IR to C and write it to `output` */
+static bool writeC(const std::string& input, const std::string& output, const IrProgram& ir,
+                   std::ostream& diagnostics)
+{
+    CEmitter    emitter{ir, input};
+    std::string c = timePhase("emit", [&] { return emitter.emit(ir.main); });
+    if (emitter.hadError())
+    {
+        for (const auto& d : emitter.diagnostics)
+        {
+            diagnostics << input << ": internal error: " << d.message << " at ip " << d.ip
+                        << "\n";
+        }
+        return false;
+    }
+    AMBRA_COUNT("C bytes", c.size());
+
+    if (!writeOutput(output, c))
+    {
+        diagnostics << "ambra_compiler: cannot write " << output << "\n";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Compile one source file to an image or to C
+ *
+ * Runs on a pool worker: everything it touches is local to the job, and its
+ * diagnostics are buffered so main() can print them in input order. With a
+ * cache, an unchanged source skips straight to writing the cached image; C
+ * output is not cached. `analysisThreads` goes to compileSource().
+ */
+static bool compileFile(const std::string& input, const std::string& output, OutputKind kind,
+                        const ImageCache* cache, size_t analysisThreads, std::ostream& diagnostics)
+{
+    std::string source;
+    if (!readFile(input, source))
+    {
+        diagnostics << "ambra_compiler: cannot read " << input << "\n";
+        return false;
+    }
+
+    ImageCacheKey        key;
+    std::vector<uint8_t> image;
+    if (kind == OutputKind::C)
+    {
+        cache = nullptr;
+    }
+    if (cache != nullptr)
+    {
+        key = cache->keyFor(source);
+        if (timePhase("cache", [&] { return cache->lookup(key, image); }))
+        {
+            if (!writeOutput(output, image))
+            {
+                diagnostics << "ambra_compiler: cannot write " << output << "\n";
+                return false;
+            }
+            return true;
+        }
+    }
+
+    // Kept per worker: each file is lowered into the storage of the last one.
+    static thread_local IrProgram ir;
+    if (!compileSource(input, source, ir, &diagnostics, analysisThreads))
+    {
+        return false;
+    }
+    if (kind == OutputKind::C)
+    {
+        return writeC(input, output, ir, diagnostics);
+    }
+
+    BytecodeEmitter emitter{ir};
+    auto            emitImage = [&]
+    {
+        Bytecode bytecode = emitter.emit(ir.main);
+        if (emitter.hadError())
+        {
+            return false;
+        }
+        image = serializeImage(bytecode);
+        return true;
+    };
+    if (!timePhase("emit", emitImage))
+    {
+        for (const auto& d : emitter.diagnostics)
+        {
+            diagnostics << input << ": internal error: " << d.message << " at ip " << d.ip
+                        << "\n";
+        }
+        return false;
+    }
+    AMBRA_COUNT("image bytes", image.size());
+
+    if (!writeOutput(output, image))
+    {
+        diagnostics << "ambra_compiler: cannot write " << output << "\n";
+        return false;
+    }
+
+    // Only successful compiles are cached, so failures always report afresh.
+    if (cache != nullptr)
+    {
+        cache->store(key, image);
+    }
+    return true;
+}
+
+/// Outcome of one input file.
+struct CompileJob
+{
+    std::string        input;
+    std::string        output;
+    std::ostringstream diagnostics;
+    StatsRegistry      stats; ///< Filled for --time-passes and --stats
+    bool               ok = false;
+};
+
+static void runJob(CompileJob& job, OutputKind kind, const ImageCache* cache,
+                   size_t analysisThreads, bool instrument)
+{
+    if (!instrument)
+    {
+        job.ok = compileFile(job.input, job.output, kind, cache, analysisThreads, job.diagnostics);
+        return;
+    }
+    StatsRegistry::Scope scope(job.stats);
+    job.ok = compileFile(job.input, job.output, kind, cache, analysisThreads, job.diagnostics);
+}
 
 int main(int argc, char** argv)
 {
-    std::cout << "ambra compiler starting...\n";
-    return 0;
-}
\ No newline at end of file
+    std::vector<std::string> inputs;
+    std::string              output;
+    std::string              cacheDir;
+    size_t                   threads = 0;
+    OutputKind               kind = OutputKind::Image;
+    bool                     timePasses = false;
+    bool                     stats = false;
+    bool                     usageError = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (arg == "-j" && i + 1 < argc)
+        {
+            char* end = nullptr;
+            long  count = std::strtol(argv[++i], &end, 10);
+            usageError |= *end != '\0' || count < 1;
+            threads = count < 1 ? 0 : static_cast<size_t>(count);
+        }
+        else if (arg.rfind("--cache-dir=", 0) == 0 && arg.size() > 12)
+        {
+            cacheDir = arg.substr(12);
+        }
+        else if (arg == "--emit=ambc" || arg == "--emit=c")
+        {
+            kind = arg == "--emit=c" ? OutputKind::C : OutputKind::Image;
+        }
+        else if (arg == "--time-passes")
+        {
+            timePasses = true;
+        }
+        else if (arg == "--stats")
+        {
+            stats = true;
+        }
+        else if (!arg.empty() && arg[0] != '-')
+        {
+            inputs.push_back(arg);
+        }
+        else
+        {
+            usageError = true;
+        }
+    }
+
+    if (usageError || inputs.empty())
+    {
+        std::cerr << "usage: ambra_compiler [-j <threads>] [--emit=ambc|c] [--cache-dir=<dir>] "
+                     "[--time-passes] [--stats] <program.ara>... [-o <output>]\n";
+        return 1;
+    }
+    if (!output.empty() && inputs.size() > 1)
+    {
+        std::cerr << "ambra_compiler: -o needs exactly one input\n";
+        return 1;
+    }
+    if ((timePasses || stats) && !STATS_ENABLED)
+    {
+        std::cerr << "ambra_compiler: built with AMBRA_NO_STATS; nothing to report\n";
+    }
+    bool instrument = timePasses || stats;
+
+    std::vector<std::unique_ptr<CompileJob>> jobs;
+    for (const std::string& input : inputs)
+    {
+        auto job = std::make_unique<CompileJob>();
+        job->input = input;
+        job->output = output.empty() ? defaultOutputPath(input, kind) : output;
+        jobs.push_back(std::move(job));
+    }
+
+    std::unique_ptr<ImageCache> cache;
+    if (!cacheDir.empty())
+    {
+        cache = std::make_unique<ImageCache>(cacheDir, compilerIdentity(argv[0]));
+    }
+    const ImageCache* sharedCache = cache.get();
+
+    if (jobs.size() == 1)
+    {
+        // A lone file gets the threads instead, for analyzing its top-level blocks.
+        runJob(*jobs[0], kind, sharedCache, threads, instrument);
+    }
+    else
+    {
+        ThreadPool pool(std::min(threads == 0 ? ThreadPool::defaultThreadCount() : threads,
+                                 jobs.size()));
+        for (auto& job : jobs)
+        {
+            CompileJob* j = job.get();
+            pool.submit([j, kind, sharedCache, instrument]
+                        { runJob(*j, kind, sharedCache, 1, instrument); });
+        }
+        pool.wait();
+    }
+
+    if (cache)
+    {
+        cache->evict();
+    }
+
+    // Diagnostics come out in the order the files were given, whatever the schedule.
+    int status = 0;
+    for (const auto& job : jobs)
+    {
+        std::cerr << job->diagnostics.str();
+        if (timePasses && STATS_ENABLED)
+        {
+            std::cerr << "pass timings for " << job->input << ":\n";
+            job->stats.printPhases(std::cerr);
+        }
+        if (stats && STATS_ENABLED)
+        {
+            std::cerr << "statistics for " << job->input << ":\n";
+            job->stats.printCounters(std::cerr);
+        }
+        if (!job->ok)
+        {
+            status = 1;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,141 @@
+#include "cli/pipeline.h"
+
+#include "ir/lowering.h"
+#include "ir/optimizer.h"
+#include "ir/slot_allocator.h"
+#include "ir/validator.h"
+#include "parser/parser.h"
+#include "sema/analyzer.h"
+#include "utils/stats.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+bool readFile(const std::string& path, std::string& contents)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    contents = buffer.str();
+    return true;
+}
+
+/** @brief Print parser or analysis diagnostics, which both have a message and a loc */
+template <typename DiagnosticT>
+static void printDiagnostics(std::ostream& err, const std::string& path,
+                             const std::vector<DiagnosticT>& diagnostics)
+{
+    for (const auto& d : diagnostics)
+    {
+        err << path << ":" << d.loc.line << ":" << d.loc.col << ": error: " << d.message << "\n";
+    }
+}
+
+/** @brief Symbols declared in `scope` and every scope nested in it */
+static size_t countSymbols(const Scope& scope)
+{
+    size_t symbols = scope.table.size();
+    for (const auto& child : scope.children)
+    {
+        symbols += countSymbols(*child);
+    }
+    return symbols;
+}
+
+bool compileSource(const std::string& path, const std::string& source, IrProgram& ir,
+                   std::ostream* diagnostics, size_t analysisThreads)
+{
+    std::ostream& err = diagnostics != nullptr ? *diagnostics : std::cerr;
+
+    // The parser normally pulls tokens from the lexer as it goes, and no token
+    // list is built. Reporting lexing as a phase of its own needs the list.
+    // Both recover from errors, so one run reports every error in the file
+    // up to the limit.
+    Lexer lexer(source);
+    lexer.setErrorLimit(Parser::DEFAULT_ERROR_LIMIT);
+    std::vector<ParseDiagnostic> parseErrors;
+    Program                      program = [&]
+    {
+        if (StatsRegistry::active() == nullptr)
+        {
+            Parser  parser(lexer);
+            Program parsed = parser.parseProgram();
+            parseErrors = parser.getDiagnostics();
+            return parsed;
+        }
+        const TokenStream& tokens = timePhase("lex", [&]() -> const TokenStream&
+                                              { return lexer.scanStream(); });
+        AMBRA_COUNT("tokens", tokens.size());
+        Parser  parser(tokens);
+        Program parsed = timePhase("parse", [&] { return parser.parseProgram(); });
+        parseErrors = parser.getDiagnostics();
+        return parsed;
+    }();
+    if (program.hadError())
+    {
+        printDiagnostics(err, path, parseErrors);
+        return false;
+    }
+    AMBRA_COUNT("AST nodes", program.getArena()->nodeCount());
+
+    Resolver resolver;
+    resolver.setThreads(analysisThreads);
+    SemanticResult sema = timePhase("resolve", [&] { return resolver.resolve(program); });
+    if (sema.hadError())
+    {
+        printDiagnostics(err, path, sema.diagnostics);
+        return false;
+    }
+    AMBRA_COUNT("symbols", countSymbols(*sema.rootScope));
+
+    TypeChecker checker(sema.resolutionTable, sema.rootScope.get());
+    checker.setThreads(analysisThreads);
+    TypeCheckerResults types = timePhase("typecheck", [&] { return checker.typeCheck(program); });
+    if (types.hadError())
+    {
+        printDiagnostics(err, path, types.diagnostics);
+        return false;
+    }
+
+    // One context per thread, so a worker compiling file after file lowers
+    // each into containers the previous ones have already grown.
+    static thread_local LoweringContext lowering{nullptr, nullptr, {}, nullptr, nullptr};
+    lowering.typeTable = &types.typeTable;
+    lowering.resolutionTable = &sema.resolutionTable;
+    timePhase("lower", [&] { lowering.lowerProgram(&program, ir); });
+    if (lowering.hadError)
+    {
+        err << path << ": error: lowering failed\n";
+        return false;
+    }
+
+    IrOptimizer optimizer{ir, ir.main};
+    timePhase("optimize", [&] { optimizer.optimize(); });
+
+    IrValidator        validator{ir, ir.main};
+    IrValidatorResults validation = timePhase("validate", [&] { return validator.validate(); });
+    if (validation.hadError())
+    {
+        for (const auto& d : validation.diagnostics)
+        {
+            err << path << ": internal error: " << d.message << " at ip " << d.ip << "\n";
+        }
+        return false;
+    }
+    timePhase("optimize", [&] { optimizer.removeUnreachable(validator.reachable); });
+
+    SlotAllocator slots{ir.main};
+    timePhase("allocate", [&] { slots.allocate(); });
+    AMBRA_COUNT("constants", ir.constants.size());
+    AMBRA_COUNT("instructions", ir.main.instructions.size());
+    AMBRA_COUNT("labels", ir.main.labelTable.position.size());
+    AMBRA_COUNT("frame slots", ir.main.frameSize);
+
+    return true;
+}
@@ -0,0 +1,36 @@
+/**
+ * @file pipeline.h
+ * @brief Frontend pipeline shared by the ambra_compiler and ambra_vm tools
+ */
+
+#pragma once
+
+#include "ir/program.h"
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+
+/**
+ * @brief Read a whole file into memory
+ * @return False if the file cannot be opened
+ */
+bool readFile(const std::string& path, std::string& contents);
+
+/**
+ * @brief Run source code through lexing, parsing, analysis, lowering, optimization
+ *        and validation
+ * @param path File name used as the prefix of printed diagnostics
+ * @param source Ambra source code
+ * @param ir Receives the lowered program on success. It is lowered into in
+ *        place, so passing the same IrProgram again reuses its storage
+ * @param diagnostics Stream that receives diagnostics (std::cerr if null)
+ * @param analysisThreads Threads for resolving and type checking a large file
+ *        (see Resolver::setThreads); 0 means one per hardware thread
+ * @return False if any stage reported an error
+ *
+ * Each stage is reported as a phase, along with counts of what it produced, to
+ * the StatsRegistry active on this thread, if there is one (utils/stats.h).
+ */
+bool compileSource(const std::string& path, const std::string& source, IrProgram& ir,
+                   std::ostream* diagnostics = nullptr, size_t analysisThreads = 1);
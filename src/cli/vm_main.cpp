@@ -1,7 +1,183 @@
+#include "cli/pipeline.h"
+#include "vm/profile.h"
+#include "vm/register_vm.h"
+#include "vm/vm.h"
+
+#include <cstdlib>
 #include <iostream>
+#include <string>
+#include <utility>
+
+static bool endsWith(const std::string& s, const std::string& suffix)
+{
+    return s.size() >= suffix.size() &&
+           s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static void printDiagnostics(const std::string& path, const VmResult& result)
+{
+    for (const auto& d : result.diagnostics)
+    {
+        std::cerr << path << ":" << d.loc.line << ":" << d.loc.col << ": runtime error: "
+                  << d.message << "\n";
+    }
+}
 
 int main(int argc, char** argv)
 {
-    std::cout << "ambra_lang VM starting...\n";
-    return 0;
-}
\ No newline at end of file
+    std::string path;
+    std::string engine = "stack";
+    bool        profile = false;
+    bool        jit = true;
+    bool        checked = false;
+    bool        unbuffered = false;
+    size_t      profileTop = 10;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg.rfind("--engine=", 0) == 0)
+        {
+            engine = arg.substr(9);
+        }
+        else if (arg == "--profile")
+        {
+            profile = true;
+        }
+        else if (arg == "--no-jit")
+        {
+            jit = false;
+        }
+        else if (arg == "--checked")
+        {
+            checked = true;
+        }
+        else if (arg == "--unbuffered")
+        {
+            unbuffered = true;
+        }
+        else if (arg.rfind("--profile-top=", 0) == 0)
+        {
+            char* end = nullptr;
+            long  count = std::strtol(arg.c_str() + 14, &end, 10);
+            if (*end != '\0' || count < 1)
+            {
+                path.clear();
+                break;
+            }
+            profile = true;
+            profileTop = static_cast<size_t>(count);
+        }
+        else if (path.empty() && arg[0] != '-')
+        {
+            path = arg;
+        }
+        else
+        {
+            path.clear();
+            break;
+        }
+    }
+
+    if (path.empty() || (engine != "stack" && engine != "register"))
+    {
+        std::cerr << "usage: ambra_vm [--engine=stack|register] [--profile[-top=<n>]] [--no-jit] "
+                     "[--checked] [--unbuffered] <program.ara | program.ambc>\n";
+        return 1;
+    }
+    if (profile && engine != "stack")
+    {
+        std::cerr << "ambra_vm: --profile needs the stack engine\n";
+        return 1;
+    }
+    if (checked && engine != "stack")
+    {
+        std::cerr << "ambra_vm: --checked needs the stack engine\n";
+        return 1;
+    }
+
+    if (engine == "register")
+    {
+        // Register code is built from IR, which images do not carry.
+        if (endsWith(path, ".ambc"))
+        {
+            std::cerr << "ambra_vm: the register engine runs source files only\n";
+            return 1;
+        }
+
+        std::string source;
+        if (!readFile(path, source))
+        {
+            std::cerr << "ambra_vm: cannot read " << path << "\n";
+            return 1;
+        }
+
+        IrProgram ir;
+        if (!compileSource(path, source, ir))
+        {
+            return 1;
+        }
+
+        RegisterVM vm(STDOUT_FD);
+        if (unbuffered)
+        {
+            vm.setUnbuffered(true);
+        }
+        VmResult   loaded = vm.load(ir);
+        VmResult   result = loaded.hadError() ? loaded : vm.run();
+        printDiagnostics(path, result);
+        return result.hadError() ? 1 : 0;
+    }
+
+    VM       vm(STDOUT_FD);
+    VmResult loaded;
+    vm.setJit(jit);
+    vm.setChecked(checked);
+    if (unbuffered)
+    {
+        vm.setUnbuffered(true);
+    }
+
+    if (endsWith(path, ".ambc"))
+    {
+        // Precompiled: map the image and execute it in place.
+        BytecodeImage image;
+        std::string   error;
+        if (!image.mapFile(path, error))
+        {
+            std::cerr << "ambra_vm: " << path << ": " << error << "\n";
+            return 1;
+        }
+        loaded = vm.load(std::move(image));
+    }
+    else
+    {
+        std::string source;
+        if (!readFile(path, source))
+        {
+            std::cerr << "ambra_vm: cannot read " << path << "\n";
+            return 1;
+        }
+
+        IrProgram ir;
+        if (!compileSource(path, source, ir))
+        {
+            return 1;
+        }
+        loaded = vm.load(ir);
+    }
+
+    VmProfile profiler;
+    if (profile)
+    {
+        vm.setProfile(&profiler);
+    }
+
+    VmResult result = loaded.hadError() ? loaded : vm.run();
+    printDiagnostics(path, result);
+    if (profile && !loaded.hadError())
+    {
+        profiler.print(std::cerr, profileTop);
+    }
+    return result.hadError() ? 1 : 0;
+}
@@ -21,8 +21,10 @@
  * - ID generators for locals and labels
  */
 
+#pragma once
 #include "instructions.h"
 
+#include <cstdint>
 #include <unordered_map>
 #include <vector>
 
@@ -47,6 +49,21 @@ struct LocalTable
      * to locals[0], LocalId{1} to locals[1], etc.
      */
     std::vector<LocalInfo> locals;
+
+    /**
+     * @brief Frame slot of each local, indexed by LocalId.value
+     *
+     * Filled in by SlotAllocator. Locals that are never live at the same time
+     * share a slot. While empty, every local has the slot equal to its id.
+     */
+    std::vector<uint32_t> slots;
+
+    /** @brief Remove every local, keeping the storage for the next function */
+    void clear()
+    {
+        locals.clear();
+        slots.clear();
+    }
 };
 
 /**
@@ -69,6 +86,13 @@ struct LabelTable
     std::vector<Label> labels;
 
     std::unordered_map<LabelId, size_t> position{};
+
+    /** @brief Remove every label, keeping the storage for the next function */
+    void clear()
+    {
+        labels.clear();
+        position.clear();
+    }
 };
 
 /**
@@ -84,7 +108,7 @@ struct LabelTable
  * represents the top-level program code.
  *
  * Execution model:
- * 1. Allocate stack frame based on local table size
+ * 1. Allocate a stack frame of frameSlots() slots
  * 2. Execute instructions sequentially
  * 3. Jump instructions can change instruction pointer
  * 4. Function completes when all instructions are executed
@@ -131,4 +155,38 @@ struct IrFunction
      * Ensures each label gets a unique ID within the function.
      */
     LabelId nextLabelId{0};
+
+    /**
+     * @brief Number of frame slots, once SlotAllocator has assigned them
+     */
+    uint32_t frameSize = 0;
+
+    /**
+     * @brief Empty the function, keeping its storage
+     *
+     * Lowering into a cleared function reuses the capacity of its tables
+     * instead of allocating them again (see LoweringContext).
+     */
+    void clear()
+    {
+        instructions.clear();
+        localTable.clear();
+        labelTable.clear();
+        nextLocalId = LocalId{0};
+        nextLabelId = LabelId{0};
+        frameSize = 0;
+    }
+
+    /** @brief Frame slot holding local `id` */
+    uint32_t slotOf(LocalId id) const
+    {
+        return localTable.slots.empty() ? id.value : localTable.slots[id.value];
+    }
+
+    /** @brief Size of the stack frame the locals need */
+    uint32_t frameSlots() const
+    {
+        return localTable.slots.empty() ? static_cast<uint32_t>(localTable.locals.size())
+                                        : frameSize;
+    }
 };
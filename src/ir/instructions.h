@@ -1,3 +1,5 @@
+#pragma once
+
 #include "ast/expr.h"
 #include "types.h"
 
@@ -7,7 +9,7 @@
  * @brief Control flow label with metadata
  *
  * Represents a position in the instruction stream that can be jumped to.
- * Labels are emitted using JLabel instruction and referenced by Jump/JumpIfFalse.
+ * Labels are emitted using JLabel instruction and referenced by Jump/JumpIfFalse/JumpIfTrue.
  */
 struct Label
 {
@@ -55,6 +57,7 @@ enum Opcode
     // Control flow
     Jump,
     JumpIfFalse,
+    JumpIfTrue,
     JLabel,
 
     // Side effects
@@ -63,8 +66,14 @@ enum Opcode
     ToString,
     ConcatString,
 
+    /// Concatenate the top Arity strings (deepest first) into one.
+    ConcatN,
+
     // Structural
-    Nop
+    Nop,
+
+    /// End of program. Never produced by lowering; appended by the VM loader.
+    Halt
 };
 
 /**
@@ -76,11 +85,12 @@ enum Opcode
  * - LocalId: References a local variable
  * - LabelId: References a control flow label
  * - ConstId: References a constant in the constant pool
+ * - Arity: Number of stack operands of a variadic instruction
  *
  * The variant ensures type safety - you can't accidentally use a
  * local ID where a constant ID is expected.
  */
-using Operand = std::variant<std::monostate, LocalId, LabelId, ConstId>;
+using Operand = std::variant<std::monostate, LocalId, LabelId, ConstId, Arity>;
 
 /**
  * @brief Single IR instruction
@@ -89,7 +99,8 @@ using Operand = std::variant<std::monostate, LocalId, LabelId, ConstId>;
  * (what to operate on). The operand meaning depends on the opcode:
  * - PushConst: operand is ConstId
  * - LoadLocal/StoreLocal: operand is LocalId
- * - Jump/JumpIfFalse/JLabel: operand is LabelId
+ * - Jump/JumpIfFalse/JumpIfTrue/JLabel: operand is LabelId
+ * - ConcatN: operand is Arity
  * - Arithmetic/comparison ops: no operand (std::monostate)
  *
  * Each instruction also tracks its source location for error reporting.
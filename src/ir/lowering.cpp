@@ -2,9 +2,11 @@
 
 #include "ast/expr.h"
 #include "ast/stmt.h"
+#include "optimizer.h"
 #include "sema/analyzer.h"
 
 #include <unordered_map>
+#include <utility>
 
 void LoweringContext::defineLabel(LabelId id)
 {
@@ -27,6 +29,22 @@ void LoweringContext::emitLabel(LabelId id)
     currentFunction->instructions.emplace_back(Instruction{JLabel, Operand{id}});
 }
 
+ConstId LoweringContext::internConstant(IrType type, std::variant<std::string, int, bool> value)
+{
+    ConstantKey key{type, std::move(value)};
+    auto        it = constantIndex.find(key);
+    if (it != constantIndex.end())
+    {
+        return it->second;
+    }
+
+    ConstId cid = program->nextConstId;
+    program->nextConstId.value++;
+    program->constants.emplace_back(Constant{type, cid, key.value});
+    constantIndex.emplace(std::move(key), cid);
+    return cid;
+}
+
 void LoweringContext::lowerExpression(const Expr* expr, Type expectedType)
 {
     switch (expr->kind)
@@ -84,118 +102,94 @@ void LoweringContext::lowerExpression(const Expr* expr, Type expectedType)
 
 void LoweringContext::lowerIntExpr(const IntLiteralExpr* e, Type expectedType)
 {
-    // 1. Allocate constant ID
-    ConstId cid = program->nextConstId;
-    program->nextConstId.value++;
-
-    program->constants.emplace_back(Constant{I32, cid, e->getValue()});
-    currentFunction->instructions.emplace_back(Instruction{PushConst, Operand{cid}});
+    ConstId cid = internConstant(I32, e->getValue());
+    currentFunction->instructions.emplace_back(Instruction{PushConst, Operand{cid}, e->getLoc()});
     if (expectedType == String)
     {
-        currentFunction->instructions.emplace_back(Instruction{ToString, Operand{}});
+        currentFunction->instructions.emplace_back(Instruction{ToString, Operand{}, e->getLoc()});
     }
     return;
 }
 void LoweringContext::lowerStringExpr(const StringExpr* e, Type expectedType)
 {
-    const StringPart& first = e->getParts()[0];
-    if (first.kind == StringPart::TEXT)
-    {
-        // 1. Allocate constant ID
-        ConstId cid = program->nextConstId;
-        program->nextConstId.value++;
-        program->constants.emplace_back(Constant{String32, cid, first.text});
-        currentFunction->instructions.emplace_back(Instruction{PushConst, Operand{cid}});
-    }
-    else
-    {
-        lowerExpression(first.expr.get(), Void);
-        currentFunction->instructions.emplace_back(Instruction{ToString, Operand{}});
-    }
+    const auto& parts = e->getParts();
+
+    // Two parts join with one ConcatString. Longer chains push every part and
+    // join once with ConcatN, so the result is sized and copied a single time
+    // instead of re-copying the growing prefix at each step.
+    bool variadic = parts.size() > 2;
 
-    for (size_t i = 1; i < e->getParts().size(); i++)
+    for (size_t i = 0; i < parts.size(); i++)
     {
-        const StringPart& part = e->getParts()[i];
+        const StringPart& part = parts[i];
 
         if (part.kind == StringPart::TEXT)
         {
-            // 1. Allocate constant ID
-            ConstId cid = program->nextConstId;
-            program->nextConstId.value++;
-            program->constants.emplace_back(Constant{String32, cid, part.text});
-            currentFunction->instructions.emplace_back(Instruction{PushConst, Operand{cid}});
+            ConstId cid = internConstant(String32, part.text);
+            currentFunction->instructions.emplace_back(Instruction{PushConst, Operand{cid}, e->getLoc()});
         }
         else
         {
             lowerExpression(part.expr.get(), Void);
-            currentFunction->instructions.emplace_back(Instruction{ToString, Operand{}});
+            currentFunction->instructions.emplace_back(Instruction{ToString, Operand{}, e->getLoc()});
         }
 
-        currentFunction->instructions.emplace_back(Instruction{ConcatString, Operand{}});
+        if (i > 0 && !variadic)
+        {
+            currentFunction->instructions.emplace_back(
+                Instruction{ConcatString, Operand{}, e->getLoc()});
+        }
+    }
+
+    if (variadic)
+    {
+        Arity count{static_cast<uint32_t>(parts.size())};
+        currentFunction->instructions.emplace_back(Instruction{ConcatN, Operand{count}, e->getLoc()});
     }
     return;
 }
 
 void LoweringContext::lowerBoolExpr(const BoolLiteralExpr* e, Type expectedType)
 {
-    // 1. Allocate constant ID
-    ConstId cid = program->nextConstId;
-    program->nextConstId.value++;
-
-    program->constants.emplace_back(Constant{Bool32, cid, e->getValue()});
-    currentFunction->instructions.emplace_back(Instruction{PushConst, Operand{cid}});
+    ConstId cid = internConstant(Bool32, e->getValue());
+    currentFunction->instructions.emplace_back(Instruction{PushConst, Operand{cid}, e->getLoc()});
 
     if (expectedType == String)
     {
-        currentFunction->instructions.emplace_back(Instruction{ToString, Operand{}});
+        currentFunction->instructions.emplace_back(Instruction{ToString, Operand{}, e->getLoc()});
     }
     return;
 }
 
 void LoweringContext::lowerIdentifierExpr(const IdentifierExpr* e, Type expectedType)
 {
-    auto it = resolutionTable.mapping.find(e);
+    const Symbol* const* symbol = resolutionTable->mapping.find(e);
 
-    if (it == resolutionTable.mapping.end())
+    if (symbol == nullptr)
     {
         hadError = true;
         return;
     }
 
-    const Symbol* symbol = it->second;
-
-    LocalId lId;
-    bool    found = false;
-
-    for (auto scopeIt = localScopes.rbegin(); scopeIt != localScopes.rend(); scopeIt++)
-    {
-        auto foundIt = scopeIt->find(symbol);
-
-        if (foundIt != scopeIt->end())
-        {
-            lId = foundIt->second;
-            found = true;
-            break;
-        }
-    }
+    const LocalId* lId = localIds.find((*symbol)->declStmt);
 
-    if (!found)
+    if (lId == nullptr)
     {
         hadError = true;
         return;
     }
-    currentFunction->instructions.emplace_back(Instruction{LoadLocal, Operand{lId}});
-    auto typeIt = typeTable.mapping.find(e);
-    if (typeIt == typeTable.mapping.end())
+    currentFunction->instructions.emplace_back(Instruction{LoadLocal, Operand{*lId}, e->getLoc()});
+    const Type* type = typeTable->mapping.find(e);
+    if (type == nullptr)
     {
         hadError = true;
         return;
     }
-    if (typeIt->second != expectedType)
+    if (*type != expectedType)
     {
         if (expectedType == String)
         {
-            currentFunction->instructions.emplace_back(Instruction{ToString, Operand{}});
+            currentFunction->instructions.emplace_back(Instruction{ToString, Operand{}, e->getLoc()});
         }
     }
     return;
@@ -209,10 +203,10 @@ void LoweringContext::lowerUnaryExpr(const UnaryExpr* e, Type expectedType)
     lowerExpression(&operand, operandType);
 
     auto opCode = e->getOperator() == LogicalNot ? NotBool : NegI32;
-    currentFunction->instructions.emplace_back(Instruction{opCode, Operand{}});
+    currentFunction->instructions.emplace_back(Instruction{opCode, Operand{}, e->getLoc()});
 
     if (expectedType == String)
-        currentFunction->instructions.emplace_back(Instruction{ToString, Operand{}});
+        currentFunction->instructions.emplace_back(Instruction{ToString, Operand{}, e->getLoc()});
     return;
 }
 
@@ -239,9 +233,14 @@ void LoweringContext::lowerBinaryExpr(const BinaryExpr* e, Type expectedType)
 
     case EqualEqual:
     case NotEqual:
-        operandType = typeTable.mapping.at(&left);
+        operandType = typeTable->mapping.at(&left);
         break;
 
+    case LogicalAnd:
+    case LogicalOr:
+        lowerLogicalExpr(e, expectedType);
+        return;
+
     default:
         hadError = true;
         return;
@@ -256,13 +255,13 @@ void LoweringContext::lowerBinaryExpr(const BinaryExpr* e, Type expectedType)
         switch (operandType)
         {
         case Int:
-            currentFunction->instructions.emplace_back(Instruction{CmpEqI32, Operand{}});
+            currentFunction->instructions.emplace_back(Instruction{CmpEqI32, Operand{}, e->getLoc()});
             break;
         case Bool:
-            currentFunction->instructions.emplace_back(Instruction{CmpEqBool32, Operand{}});
+            currentFunction->instructions.emplace_back(Instruction{CmpEqBool32, Operand{}, e->getLoc()});
             break;
         case String:
-            currentFunction->instructions.emplace_back(Instruction{CmpEqString32, Operand{}});
+            currentFunction->instructions.emplace_back(Instruction{CmpEqString32, Operand{}, e->getLoc()});
             break;
         default:
             hadError = true;
@@ -273,13 +272,13 @@ void LoweringContext::lowerBinaryExpr(const BinaryExpr* e, Type expectedType)
         switch (operandType)
         {
         case Int:
-            currentFunction->instructions.emplace_back(Instruction{CmpNEqI32, Operand{}});
+            currentFunction->instructions.emplace_back(Instruction{CmpNEqI32, Operand{}, e->getLoc()});
             break;
         case Bool:
-            currentFunction->instructions.emplace_back(Instruction{CmpNEqBool32, Operand{}});
+            currentFunction->instructions.emplace_back(Instruction{CmpNEqBool32, Operand{}, e->getLoc()});
             break;
         case String:
-            currentFunction->instructions.emplace_back(Instruction{CmpNEqString32, Operand{}});
+            currentFunction->instructions.emplace_back(Instruction{CmpNEqString32, Operand{}, e->getLoc()});
             break;
         default:
             hadError = true;
@@ -288,42 +287,42 @@ void LoweringContext::lowerBinaryExpr(const BinaryExpr* e, Type expectedType)
         break;
     case Greater:
     {
-        currentFunction->instructions.emplace_back(Instruction{CmpGtI32, Operand{}});
+        currentFunction->instructions.emplace_back(Instruction{CmpGtI32, Operand{}, e->getLoc()});
         break;
     }
     case GreaterEqual:
     {
-        currentFunction->instructions.emplace_back(Instruction{CmpGtEqI32, Operand{}});
+        currentFunction->instructions.emplace_back(Instruction{CmpGtEqI32, Operand{}, e->getLoc()});
         break;
     }
     case Less:
     {
-        currentFunction->instructions.emplace_back(Instruction{CmpLtI32, Operand{}});
+        currentFunction->instructions.emplace_back(Instruction{CmpLtI32, Operand{}, e->getLoc()});
         break;
     }
     case LessEqual:
     {
-        currentFunction->instructions.emplace_back(Instruction{CmpLtEqI32, Operand{}});
+        currentFunction->instructions.emplace_back(Instruction{CmpLtEqI32, Operand{}, e->getLoc()});
         break;
     }
     case Add:
     {
-        currentFunction->instructions.emplace_back(Instruction{AddI32, Operand{}});
+        currentFunction->instructions.emplace_back(Instruction{AddI32, Operand{}, e->getLoc()});
         break;
     }
     case Subtract:
     {
-        currentFunction->instructions.emplace_back(Instruction{SubI32, Operand{}});
+        currentFunction->instructions.emplace_back(Instruction{SubI32, Operand{}, e->getLoc()});
         break;
     }
     case Multiply:
     {
-        currentFunction->instructions.emplace_back(Instruction{MulI32, Operand{}});
+        currentFunction->instructions.emplace_back(Instruction{MulI32, Operand{}, e->getLoc()});
         break;
     }
     case Divide:
     {
-        currentFunction->instructions.emplace_back(Instruction{DivI32, Operand{}});
+        currentFunction->instructions.emplace_back(Instruction{DivI32, Operand{}, e->getLoc()});
         break;
     }
     default:
@@ -332,10 +331,32 @@ void LoweringContext::lowerBinaryExpr(const BinaryExpr* e, Type expectedType)
     }
 
     if (expectedType == String)
-        currentFunction->instructions.emplace_back(Instruction{ToString, Operand{}});
+        currentFunction->instructions.emplace_back(Instruction{ToString, Operand{}, e->getLoc()});
     return;
 }
 
+void LoweringContext::lowerLogicalExpr(const BinaryExpr* e, Type expectedType)
+{
+    // The left operand alone decides `negative and x` and `affirmative or x`.
+    bool    isAnd = e->getOperator() == LogicalAnd;
+    LabelId decided = currentFunction->nextLabelId;
+    currentFunction->nextLabelId.value++;
+    LabelId endLabel = currentFunction->nextLabelId;
+    currentFunction->nextLabelId.value++;
+
+    lowerJump(&e->getLeft(), !isAnd, decided, e->getLoc());
+    lowerExpression(&e->getRight(), Bool);
+    currentFunction->instructions.emplace_back(Instruction{Jump, Operand{endLabel}, e->getLoc()});
+
+    emitLabel(decided);
+    currentFunction->instructions.emplace_back(
+        Instruction{PushConst, Operand{internConstant(Bool32, !isAnd)}, e->getLoc()});
+    emitLabel(endLabel);
+
+    if (expectedType == String)
+        currentFunction->instructions.emplace_back(Instruction{ToString, Operand{}, e->getLoc()});
+}
+
 void LoweringContext::lowerGroupingExpr(const GroupingExpr* e, Type expectedType)
 {
     lowerExpression(&e->getExpression(), expectedType);
@@ -390,16 +411,16 @@ void LoweringContext::lowerSummonStatement(const SummonStmt* s)
     LocalInfo localInfo;
     localInfo.id = lId;
     localInfo.debugName = s->getIdentifier().getName();
-    localInfo.declLoc = s->loc;
+    localInfo.declLoc = s->getLoc();
 
-    IrType t;
-    auto   typeIt = typeTable.mapping.find(&s->getInitializer());
-    if (typeIt == typeTable.mapping.end())
+    IrType      t;
+    const Type* type = typeTable->mapping.find(&s->getInitializer());
+    if (type == nullptr)
     {
         hadError = true;
         return;
     }
-    switch (typeIt->second)
+    switch (*type)
     {
     case Int:
     {
@@ -427,29 +448,153 @@ void LoweringContext::lowerSummonStatement(const SummonStmt* s)
     }
     currentFunction->localTable.locals.emplace_back(localInfo);
 
-    auto symbol = s->getSymbol();
-    localScopes.back()[symbol] = lId;
+    const Symbol* symbol = s->getSymbol();
+    if (symbol == nullptr)
+    {
+        hadError = true;
+        return;
+    }
+    localIds.assign(symbol->declStmt, lId);
+    localScopes[scopeDepth - 1].push_back(symbol->declStmt);
 
-    lowerExpression(&s->getInitializer(), typeIt->second);
-    currentFunction->instructions.emplace_back(Instruction{StoreLocal, Operand{lId}});
+    lowerExpression(&s->getInitializer(), *type);
+    currentFunction->instructions.emplace_back(Instruction{StoreLocal, Operand{lId}, s->getLoc()});
     return;
 }
 
 void LoweringContext::lowerSayStatement(const SayStmt* stmt)
 {
     lowerExpression(&stmt->getExpression(), String);
-    currentFunction->instructions.emplace_back(Instruction{PrintString, Operand{}});
+    currentFunction->instructions.emplace_back(Instruction{PrintString, Operand{}, stmt->getLoc()});
     return;
 }
 
 void LoweringContext::lowerBlockStatement(const BlockStmt* stmt)
 {
-    localScopes.emplace_back();
+    pushScope();
     for (auto& stmt : *stmt)
     {
         lowerStatement(stmt.get());
     }
-    localScopes.pop_back();
+    popScope();
+}
+
+void LoweringContext::pushScope()
+{
+    if (scopeDepth == localScopes.size())
+    {
+        localScopes.emplace_back();
+    }
+    localScopes[scopeDepth++].clear();
+}
+
+void LoweringContext::popScope()
+{
+    for (const SummonStmt* declaration : localScopes[--scopeDepth])
+    {
+        localIds.erase(declaration);
+    }
+}
+
+/** @brief Whether `e`, under any parentheses and `not`s, is an `and` or an `or` */
+static bool isLogical(const Expr* e)
+{
+    while (e->kind == Grouping || e->kind == Unary)
+    {
+        if (e->kind == Grouping)
+        {
+            e = &static_cast<const GroupingExpr*>(e)->getExpression();
+        }
+        else if (static_cast<const UnaryExpr*>(e)->getOperator() == LogicalNot)
+        {
+            e = &static_cast<const UnaryExpr*>(e)->getOperand();
+        }
+        else
+        {
+            return false;
+        }
+    }
+    if (e->kind != Binary)
+    {
+        return false;
+    }
+    BinaryOpKind op = static_cast<const BinaryExpr*>(e)->getOperator();
+    return op == LogicalAnd || op == LogicalOr;
+}
+
+void LoweringContext::lowerJump(const Expr* cond, bool when, LabelId target, SourceLoc loc)
+{
+    if (cond->kind == Grouping)
+    {
+        lowerJump(&static_cast<const GroupingExpr*>(cond)->getExpression(), when, target, loc);
+        return;
+    }
+    if (cond->kind == Unary && static_cast<const UnaryExpr*>(cond)->getOperator() == LogicalNot)
+    {
+        lowerJump(&static_cast<const UnaryExpr*>(cond)->getOperand(), !when, target, loc);
+        return;
+    }
+    if (isLogical(cond))
+    {
+        const auto* e = static_cast<const BinaryExpr*>(cond);
+        if ((e->getOperator() == LogicalAnd) != when)
+        {
+            // `a and b` is false as soon as either is; `a or b` true as soon as either is.
+            lowerJump(&e->getLeft(), when, target, loc);
+            lowerJump(&e->getRight(), when, target, loc);
+            return;
+        }
+        // Both operands are needed to jump: the left one can only rule it out.
+        LabelId skip = currentFunction->nextLabelId;
+        currentFunction->nextLabelId.value++;
+        lowerJump(&e->getLeft(), !when, skip, loc);
+        lowerJump(&e->getRight(), when, target, loc);
+        emitLabel(skip);
+        return;
+    }
+
+    bool constant = false;
+    if (lowerCondition(cond, constant))
+    {
+        if (constant == when)
+        {
+            currentFunction->instructions.emplace_back(Instruction{Jump, Operand{target}, loc});
+        }
+        return;
+    }
+    currentFunction->instructions.emplace_back(
+        Instruction{when ? JumpIfTrue : JumpIfFalse, Operand{target}, loc});
+}
+
+bool LoweringContext::lowerBranch(const Expr* cond, LabelId falseLabel, SourceLoc loc, bool& value)
+{
+    if (isLogical(cond))
+    {
+        lowerJump(cond, false, falseLabel, loc);
+        return false;
+    }
+    if (lowerCondition(cond, value))
+    {
+        return true;
+    }
+    currentFunction->instructions.emplace_back(Instruction{JumpIfFalse, Operand{falseLabel}, loc});
+    return false;
+}
+
+bool LoweringContext::lowerCondition(const Expr* cond, bool& value)
+{
+    auto&       instrs = currentFunction->instructions;
+    size_t      start = instrs.size();
+    ConstantKey result;
+    lowerExpression(cond, Bool);
+    if (!evaluateConstant(*program, instrs, start, result) || result.type != Bool32)
+    {
+        return false;
+    }
+    // Only constants and pure operators were emitted, so they can simply go.
+    instrs.resize(start);
+    value = std::get<bool>(result.value);
+    return true;
 }
 
 void LoweringContext::lowerIfChainStatement(const IfChainStmt* stmt)
@@ -468,20 +613,33 @@ void LoweringContext::lowerIfChainStatement(const IfChainStmt* stmt)
     currentFunction->nextLabelId.value++;
 
     const auto& branches = stmt->getBranches();
+    bool        reachesEnd = false; // some branch jumps to endLabel
 
     for (size_t i = 0; i < branches.size(); ++i)
     {
         const auto& [cond, block] = branches[i];
 
-        lowerExpression(cond.get(), Bool);
-
-        currentFunction->instructions.emplace_back(
-            Instruction{JumpIfFalse, Operand{nextLabels[i]}});
+        bool constant = false;
+        if (lowerBranch(cond.get(), nextLabels[i], stmt->getLoc(), constant))
+        {
+            if (!constant)
+            {
+                continue;
+            }
+            // Always taken: the branches after it and the else are dead.
+            lowerBlockStatement(block.get());
+            if (reachesEnd)
+            {
+                emitLabel(endLabel);
+            }
+            return;
+        }
 
         lowerBlockStatement(block.get());
 
         // Jump to end after executing this branch
-        currentFunction->instructions.emplace_back(Instruction{Jump, Operand{endLabel}});
+        currentFunction->instructions.emplace_back(Instruction{Jump, Operand{endLabel}, stmt->getLoc()});
+        reachesEnd = true;
 
         // Emit label for next branch
         emitLabel(nextLabels[i]);
@@ -492,7 +650,10 @@ void LoweringContext::lowerIfChainStatement(const IfChainStmt* stmt)
         lowerBlockStatement(stmt->getElseBranch().get());
     }
 
-    emitLabel(endLabel);
+    if (reachesEnd)
+    {
+        emitLabel(endLabel);
+    }
 }
 
 void LoweringContext::lowerWhileStatement(const WhileStmt* stmt)
@@ -507,14 +668,27 @@ void LoweringContext::lowerWhileStatement(const WhileStmt* stmt)
     // push loop start label
     emitLabel(loopLabel);
 
-    lowerExpression(&stmt->getCondition(), Bool);
-    // jump to end if false
-    currentFunction->instructions.emplace_back(Instruction{JumpIfFalse, Operand{endLabel}});
+    bool constant = false;
+    if (lowerBranch(&stmt->getCondition(), endLabel, stmt->getLoc(), constant))
+    {
+        if (!constant)
+        {
+            // Never entered: take the label back too.
+            currentFunction->instructions.pop_back();
+            currentFunction->labelTable.position.erase(loopLabel);
+            return;
+        }
+        // Endless: no test, and nothing after the loop is reachable.
+        lowerBlockStatement(&stmt->getBody());
+        currentFunction->instructions.emplace_back(
+            Instruction{Jump, Operand{loopLabel}, stmt->getLoc()});
+        return;
+    }
 
     lowerBlockStatement(&stmt->getBody());
 
     // jump back to loop start
-    currentFunction->instructions.emplace_back(Instruction{Jump, Operand{loopLabel}});
+    currentFunction->instructions.emplace_back(Instruction{Jump, Operand{loopLabel}, stmt->getLoc()});
 
     // push loop end label
     emitLabel(endLabel);
@@ -523,22 +697,33 @@ void LoweringContext::lowerWhileStatement(const WhileStmt* stmt)
 IrProgram LoweringContext::lowerProgram(const Program* prog)
 {
     IrProgram result;
+    lowerProgram(prog, result);
+    return result;
+}
 
-    program = &result;
-    currentFunction = &result.main;
+void LoweringContext::lowerProgram(const Program* prog, IrProgram& out)
+{
+    out.clear();
+    program = &out;
+    currentFunction = &out.main;
+    hadError = false;
 
-    localScopes.clear();
-    localScopes.emplace_back();
+    scopeDepth = 0;
+    pushScope();
+    localIds.clear();
+    if (prog->getArena() != nullptr)
+    {
+        localIds.reserve(prog->getArena()->nodeCount());
+    }
+    constantIndex.clear();
 
     for (auto& stmt : *prog)
     {
         lowerStatement(stmt.get());
     }
 
-    localScopes.pop_back();
+    popScope();
 
     program = nullptr;
     currentFunction = nullptr;
-
-    return result;
 }
\ No newline at end of file
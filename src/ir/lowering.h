@@ -8,6 +8,7 @@
  * further compilation.
  */
 
+#pragma once
 #include "ast/expr.h"
 #include "ast/stmt.h"
 #include "program.h"
@@ -26,6 +27,13 @@
  *
  * The context is stateful and mutates the IrProgram as lowering proceeds.
  * Lowering is a single-pass traversal of the AST.
+ *
+ * A context can lower any number of programs in turn: point `typeTable` and
+ * `resolutionTable` at the next program's tables and call lowerProgram()
+ * again. Its own containers keep their capacity from one program to the
+ * next, and so does an IrProgram lowered into with lowerProgram(prog, out),
+ * so a compiler that keeps one of each per thread does next to no
+ * allocation while lowering.
  */
 struct LoweringContext
 {
@@ -38,21 +46,45 @@ struct LoweringContext
     /**
      * @brief Stack of local variable scopes
      *
-     * Each scope maps symbols to their corresponding local IDs.
-     * Inner scopes are pushed/popped as blocks are entered/exited.
-     * This enables proper variable shadowing and scope isolation.
+     * Each scope lists the declarations made in it, whose locals are in
+     * `localIds`. Inner scopes are pushed/popped as blocks are entered/exited,
+     * and popping a scope drops its declarations' locals again. Shadowing
+     * needs no search: each symbol has its own declaration.
+     *
+     * Only the first `scopeDepth` entries are open. Popped scopes stay in the
+     * vector, so that entering a block reuses their storage.
      */
-    std::vector<std::unordered_map<const Symbol*, LocalId>> localScopes;
+    std::vector<std::vector<const SummonStmt*>> localScopes;
 
     /** @brief Type information from the type checking phase */
-    const TypeTable& typeTable;
+    const TypeTable* typeTable;
 
     /** @brief Symbol resolution information from semantic analysis */
-    const ResolutionTable& resolutionTable;
+    const ResolutionTable* resolutionTable;
+
+    /** @brief Number of open scopes in `localScopes` */
+    size_t scopeDepth = 0;
 
     /** @brief Error flag set if lowering encounters an unrecoverable issue */
     bool hadError = false;
 
+    /** @brief Local of each declaration in an open scope, by the summon's node id */
+    NodeTable<SummonStmt, LocalId> localIds{};
+
+    /**
+     * @brief Constants already in the pool, keyed by type and value
+     *
+     * Lets identical literals share one ConstId. Cleared by lowerProgram().
+     */
+    std::unordered_map<ConstantKey, ConstId> constantIndex{};
+
+    /**
+     * @brief Return the ConstId for a literal, adding it to the pool if new
+     * @param type Type of the constant
+     * @param value The literal value
+     */
+    ConstId internConstant(IrType type, std::variant<std::string, int, bool> value);
+
     /**
      * @brief Register a label in the label table
      * @param id The label identifier to define
@@ -94,7 +126,8 @@ struct LoweringContext
      * @param expectedType Expected type (typically String32)
      *
      * For simple strings: PushConst (string constant)
-     * For interpolated strings: Multiple PushConst/expression evaluations + ConcatString
+     * For interpolated strings: PushConst/expression evaluation (+ ToString) per part,
+     * joined by ConcatString for two parts or by a single ConcatN for more
      */
     void lowerStringExpr(const StringExpr* expr, Type expectedType);
 
@@ -123,12 +156,23 @@ struct LoweringContext
     void lowerUnaryExpr(const UnaryExpr* expr, Type expectedType);
 
     /**
-     * @brief Lower binary expression (arithmetic, comparison)
+     * @brief Lower binary expression (arithmetic, comparison, logical)
      * @param expr Binary expression AST node
      * @param expectedType Expected result type
      */
     void lowerBinaryExpr(const BinaryExpr* expr, Type expectedType);
 
+    /**
+     * @brief Lower `and`/`or` used as a value
+     * @param expr Binary expression with a logical operator
+     * @param expectedType Expected result type
+     *
+     * Generates: <left jumps to L when it decides>; <right>; Jump End;
+     * L: PushConst (false for `and`, true for `or`); End:
+     * The right operand is skipped whenever the left one decides.
+     */
+    void lowerLogicalExpr(const BinaryExpr* expr, Type expectedType);
+
     /**
      * @brief Lower grouping (parenthesized) expression
      * @param expr Grouping expression AST node
@@ -136,6 +180,41 @@ struct LoweringContext
      */
     void lowerGroupingExpr(const GroupingExpr* expr, Type expectedType);
 
+    /**
+     * @brief Lower a condition, or decide it if it is a constant
+     * @param cond Bool-typed condition expression
+     * @param value Set to the condition's value when it is constant
+     * @return True if the condition is constant; nothing is emitted for it then
+     *
+     * Literals and operators over them (`should (negative)`,
+     * `aslongas (1 > 2)`) are constant; anything that reads a local is not. A
+     * division by zero never is, so the VM still reports it.
+     */
+    bool lowerCondition(const Expr* cond, bool& value);
+
+    /**
+     * @brief Lower a condition as control flow: jump to `target` if it is `when`
+     * @param cond Bool-typed condition expression
+     * @param when Value of the condition that takes the jump
+     * @param target Label to jump to
+     * @param loc Source location of the jumps
+     *
+     * Parentheses, `not`, `and` and `or` become chains of JumpIfFalse and
+     * JumpIfTrue, so no Bool is pushed for them and each operand is only
+     * evaluated if the ones before it left the outcome open.
+     */
+    void lowerJump(const Expr* cond, bool when, LabelId target, SourceLoc loc);
+
+    /**
+     * @brief Lower the test of a `should` branch or an `aslongas` loop
+     * @param cond Bool-typed condition expression
+     * @param falseLabel Where control goes when the condition is false
+     * @param loc Source location of the jumps
+     * @param value Set to the condition's value when it is constant
+     * @return True if the condition is constant; nothing is emitted for it then
+     */
+    bool lowerBranch(const Expr* cond, LabelId falseLabel, SourceLoc loc, bool& value);
+
     /**
      * @brief Lower a statement to IR instructions
      * @param stmt The statement AST node to lower
@@ -164,19 +243,38 @@ struct LoweringContext
     /**
      * @brief Lower if/else statement chain (should/otherwise)
      * @param stmt If chain statement AST node
+     *
+     * Branches whose condition is constant lose their test: a false one is
+     * dropped, and a true one is lowered as plain code that ends the chain.
      */
     void lowerIfChainStatement(const IfChainStmt* stmt);
 
     /**
      * @brief Lower while loop statement (aslongas)
      * @param stmt While statement AST node
+     *
+     * A constant false condition emits nothing; a constant true one emits the
+     * loop without its test or exit label.
      */
     void lowerWhileStatement(const WhileStmt* stmt);
 
+    /** @brief Open a scope for a block, reusing a popped scope's storage */
+    void pushScope();
+
+    /** @brief Close the innermost scope, dropping the locals declared in it */
+    void popScope();
+
     /**
      * @brief Lower entire program from AST to IR
      * @param program The root AST node representing the complete program
      * @return Complete IR program ready for execution or further compilation
      */
     IrProgram lowerProgram(const Program* program);
+
+    /**
+     * @brief Lower entire program from AST to IR into an existing IrProgram
+     * @param program The root AST node representing the complete program
+     * @param out Cleared first (IrProgram::clear()), so its storage is reused
+     */
+    void lowerProgram(const Program* program, IrProgram& out);
 };
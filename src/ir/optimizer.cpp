@@ -0,0 +1,505 @@
+/**
+ * @file optimizer.cpp
+ * @brief Implementation of the IR peephole optimizer.
+ */
+
+#include "optimizer.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+
+// ==================================================================================
+// CONSTANT EVALUATION
+// ==================================================================================
+
+static bool isJump(Opcode op)
+{
+    return op == Jump || op == JumpIfFalse || op == JumpIfTrue;
+}
+
+/**
+ * @brief Text the VM prints for a constant converted with ToString
+ */
+static std::string constantText(const Constant& c)
+{
+    switch (c.type)
+    {
+    case I32:
+        return std::to_string(std::get<int>(c.value));
+    case Bool32:
+        return std::get<bool>(c.value) ? "affirmative" : "negative";
+    case String32:
+    default:
+        return std::get<std::string>(c.value);
+    }
+}
+
+/**
+ * @brief Evaluate a unary opcode on a constant
+ * @return false if the opcode cannot be folded for this operand
+ */
+static bool foldUnary(Opcode op, const Constant& a, ConstantKey& result)
+{
+    switch (op)
+    {
+    case NotBool:
+        result = {Bool32, !std::get<bool>(a.value)};
+        return true;
+    case NegI32:
+        result = {I32, static_cast<int>(0u - static_cast<uint32_t>(std::get<int>(a.value)))};
+        return true;
+    case ToString:
+        result = {String32, constantText(a)};
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Evaluate a binary opcode on two constants (`a` pushed first)
+ * @return false if the opcode cannot be folded for these operands
+ *
+ * Integer arithmetic wraps exactly like the VM. Division by zero is not
+ * folded so the VM still reports it at the right source location.
+ */
+static bool foldBinary(Opcode op, const Constant& a, const Constant& b, ConstantKey& result)
+{
+    switch (op)
+    {
+    case AddI32:
+    case SubI32:
+    case MulI32:
+    case DivI32:
+    case CmpEqI32:
+    case CmpNEqI32:
+    case CmpLtI32:
+    case CmpLtEqI32:
+    case CmpGtI32:
+    case CmpGtEqI32:
+    {
+        int32_t  x = std::get<int>(a.value);
+        int32_t  y = std::get<int>(b.value);
+        uint32_t ux = static_cast<uint32_t>(x);
+        uint32_t uy = static_cast<uint32_t>(y);
+        switch (op)
+        {
+        case AddI32:
+            result = {I32, static_cast<int>(ux + uy)};
+            return true;
+        case SubI32:
+            result = {I32, static_cast<int>(ux - uy)};
+            return true;
+        case MulI32:
+            result = {I32, static_cast<int>(ux * uy)};
+            return true;
+        case DivI32:
+            if (y == 0)
+            {
+                return false;
+            }
+            result = {I32, (x == INT32_MIN && y == -1) ? INT32_MIN : x / y};
+            return true;
+        case CmpEqI32:
+            result = {Bool32, x == y};
+            return true;
+        case CmpNEqI32:
+            result = {Bool32, x != y};
+            return true;
+        case CmpLtI32:
+            result = {Bool32, x < y};
+            return true;
+        case CmpLtEqI32:
+            result = {Bool32, x <= y};
+            return true;
+        case CmpGtI32:
+            result = {Bool32, x > y};
+            return true;
+        default:
+            result = {Bool32, x >= y};
+            return true;
+        }
+    }
+    case CmpEqBool32:
+        result = {Bool32, std::get<bool>(a.value) == std::get<bool>(b.value)};
+        return true;
+    case CmpNEqBool32:
+        result = {Bool32, std::get<bool>(a.value) != std::get<bool>(b.value)};
+        return true;
+    case CmpEqString32:
+        result = {Bool32, std::get<std::string>(a.value) == std::get<std::string>(b.value)};
+        return true;
+    case CmpNEqString32:
+        result = {Bool32, std::get<std::string>(a.value) != std::get<std::string>(b.value)};
+        return true;
+    case ConcatString:
+        result = {String32, std::get<std::string>(a.value) + std::get<std::string>(b.value)};
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool evaluateConstant(const IrProgram& program, const std::vector<Instruction>& instrs,
+                      size_t begin, ConstantKey& result)
+{
+    std::vector<Constant> stack;
+    for (size_t ip = begin; ip < instrs.size(); ip++)
+    {
+        const Instruction& inst = instrs[ip];
+        ConstantKey        folded;
+        if (inst.opcode == PushConst)
+        {
+            uint32_t index = std::get<ConstId>(inst.operand).value;
+            if (index >= program.constants.size())
+            {
+                return false;
+            }
+            stack.push_back(program.constants[index]);
+        }
+        else if (inst.opcode == Nop)
+        {
+            continue;
+        }
+        else if (!stack.empty() && foldUnary(inst.opcode, stack.back(), folded))
+        {
+            stack.back() = Constant{folded.type, ConstId{0}, folded.value};
+        }
+        else if (stack.size() >= 2 &&
+                 foldBinary(inst.opcode, stack[stack.size() - 2], stack.back(), folded))
+        {
+            stack.pop_back();
+            stack.back() = Constant{folded.type, ConstId{0}, folded.value};
+        }
+        else
+        {
+            return false;
+        }
+    }
+    if (stack.size() != 1)
+    {
+        return false;
+    }
+    result = {stack[0].type, stack[0].value};
+    return true;
+}
+
+// ==================================================================================
+// OPTIMIZER
+// ==================================================================================
+
+void IrOptimizer::optimize()
+{
+    stats = OptimizerStats{};
+    constantIndex.clear();
+    for (const Constant& c : program.constants)
+    {
+        constantIndex.emplace(ConstantKey{c.type, c.value}, c.constId);
+    }
+
+    // threadJumps() rebuilds the label positions before it looks at them, and
+    // the loop only ends after a threadJumps() call that changed nothing, so
+    // the table is current on exit.
+    bool changed = true;
+    while (changed)
+    {
+        changed = peephole();
+        changed = threadJumps() || changed;
+    }
+}
+
+ConstId IrOptimizer::internConstant(IrType type, std::variant<std::string, int, bool> value)
+{
+    ConstantKey key{type, std::move(value)};
+    auto        it = constantIndex.find(key);
+    if (it != constantIndex.end())
+    {
+        return it->second;
+    }
+
+    ConstId cid = program.nextConstId;
+    program.nextConstId.value++;
+    program.constants.emplace_back(Constant{type, cid, key.value});
+    constantIndex.emplace(std::move(key), cid);
+    return cid;
+}
+
+const Constant* IrOptimizer::pushedConstant(const Instruction& inst) const
+{
+    if (inst.opcode != PushConst)
+    {
+        return nullptr;
+    }
+    uint32_t index = std::get<ConstId>(inst.operand).value;
+    return index < program.constants.size() ? &program.constants[index] : nullptr;
+}
+
+bool IrOptimizer::producesString(const Instruction& inst) const
+{
+    switch (inst.opcode)
+    {
+    case PushConst:
+    {
+        const Constant* c = pushedConstant(inst);
+        return c != nullptr && c->type == String32;
+    }
+    case LoadLocal:
+    {
+        uint32_t index = std::get<LocalId>(inst.operand).value;
+        return index < function.localTable.locals.size() &&
+               function.localTable.locals[index].type == String32;
+    }
+    case ToString:
+    case ConcatString:
+    case ConcatN:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool IrOptimizer::foldTail(std::vector<Instruction>& out)
+{
+    size_t             n = out.size();
+    const Instruction& op = out.back();
+    SourceLoc          loc = op.loc;
+    ConstantKey        result{Void32, 0};
+
+    if (op.opcode == ConcatN)
+    {
+        uint32_t count = std::get<Arity>(op.operand).value;
+        if (n < count + 1)
+        {
+            return false;
+        }
+
+        // All parts constant: join them now.
+        std::string joined;
+        bool        allConstant = true;
+        for (size_t i = n - 1 - count; i < n - 1 && allConstant; i++)
+        {
+            const Constant* c = pushedConstant(out[i]);
+            allConstant = c != nullptr && c->type == String32;
+            if (allConstant)
+            {
+                joined += std::get<std::string>(c->value);
+            }
+        }
+        if (allConstant)
+        {
+            ConstId cid = internConstant(String32, std::move(joined));
+            out.resize(n - 1 - count);
+            out.push_back(Instruction{PushConst, Operand{cid}, loc});
+            return true;
+        }
+
+        // An empty last part (interpolations ending in `{expr}`) adds nothing.
+        const Constant* last = pushedConstant(out[n - 2]);
+        if (last != nullptr && last->type == String32 && std::get<std::string>(last->value).empty())
+        {
+            out.resize(n - 2);
+            if (count - 1 > 2)
+            {
+                out.push_back(Instruction{ConcatN, Operand{Arity{count - 1}}, loc});
+            }
+            else if (count - 1 == 2)
+            {
+                out.push_back(Instruction{ConcatString, Operand{}, loc});
+            }
+            return true;
+        }
+        return false;
+    }
+
+    if (op.opcode == ConcatString && n >= 2)
+    {
+        const Constant* last = pushedConstant(out[n - 2]);
+        if (last != nullptr && last->type == String32 && std::get<std::string>(last->value).empty())
+        {
+            out.resize(n - 2);
+            return true;
+        }
+    }
+
+    if (n >= 3)
+    {
+        const Constant* a = pushedConstant(out[n - 3]);
+        const Constant* b = pushedConstant(out[n - 2]);
+        if (a != nullptr && b != nullptr && foldBinary(op.opcode, *a, *b, result))
+        {
+            ConstId cid = internConstant(result.type, std::move(result.value));
+            out.resize(n - 3);
+            out.push_back(Instruction{PushConst, Operand{cid}, loc});
+            return true;
+        }
+    }
+
+    if (n >= 2)
+    {
+        const Constant* a = pushedConstant(out[n - 2]);
+        if (a != nullptr && foldUnary(op.opcode, *a, result))
+        {
+            ConstId cid = internConstant(result.type, std::move(result.value));
+            out.resize(n - 2);
+            out.push_back(Instruction{PushConst, Operand{cid}, loc});
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool IrOptimizer::peephole()
+{
+    std::vector<Instruction> out;
+    out.reserve(function.instructions.size());
+    bool changed = false;
+
+    for (const Instruction& inst : function.instructions)
+    {
+        if (inst.opcode == Nop)
+        {
+            stats.nopsDropped++;
+            changed = true;
+            continue;
+        }
+
+        if (!out.empty())
+        {
+            Instruction& prev = out.back();
+
+            if (inst.opcode == ToString && producesString(prev))
+            {
+                stats.toStringsDropped++;
+                changed = true;
+                continue;
+            }
+
+            if (prev.opcode == NotBool && (inst.opcode == JumpIfFalse || inst.opcode == JumpIfTrue))
+            {
+                prev = Instruction{inst.opcode == JumpIfFalse ? JumpIfTrue : JumpIfFalse,
+                                   inst.operand, inst.loc};
+                stats.branchesInverted++;
+                changed = true;
+                continue;
+            }
+        }
+
+        out.push_back(inst);
+        if (foldTail(out))
+        {
+            stats.constantsFolded++;
+            changed = true;
+        }
+    }
+
+    function.instructions = std::move(out);
+    return changed;
+}
+
+bool IrOptimizer::threadJumps()
+{
+    rebuildLabelPositions();
+
+    auto&       instrs = function.instructions;
+    const auto& position = function.labelTable.position;
+    bool        changed = false;
+
+    // First instruction at or after `ip` that is not a label.
+    auto skipLabels = [&](size_t ip)
+    {
+        while (ip < instrs.size() && instrs[ip].opcode == JLabel)
+        {
+            ip++;
+        }
+        return ip;
+    };
+
+    for (size_t ip = 0; ip < instrs.size(); ip++)
+    {
+        Instruction& inst = instrs[ip];
+        if (!isJump(inst.opcode))
+        {
+            continue;
+        }
+
+        // Follow chains of unconditional jumps. The hop limit stops on cycles.
+        LabelId original = std::get<LabelId>(inst.operand);
+        LabelId target = original;
+        for (size_t hops = 0; hops < instrs.size(); hops++)
+        {
+            auto it = position.find(target);
+            if (it == position.end())
+            {
+                break;
+            }
+            size_t next = skipLabels(it->second);
+            if (next >= instrs.size() || next == ip || instrs[next].opcode != Jump)
+            {
+                break;
+            }
+            LabelId further = std::get<LabelId>(instrs[next].operand);
+            if (further == target)
+            {
+                break;
+            }
+            target = further;
+        }
+        if (!(target == original))
+        {
+            inst.operand = target;
+            stats.jumpsThreaded++;
+            changed = true;
+        }
+
+        // A jump to one of the labels directly after it only falls through.
+        for (size_t j = ip + 1; j < instrs.size() && instrs[j].opcode == JLabel; j++)
+        {
+            if (std::get<LabelId>(instrs[j].operand) == target)
+            {
+                // A conditional jump must still consume its condition.
+                inst = Instruction{inst.opcode == Jump ? Nop : Pop, Operand{}, inst.loc};
+                stats.jumpsRemoved++;
+                changed = true;
+                break;
+            }
+        }
+    }
+
+    return changed;
+}
+
+void IrOptimizer::removeUnreachable(const std::vector<bool>& reachable)
+{
+    auto&  instrs = function.instructions;
+    size_t kept = 0;
+    for (size_t ip = 0; ip < instrs.size(); ip++)
+    {
+        if (ip < reachable.size() && !reachable[ip])
+        {
+            continue;
+        }
+        instrs[kept++] = std::move(instrs[ip]);
+    }
+    stats.unreachableRemoved += instrs.size() - kept;
+    if (kept < instrs.size())
+    {
+        instrs.resize(kept);
+        rebuildLabelPositions();
+    }
+}
+
+void IrOptimizer::rebuildLabelPositions()
+{
+    auto& position = function.labelTable.position;
+    position.clear();
+    for (size_t ip = 0; ip < function.instructions.size(); ip++)
+    {
+        const Instruction& inst = function.instructions[ip];
+        if (inst.opcode == JLabel)
+        {
+            position[std::get<LabelId>(inst.operand)] = ip;
+        }
+    }
+}
@@ -0,0 +1,119 @@
+/**
+ * @file optimizer.h
+ * @brief Peephole optimization of lowered IR
+ *
+ * IrOptimizer runs between lowering and IrValidator. Lowering translates each
+ * AST node in isolation, so it leaves sequences a single look at neighbouring
+ * instructions can improve:
+ *
+ * - Constant folding: `PushConst 2, PushConst 3, AddI32` becomes `PushConst 5`.
+ *   Arithmetic, comparisons, NotBool/NegI32, ToString and ConcatString of
+ *   constants are folded with the VM's semantics (wrapping i32 arithmetic).
+ *   Division by a constant zero is left for the VM to report.
+ * - ToString applied to a value that is already a string is dropped.
+ * - `NotBool, JumpIfFalse L` becomes `JumpIfTrue L` (and vice versa).
+ * - Jumps to a label whose next instruction is a Jump are retargeted to the
+ *   final destination; a Jump to the label that immediately follows it is
+ *   removed.
+ * - Nops are dropped.
+ *
+ * Labels stay as JLabel instructions and act as barriers: no pattern spans a
+ * label, so folding never merges values from different control-flow paths.
+ * The label position table is rebuilt after rewriting.
+ *
+ * Once IrValidator has accepted the function, removeUnreachable() drops the
+ * instructions it found no path to, such as the code after an endless loop.
+ */
+
+#pragma once
+#include "program.h"
+
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Evaluate a run of instructions that only combines constants
+ * @param instrs Instructions; the run is [begin, end of instrs)
+ * @param result The single value the run leaves on the stack
+ * @return False if the run reads a local, does anything else that cannot be
+ *         folded, or does not leave exactly one value
+ *
+ * Uses the optimizer's folding rules, so division by zero is never constant.
+ */
+bool evaluateConstant(const IrProgram& program, const std::vector<Instruction>& instrs,
+                      size_t begin, ConstantKey& result);
+
+/**
+ * @brief Counts of rewrites applied by an IrOptimizer run
+ */
+struct OptimizerStats
+{
+    size_t constantsFolded = 0;
+    size_t toStringsDropped = 0;
+    size_t branchesInverted = 0;
+    size_t jumpsThreaded = 0;
+    size_t jumpsRemoved = 0;
+    size_t nopsDropped = 0;
+    size_t unreachableRemoved = 0;
+};
+
+/**
+ * @brief Peephole optimizer for one IR function
+ *
+ * Folded results are added to the program's constant pool, reusing an
+ * existing entry when one already holds the same value.
+ */
+struct IrOptimizer
+{
+    IrProgram&  program;
+    IrFunction& function;
+
+    /** @brief What the last optimize() call changed */
+    OptimizerStats stats{};
+
+    /** @brief Existing pool entries by value, so folded results are shared */
+    std::unordered_map<ConstantKey, ConstId> constantIndex{};
+
+    /**
+     * @brief Rewrite the function until no pattern applies
+     */
+    void optimize();
+
+    /**
+     * @brief Drop every instruction no path from the entry reaches
+     * @param reachable IrValidator::reachable for this function
+     */
+    void removeUnreachable(const std::vector<bool>& reachable);
+
+  private:
+    /**
+     * @brief One peephole pass; returns true if anything changed
+     *
+     * Instructions are copied to a new stream, and after each copy the tail of
+     * that stream is matched against the patterns. Folding at the tail lets
+     * results cascade: `1 + 2 * 3` folds the product, then the sum.
+     */
+    bool peephole();
+
+    /**
+     * @brief Retarget jumps through Jump-only blocks; returns true if changed
+     */
+    bool threadJumps();
+
+    /** @brief Recompute labelTable.position from the JLabel instructions */
+    void rebuildLabelPositions();
+
+    /**
+     * @brief Try to fold the instruction at the tail of `out` with the
+     *        constants pushed right before it
+     */
+    bool foldTail(std::vector<Instruction>& out);
+
+    /** @brief Whether `inst` always leaves a String32 on top of the stack */
+    bool producesString(const Instruction& inst) const;
+
+    /** @brief The constant pushed by `inst`, or nullptr if it is not a PushConst */
+    const Constant* pushedConstant(const Instruction& inst) const;
+
+    ConstId internConstant(IrType type, std::variant<std::string, int, bool> value);
+};
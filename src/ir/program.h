@@ -18,6 +18,7 @@
  * Future versions may support multiple functions for user-defined functions.
  */
 
+#pragma once
 #include "functions.h"
 
 #include <vector>
@@ -62,4 +63,12 @@ struct IrProgram
      * Incremented each time a constant is added.
      */
     ConstId nextConstId{0};
+
+    /** @brief Empty the program, keeping the storage of its tables */
+    void clear()
+    {
+        constants.clear();
+        main.clear();
+        nextConstId = ConstId{0};
+    }
 };
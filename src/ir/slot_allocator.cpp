@@ -0,0 +1,187 @@
+/**
+ * @file slot_allocator.cpp
+ * @brief Implementation of frame slot allocation by live range.
+ */
+
+#include "slot_allocator.h"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <utility>
+
+/** @brief A set of locals, one bit per LocalId */
+using LocalSet = std::vector<uint64_t>;
+
+static bool endsBlock(Opcode op)
+{
+    return op == Jump || op == JumpIfFalse || op == JumpIfTrue || op == Halt;
+}
+
+/** @brief Call `visit` with the index of every local in `set` */
+template <typename Visit> static void forEachLocal(const LocalSet& set, Visit&& visit)
+{
+    for (size_t word = 0; word < set.size(); word++)
+    {
+        for (size_t bit = 0; bit < 64; bit++)
+        {
+            if ((set[word] >> bit) & 1)
+                visit(word * 64 + bit);
+        }
+    }
+}
+
+void SlotAllocator::computeLiveRanges()
+{
+    const auto& instrs = function.instructions;
+    size_t      localCount = function.localTable.locals.size();
+    size_t      words = (localCount + 63) / 64;
+
+    ranges.assign(localCount, LiveRange{});
+    if (instrs.empty() || localCount == 0)
+    {
+        return;
+    }
+
+    // Split into basic blocks, as IrValidator does.
+    std::vector<bool> leader(instrs.size(), false);
+    leader[0] = true;
+    for (const auto& [label, ip] : function.labelTable.position)
+    {
+        if (ip < instrs.size())
+            leader[ip] = true;
+    }
+    for (size_t ip = 0; ip + 1 < instrs.size(); ip++)
+    {
+        if (endsBlock(instrs[ip].opcode))
+            leader[ip + 1] = true;
+    }
+    std::vector<size_t>   blockStart;
+    std::vector<uint32_t> blockAt(instrs.size());
+    for (size_t ip = 0; ip < instrs.size(); ip++)
+    {
+        if (leader[ip])
+            blockStart.push_back(ip);
+        blockAt[ip] = static_cast<uint32_t>(blockStart.size() - 1);
+    }
+    size_t blocks = blockStart.size();
+    auto   blockEnd = [&](size_t block)
+    { return block + 1 < blocks ? blockStart[block + 1] : instrs.size(); };
+
+    // Per block: locals read before any store in it (use), locals stored in it
+    // (def), and successors. Every instruction also extends its local's range.
+    std::vector<LocalSet>              use(blocks, LocalSet(words)), def(blocks, LocalSet(words));
+    std::vector<std::vector<uint32_t>> successors(blocks);
+    for (size_t block = 0; block < blocks; block++)
+    {
+        for (size_t ip = blockStart[block]; ip < blockEnd(block); ip++)
+        {
+            const Instruction& inst = instrs[ip];
+            if (inst.opcode != LoadLocal && inst.opcode != StoreLocal)
+                continue;
+            size_t   local = std::get<LocalId>(inst.operand).value;
+            uint64_t bit = uint64_t{1} << (local % 64);
+            if (inst.opcode == LoadLocal && (def[block][local / 64] & bit) == 0)
+                use[block][local / 64] |= bit;
+            if (inst.opcode == StoreLocal)
+                def[block][local / 64] |= bit;
+            ranges[local].first = std::min(ranges[local].first, ip);
+            ranges[local].last = std::max(ranges[local].last, ip);
+        }
+
+        const Instruction& last = instrs[blockEnd(block) - 1];
+        if (last.opcode == Jump || last.opcode == JumpIfFalse || last.opcode == JumpIfTrue)
+        {
+            auto target = function.labelTable.position.find(std::get<LabelId>(last.operand));
+            if (target != function.labelTable.position.end() && target->second < instrs.size())
+                successors[block].push_back(blockAt[target->second]);
+        }
+        if (last.opcode != Jump && last.opcode != Halt && block + 1 < blocks)
+            successors[block].push_back(static_cast<uint32_t>(block + 1));
+    }
+
+    // liveIn = use | (liveOut & ~def), liveOut = union of the successors' liveIn.
+    // Visiting blocks last to first settles straight-line code in one sweep;
+    // loops take another sweep per nesting level.
+    std::vector<LocalSet> liveIn(blocks, LocalSet(words)), liveOut(blocks, LocalSet(words));
+    bool                  changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t block = blocks; block-- > 0;)
+        {
+            LocalSet& out = liveOut[block];
+            for (uint32_t succ : successors[block])
+            {
+                for (size_t w = 0; w < words; w++)
+                    out[w] |= liveIn[succ][w];
+            }
+            for (size_t w = 0; w < words; w++)
+            {
+                uint64_t in = use[block][w] | (out[w] & ~def[block][w]);
+                if (in != liveIn[block][w])
+                {
+                    liveIn[block][w] = in;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    // Inside a block, a local is only live between its loads and stores and
+    // the block's edges, so those bound its range.
+    for (size_t block = 0; block < blocks; block++)
+    {
+        size_t first = blockStart[block];
+        size_t last = blockEnd(block) - 1;
+        forEachLocal(liveIn[block], [&](size_t local)
+                     { ranges[local].first = std::min(ranges[local].first, first); });
+        forEachLocal(liveOut[block], [&](size_t local)
+                     { ranges[local].last = std::max(ranges[local].last, last); });
+    }
+}
+
+void SlotAllocator::allocate()
+{
+    computeLiveRanges();
+
+    size_t localCount = ranges.size();
+    auto&  slots = function.localTable.slots;
+    slots.assign(localCount, 0);
+    function.frameSize = 0;
+
+    std::vector<uint32_t> order;
+    for (uint32_t local = 0; local < localCount; local++)
+    {
+        if (ranges[local].first <= ranges[local].last)
+            order.push_back(local);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+              { return ranges[a].first < ranges[b].first; });
+
+    // Slots in use, by the end of their current range, and slots free to reuse.
+    using Busy = std::pair<size_t, uint32_t>;
+    std::priority_queue<Busy, std::vector<Busy>, std::greater<Busy>>             busy;
+    std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> idle;
+
+    for (uint32_t local : order)
+    {
+        while (!busy.empty() && busy.top().first < ranges[local].first)
+        {
+            idle.push(busy.top().second);
+            busy.pop();
+        }
+        uint32_t slot;
+        if (!idle.empty())
+        {
+            slot = idle.top();
+            idle.pop();
+        }
+        else
+        {
+            slot = function.frameSize++;
+        }
+        slots[local] = slot;
+        busy.emplace(ranges[local].last, slot);
+    }
+}
@@ -0,0 +1,64 @@
+/**
+ * @file slot_allocator.h
+ * @brief Frame slot allocation for IR locals by live range
+ *
+ * Lowering gives every `summon` a LocalId of its own, so a function's local
+ * table grows with every declaration, even when the variables live in sibling
+ * blocks and never hold a value at the same time. SlotAllocator maps the
+ * LocalIds of a validated function onto as few frame slots as their live
+ * ranges allow, and records the result in LocalTable::slots and
+ * IrFunction::frameSize. Instructions keep their LocalIds, so the local
+ * table, its types and its names stay valid; only back ends that lay out a
+ * frame (the bytecode emitter and the register VM) translate ids to slots.
+ *
+ * Liveness is computed per basic block by the usual backward dataflow, so a
+ * local read again on the next iteration of a loop stays live across the
+ * whole loop. Each local's live range is then the span of instructions from
+ * the first one it is live at or stored by to the last one, and ranges are
+ * packed with a linear scan that always reuses the lowest free slot.
+ *
+ * A slot may hold locals of different types over its lifetime. Every load of
+ * a local follows a store to it on every path, and no other local is stored
+ * to the slot in between, so typed code always finds the type it expects.
+ */
+
+#pragma once
+#include "program.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Assigns frame slots to the locals of one IR function
+ */
+struct SlotAllocator
+{
+    IrFunction& function;
+
+    /**
+     * @brief Per local: the first and last instruction it is live at
+     *
+     * Locals no instruction refers to have an empty range (first > last) and
+     * get slot 0 without occupying it.
+     */
+    struct LiveRange
+    {
+        size_t first = SIZE_MAX;
+        size_t last = 0;
+    };
+
+    /** @brief Live range of each local, indexed by LocalId.value, from the last allocate() */
+    std::vector<LiveRange> ranges{};
+
+    /**
+     * @brief Assign slots and set the function's frame size
+     *
+     * The function must have passed IrValidator.
+     */
+    void allocate();
+
+  private:
+    /** @brief Fill `ranges` from block-level liveness */
+    void computeLiveRanges();
+};
@@ -19,6 +19,7 @@
  * ID spaces (locals vs labels vs constants).
  */
 
+#pragma once
 #include "ast/expr.h"
 
 #include <cstdint>
@@ -84,6 +85,21 @@ struct ConstId
     }
 };
 
+/**
+ * @brief Operand count of a variadic instruction
+ *
+ * Used by ConcatN to say how many stack values it consumes.
+ */
+struct Arity
+{
+    uint32_t value; ///< Number of operands taken from the stack
+
+    bool operator==(Arity other) const
+    {
+        return value == other.value;
+    }
+};
+
 /**
  * @brief Metadata for a local variable
  *
@@ -127,6 +143,23 @@ struct Constant
     }
 };
 
+/**
+ * @brief Identity of a constant's contents, used to deduplicate the pool
+ *
+ * Two literals with the same IrType and value map to the same ConstantKey and
+ * therefore share one ConstId.
+ */
+struct ConstantKey
+{
+    IrType                               type;
+    std::variant<std::string, int, bool> value;
+
+    bool operator==(const ConstantKey& other) const
+    {
+        return type == other.type && value == other.value;
+    }
+};
+
 /**
  * @brief Hash function specializations for IR identifier types
  * Example usage:
@@ -178,4 +211,18 @@ template <> struct hash<ConstId>
         return hash<uint32_t>()(id.value);
     }
 };
+
+/**
+ * @brief Hash function for ConstantKey
+ *
+ * Combines the type with the hash of the held value.
+ */
+template <> struct hash<ConstantKey>
+{
+    size_t operator()(const ConstantKey& key) const noexcept
+    {
+        size_t h = hash<variant<string, int, bool>>()(key.value);
+        return h ^ (static_cast<size_t>(key.type) + 0x9e3779b9 + (h << 6) + (h >> 2));
+    }
+};
 } // namespace std
@@ -1,6 +1,10 @@
+#pragma once
+
 #include "lowering.h"
 
+#include <cstdint>
 #include <deque>
+#include <optional>
 #include <unordered_map>
 #include <vector>
 
@@ -52,6 +56,8 @@ static const char* getOpcodeName(Opcode op)
         return "Jump";
     case JumpIfFalse:
         return "JumpIfFalse";
+    case JumpIfTrue:
+        return "JumpIfTrue";
     case JLabel:
         return "JLabel";
     case PrintString:
@@ -60,8 +66,12 @@ static const char* getOpcodeName(Opcode op)
         return "ToString";
     case ConcatString:
         return "ConcatString";
+    case ConcatN:
+        return "ConcatN";
     case Nop:
         return "Nop";
+    case Halt:
+        return "Halt";
     default:
         return "Unknown";
     }
@@ -100,6 +110,92 @@ struct IrValidatorResults
     }
 };
 
+/**
+ * @brief Abstract operand stack whose states can be shared between paths
+ *
+ * Entries live in a pool and point at the entry below them, so a whole stack
+ * is named by its top entry and its height. Saving the state at a block
+ * boundary copies two integers, and paths that share a prefix share its
+ * entries. Popping never frees an entry; the pool grows with the number of
+ * pushes, which is linear in the function's length.
+ */
+struct IrTypeStack
+{
+    /** @brief One pushed type */
+    struct Entry
+    {
+        IrType   type;
+        uint32_t below; ///< Index of the entry under this one (0 is the empty stack)
+    };
+
+    /** @brief A stack, as its top entry and height */
+    struct State
+    {
+        uint32_t top = 0;
+        uint32_t height = 0;
+    };
+
+    std::vector<Entry> entries{Entry{Void32, 0}}; ///< Pool; entry 0 is the empty-stack sentinel
+    State              state;                      ///< The stack being worked on
+
+    size_t size() const
+    {
+        return state.height;
+    }
+
+    bool empty() const
+    {
+        return state.height == 0;
+    }
+
+    IrType back() const
+    {
+        return entries[state.top].type;
+    }
+
+    void push_back(IrType type)
+    {
+        entries.push_back(Entry{type, state.top});
+        state.top = static_cast<uint32_t>(entries.size() - 1);
+        state.height++;
+    }
+
+    void pop_back()
+    {
+        state.top = entries[state.top].below;
+        state.height--;
+    }
+
+    /** @brief Whether two states hold the same types: height first, then entry by entry */
+    bool same(State a, State b) const
+    {
+        if (a.height != b.height)
+        {
+            return false;
+        }
+        // Shared entries stop the walk early; paths that never diverged compare in O(1).
+        while (a.top != b.top)
+        {
+            if (entries[a.top].type != entries[b.top].type)
+            {
+                return false;
+            }
+            a.top = entries[a.top].below;
+            b.top = entries[b.top].below;
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief Checks that a function's operand stack is well typed on every path
+ *
+ * The function is split into basic blocks (a block starts at instruction 0,
+ * at every label and after every jump or Halt). Each reachable block is
+ * checked once, starting from the stack state it was first reached with;
+ * every later edge into it must bring an equal state. Only the entry state of
+ * each block is stored, so the work is linear in the number of instructions.
+ */
 struct IrValidator
 {
     const IrProgram&  program;
@@ -107,162 +203,151 @@ struct IrValidator
 
     std::vector<IrDiagnostic> diagnostics;
 
+    /** @brief Per instruction: whether any path from the entry reaches it */
+    std::vector<bool> reachable;
+
     IrValidatorResults validate()
     {
         diagnostics.clear();
+        reachable.assign(function.instructions.size(), false);
         validateFunction();
 
         return IrValidatorResults{diagnostics};
     };
 
   private:
+    /// Marks instructions that do not start a block.
+    static constexpr uint32_t NOT_A_LEADER = UINT32_MAX;
+
+    /** @brief Whether control never falls through `op` to the next instruction */
+    static bool endsBlock(Opcode op)
+    {
+        return op == Jump || op == JumpIfFalse || op == JumpIfTrue || op == Halt;
+    }
+
     void validateFunction()
     {
         const auto& instrs = function.instructions;
         if (instrs.empty())
             return;
 
-        const std::unordered_map<LabelId, size_t> labelToIp = function.labelTable.position;
-        
-        // For each instruction index, we store the "incoming" abstract stack.
-        // If an instruction is reachable via multiple paths, their incoming stacks must match.
-        std::vector<std::optional<std::vector<IrType>>> inStack(instrs.size());
+        const std::unordered_map<LabelId, size_t>& labelToIp = function.labelTable.position;
 
-        auto enqueueIfCompatible =
-            [&](size_t targetIp, const std::vector<IrType>& incoming, size_t fromIp)
+        // Number the blocks: blockAt[ip] is the block starting at ip, if any.
+        std::vector<uint32_t> blockAt(instrs.size(), NOT_A_LEADER);
+        blockAt[0] = 0;
+        for (const auto& [label, ip] : labelToIp)
+        {
+            if (ip < instrs.size())
+                blockAt[ip] = 0;
+        }
+        for (size_t ip = 0; ip + 1 < instrs.size(); ip++)
+        {
+            if (endsBlock(instrs[ip].opcode))
+                blockAt[ip + 1] = 0;
+        }
+        std::vector<size_t> blockStart;
+        for (size_t ip = 0; ip < instrs.size(); ip++)
+        {
+            if (blockAt[ip] != NOT_A_LEADER)
+            {
+                blockAt[ip] = static_cast<uint32_t>(blockStart.size());
+                blockStart.push_back(ip);
+            }
+        }
+
+        // Entry state of each block, once it has been reached.
+        IrTypeStack                     stack;
+        std::vector<IrTypeStack::State> entry(blockStart.size());
+        std::vector<bool>               reached(blockStart.size(), false);
+
+        // Blocks waiting to be checked; each is queued once, when first reached.
+        std::deque<uint32_t> work;
+        reached[0] = true; // entry stack is empty
+        work.push_back(0);
+
+        // An edge from `fromIp` into the block at `targetIp`, carrying the current stack.
+        auto flowTo = [&](size_t targetIp, size_t fromIp)
         {
             if (targetIp >= instrs.size())
             {
                 diagnostics.push_back({"Jump target out of range", fromIp});
                 return;
             }
-
-            auto& slot = inStack[targetIp];
-            if (!slot.has_value())
+            uint32_t target = blockAt[targetIp];
+            if (!reached[target])
             {
-                slot = incoming;
+                reached[target] = true;
+                entry[target] = stack.state;
+                work.push_back(target);
                 return;
             }
-
-            if (slot.value() != incoming)
+            if (!stack.same(entry[target], stack.state))
             {
                 diagnostics.push_back({"Stack mismatch at control-flow merge", fromIp});
                 // Keep the first one; do not update.
             }
         };
 
-        // Worklist of instruction pointers to process.
-        std::deque<size_t> work;
-        inStack[0] = std::vector<IrType>{}; // entry stack is empty
-        work.push_back(0);
-
-        // To avoid infinite loop, we only re-enqueue when we first discover a node.
-        // Since we require exact equality at merges, the first discovery is enough.
-        std::vector<bool> enqueued(instrs.size(), false);
-        enqueued[0] = true;
+        // Resolve a jump's label operand to its target ip.
+        auto resolveLabelTarget = [&](size_t fromIp) -> std::optional<size_t>
+        {
+            const Instruction& inst = instrs[fromIp];
+            if (!std::holds_alternative<LabelId>(inst.operand))
+            {
+                diagnostics.push_back({"Jump missing LabelId operand", fromIp});
+                return std::nullopt;
+            }
+            auto it = labelToIp.find(std::get<LabelId>(inst.operand));
+            if (it == labelToIp.end())
+            {
+                diagnostics.push_back({"Jump to undefined label", fromIp});
+                return std::nullopt;
+            }
+            return it->second;
+        };
 
         while (!work.empty())
         {
-            size_t ip = work.front();
+            uint32_t block = work.front();
             work.pop_front();
-            enqueued[ip] = false;
-
-            // If this instruction became unreachable, skip.
-            if (!inStack[ip].has_value())
-                continue;
 
-            std::vector<IrType> stack = inStack[ip].value(); // local copy for this path
+            size_t start = blockStart[block];
+            size_t end = block + 1 < blockStart.size() ? blockStart[block + 1] : instrs.size();
 
-            // Validate and update stack for this instruction
-            validateInstruction(ip, stack);
-
-            // Compute successors and propagate stack states
-            const Instruction& inst = instrs[ip];
-
-            auto pushWork = [&](size_t target)
-            {
-                if (target >= instrs.size())
-                    return;
-                if (!inStack[target].has_value())
-                    return;
-                if (!enqueued[target])
-                {
-                    enqueued[target] = true;
-                    work.push_back(target);
-                }
-            };
-
-            // Helper: resolve label operand -> target ip
-            auto resolveLabelTarget = [&](size_t fromIp) -> std::optional<size_t>
+            stack.state = entry[block];
+            for (size_t ip = start; ip < end; ip++)
             {
-                if (!std::holds_alternative<LabelId>(inst.operand))
-                {
-                    diagnostics.push_back({"Jump missing LabelId operand", fromIp});
-                    return std::nullopt;
-                }
-                LabelId target = std::get<LabelId>(inst.operand);
-                auto    it = labelToIp.find(target);
-                if (it == labelToIp.end())
-                {
-                    diagnostics.push_back({"Jump to undefined label", fromIp});
-                    return std::nullopt;
-                }
-                return it->second;
-            };
-
-            if (inst.opcode == Jump)
-            {
-                auto targetIpOpt = resolveLabelTarget(ip);
-                if (targetIpOpt.has_value())
-                {
-                    size_t targetIp = *targetIpOpt;
-                    bool   wasUnset = !inStack[targetIp].has_value();
-                    enqueueIfCompatible(targetIp, stack, ip);
-                    if (wasUnset && inStack[targetIp].has_value())
-                        pushWork(targetIp);
-                }
-                continue; // unconditional jump: no fallthrough
+                validateInstruction(ip, stack);
             }
 
-            if (inst.opcode == JumpIfFalse)
+            // Successors come from the block's last instruction.
+            size_t last = end - 1;
+            Opcode op = instrs[last].opcode;
+
+            if (op == Jump || op == JumpIfFalse || op == JumpIfTrue)
             {
                 // Branch taken: jump target
-                auto targetIpOpt = resolveLabelTarget(ip);
+                auto targetIpOpt = resolveLabelTarget(last);
                 if (targetIpOpt.has_value())
-                {
-                    size_t targetIp = *targetIpOpt;
-                    bool   wasUnset = !inStack[targetIp].has_value();
-                    enqueueIfCompatible(targetIp, stack, ip);
-                    if (wasUnset && inStack[targetIp].has_value())
-                        pushWork(targetIp);
-                }
-
-                // Branch not taken: fallthrough
-                if (ip + 1 < instrs.size())
-                {
-                    size_t fallthrough = ip + 1;
-                    bool   wasUnset = !inStack[fallthrough].has_value();
-                    enqueueIfCompatible(fallthrough, stack, ip);
-                    if (wasUnset && inStack[fallthrough].has_value())
-                        pushWork(fallthrough);
-                }
-                continue;
+                    flowTo(*targetIpOpt, last);
             }
 
-            // Normal fallthrough
-            if (ip + 1 < instrs.size())
-            {
-                size_t nextIp = ip + 1;
-                bool   wasUnset = !inStack[nextIp].has_value();
-                enqueueIfCompatible(nextIp, stack, ip);
-                if (wasUnset && inStack[nextIp].has_value())
-                    pushWork(nextIp);
-            }
+            // Fallthrough, unless the jump is unconditional or execution stops
+            if (op != Jump && op != Halt && end < instrs.size())
+                flowTo(end, last);
+        }
+
+        for (size_t block = 0; block < blockStart.size(); block++)
+        {
+            size_t end = block + 1 < blockStart.size() ? blockStart[block + 1] : instrs.size();
+            for (size_t ip = blockStart[block]; ip < end; ip++)
+                reachable[ip] = reached[block];
         }
     }
 
     bool maintainStack(size_t popCount, size_t pushCount, IrType popType, IrType pushType,
-                       std::vector<IrType>& stack, size_t ip)
+                       IrTypeStack& stack, size_t ip)
     {
         if (stack.size() < popCount)
         {
@@ -291,7 +376,7 @@ struct IrValidator
         return true;
     }
 
-    void validateInstruction(size_t ip, std::vector<IrType>& stack)
+    void validateInstruction(size_t ip, IrTypeStack& stack)
     {
         switch (function.instructions[ip].opcode)
         {
@@ -431,6 +516,20 @@ struct IrValidator
                 return;
             break;
         }
+        case ConcatN:
+        {
+            const Operand& operand = function.instructions[ip].operand;
+            if (!std::holds_alternative<Arity>(operand) || std::get<Arity>(operand).value < 2)
+            {
+                diagnostics.push_back({"ConcatN needs an Arity of at least 2", ip});
+                return;
+            }
+            bool res = maintainStack(std::get<Arity>(operand).value, 1, String32, String32, stack,
+                                     ip);
+            if (!res)
+                return;
+            break;
+        }
         case PrintString:
         {
             bool res = maintainStack(1, 0, String32, Void32, stack, ip);
@@ -439,15 +538,28 @@ struct IrValidator
             break;
         }
         case JumpIfFalse:
+        case JumpIfTrue:
         {
             bool res = maintainStack(1, 0, Bool32, Void32, stack, ip);
             if (!res)
                 return;
             break;
         }
+        case Pop:
+        {
+            // Discards a value of any type.
+            if (stack.empty())
+            {
+                diagnostics.push_back({"Stack underflow", ip});
+                return;
+            }
+            stack.pop_back();
+            break;
+        }
         case Jump:
         case JLabel:
         case Nop:
+        case Halt:
             break;
         default:
             diagnostics.push_back({"Unexpected opcode", ip});
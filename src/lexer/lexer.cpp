@@ -9,7 +9,10 @@
 
 #include "lexer.h"
 
+#include "scan.h"
+
 #include <cctype>
+#include <charconv>
 #include <variant>
 
 /**
@@ -20,7 +23,7 @@
  *
  * @param source The complete source code to tokenize
  */
-Lexer::Lexer(std::string source) : source(source)
+Lexer::Lexer(std::string source) : source(source), stream(this->source)
 {
     start = 0;
     current = 0;
@@ -29,15 +32,56 @@ Lexer::Lexer(std::string source) : source(source)
 };
 
 /**
- * @brief Static keyword map for the Ambra language.
+ * @brief Classify a scanned word as a keyword or an identifier.
+ *
+ * Identifier scanning is the lexer's most frequent path, so the handful of
+ * reserved words are recognised without hashing or allocation: the length and
+ * first character single out at most one candidate, which is then compared in
+ * full. Boolean literals "affirmative" and "negative" both map to BOOL and are
+ * handled specially during identifier scanning.
  *
- * Maps reserved word lexemes to their corresponding token types.
- * Boolean literals "affirmative" and "negative" both map to BOOL
- * and are handled specially during identifier scanning.
+ * @return The keyword's TokenType, or IDENTIFIER if `word` is not reserved
  */
-std::unordered_map<std::string, TokenType> Lexer::keywordMap = {
-    {"summon", SUMMON}, {"should", SHOULD}, {"otherwise", OTHERWISE}, {"aslongas", ASLONGAS},
-    {"say", SAY},       {"not", NOT},       {"affirmative", BOOL},    {"negative", BOOL}};
+static constexpr TokenType keywordType(std::string_view word)
+{
+    switch (word.size())
+    {
+    case 2:
+        return word == "or" ? OR : IDENTIFIER;
+    case 3:
+        if (word[0] == 's')
+        {
+            return word == "say" ? SAY : IDENTIFIER;
+        }
+        if (word[0] == 'a')
+        {
+            return word == "and" ? AND : IDENTIFIER;
+        }
+        return word == "not" ? NOT : IDENTIFIER;
+    case 6:
+        if (word[1] == 'u')
+        {
+            return word == "summon" ? SUMMON : IDENTIFIER;
+        }
+        return word == "should" ? SHOULD : IDENTIFIER;
+    case 8:
+        if (word[0] == 'a')
+        {
+            return word == "aslongas" ? ASLONGAS : IDENTIFIER;
+        }
+        return word == "negative" ? BOOL : IDENTIFIER;
+    case 9:
+        return word == "otherwise" ? OTHERWISE : IDENTIFIER;
+    case 11:
+        return word == "affirmative" ? BOOL : IDENTIFIER;
+    default:
+        return IDENTIFIER;
+    }
+}
+
+static_assert(keywordType("aslongas") == ASLONGAS && keywordType("or") == OR &&
+                  keywordType("and") == AND && keywordType("sayy") == IDENTIFIER,
+              "keywordType must recognise exactly the reserved words");
 
 char Lexer::advance()
 {
@@ -55,6 +99,27 @@ char Lexer::advance()
     return current_char;
 }
 
+void Lexer::advanceBy(size_t count)
+{
+    const char* run = source.data() + current;
+    size_t      newlines = scanCountNewlines(run, count);
+    if (newlines == 0)
+    {
+        column += static_cast<int>(count);
+    }
+    else
+    {
+        size_t lineStart = count;
+        while (run[lineStart - 1] != '\n')
+        {
+            lineStart--;
+        }
+        line += static_cast<int>(newlines);
+        column = 1 + static_cast<int>(count - lineStart);
+    }
+    current += static_cast<int>(count);
+}
+
 char Lexer::peek()
 {
     if (isAtEnd())
@@ -112,7 +177,7 @@ bool Lexer::isAtEnd()
     return current >= source.length();
 }
 
-Token Lexer::scanNumber(int startLine, int startColumn)
+CompactToken Lexer::scanNumber(int startLine, int startColumn)
 {
     // Consume leading digits
     while (!isAtEnd() && std::isdigit(peek()))
@@ -132,41 +197,40 @@ Token Lexer::scanNumber(int startLine, int startColumn)
     }
 
     // Valid integer
-    std::string lexeme = source.substr(start, current - start);
-    int         number = std::stoi(lexeme);
-    return makeToken(TokenType::INTEGER, startLine, startColumn, number);
+    int32_t number = 0;
+    auto [end, error] = std::from_chars(source.data() + start, source.data() + current, number);
+    if (error != std::errc())
+    {
+        // Does not fit in an int32
+        return makeErrorToken("Invalid number", startLine, startColumn);
+    }
+    return makeToken(TokenType::INTEGER, startLine, startColumn, static_cast<uint32_t>(number));
 }
 
-Token Lexer::scanIdentifierOrKeyword(int startLine, int startColumn)
+CompactToken Lexer::scanIdentifierOrKeyword(int startLine, int startColumn)
 {
     while (!isAtEnd() && (std::isalnum(static_cast<unsigned char>(peek())) || peek() == '_'))
     {
         advance();
     }
 
-    std::string lexeme = source.substr(start, current - start);
+    std::string_view lexeme = std::string_view(source).substr(start, current - start);
 
-    auto it = keywordMap.find(lexeme);
-    if (it != keywordMap.end())
+    TokenType type = keywordType(lexeme);
+    if (type == BOOL)
     {
-        TokenType type = it->second;
-
-        if (lexeme == "affirmative")
-        {
-            return makeToken(type, startLine, startColumn, true);
-        }
-        else if (lexeme == "negative")
-        {
-            return makeToken(type, startLine, startColumn, false);
-        }
-
-        return makeToken(type, startLine, startColumn, std::monostate{});
+        // "affirmative" or "negative"
+        return makeToken(type, startLine, startColumn, lexeme[0] == 'a' ? 1 : 0);
+    }
+    if (type != IDENTIFIER)
+    {
+        return makeToken(type, startLine, startColumn);
     }
 
-    return makeToken(TokenType::IDENTIFIER, startLine, startColumn, std::monostate{});
+    return makeToken(TokenType::IDENTIFIER, startLine, startColumn, stream.intern(lexeme));
 }
 
-Token Lexer::scanString(int startLine, int startColumn)
+CompactToken Lexer::scanString(int startLine, int startColumn)
 {
     // Check if we're starting fresh (mode is not STRING_MODE yet) or resuming (mode is already
     // STRING_MODE)
@@ -177,70 +241,65 @@ Token Lexer::scanString(int startLine, int startColumn)
     // Now enter STRING_MODE for scanning
     mode = STRING_MODE;
 
-    // Scan until closing quote OR interpolation
-    while (true)
+    // Skip the literal text in one go; it ends at a closing quote, an
+    // interpolation or (as an error) a line break.
+    advanceBy(scanFindAny(source.data() + current, remaining(), '"', '{', '\n'));
+
+    if (isAtEnd())
     {
-        if (isAtEnd())
-        {
-            return makeErrorToken("Unterminated string", startLine, startColumn);
-        }
+        return makeErrorToken("Unterminated string", startLine, startColumn);
+    }
 
-        char c = peek();
+    char c = peek();
 
-        // 1. End of string
-        if (c == '"')
-        {
-            advance(); // consume closing quote
-            mode = NORMAL_MODE;
-            // If initial entry, skip the opening quote; if resuming, don't skip
-            // Compute literal content correctly (exclude the closing quote)
-            int offset = isInitialEntry ? 1 : 0;
-            int length = (current - start - offset - 1);
+    // 1. End of string
+    if (c == '"')
+    {
+        advance(); // consume closing quote
+        mode = NORMAL_MODE;
+        // If initial entry, skip the opening quote; if resuming, don't skip
+        // Compute literal content correctly (exclude the closing quote)
+        int offset = isInitialEntry ? 1 : 0;
+        int length = (current - start - offset - 1);
 
-            if (length < 0)
-                length = 0;
-            std::string literal = source.substr(start + offset, length);
+        if (length < 0)
+            length = 0;
 
-            return makeToken(STRING, startLine, startColumn, literal);
-        }
+        return makeStringToken(STRING, startLine, startColumn, start + offset, length);
+    }
 
-        // 2. Start of interpolation
-        if (c == '{')
+    // 2. Start of interpolation
+    if (c == '{')
+    {
+        // Interpolation tracking
+        interpStartLine = line;
+        interpStartColumn = column;
+        interpStart = current;
+        // If we're resuming (not initial entry) and immediately hit '{',
+        // don't emit an empty STRING token - just switch modes
+        if (!isInitialEntry && current == start)
         {
-            // Interpolation tracking
-            interpStartLine = line;
-            interpStartColumn = column;
-            interpStart = current;
-            // If we're resuming (not initial entry) and immediately hit '{',
-            // don't emit an empty STRING token - just switch modes
-            if (!isInitialEntry && current == start)
-            {
-                mode = INTERP_EXPR_MODE;
-                // Return a SKIP token to indicate no string content to emit
-                return makeToken(SKIP, startLine, startColumn, std::monostate{});
-            }
+            mode = INTERP_EXPR_MODE;
+            // Return a SKIP token to indicate no string content to emit
+            return makeToken(SKIP, startLine, startColumn);
+        }
 
-            // Do NOT consume '{'
-            // If initial entry, skip the opening quote; if resuming, don't skip
-            int offset = isInitialEntry ? 1 : 0;
-            int length = (current - start - offset);
+        // Do NOT consume '{'
+        // If initial entry, skip the opening quote; if resuming, don't skip
+        int offset = isInitialEntry ? 1 : 0;
+        int length = (current - start - offset);
 
-            if (length < 0)
-                length = 0;
-            std::string literal = source.substr(start + offset, length);
+        if (length < 0)
+            length = 0;
 
-            mode = INTERP_EXPR_MODE;
-            return makeToken(STRING, startLine, startColumn, literal);
-        }
-        if (c == '\n')
-        {
-            return makeErrorToken("Unterminated string", startLine, startColumn);
-        }
-        advance();
+        mode = INTERP_EXPR_MODE;
+        return makeStringToken(STRING, startLine, startColumn, start + offset, length);
     }
+    // 3. Line break before the closing quote
+    return makeErrorToken("Unterminated string", startLine, startColumn);
 }
 
-Token Lexer::scanMultiLineString(int startLine, int startColumn)
+CompactToken Lexer::scanMultiLineString(int startLine, int startColumn)
 {
     // Enter multiline string mode
     mode = MULTILINE_STRING_MODE;
@@ -266,6 +325,9 @@ Token Lexer::scanMultiLineString(int startLine, int startColumn)
 
     while (true)
     {
+        // Newlines are part of the text, so only '{' and '"' can end it.
+        advanceBy(scanFindAny(source.data() + current, remaining(), '{', '"', '"'));
+
         if (isAtEnd())
         {
             insideMultiline = false;
@@ -280,20 +342,19 @@ Token Lexer::scanMultiLineString(int startLine, int startColumn)
             interpStartColumn = column;
             interpStart = current;
             // Do NOT consume '{'
-            std::string lexeme = source.substr(start, current - start);
             mode = INTERP_EXPR_MODE;
-            return makeToken(MULTILINE_STRING, startLine, startColumn, lexeme);
+            return makeStringToken(MULTILINE_STRING, startLine, startColumn, start,
+                                   current - start);
         }
 
         // Check for closing triple quotes
         if (peek() == '"' && peekNext() == '"' && peekAhead(2) == '"')
         {
             // Produce the final multiline string chunk *before* consuming """.
-            std::string lexeme = source.substr(start, current - start);
-
             // Create the token now (uses current/start as the bounds),
             // then consume the closing quotes so scanning continues after them.
-            Token t = makeToken(MULTILINE_STRING, startLine, startColumn, lexeme);
+            CompactToken t =
+                makeStringToken(MULTILINE_STRING, startLine, startColumn, start, current - start);
 
             // Consume the closing triple quotes
             advance(); // "
@@ -304,12 +365,12 @@ Token Lexer::scanMultiLineString(int startLine, int startColumn)
             return t;
         }
 
-        // Otherwise: consume a character (newline allowed)
+        // A lone quote is part of the text
         advance();
     }
 }
 
-Token Lexer::scanSlashOrComment(int startLine, int startColumn)
+CompactToken Lexer::scanSlashOrComment(int startLine, int startColumn)
 {
     advance(); // consume the '/'
 
@@ -325,22 +386,21 @@ Token Lexer::scanSlashOrComment(int startLine, int startColumn)
     if (!isMultiLine)
     {
         // Eat until newline or EOF
-        while (!isAtEnd() && peek() != '\n')
-        {
-            advance();
-        }
-        return makeToken(SKIP, startLine, startColumn, std::monostate{});
+        advanceBy(scanFindAny(source.data() + current, remaining(), '\n', '\n', '\n'));
+        return makeToken(SKIP, startLine, startColumn);
     }
 
     while (true)
     {
+        advanceBy(scanFindAny(source.data() + current, remaining(), '/', '/', '/'));
+
         if (isAtEnd())
         {
             // Unterminated multi-line comment
             return makeErrorToken("Unterminated multi-line comment", line, column);
         }
 
-        if (peek() == '/' && peekNext() == '>')
+        if (peekNext() == '>')
         {
             break;
         }
@@ -351,35 +411,35 @@ Token Lexer::scanSlashOrComment(int startLine, int startColumn)
     advance();
     advance();
 
-    return makeToken(SKIP, startLine, startColumn, std::monostate{});
+    return makeToken(SKIP, startLine, startColumn);
 }
 
-Token Lexer::scanOperator(char c, int startLine, int startColumn)
+CompactToken Lexer::scanOperator(char c, int startLine, int startColumn)
 {
 
     switch (c)
     {
     case '+':
-        return makeToken(PLUS, startLine, startColumn, std::monostate{});
+        return makeToken(PLUS, startLine, startColumn);
     case '-':
-        return makeToken(MINUS, startLine, startColumn, std::monostate{});
+        return makeToken(MINUS, startLine, startColumn);
     case '*':
-        return makeToken(STAR, startLine, startColumn, std::monostate{});
+        return makeToken(STAR, startLine, startColumn);
     case '/':
-        return makeToken(SLASH, startLine, startColumn, std::monostate{});
+        return makeToken(SLASH, startLine, startColumn);
     case '=':
         if (!isAtEnd() && peek() == '=')
         {
             advance();
-            return makeToken(EQUAL_EQUAL, startLine, startColumn, std::monostate{});
+            return makeToken(EQUAL_EQUAL, startLine, startColumn);
         }
-        return makeToken(EQUAL, startLine, startColumn, std::monostate{});
+        return makeToken(EQUAL, startLine, startColumn);
 
     case '!':
         if (!isAtEnd() && peek() == '=')
         {
             advance();
-            return makeToken(BANG_EQUAL, startLine, startColumn, std::monostate{});
+            return makeToken(BANG_EQUAL, startLine, startColumn);
         }
         return makeErrorToken("We lack support for unary bang", startLine, startColumn);
 
@@ -387,22 +447,22 @@ Token Lexer::scanOperator(char c, int startLine, int startColumn)
         if (!isAtEnd() && peek() == '=')
         {
             advance();
-            return makeToken(LESS_EQUAL, startLine, startColumn, std::monostate{});
+            return makeToken(LESS_EQUAL, startLine, startColumn);
         }
-        return makeToken(LESS, startLine, startColumn, std::monostate{});
+        return makeToken(LESS, startLine, startColumn);
     case '>':
         if (!isAtEnd() && peek() == '=')
         {
             advance();
-            return makeToken(GREATER_EQUAL, startLine, startColumn, std::monostate{});
+            return makeToken(GREATER_EQUAL, startLine, startColumn);
         }
-        return makeToken(GREATER, startLine, startColumn, std::monostate{});
+        return makeToken(GREATER, startLine, startColumn);
     default:
         return makeErrorToken("Unexpected character", line, column);
     }
 }
 
-Token Lexer::scanPunctuation(char c, int startLine, int startColumn)
+CompactToken Lexer::scanPunctuation(char c, int startLine, int startColumn)
 {
     switch (c)
     {
@@ -454,17 +514,24 @@ Token Lexer::scanPunctuation(char c, int startLine, int startColumn)
     }
 }
 
-Token Lexer::makeToken(TokenType type, int startLine, int startColumn,
-                       std::variant<std::monostate, int, bool, std::string> literalValue)
+CompactToken Lexer::makeToken(TokenType type, int startLine, int startColumn, uint32_t value)
+{
+    uint32_t offset = static_cast<uint32_t>(start);
+    uint32_t length = static_cast<uint32_t>(current - start);
+    return CompactToken{type, offset, length, startLine, startColumn, value};
+}
+
+CompactToken Lexer::makeStringToken(TokenType type, int startLine, int startColumn, int textStart,
+                                    int textLength)
 {
-    std::string lexeme = source.substr(start, current - start);
-    return Token(lexeme, type, literalValue, startLine, startColumn);
+    CompactToken token = makeToken(type, startLine, startColumn, static_cast<uint32_t>(textStart));
+    token.valueLength = static_cast<uint32_t>(textLength);
+    return token;
 }
 
-Token Lexer::makeErrorToken(std::string message, int startLine, int startColumn)
+CompactToken Lexer::makeErrorToken(const char* message, int startLine, int startColumn)
 {
-    std::string lexeme = source.substr(start, current - start);
-    return Token(lexeme, ERROR, message, startLine, startColumn);
+    return makeToken(ERROR, startLine, startColumn, stream.addMessage(message));
 }
 
 bool Lexer::isMultilineString()
@@ -475,26 +542,26 @@ bool Lexer::isMultilineString()
 }
 
 Token Lexer::scanToken()
+{
+    return stream.expand(scanCompactToken());
+}
+
+CompactToken Lexer::scanCompactToken()
 {
     int startLine = line;
     int startColumn = column;
     start = current;
     // Interpolation unterminated error check
-    if (mode == INTERP_EXPR_MODE && isAtEnd())
-    {
-        std::string lex = source.substr(interpStart, 1);
-        return Token(lex, ERROR, std::string("Unterminated interpolation"), interpStartLine,
-                     interpStartColumn);
-    }
-    if (mode == INTERP_EXPR_MODE && peek() == '"')
+    if (mode == INTERP_EXPR_MODE && (isAtEnd() || peek() == '"'))
     {
-        std::string lex = source.substr(interpStart, 1);
-        return Token(lex, ERROR, std::string("Unterminated interpolation"), interpStartLine,
-                     interpStartColumn);
+        // Points back at the '{' that opened the interpolation.
+        return CompactToken{ERROR,           static_cast<uint32_t>(interpStart), 1,
+                            interpStartLine, interpStartColumn,
+                            stream.addMessage("Unterminated interpolation")};
     }
     if (isAtEnd())
     {
-        return makeToken(EOF_TOKEN, startLine, startColumn, std::monostate{});
+        return makeToken(EOF_TOKEN, startLine, startColumn);
     }
 
     // If we are in the middle of a multiline string, always delegate to scanMultiLineString
@@ -537,7 +604,9 @@ Token Lexer::scanToken()
     case '\r':
     case '\t':
     case '\n':
-        return makeToken(SKIP, startLine, startColumn, std::monostate{});
+        // One SKIP for the whole run of whitespace
+        advanceBy(scanSkipWhitespace(source.data() + current, remaining()));
+        return makeToken(SKIP, startLine, startColumn);
     case '"':
         if (isMultilineString())
         {
@@ -582,25 +651,99 @@ Token Lexer::scanToken()
     }
 }
 
-std::vector<Token> Lexer::scanTokens()
+const TokenStream& Lexer::scanStream()
 {
-
-    std::vector<Token> tokens;
-
     while (true)
     {
-        Token token = scanToken();
+        CompactToken token = scanCompactToken();
 
-        if (token.getType() == SKIP)
+        if (token.type == SKIP)
         {
             continue;
         }
 
-        tokens.push_back(token);
+        stream.push(token);
+
+        if (token.type == EOF_TOKEN)
+        {
+            return stream;
+        }
+        if (token.type == ERROR)
+        {
+            if (++errors >= errorLimit)
+            {
+                return stream;
+            }
+            recoverFromError();
+        }
+    }
+}
+
+CompactToken Lexer::nextToken()
+{
+    CompactToken token = scanCompactToken();
+    while (token.type == SKIP)
+    {
+        token = scanCompactToken();
+    }
+    if (token.type == ERROR && ++errors < errorLimit)
+    {
+        recoverFromError();
+    }
+    return token;
+}
 
-        if (token.getType() == ERROR || token.getType() == EOF_TOKEN)
+void Lexer::recoverFromError()
+{
+    if (mode == INTERP_EXPR_MODE)
+    {
+        // Only a multiline string lets an interpolation run past a line break.
+        int depth = 0;
+        while (!isAtEnd() && peek() != '"' && (insideMultiline || peek() != '\n'))
         {
-            return tokens;
+            if (peek() == '}')
+            {
+                if (depth == 0)
+                {
+                    return; // scanned next as INTERP_END
+                }
+                depth--;
+            }
+            else if (peek() == '{')
+            {
+                depth++;
+            }
+            advance();
+        }
+        if (!isAtEnd() && peek() == '"')
+        {
+            advance();
+            if (insideMultiline && !(peek() == '"' && peekNext() == '"'))
+            {
+                // A lone quote is text; the multiline string goes on.
+                mode = MULTILINE_STRING_MODE;
+                return;
+            }
+            if (insideMultiline)
+            {
+                advance();
+                advance();
+            }
         }
     }
-}
\ No newline at end of file
+    mode = NORMAL_MODE;
+    insideMultiline = false;
+}
+
+std::vector<Token> Lexer::scanTokens()
+{
+    const TokenStream& scanned = scanStream();
+
+    std::vector<Token> tokens;
+    tokens.reserve(scanned.size());
+    for (size_t i = 0; i < scanned.size(); i++)
+    {
+        tokens.push_back(scanned.expand(scanned[i]));
+    }
+    return tokens;
+}
@@ -1,7 +1,9 @@
 #include "token/token.h"
+#include "token/token_stream.h"
 
+#include <cstdint>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
 
 enum LexerMode
@@ -36,6 +38,14 @@ class Lexer
      */
     const std::string source;
 
+    /**
+     * @brief Tokens scanned so far, as views into `source`.
+     *
+     * Also owns the identifier table, so every occurrence of a name gets the
+     * same IdentifierId.
+     */
+    TokenStream stream;
+
     /**
      * @brief Index of the first character of the current token.
      *
@@ -104,6 +114,24 @@ class Lexer
      * - MULTILINE_STRING_MODE: Inside a triple-quoted multiline string
      */
     LexerMode mode;
+
+    /** @brief ERROR tokens after which the stream ends (see setErrorLimit()) */
+    size_t errorLimit = 1;
+
+    /** @brief ERROR tokens produced so far */
+    size_t errors = 0;
+
+    /**
+     * @brief Leave whatever string or interpolation an error occurred in.
+     *
+     * An error inside an interpolation skips the rest of it: its closing '}'
+     * is left to end it as usual, so the text after it is still lexed as part
+     * of the string. An interpolation left open at the string's terminator
+     * takes the terminator with it. Anywhere else, scanning resumes with
+     * ordinary tokens.
+     */
+    void recoverFromError();
+
     /**
      * @brief Advances the scanner by one character and returns it.
      *
@@ -111,6 +139,20 @@ class Lexer
      */
     char advance();
 
+    /**
+     * @brief Advances the scanner over `count` characters at once.
+     *
+     * Used after one of the block scanners in scan.h has found the end of a
+     * run; newlines in the run are counted in bulk to update line/column.
+     */
+    void advanceBy(size_t count);
+
+    /** @brief Number of characters left to scan */
+    size_t remaining() const
+    {
+        return source.size() - current;
+    }
+
     /**
      * @brief Returns the current unconsumed character without advancing.
      */
@@ -154,13 +196,13 @@ class Lexer
      * @param startColumn Column where the number started
      * @return INTEGER token with the parsed value, or ERROR token
      */
-    Token scanNumber(int startLine, int startColumn);
+    CompactToken scanNumber(int startLine, int startColumn);
 
     /**
      * @brief Scans an identifier or keyword token.
      *
      * Consumes alphanumeric characters and underscores. Checks the
-     * resulting lexeme against the keyword map to determine if it's
+     * resulting lexeme against the reserved words to determine if it's
      * a reserved word. Special handling for boolean literals
      * "affirmative" and "negative".
      *
@@ -168,7 +210,7 @@ class Lexer
      * @param startColumn Column where the identifier started
      * @return IDENTIFIER token, keyword token, or BOOL token
      */
-    Token scanIdentifierOrKeyword(int startLine, int startColumn);
+    CompactToken scanIdentifierOrKeyword(int startLine, int startColumn);
 
     /**
      * @brief Scans a string literal, handling interpolations.
@@ -182,7 +224,7 @@ class Lexer
      * @param startColumn Column where the string/segment started
      * @return STRING token with literal value, or ERROR if unterminated
      */
-    Token scanString(int startLine, int startColumn);
+    CompactToken scanString(int startLine, int startColumn);
 
     /**
      * @brief Scans a multiline string literal (triple-quoted).
@@ -195,7 +237,7 @@ class Lexer
      * @param startColumn Column where the multiline string/segment started
      * @return MULTILINE_STRING token, or ERROR if unterminated
      */
-    Token scanMultiLineString(int startLine, int startColumn);
+    CompactToken scanMultiLineString(int startLine, int startColumn);
 
     /**
      * @brief Scans a comment (single-line or multi-line).
@@ -207,7 +249,7 @@ class Lexer
      * @param startColumn Column where the comment started
      * @return SKIP token, or ERROR if multi-line comment is unterminated
      */
-    Token scanSlashOrComment(int startLine, int startColumn);
+    CompactToken scanSlashOrComment(int startLine, int startColumn);
 
     /**
      * @brief Scans an operator token.
@@ -221,7 +263,7 @@ class Lexer
      * @param startColumn Column where the operator started
      * @return The corresponding operator token, or ERROR for unary '!'
      */
-    Token scanOperator(char c, int startLine, int startColumn);
+    CompactToken scanOperator(char c, int startLine, int startColumn);
 
     /**
      * @brief Scans a punctuation token.
@@ -236,36 +278,44 @@ class Lexer
      * @param startColumn Column where the punctuation started
      * @return The corresponding punctuation token or special interpolation token
      */
-    Token scanPunctuation(char c, int startLine, int startColumn);
+    CompactToken scanPunctuation(char c, int startLine, int startColumn);
 
     /**
      * @brief Constructs a token from the current lexeme.
      *
-     * Extracts the lexeme from source[start..current) and creates a Token
-     * with the specified type, location, and optional literal value.
+     * The lexeme is the range source[start..current); nothing is copied.
      *
      * @param type The token type
      * @param startLine Line where the token started
      * @param startColumn Column where the token started
-     * @param literalValue Optional literal value (for integers, bools, strings)
-     * @return The constructed Token
+     * @param value Type-dependent payload (see CompactToken)
+     * @return The constructed token
+     */
+    CompactToken makeToken(TokenType type, int startLine, int startColumn, uint32_t value = 0);
+
+    /**
+     * @brief Constructs a string token whose literal text is source[textStart..+textLength).
      */
-    Token
-    makeToken(TokenType type, int startLine, int startColumn,
-              std::variant<std::monostate, int, bool, std::string> literalValue = std::monostate{});
+    CompactToken makeStringToken(TokenType type, int startLine, int startColumn, int textStart,
+                                 int textLength);
 
     /**
      * @brief Creates an error token with a diagnostic message.
      *
-     * Extracts the problematic lexeme and creates an ERROR token containing
-     * the error message as its value.
+     * The problematic lexeme is the current one; the message must be a string
+     * literal, since the token stream only keeps a view of it.
      *
      * @param message Description of the error
      * @param startLine Line where the error occurred
      * @param startColumn Column where the error occurred
-     * @return An ERROR token with the message as its value
+     * @return An ERROR token carrying the message
+     */
+    CompactToken makeErrorToken(const char* message, int startLine, int startColumn);
+
+    /**
+     * @brief scanToken() without conversion to an owning Token.
      */
-    Token makeErrorToken(std::string message, int startLine, int startColumn);
+    CompactToken scanCompactToken();
 
     /**
      * @brief Checks if the current position starts a multiline string.
@@ -285,12 +335,69 @@ class Lexer
      */
     Lexer(std::string source);
 
+    /// Tokens point into this lexer's own copy of the source.
+    Lexer(const Lexer&) = delete;
+    Lexer& operator=(const Lexer&) = delete;
+
+    /**
+     * @brief Keep scanning after errors, up to `limit` ERROR tokens.
+     *
+     * By default the stream ends at the first ERROR token. With a higher
+     * limit the lexer recovers after each one, so a single pass reports the
+     * lexical errors of a whole file; the stream then ends at EOF, or at the
+     * ERROR token that reaches the limit.
+     *
+     * @param limit At least 1
+     */
+    void setErrorLimit(size_t limit)
+    {
+        errorLimit = limit == 0 ? 1 : limit;
+    }
+
+    size_t getErrorLimit() const
+    {
+        return errorLimit;
+    }
+
+    /**
+     * @brief Scans the entire source into a compact token stream.
+     *
+     * Same tokens as scanTokens(), but stored as offsets into the source
+     * buffer with interned identifiers, so no per-token allocation happens.
+     * The stream is owned by the lexer and stays valid for its lifetime.
+     *
+     * @return The token stream, ending with an EOF token or the last ERROR
+     *         token allowed by setErrorLimit().
+     */
+    const TokenStream& scanStream();
+
+    /**
+     * @brief Scans the next significant token for a parser that pulls tokens.
+     *
+     * Whitespace and comments are skipped. The token is not stored; its text
+     * stays reachable through getStream(), which in this mode keeps only the
+     * identifier table and error messages.
+     *
+     * @return The next token; EOF_TOKEN once the source is exhausted. Nothing
+     *         may be asked for after the ERROR token that reaches the limit.
+     */
+    CompactToken nextToken();
+
+    /**
+     * @brief The stream that token text, identifiers and messages resolve against.
+     */
+    const TokenStream& getStream() const
+    {
+        return stream;
+    }
+
     /**
      * @brief Scans the entire source and produces a list of Tokens.
      *
      * This is the main entry point for the lexer. It repeatedly invokes
      * the internal scanning routines until the end of the input is reached,
-     * then appends an EOF token.
+     * then appends an EOF token. Tokens are expanded from scanStream() into
+     * owning Token objects.
      *
      * @return A vector containing the full token stream.
      */
@@ -318,24 +425,4 @@ class Lexer
      * @return A Token representing the next meaningful unit in the source.
      */
     Token scanToken();
-
-    /**
-     * @brief Mapping of language keywords to their corresponding token types.
-     *
-     * During identifier scanning, the lexer must determine whether a scanned
-     * lexeme is a user-defined identifier or a reserved keyword with special
-     * syntactic meaning. All reserved words of the Ambra language are stored
-     * in this table, allowing the lexer to perform an O(1) lookup after
-     * scanning an identifier.
-     *
-     * When an identifier lexeme matches an entry in this table, the lexer
-     * emits the associated keyword TokenType instead of IDENTIFIER. Boolean
-     * keywords ("affirmative" and "negative") are also included here and are
-     * handled specially by the identifier-scanning routine to produce BOOL
-     * literal tokens with the appropriate boolean value.
-     *
-     * This table is initialized once (typically in the constructor) and is
-     * treated as read-only throughout lexing.
-     */
-    static std::unordered_map<std::string, TokenType> keywordMap;
 };
\ No newline at end of file
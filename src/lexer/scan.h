@@ -0,0 +1,187 @@
+/**
+ * @file scan.h
+ * @brief Block-at-a-time byte scanning helpers for the lexer
+ *
+ * The lexer spends most of its time in long runs that contain nothing of
+ * interest: whitespace between tokens, the bodies of string literals and the
+ * text of comments. These helpers find the end of such a run 16 bytes at a
+ * time using SSE2 (always available on x86-64) or NEON, and fall back to a
+ * plain loop elsewhere and for the tail of the buffer.
+ *
+ * All functions take a pointer/size pair and return an offset from `data`;
+ * "not found" is reported as `size`.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define AMBRA_SCAN_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define AMBRA_SCAN_NEON 1
+#endif
+
+static constexpr size_t SCAN_BLOCK = 16;
+
+inline int scanPopcount(uint32_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcount(bits);
+#else
+    int count = 0;
+    for (; bits != 0; bits &= bits - 1)
+    {
+        count++;
+    }
+    return count;
+#endif
+}
+
+inline int scanCountTrailingZeros(uint32_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(bits);
+#else
+    int count = 0;
+    for (; (bits & 1) == 0; bits >>= 1)
+    {
+        count++;
+    }
+    return count;
+#endif
+}
+
+#if AMBRA_SCAN_SSE2
+using ScanBlock = __m128i;
+
+inline ScanBlock scanLoad(const char* p)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+inline ScanBlock scanEqual(ScanBlock block, char c)
+{
+    return _mm_cmpeq_epi8(block, _mm_set1_epi8(c));
+}
+
+inline ScanBlock scanEither(ScanBlock a, ScanBlock b)
+{
+    return _mm_or_si128(a, b);
+}
+
+/** @brief One bit per byte lane that compared equal */
+inline uint32_t scanBits(ScanBlock mask)
+{
+    return static_cast<uint32_t>(_mm_movemask_epi8(mask));
+}
+#elif AMBRA_SCAN_NEON
+using ScanBlock = uint8x16_t;
+
+inline ScanBlock scanLoad(const char* p)
+{
+    return vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+}
+
+inline ScanBlock scanEqual(ScanBlock block, char c)
+{
+    return vceqq_u8(block, vdupq_n_u8(static_cast<uint8_t>(c)));
+}
+
+inline ScanBlock scanEither(ScanBlock a, ScanBlock b)
+{
+    return vorrq_u8(a, b);
+}
+
+/** @brief One bit per byte lane that compared equal */
+inline uint32_t scanBits(ScanBlock mask)
+{
+    // NEON has no movemask: weight each lane by its bit and add up each half.
+    static const uint8_t weights[16] = {1, 2, 4, 8, 16, 32, 64, 128,
+                                        1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t           masked = vandq_u8(mask, vld1q_u8(weights));
+    uint32_t             low = vaddv_u8(vget_low_u8(masked));
+    uint32_t             high = vaddv_u8(vget_high_u8(masked));
+    return low | (high << 8);
+}
+#endif
+
+/**
+ * @brief Offset of the first byte equal to `a`, `b` or `c`
+ *
+ * Pass the same character more than once to search for fewer.
+ */
+inline size_t scanFindAny(const char* data, size_t size, char a, char b, char c)
+{
+    size_t i = 0;
+#if AMBRA_SCAN_SSE2 || AMBRA_SCAN_NEON
+    for (; i + SCAN_BLOCK <= size; i += SCAN_BLOCK)
+    {
+        ScanBlock block = scanLoad(data + i);
+        ScanBlock match =
+            scanEither(scanEither(scanEqual(block, a), scanEqual(block, b)), scanEqual(block, c));
+        uint32_t  hits = scanBits(match);
+        if (hits != 0)
+        {
+            return i + scanCountTrailingZeros(hits);
+        }
+    }
+#endif
+    for (; i < size; i++)
+    {
+        if (data[i] == a || data[i] == b || data[i] == c)
+        {
+            return i;
+        }
+    }
+    return size;
+}
+
+/** @brief Offset of the first byte that is not a space, tab, carriage return or newline */
+inline size_t scanSkipWhitespace(const char* data, size_t size)
+{
+    size_t i = 0;
+#if AMBRA_SCAN_SSE2 || AMBRA_SCAN_NEON
+    for (; i + SCAN_BLOCK <= size; i += SCAN_BLOCK)
+    {
+        ScanBlock block = scanLoad(data + i);
+        ScanBlock space = scanEither(scanEither(scanEqual(block, ' '), scanEqual(block, '\t')),
+                                     scanEither(scanEqual(block, '\r'), scanEqual(block, '\n')));
+        uint32_t  other = ~scanBits(space) & 0xFFFFu;
+        if (other != 0)
+        {
+            return i + scanCountTrailingZeros(other);
+        }
+    }
+#endif
+    for (; i < size; i++)
+    {
+        char c = data[i];
+        if (c != ' ' && c != '\t' && c != '\r' && c != '\n')
+        {
+            return i;
+        }
+    }
+    return size;
+}
+
+/** @brief Number of '\n' bytes in the range */
+inline size_t scanCountNewlines(const char* data, size_t size)
+{
+    size_t count = 0;
+    size_t i = 0;
+#if AMBRA_SCAN_SSE2 || AMBRA_SCAN_NEON
+    for (; i + SCAN_BLOCK <= size; i += SCAN_BLOCK)
+    {
+        count += scanPopcount(scanBits(scanEqual(scanLoad(data + i), '\n')));
+    }
+#endif
+    for (; i < size; i++)
+    {
+        count += data[i] == '\n';
+    }
+    return count;
+}
@@ -1,3 +1,5 @@
+#pragma once
+
 #include <string>
 #include <variant>
 
@@ -39,6 +41,8 @@ enum TokenType
     ASLONGAS,  ///< Loop (while) keyword
     SAY,       ///< Print statement keyword
     NOT,       ///< Logical negation keyword
+    AND,       ///< Logical conjunction keyword
+    OR,        ///< Logical disjunction keyword
 
     // Operators
     PLUS,          ///< Addition operator (+)
@@ -0,0 +1,117 @@
+/**
+ * @file token_stream.cpp
+ * @brief Implementation of the compact token stream.
+ */
+
+#include "token_stream.h"
+
+#include <utility>
+
+IdentifierId TokenStream::intern(std::string_view name)
+{
+    auto [it, inserted] =
+        identifierIds.emplace(name, static_cast<IdentifierId>(identifierNames.size()));
+    if (inserted)
+    {
+        identifierNames.push_back(name);
+    }
+    return it->second;
+}
+
+uint32_t TokenStream::addMessage(std::string_view message)
+{
+    messages.push_back(message);
+    return static_cast<uint32_t>(messages.size() - 1);
+}
+
+Token TokenStream::expand(const CompactToken& token) const
+{
+    std::variant<std::monostate, int, bool, std::string> value;
+    switch (token.type)
+    {
+    case INTEGER:
+        value = intValue(token);
+        break;
+    case BOOL:
+        value = boolValue(token);
+        break;
+    case STRING:
+    case MULTILINE_STRING:
+    case ERROR:
+        value = std::string(text(token));
+        break;
+    default:
+        break;
+    }
+    return Token(std::string(lexeme(token)), token.type, std::move(value), token.line,
+                 token.column);
+}
+
+TokenStream TokenStream::fromTokens(const std::vector<Token>& tokens)
+{
+    TokenStream stream;
+    auto        text = std::make_unique<std::string>();
+
+    // Lay the text out first; views can only be taken once the buffer stops growing.
+    struct Pending
+    {
+        uint32_t offset;
+        uint32_t length;
+    };
+    std::vector<Pending> values;
+    values.reserve(tokens.size());
+
+    for (const Token& token : tokens)
+    {
+        std::string  lexeme = token.getLexeme();
+        CompactToken compact{token.getType(), static_cast<uint32_t>(text->size()),
+                             static_cast<uint32_t>(lexeme.size()), token.getLocation().line,
+                             token.getLocation().column};
+        text->append(lexeme);
+
+        Pending pending{0, 0};
+        auto    value = token.getValue();
+        if (std::holds_alternative<int>(value))
+        {
+            compact.value = static_cast<uint32_t>(std::get<int>(value));
+        }
+        else if (std::holds_alternative<bool>(value))
+        {
+            compact.value = std::get<bool>(value) ? 1 : 0;
+        }
+        else if (std::holds_alternative<std::string>(value))
+        {
+            const std::string& s = std::get<std::string>(value);
+            pending = {static_cast<uint32_t>(text->size()), static_cast<uint32_t>(s.size())};
+            text->append(s);
+        }
+        values.push_back(pending);
+        stream.tokens.push_back(compact);
+    }
+
+    stream.storage = std::move(text);
+    stream.source = *stream.storage;
+
+    for (size_t i = 0; i < stream.tokens.size(); i++)
+    {
+        CompactToken& token = stream.tokens[i];
+        switch (token.type)
+        {
+        case IDENTIFIER:
+            token.value = stream.intern(stream.lexeme(token));
+            break;
+        case STRING:
+        case MULTILINE_STRING:
+            token.value = values[i].offset;
+            token.valueLength = values[i].length;
+            break;
+        case ERROR:
+            token.value =
+                stream.addMessage(stream.source.substr(values[i].offset, values[i].length));
+            break;
+        default:
+            break;
+        }
+    }
+    return stream;
+}
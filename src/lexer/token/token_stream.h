@@ -0,0 +1,180 @@
+/**
+ * @file token_stream.h
+ * @brief Compact, allocation-free token representation
+ *
+ * A CompactToken does not own any text. Its lexeme is an offset and length
+ * into the source buffer of the TokenStream it belongs to; string literal
+ * contents are a second range into the same buffer, and identifiers carry an
+ * id interned in the stream's identifier table. Scanning a file therefore
+ * performs no per-token heap allocation: the only growth is the token vector
+ * itself, the identifier table (once per distinct name) and error messages.
+ *
+ * A stream produced by Lexer::scanStream() views the lexer's source, so the
+ * lexer must outlive it. Streams built from owning Tokens with fromTokens()
+ * carry their own copy of the text.
+ */
+
+#pragma once
+
+#include "token.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Index of a distinct identifier name within a TokenStream
+ */
+using IdentifierId = uint32_t;
+
+/**
+ * @brief A token stored as ranges into its stream's source buffer
+ *
+ * The meaning of `value` depends on the type:
+ * - INTEGER: the value, as the bits of an int32_t
+ * - BOOL: 1 for affirmative, 0 for negative
+ * - IDENTIFIER: the IdentifierId of the name
+ * - STRING / MULTILINE_STRING: offset of the literal text (length in valueLength)
+ * - ERROR: index of the message in the stream
+ */
+struct CompactToken
+{
+    TokenType type;
+    uint32_t  offset;          ///< Start of the lexeme in the source buffer
+    uint32_t  length;          ///< Length of the lexeme
+    int       line;            ///< Line number (1-indexed)
+    int       column;          ///< Column number (1-indexed)
+    uint32_t  value = 0;       ///< Type-dependent payload (see above)
+    uint32_t  valueLength = 0; ///< Length of the literal text of string tokens
+
+    TokenType getType() const
+    {
+        return type;
+    }
+
+    SourceLocation getLocation() const
+    {
+        return {line, column};
+    }
+};
+
+/**
+ * @brief A sequence of CompactTokens together with the text they refer to
+ */
+class TokenStream
+{
+  public:
+    TokenStream() = default;
+
+    /**
+     * @brief Create an empty stream over an existing source buffer
+     * @param source Text the tokens will point into (must outlive the stream)
+     */
+    explicit TokenStream(std::string_view source) : source(source) {};
+
+    /**
+     * @brief Build a stream from owning tokens
+     *
+     * Used for token lists constructed by hand; the lexemes and literal values
+     * are copied into a buffer owned by the stream.
+     */
+    static TokenStream fromTokens(const std::vector<Token>& tokens);
+
+    size_t size() const
+    {
+        return tokens.size();
+    }
+
+    bool empty() const
+    {
+        return tokens.empty();
+    }
+
+    const CompactToken& operator[](size_t index) const
+    {
+        return tokens[index];
+    }
+
+    const CompactToken& back() const
+    {
+        return tokens.back();
+    }
+
+    /** @brief Text the tokens point into: the scanned source, or the copy made by fromTokens() */
+    std::string_view getSource() const
+    {
+        return source;
+    }
+
+    /** @brief Raw source text of a token */
+    std::string_view lexeme(const CompactToken& token) const
+    {
+        return source.substr(token.offset, token.length);
+    }
+
+    /** @brief Value of an INTEGER token */
+    int intValue(const CompactToken& token) const
+    {
+        return static_cast<int32_t>(token.value);
+    }
+
+    /** @brief Value of a BOOL token */
+    bool boolValue(const CompactToken& token) const
+    {
+        return token.value != 0;
+    }
+
+    /** @brief Literal text of a STRING / MULTILINE_STRING token, or the message of an ERROR */
+    std::string_view text(const CompactToken& token) const
+    {
+        if (token.type == ERROR)
+        {
+            return messages[token.value];
+        }
+        return source.substr(token.value, token.valueLength);
+    }
+
+    /** @brief Name of an interned identifier */
+    std::string_view identifierName(IdentifierId id) const
+    {
+        return identifierNames[id];
+    }
+
+    /** @brief Number of distinct identifier names seen so far */
+    size_t identifierCount() const
+    {
+        return identifierNames.size();
+    }
+
+    /** @brief Convert a token to the owning Token representation */
+    Token expand(const CompactToken& token) const;
+
+    /** @brief Append a token */
+    void push(const CompactToken& token)
+    {
+        tokens.push_back(token);
+    }
+
+    /**
+     * @brief Return the id of `name`, assigning the next one if it is new
+     * @param name Text inside the stream's source buffer
+     */
+    IdentifierId intern(std::string_view name);
+
+    /**
+     * @brief Record an error message and return its index
+     * @param message Text with static storage duration (or inside the source buffer)
+     */
+    uint32_t addMessage(std::string_view message);
+
+  private:
+    std::unique_ptr<const std::string>                 storage;         ///< Owned text, if any
+    std::string_view                                   source;          ///< Text tokens point into
+    std::vector<CompactToken>                          tokens;          ///< The tokens, in order
+    std::unordered_map<std::string_view, IdentifierId> identifierIds;   ///< Name to id
+    std::vector<std::string_view>                      identifierNames; ///< Id to name
+    std::vector<std::string_view>                      messages;        ///< ERROR token messages
+};
@@ -11,34 +11,55 @@
 #include <utility>
 #include <vector>
 
-Token Parser::peek()
+const CompactToken& Parser::tokenAt(size_t index)
 {
-    // Returns the current token without consuming it.
-    // returns EOF token if current is out of bounds.
-    if (current >= tokens.size())
+    if (lexer == nullptr)
+    {
+        return index < tokens.size() ? tokens[index] : tokens.back();
+    }
+
+    while (pulled <= index)
     {
-        return tokens.back();
+        // The stream ends at EOF, or at the ERROR token that reaches the
+        // lexer's error limit, as in scanStream().
+        if (pulled > 0)
+        {
+            const CompactToken& last = window[(pulled - 1) % LOOKAHEAD];
+            if (last.type == EOF_TOKEN ||
+                (last.type == ERROR && pulledErrors >= lexer->getErrorLimit()))
+            {
+                return last;
+            }
+        }
+        CompactToken& token = window[pulled % LOOKAHEAD];
+        token = lexer->nextToken();
+        pulled++;
+        if (token.type == ERROR)
+        {
+            pulledErrors++;
+        }
     }
-    return tokens[current];
+    return window[index % LOOKAHEAD];
 }
 
-Token Parser::peekAhead(int pos)
+CompactToken Parser::peek()
 {
-    size_t index = current + pos;
+    // Returns the current token without consuming it.
+    // returns EOF token if current is out of bounds.
+    return tokenAt(current);
+}
 
-    if (index >= tokens.size())
-    {
-        // return the EOF token
-        return tokens.back();
-    }
-    return tokens[index];
+CompactToken Parser::peekAhead(int pos)
+{
+    // Returns the EOF token if current + pos is out of bounds.
+    return tokenAt(current + pos);
 }
 
-Token Parser::previous()
+CompactToken Parser::previous()
 {
     // Returns the previously consumed token.
     // Assumes at least one token has been consumed (current > 0).
-    return tokens[current - 1];
+    return tokenAt(current - 1);
 }
 
 bool Parser::isAtEnd()
@@ -47,10 +68,29 @@ bool Parser::isAtEnd()
     return peek().getType() == EOF_TOKEN;
 }
 
-Token Parser::advance()
+bool Parser::atEndOfInput()
+{
+    CompactToken token = peek();
+    if (token.type == EOF_TOKEN)
+    {
+        return true;
+    }
+    if (token.type != ERROR)
+    {
+        return false;
+    }
+    // In pull mode the lexer is never asked for anything past its last ERROR.
+    if (lexer != nullptr)
+    {
+        return current + 1 >= pulled && pulledErrors >= lexer->getErrorLimit();
+    }
+    return current + 1 >= tokens.size();
+}
+
+CompactToken Parser::advance()
 {
     // Consumes the current token and advances the cursor.
-    auto token = tokens[current];
+    auto token = tokenAt(current);
     current += 1;
     return token;
 }
@@ -82,7 +122,7 @@ bool Parser::match(TokenType t)
 // Error reporting responsibility: called when a token of expected type is required.
 // On failure, reports an error and does not consume the token.
 // The returned token should not be used if hadError() is true.
-Token Parser::consume(TokenType t, const std::string& msg)
+CompactToken Parser::consume(TokenType t, const std::string& msg)
 {
     if (check(t))
     {
@@ -93,11 +133,61 @@ Token Parser::consume(TokenType t, const std::string& msg)
     return peek();
 }
 
-// Records a parse error at the given token location.
-// Intended to be called exactly once per detected error.
-void Parser::reportError(const Token& where, const std::string& msg)
+// Records a parse error at the given token location. Errors that follow
+// from one already reported, until the next statement boundary, are dropped.
+void Parser::reportError(const CompactToken& where, const std::string& msg)
 {
     hasError = true;
+    bool lexical = where.type == ERROR;
+    if (gaveUp || (panicking && !lexical))
+    {
+        return;
+    }
+    panicking = true;
+
+    ParseDiagnostic diagnostic{lexical ? std::string(tokens.text(where)) : msg,
+                               {where.line, where.column}};
+    // Unwinding out of nested constructs can hit the same spot twice.
+    if (!diagnostics.empty() && diagnostics.back().loc == diagnostic.loc &&
+        diagnostics.back().message == diagnostic.message)
+    {
+        return;
+    }
+    diagnostics.push_back(std::move(diagnostic));
+    if (diagnostics.size() >= errorLimit)
+    {
+        diagnostics.push_back({"Too many errors; stopping", diagnostics.back().loc});
+        gaveUp = true;
+    }
+}
+
+void Parser::synchronize()
+{
+    while (!atEndOfInput() && !gaveUp)
+    {
+        switch (peek().type)
+        {
+        case SEMI_COLON:
+            advance();
+            panicking = false;
+            return;
+        case LEFT_BRACE:
+        case RIGHT_BRACE:
+        case SUMMON:
+        case SAY:
+        case SHOULD:
+        case ASLONGAS:
+            panicking = false;
+            return;
+        case ERROR:
+            reportError(peek(), "");
+            break;
+        default:
+            break;
+        }
+        advance();
+    }
+    panicking = false;
 }
 
 bool Parser::hadError()
@@ -110,7 +200,7 @@ bool Parser::hadError()
 std::unique_ptr<Expr> Parser::parsePrimary()
 {
 
-    Token          token = peek();
+    CompactToken   token = peek();
     SourceLocation loc = token.getLocation();
 
     switch (token.getType())
@@ -118,19 +208,19 @@ std::unique_ptr<Expr> Parser::parsePrimary()
     case INTEGER:
     {
         advance();
-        int value = std::get<int>(token.getValue());
+        int value = tokens.intValue(token);
         return std::make_unique<IntLiteralExpr>(value, loc.line, loc.column);
     }
     case BOOL:
     {
         advance();
-        bool value = std::get<bool>(token.getValue());
+        bool value = tokens.boolValue(token);
         return std::make_unique<BoolLiteralExpr>(value, loc.line, loc.column);
     }
     case IDENTIFIER:
     {
         advance();
-        std::string name = token.getLexeme();
+        std::string name(tokens.lexeme(token));
         return std::make_unique<IdentifierExpr>(name, loc.line, loc.column);
     }
     case LEFT_PAREN:
@@ -177,18 +267,18 @@ std::unique_ptr<Expr> Parser::parsePrimary()
         std::vector<StringPart> parts;
 
         // Consume initial string token
-        Token          strToken = advance();
+        CompactToken   strToken = advance();
         SourceLocation loc = strToken.getLocation();
 
         StringPart textPart;
         textPart.kind = StringPart::TEXT;
-        textPart.text = std::get<std::string>(strToken.getValue());
+        textPart.text = tokens.text(strToken);
         parts.push_back(std::move(textPart));
 
         // Handle interpolations
         while (peek().getType() == INTERP_START)
         {
-            Token interpStart = advance(); // consume '{'
+            CompactToken interpStart = advance(); // consume '{'
 
             TokenType type = peek().getType();
 
@@ -205,7 +295,9 @@ std::unique_ptr<Expr> Parser::parsePrimary()
 
             if (peek().getType() != INTERP_END)
             {
-                reportError(interpStart, "Unterminated interpolation");
+                // A lexical error cut the expression short; the lexer has reported why.
+                reportError(peek().getType() == ERROR ? peek() : interpStart,
+                            "Unterminated interpolation");
                 return nullptr;
             }
 
@@ -223,11 +315,11 @@ std::unique_ptr<Expr> Parser::parsePrimary()
                 return nullptr;
             }
 
-            Token nextStr = advance();
+            CompactToken nextStr = advance();
 
             StringPart nextText;
             nextText.kind = StringPart::TEXT;
-            nextText.text = std::get<std::string>(nextStr.getValue());
+            nextText.text = tokens.text(nextStr);
             parts.push_back(std::move(nextText));
         }
 
@@ -245,8 +337,8 @@ std::unique_ptr<Expr> Parser::parseUnary()
 {
     if (match(NOT) || match(MINUS))
     {
-        Token op = previous();
-        auto  loc = op.getLocation();
+        CompactToken op = previous();
+        auto         loc = op.getLocation();
 
         auto operand = parseUnary();
         if (!operand)
@@ -271,7 +363,7 @@ std::unique_ptr<Expr> Parser::parseMultiplication()
 
     while (check(STAR) || check(SLASH))
     {
-        Token                 op = advance();
+        CompactToken          op = advance();
         SourceLocation        loc = op.getLocation();
         std::unique_ptr<Expr> right = parseUnary();
         if (!right)
@@ -300,7 +392,7 @@ std::unique_ptr<Expr> Parser::parseAddition()
 
     while (check(PLUS) || check(MINUS))
     {
-        Token                 op = advance();
+        CompactToken          op = advance();
         SourceLocation        loc = op.getLocation();
         std::unique_ptr<Expr> right = parseMultiplication();
         if (!right)
@@ -329,7 +421,7 @@ std::unique_ptr<Expr> Parser::parseComparison()
 
     while (check(LESS) || check(LESS_EQUAL) || check(GREATER) || check(GREATER_EQUAL))
     {
-        Token                 op = advance();
+        CompactToken          op = advance();
         SourceLocation        loc = op.getLocation();
         std::unique_ptr<Expr> right = parseAddition();
         if (!right)
@@ -379,7 +471,7 @@ std::unique_ptr<Expr> Parser::parseEquality()
     std::unique_ptr<Expr> left = parseComparison();
     while (check(EQUAL_EQUAL) || check(BANG_EQUAL))
     {
-        Token          op = advance();
+        CompactToken   op = advance();
         SourceLocation loc = op.getLocation();
 
         std::unique_ptr<Expr> right = parseComparison();
@@ -403,16 +495,56 @@ std::unique_ptr<Expr> Parser::parseEquality()
     return left;
 }
 
+// Parses conjunctions: `and` binds tighter than `or`, looser than equality.
+// Returns nullptr on failure.
+std::unique_ptr<Expr> Parser::parseAnd()
+{
+    std::unique_ptr<Expr> left = parseEquality();
+    while (check(AND))
+    {
+        CompactToken          op = advance();
+        SourceLocation        loc = op.getLocation();
+        std::unique_ptr<Expr> right = parseEquality();
+        if (!right)
+        {
+            return nullptr;
+        }
+        left = std::make_unique<BinaryExpr>(std::move(left), LogicalAnd, std::move(right),
+                                            loc.line, loc.column);
+    }
+    return left;
+}
+
+// Parses disjunctions, the loosest binary level.
+// Returns nullptr on failure.
+std::unique_ptr<Expr> Parser::parseOr()
+{
+    std::unique_ptr<Expr> left = parseAnd();
+    while (check(OR))
+    {
+        CompactToken          op = advance();
+        SourceLocation        loc = op.getLocation();
+        std::unique_ptr<Expr> right = parseAnd();
+        if (!right)
+        {
+            return nullptr;
+        }
+        left = std::make_unique<BinaryExpr>(std::move(left), LogicalOr, std::move(right),
+                                            loc.line, loc.column);
+    }
+    return left;
+}
+
 // Top-level expression parsing entry point.
 // Returns nullptr on failure.
 std::unique_ptr<Expr> Parser::parseExpression()
 {
-    return parseEquality();
+    return parseOr();
 }
 
 std::unique_ptr<Stmt> Parser::parseSayStatement()
 {
-    Token          sayToken = advance();
+    CompactToken   sayToken = advance();
     SourceLocation loc = sayToken.getLocation();
 
     TokenType type = peek().getType();
@@ -445,7 +577,7 @@ std::unique_ptr<Stmt> Parser::parseSayStatement()
 
 std::unique_ptr<Stmt> Parser::parseSummonStatement()
 {
-    Token          summonToken = advance();
+    CompactToken   summonToken = advance();
     SourceLocation loc = summonToken.getLocation();
 
     // expect identifier
@@ -455,7 +587,7 @@ std::unique_ptr<Stmt> Parser::parseSummonStatement()
         return nullptr;
     }
 
-    Token          nameToken = advance();
+    CompactToken   nameToken = advance();
     SourceLocation nameTokenLoc = nameToken.getLocation();
 
     // expect '='
@@ -491,24 +623,25 @@ std::unique_ptr<Stmt> Parser::parseSummonStatement()
         return nullptr;
     }
 
-    return std::make_unique<SummonStmt>(std::make_unique<IdentifierExpr>(nameToken.getLexeme(),
-                                                                         nameTokenLoc.line,
-                                                                         nameTokenLoc.column),
-                                        std::move(initializer), loc.line, loc.column);
+    std::string name(tokens.lexeme(nameToken));
+    return std::make_unique<SummonStmt>(
+        std::make_unique<IdentifierExpr>(name, nameTokenLoc.line, nameTokenLoc.column),
+        std::move(initializer), loc.line, loc.column);
 }
 
 std::unique_ptr<Stmt> Parser::parseBlockStatement()
 {
 
-    Token          leftBraceToken = advance();
+    CompactToken   leftBraceToken = advance();
     SourceLocation loc = leftBraceToken.getLocation();
 
     std::vector<std::unique_ptr<Stmt>> statements;
+    bool                               failed = false;
 
     while (peek().getType() != RIGHT_BRACE)
     {
 
-        if (peek().getType() == EOF_TOKEN)
+        if (atEndOfInput())
         {
             reportError(peek(), "Expected } to close block");
             return nullptr;
@@ -516,7 +649,15 @@ std::unique_ptr<Stmt> Parser::parseBlockStatement()
         std::unique_ptr<Stmt> statement = parseStatement();
         if (!statement)
         {
-            return nullptr;
+            // Report the rest of the block too. It still fails as a whole, but
+            // only after its `}`, where whatever follows can be parsed.
+            if (gaveUp)
+            {
+                return nullptr;
+            }
+            failed = true;
+            synchronize();
+            continue;
         }
         statements.push_back(std::move(statement));
     }
@@ -525,6 +666,10 @@ std::unique_ptr<Stmt> Parser::parseBlockStatement()
         reportError(peek(), "Expected } to close block");
         return nullptr;
     }
+    if (failed)
+    {
+        return nullptr;
+    }
     return std::make_unique<BlockStmt>(std::move(statements), loc.line, loc.column);
 }
 
@@ -571,7 +716,7 @@ std::tuple<std::unique_ptr<Expr>, std::unique_ptr<BlockStmt>> Parser::parseCondi
 std::unique_ptr<Stmt> Parser::parseIfChainStatement()
 {
     // Consume 'should'
-    Token          shouldToken = advance();
+    CompactToken   shouldToken = advance();
     SourceLocation loc = shouldToken.getLocation();
 
     std::vector<std::tuple<std::unique_ptr<Expr>, std::unique_ptr<BlockStmt>>> branches;
@@ -634,7 +779,7 @@ std::unique_ptr<Stmt> Parser::parseIfChainStatement()
 
 std::unique_ptr<Stmt> Parser::parseWhileStatement()
 {
-    Token          aslongasToken = advance();
+    CompactToken   aslongasToken = advance();
     SourceLocation loc = aslongasToken.getLocation();
 
     auto [condition, block] = parseConditionAndBlock();
@@ -650,7 +795,7 @@ std::unique_ptr<Stmt> Parser::parseWhileStatement()
 
 std::unique_ptr<Stmt> Parser::parseStatement()
 {
-    Token token = peek();
+    CompactToken token = peek();
 
     switch (token.getType())
     {
@@ -682,49 +827,44 @@ std::unique_ptr<Stmt> Parser::parseStatement()
 
 Program Parser::parseProgram()
 {
+    // Every node created below is carved out of this arena, and packs its
+    // location as an offset into the lines of the source.
+    auto arena = std::make_unique<AstArena>();
+    arena->setLines(SourceLines(tokens.getSource()));
+    AstArena::Scope arenaScope(*arena);
+
     std::vector<std::unique_ptr<Stmt>> statements;
 
     // Program start location = first token (may be EOF for empty file)
-    Token     firstToken = peek();
-    SourceLoc startLoc{firstToken.getLocation().line, firstToken.getLocation().column};
+    CompactToken firstToken = peek();
+    SourceLoc    startLoc{firstToken.getLocation().line, firstToken.getLocation().column};
 
-    while (!check(EOF_TOKEN))
+    while (!atEndOfInput() && !gaveUp)
     {
+        size_t                start = current;
         std::unique_ptr<Stmt> stmt = parseStatement();
 
         if (stmt)
         {
             statements.push_back(std::move(stmt));
+            continue;
         }
-        else
+        synchronize();
+        // A stray `}` closes nothing at the top level, and any statement
+        // start that failed without consuming anything would fail again.
+        if (current == start && !atEndOfInput())
         {
-            // Skip tokens until we reach a statement boundary
-            while (!check(EOF_TOKEN) && !check(SEMI_COLON) && !check(LEFT_BRACE) &&
-                   !check(RIGHT_BRACE))
-            {
-                advance();
-            }
-
-            if (match(SEMI_COLON))
-            {
-                continue;
-            }
-
-            if (match(RIGHT_BRACE))
-            {
-                continue;
-            }
-
-            if (check(EOF_TOKEN))
-            {
-                break;
-            }
+            advance();
         }
     }
+    if (!gaveUp && peek().type == ERROR)
+    {
+        reportError(peek(), "");
+    }
 
     // Program end location = EOF token
-    Token     lastToken = peek();
-    SourceLoc endLoc{lastToken.getLocation().line, lastToken.getLocation().column};
+    CompactToken lastToken = peek();
+    SourceLoc    endLoc{lastToken.getLocation().line, lastToken.getLocation().column};
 
-    return Program(std::move(statements), hasError, startLoc, endLoc);
+    return Program(std::move(statements), hasError, startLoc, endLoc, std::move(arena));
 }
\ No newline at end of file
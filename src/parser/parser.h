@@ -11,26 +11,66 @@
 #include "ast/prog.h"
 #include "ast/stmt.h"
 #include "lexer/lexer.h"
+#include "lexer/token/token_stream.h"
 
+#include <cstddef>
 #include <memory>
 #include <string>
 #include <vector>
 
+/** @brief A lexical or syntax error found while parsing */
+struct ParseDiagnostic
+{
+    std::string message;
+    SourceLoc   loc;
+};
+
 /**
  * @brief Parses tokens into expression ASTs.
  *
  * Construct a Parser with a vector of tokens (usually produced by the lexer),
  * then call `parseExpression()` to obtain the parsed AST. Errors encountered
- * during parsing are recorded; `hadError()` reports whether an error occurred.
+ * during parsing are recorded; `hadError()` reports whether an error occurred
+ * and `getDiagnostics()` lists them.
+ *
+ * After an error the parser skips ahead to the next statement boundary (panic
+ * mode) and carries on, inside blocks as well as at the top level, so one
+ * parse reports the errors of the whole file. Errors that only follow from
+ * the first one, before the boundary is reached, are not reported. Parsing
+ * stops once the error limit is reached.
  */
 class Parser
 {
   public:
     /**
      * @brief Construct a parser over an existing token sequence.
-     * @param tokens Reference to the token vector to parse (must outlive parser)
+     * @param tokens Token vector to parse; copied into a compact stream
+     */
+    Parser(const std::vector<Token>& tokens)
+        : ownedTokens(TokenStream::fromTokens(tokens)), tokens(ownedTokens), current(0),
+          hasError(false) {};
+
+    /**
+     * @brief Construct a parser over a compact token stream.
+     * @param tokens Stream from Lexer::scanStream() (must outlive parser)
      */
-    Parser(const std::vector<Token>& tokens) : tokens(tokens), current(0), hasError(false) {};
+    Parser(const TokenStream& tokens) : tokens(tokens), current(0), hasError(false) {};
+
+    /**
+     * @brief Construct a parser that pulls tokens from a lexer on demand.
+     *
+     * No token list is built: tokens are scanned as the parser reaches them
+     * and only the last LOOKAHEAD of them are kept, so memory for tokens does
+     * not grow with the size of the file.
+     *
+     * @param lexer Lexer positioned at the start of its source (must outlive parser)
+     */
+    explicit Parser(Lexer& lexer)
+        : tokens(lexer.getStream()), lexer(&lexer), current(0), hasError(false) {};
+
+    /// `tokens` may refer to the parser's own storage.
+    Parser(const Parser&) = delete;
+    Parser& operator=(const Parser&) = delete;
 
     /**
      * @brief Parse the next full expression from the token stream.
@@ -58,6 +98,7 @@ class Parser
      *
      * This is the main entry point for parsing a complete program. It parses all
      * statements until EOF is reached, collecting them into a Program object.
+     * All nodes are allocated from an AstArena that the Program takes over.
      *
      * @return Program containing all parsed statements and error status
      */
@@ -70,10 +111,59 @@ class Parser
      */
     bool hadError();
 
+    /** @brief Errors reported when no limit is set */
+    static constexpr size_t DEFAULT_ERROR_LIMIT = 100;
+
+    /**
+     * @brief Stop parsing after `limit` errors
+     *
+     * A last diagnostic saying so is added when the limit is reached. This
+     * bounds the work spent on a badly broken file.
+     *
+     * @param limit At least 1
+     */
+    void setErrorLimit(size_t limit)
+    {
+        errorLimit = limit == 0 ? 1 : limit;
+    }
+
+    /**
+     * @brief Errors found so far, in source order
+     *
+     * ERROR tokens from the lexer are reported with the lexer's message. The
+     * lexer's own error limit (Lexer::setErrorLimit) decides how many of them
+     * the token stream holds.
+     */
+    const std::vector<ParseDiagnostic>& getDiagnostics() const
+    {
+        return diagnostics;
+    }
+
   private:
-    const std::vector<Token>& tokens;   ///< Token stream being parsed
-    size_t                    current;  ///< Current index into `tokens`
-    bool                      hasError; ///< Whether a parse error occurred
+    /// Tokens kept in pull mode: previous(), peek() and peekAhead(1) plus one spare.
+    static constexpr size_t LOOKAHEAD = 4;
+
+    TokenStream        ownedTokens;       ///< Storage when built from owning Tokens
+    const TokenStream& tokens;            ///< Token stream being parsed (text only in pull mode)
+    Lexer*             lexer = nullptr;   ///< Token source in pull mode
+    CompactToken       window[LOOKAHEAD]; ///< Ring of recently pulled tokens
+    size_t             pulled = 0;        ///< Number of tokens pulled from `lexer`
+    size_t             pulledErrors = 0;  ///< ERROR tokens pulled from `lexer`
+    size_t             current;           ///< Index of the current token
+    bool               hasError;          ///< Whether a parse error occurred
+
+    std::vector<ParseDiagnostic> diagnostics;
+    size_t                       errorLimit = DEFAULT_ERROR_LIMIT;
+    bool panicking = false; ///< An error was reported and no boundary reached since
+    bool gaveUp = false;    ///< The error limit was reached
+
+    /**
+     * @brief Token at absolute position `index`, the final token if past the end.
+     *
+     * In pull mode this scans up to `index`; it must not be more than
+     * LOOKAHEAD - 1 tokens behind the furthest token pulled so far.
+     */
+    const CompactToken& tokenAt(size_t index);
 
     /**
      * @brief Look at the current token without consuming it.
@@ -83,7 +173,7 @@ class Parser
      *
      * @return The current token.
      */
-    Token peek();
+    CompactToken peek();
 
     /**
      * @brief Look at the (current + pos) token without consuming it.
@@ -93,7 +183,7 @@ class Parser
      *
      * @return The (current + pos) token.
      */
-    Token peekAhead(int pos);
+    CompactToken peekAhead(int pos);
 
     /**
      * @brief Return the most recently consumed token.
@@ -103,7 +193,7 @@ class Parser
      *
      * @return The previous token.
      */
-    Token previous();
+    CompactToken previous();
 
     /**
      * @brief True when the parser has reached the end-of-file token.
@@ -114,6 +204,14 @@ class Parser
      */
     bool isAtEnd();
 
+    /**
+     * @brief True when no token can follow the current one.
+     *
+     * That is the EOF token, or an ERROR token that ends the stream (a lexer
+     * stops at its error limit). Recovery must not skip past this point.
+     */
+    bool atEndOfInput();
+
     /**
      * @brief Consume and return the current token, advancing the cursor.
      *
@@ -121,7 +219,7 @@ class Parser
      *
      * @return The consumed token.
      */
-    Token advance();
+    CompactToken advance();
 
     /**
      * @brief Check whether the current token is of type `t` (without consuming).
@@ -153,21 +251,49 @@ class Parser
      *
      * @return The consumed token if it matches `t`.
      */
-    Token consume(TokenType t, const std::string& msg);
+    CompactToken consume(TokenType t, const std::string& msg);
 
     /**
      * @brief Record a parse error at a token location.
      *
-     * Records that a parse error has occurred and logs the error message.
-     * Intended to be called exactly once per detected error.
+     * Records that a parse error has occurred and adds a diagnostic, unless
+     * the parser is already panicking over an earlier error. At an ERROR
+     * token the lexer's message is reported instead of `msg`.
      *
      * @param where Token location where the error was detected.
      * @param msg Error message describing the problem.
      */
-    void reportError(const Token& where, const std::string& msg);
+    void reportError(const CompactToken& where, const std::string& msg);
+
+    /**
+     * @brief Skip to the next statement boundary after an error.
+     *
+     * Stops after a `;`, or before a `{`, a `}`, a keyword that starts a
+     * statement, or the end of input. ERROR tokens skipped on the way are
+     * still reported, since they are errors of their own.
+     */
+    void synchronize();
 
     /* Parsing helpers for precedence levels */
 
+    /**
+     * @brief Parse disjunctions (`or`).
+     *
+     * The loosest binary level; `a or b and c` is `a or (b and c)`.
+     *
+     * @return Parsed Expr or nullptr on error.
+     */
+    std::unique_ptr<Expr> parseOr();
+
+    /**
+     * @brief Parse conjunctions (`and`).
+     *
+     * Binds looser than equality, so `a == b and c` needs no parentheses.
+     *
+     * @return Parsed Expr or nullptr on error.
+     */
+    std::unique_ptr<Expr> parseAnd();
+
     /**
      * @brief Parse equality expressions (==, !=).
      *
@@ -0,0 +1,75 @@
+/**
+ * @file builtins.cpp
+ * @brief Implementation of the shared runtime conversions.
+ */
+
+#include "runtime/builtins.h"
+
+#include <cstring>
+
+/** @brief "00" "01" ... "99": the two digits of every value below 100 */
+static constexpr char DIGIT_PAIRS[] = "00010203040506070809"
+                                      "10111213141516171819"
+                                      "20212223242526272829"
+                                      "30313233343536373839"
+                                      "40414243444546474849"
+                                      "50515253545556575859"
+                                      "60616263646566676869"
+                                      "70717273747576777879"
+                                      "80818283848586878889"
+                                      "90919293949596979899";
+
+/** @brief Magnitude of `value`, exact for INT32_MIN too */
+static uint32_t magnitude(int32_t value)
+{
+    return value < 0 ? 0u - static_cast<uint32_t>(value) : static_cast<uint32_t>(value);
+}
+
+static uint32_t digitCount(uint32_t v)
+{
+    // Comparisons instead of a division loop: no data-dependent branches.
+    return 1 + (v >= 10) + (v >= 100) + (v >= 1000) + (v >= 10000) + (v >= 100000) +
+           (v >= 1000000) + (v >= 10000000) + (v >= 100000000) + (v >= 1000000000);
+}
+
+uint32_t i32TextLength(int32_t value)
+{
+    return digitCount(magnitude(value)) + (value < 0);
+}
+
+char* formatI32(int32_t value, char* out)
+{
+    uint32_t v = magnitude(value);
+    if (value < 0)
+    {
+        *out++ = '-';
+    }
+    char* end = out + digitCount(v);
+
+    // Fill from the right, two digits per division.
+    char* p = end;
+    while (v >= 100)
+    {
+        uint32_t pair = (v % 100) * 2;
+        v /= 100;
+        p -= 2;
+        std::memcpy(p, DIGIT_PAIRS + pair, 2);
+    }
+    if (v >= 10)
+    {
+        p -= 2;
+        std::memcpy(p, DIGIT_PAIRS + v * 2, 2);
+    }
+    else
+    {
+        *--p = static_cast<char>('0' + v);
+    }
+    return end;
+}
+
+const StringObject* makeI32String(StringHeap& heap, int32_t value)
+{
+    StringObject* s = heap.allocate(i32TextLength(value));
+    formatI32(value, const_cast<char*>(s->chars()));
+    return s;
+}
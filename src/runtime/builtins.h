@@ -0,0 +1,36 @@
+/**
+ * @file builtins.h
+ * @brief Conversions shared by the VM engines
+ *
+ * Every `say` of a number and every interpolated I32 goes through ToString,
+ * so integer formatting is on the hot path of output-heavy programs. The
+ * text is produced two digits at a time from a 200-byte table and written
+ * straight into its destination: the characters of a new StringObject, or
+ * the output line of a fused PRINT_I32. No temporary std::string is built.
+ */
+
+#pragma once
+
+#include "runtime/string_heap.h"
+
+#include <cstdint>
+
+/** @brief Most characters formatI32() writes: "-2147483648" */
+constexpr uint32_t I32_TEXT_MAX = 11;
+
+/** @brief Number of characters in the decimal text of `value` */
+uint32_t i32TextLength(int32_t value);
+
+/**
+ * @brief Write the decimal text of `value`, without a NUL
+ * @param out Room for at least i32TextLength(value) characters
+ * @return One past the last character written
+ */
+char* formatI32(int32_t value, char* out);
+
+/**
+ * @brief Allocate the decimal text of `value` in `heap`
+ *
+ * Collection is the caller's business, as for any allocation.
+ */
+const StringObject* makeI32String(StringHeap& heap, int32_t value);
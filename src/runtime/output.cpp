@@ -0,0 +1,152 @@
+/**
+ * @file output.cpp
+ * @brief Implementation of the buffered output of `say`.
+ */
+
+#include "runtime/output.h"
+
+#include <cstring>
+#include <ostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <sys/uio.h>
+#include <unistd.h>
+#define AMBRA_HAVE_WRITEV 1
+#else
+#include <cstdio>
+#define AMBRA_HAVE_WRITEV 0
+#endif
+
+OutputBuffer::OutputBuffer(std::ostream& stream, size_t capacity)
+    : stream(&stream), buffer(capacity)
+{
+}
+
+OutputBuffer::OutputBuffer(int fd, size_t capacity) : fd(fd), buffer(capacity)
+{
+#if AMBRA_HAVE_WRITEV
+    unbuffered = isatty(fd) != 0;
+#endif
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    flush();
+}
+
+void OutputBuffer::setUnbuffered(bool enabled)
+{
+    unbuffered = enabled;
+    if (unbuffered)
+    {
+        drain();
+    }
+}
+
+void OutputBuffer::writeLine(const char* text, size_t length)
+{
+    if (length < buffer.size() - used)
+    {
+        std::memcpy(buffer.data() + used, text, length);
+        used += length;
+        buffer[used++] = '\n';
+    }
+    else
+    {
+        // Too long to copy: send it after the pending bytes, in one call.
+        Piece pieces[] = {{buffer.data(), used}, {text, length}, {"\n", 1}};
+        send(pieces, 3);
+        used = 0;
+        return;
+    }
+    if (unbuffered)
+    {
+        drain();
+    }
+}
+
+bool OutputBuffer::flush()
+{
+    drain();
+    if (stream != nullptr)
+    {
+        stream->flush();
+        failed |= stream->fail();
+    }
+    bool ok = !failed;
+    failed = false;
+    return ok;
+}
+
+void OutputBuffer::drain()
+{
+    if (used > 0)
+    {
+        Piece piece = {buffer.data(), used};
+        send(&piece, 1);
+        used = 0;
+    }
+}
+
+void OutputBuffer::send(const Piece* pieces, size_t count)
+{
+    if (stream != nullptr)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            stream->write(pieces[i].data, static_cast<std::streamsize>(pieces[i].length));
+        }
+        return;
+    }
+
+#if AMBRA_HAVE_WRITEV
+    iovec  vectors[3];
+    size_t pending = 0;
+    for (size_t i = 0; i < count && pending < 3; i++)
+    {
+        if (pieces[i].length > 0)
+        {
+            vectors[pending++] = {const_cast<char*>(pieces[i].data), pieces[i].length};
+        }
+    }
+
+    // writev may stop early (e.g. on a full pipe); resume after what it took.
+    iovec* next = vectors;
+    while (pending > 0)
+    {
+        ssize_t written = writev(fd, next, static_cast<int>(pending));
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            failed = true;
+            return;
+        }
+        auto left = static_cast<size_t>(written);
+        while (pending > 0 && left >= next->iov_len)
+        {
+            left -= next->iov_len;
+            next++;
+            pending--;
+        }
+        if (pending > 0)
+        {
+            next->iov_base = static_cast<char*>(next->iov_base) + left;
+            next->iov_len -= left;
+        }
+    }
+#else
+    std::FILE* file = fd == 2 ? stderr : stdout;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (std::fwrite(pieces[i].data, 1, pieces[i].length, file) != pieces[i].length)
+        {
+            failed = true;
+        }
+    }
+    std::fflush(file);
+#endif
+}
@@ -0,0 +1,109 @@
+/**
+ * @file output.h
+ * @brief Buffered destination of `say` output
+ *
+ * Every PrintString writes one line. Sending each line to the stream or the
+ * file descriptor on its own makes print-heavy programs spend their time in
+ * the C++ stream layer or in system calls, so each VM collects its lines in
+ * an OutputBuffer and hands them over in large blocks: when the buffer is
+ * full, and when run() ends, whether at HALT or at a runtime error.
+ *
+ * A buffer writes either to a std::ostream or straight to a file descriptor
+ * with write(2). A line longer than the space left is not copied: the
+ * pending lines and the long one leave together in a single writev(2).
+ *
+ * Unbuffered mode hands over every line as soon as it is complete, for
+ * interactive use. A buffer on a terminal starts out unbuffered, like
+ * stdout in C.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <iosfwd>
+#include <vector>
+
+/** @brief File descriptor of standard output */
+constexpr int STDOUT_FD = 1;
+
+class OutputBuffer
+{
+  public:
+    /** @brief Bytes collected before they are handed over */
+    static constexpr size_t DEFAULT_CAPACITY = 64 * 1024;
+
+    /**
+     * @brief Collect output for `stream`
+     * @param capacity Bytes collected before they are handed over; at least 1
+     */
+    explicit OutputBuffer(std::ostream& stream, size_t capacity = DEFAULT_CAPACITY);
+
+    /** @brief Collect output for the file descriptor `fd`, which stays open */
+    explicit OutputBuffer(int fd, size_t capacity = DEFAULT_CAPACITY);
+
+    /** @brief Flushes whatever is pending */
+    ~OutputBuffer();
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    /** @brief Hand over every line as soon as it is written */
+    void setUnbuffered(bool enabled);
+
+    /** @brief Append `length` characters of `text` and a newline */
+    void writeLine(const char* text, size_t length);
+
+    /**
+     * @brief Room to format up to `length` characters in place
+     *
+     * The caller writes its text, then passes the end of it to commit().
+     * Nothing else may be written in between.
+     *
+     * @param length At most the capacity given to the constructor
+     */
+    char* claim(size_t length)
+    {
+        if (buffer.size() - used < length)
+        {
+            drain();
+        }
+        return buffer.data() + used;
+    }
+
+    /** @brief Keep the text written since claim(), up to `end` */
+    void commit(const char* end)
+    {
+        used = static_cast<size_t>(end - buffer.data());
+        if (unbuffered)
+        {
+            drain();
+        }
+    }
+
+    /**
+     * @brief Hand over everything pending
+     * @return Whether every write since the previous flush() succeeded
+     */
+    bool flush();
+
+  private:
+    /** @brief A run of bytes for send() */
+    struct Piece
+    {
+        const char* data;
+        size_t      length;
+    };
+
+    /** @brief Write the pending bytes, keeping any failure for flush() */
+    void drain();
+
+    /** @brief Write `count` pieces in order, in one system call where possible */
+    void send(const Piece* pieces, size_t count);
+
+    std::ostream*     stream = nullptr; ///< Destination, or null for `fd`
+    int               fd = -1;          ///< Destination when `stream` is null
+    std::vector<char> buffer;           ///< Pending bytes are [0, used)
+    size_t            used = 0;
+    bool              unbuffered = false;
+    bool              failed = false; ///< A write failed since the last flush()
+};
@@ -0,0 +1,107 @@
+/**
+ * @file string_heap.cpp
+ * @brief Implementation of the runtime string heap.
+ */
+
+#include "runtime/string_heap.h"
+
+#include <algorithm>
+#include <new>
+
+static size_t objectSize(uint32_t length)
+{
+    return sizeof(StringObject) + length + 1;
+}
+
+static StringObject* newString(uint32_t length, uint32_t flags)
+{
+    auto* s = static_cast<StringObject*>(::operator new(objectSize(length)));
+    s->length = length;
+    s->flags = flags;
+    const_cast<char*>(s->chars())[length] = '\0';
+    return s;
+}
+
+static void deleteString(StringObject* s)
+{
+    ::operator delete(s);
+}
+
+StringHeap::~StringHeap()
+{
+    clear();
+    for (StringObject* s : pinned)
+    {
+        deleteString(s);
+    }
+}
+
+StringObject* StringHeap::allocate(uint32_t length)
+{
+    StringObject* s = newString(length, STRING_HEAP);
+    objects.push_back(s);
+    liveBytes += objectSize(length);
+    allocatedSinceSweep += objectSize(length);
+    return s;
+}
+
+const StringObject* StringHeap::make(std::string_view text)
+{
+    StringObject* s = allocate(static_cast<uint32_t>(text.size()));
+    std::copy(text.begin(), text.end(), const_cast<char*>(s->chars()));
+    return s;
+}
+
+const StringObject* StringHeap::pin(std::string_view text, uint32_t flags)
+{
+    // Without STRING_HEAP the string is never marked or swept.
+    StringObject* s = newString(static_cast<uint32_t>(text.size()), flags & ~STRING_HEAP);
+    std::copy(text.begin(), text.end(), const_cast<char*>(s->chars()));
+    pinned.push_back(s);
+    return s;
+}
+
+void StringHeap::mark(const Value* begin, const Value* end)
+{
+    for (const Value* v = begin; v != end; ++v)
+    {
+        if (v->isString() && (v->asString()->flags & STRING_HEAP))
+        {
+            const_cast<StringObject*>(v->asString())->flags |= STRING_MARKED;
+        }
+    }
+}
+
+void StringHeap::sweep()
+{
+    size_t kept = 0;
+    for (StringObject* s : objects)
+    {
+        if (s->flags & STRING_MARKED)
+        {
+            s->flags &= ~STRING_MARKED;
+            objects[kept++] = s;
+        }
+        else
+        {
+            liveBytes -= objectSize(s->length);
+            deleteString(s);
+        }
+    }
+    objects.resize(kept);
+
+    allocatedSinceSweep = 0;
+    threshold = std::max(INITIAL_THRESHOLD, liveBytes * 2);
+}
+
+void StringHeap::clear()
+{
+    for (StringObject* s : objects)
+    {
+        deleteString(s);
+    }
+    objects.clear();
+    liveBytes = 0;
+    allocatedSinceSweep = 0;
+    threshold = INITIAL_THRESHOLD;
+}
@@ -0,0 +1,81 @@
+/**
+ * @file string_heap.h
+ * @brief Allocation and collection of runtime strings
+ *
+ * Strings created while a program runs (by ToString and ConcatString) are
+ * StringObjects allocated here. Values do not own strings, so the heap frees
+ * them with a simple mark-sweep pass: the VM marks every Value reachable from
+ * its operand stack and locals, then sweeps whatever was not marked.
+ *
+ * Collection only happens when the VM asks for it, at allocation points where
+ * the full set of live Values is known.
+ */
+
+#pragma once
+
+#include "vm/value.h"
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+class StringHeap
+{
+  public:
+    StringHeap() = default;
+    ~StringHeap();
+
+    StringHeap(const StringHeap&) = delete;
+    StringHeap& operator=(const StringHeap&) = delete;
+
+    /**
+     * @brief Allocate a collectable string with uninitialized contents
+     * @param length Number of characters; the NUL terminator is written here
+     * @return String whose first `length` characters the caller must fill
+     */
+    StringObject* allocate(uint32_t length);
+
+    /**
+     * @brief Allocate a collectable copy of `text`
+     */
+    const StringObject* make(std::string_view text);
+
+    /**
+     * @brief Allocate a string that lives as long as the heap
+     * @param flags StringFlags of the new string; never STRING_HEAP
+     *
+     * Pinned strings are never swept, so they can be referenced from places
+     * the collector does not trace (e.g. cached conversions).
+     */
+    const StringObject* pin(std::string_view text, uint32_t flags = 0);
+
+    /** @brief Whether enough has been allocated since the last sweep to collect */
+    bool shouldCollect() const
+    {
+        return allocatedSinceSweep >= threshold;
+    }
+
+    /** @brief Mark every heap string referenced from [begin, end) */
+    void mark(const Value* begin, const Value* end);
+
+    /** @brief Free every heap string not marked since the previous sweep */
+    void sweep();
+
+    /** @brief Free every collectable string */
+    void clear();
+
+    /** @brief Number of collectable strings currently allocated */
+    size_t liveCount() const
+    {
+        return objects.size();
+    }
+
+  private:
+    static constexpr size_t INITIAL_THRESHOLD = 1u << 20;
+
+    std::vector<StringObject*> objects;                       ///< Collectable strings
+    std::vector<StringObject*> pinned;                        ///< Freed only on destruction
+    size_t                     liveBytes = 0;                 ///< Bytes held by `objects`
+    size_t                     allocatedSinceSweep = 0;       ///< Bytes since last sweep
+    size_t                     threshold = INITIAL_THRESHOLD; ///< Volume that triggers GC
+};
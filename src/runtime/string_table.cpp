@@ -0,0 +1,67 @@
+/**
+ * @file string_table.cpp
+ * @brief Implementation of the runtime string table.
+ */
+
+#include "runtime/string_table.h"
+
+#include "runtime/builtins.h"
+
+#include <algorithm>
+
+StringTable::StringTable()
+    : smallInts(SMALL_INT_MAX - SMALL_INT_MIN + 1, nullptr), copies(std::make_unique<StringHeap>())
+{
+}
+
+const StringObject* StringTable::intern(std::string_view text)
+{
+    if (const StringObject* found = find(text))
+    {
+        return found;
+    }
+    const StringObject* s = copies->pin(text, STRING_INTERNED);
+    index.emplace(s->view(), s);
+    return s;
+}
+
+const StringObject* StringTable::intern(const StringObject* s)
+{
+    if (shared != nullptr)
+    {
+        if (const StringObject* found = shared->find(s->view()))
+        {
+            return found;
+        }
+    }
+    return index.emplace(s->view(), s).first->second;
+}
+
+const StringObject* StringTable::find(std::string_view text) const
+{
+    auto found = index.find(text);
+    if (found != index.end())
+    {
+        return found->second;
+    }
+    return shared != nullptr ? shared->find(text) : nullptr;
+}
+
+const StringObject* StringTable::smallInt(int32_t value)
+{
+    const StringObject*& cached = smallInts[value - SMALL_INT_MIN];
+    if (cached == nullptr)
+    {
+        char text[I32_TEXT_MAX];
+        cached = intern(std::string_view(text, formatI32(value, text) - text));
+    }
+    return cached;
+}
+
+void StringTable::clear(const StringTable* shared)
+{
+    this->shared = shared;
+    index.clear();
+    std::fill(smallInts.begin(), smallInts.end(), nullptr);
+    copies = std::make_unique<StringHeap>();
+}
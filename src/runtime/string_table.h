@@ -0,0 +1,95 @@
+/**
+ * @file string_table.h
+ * @brief Interned runtime strings
+ *
+ * A StringTable keeps at most one interned string per text. Every String32
+ * constant of a loaded program is interned when the program is loaded, and
+ * so are the strings ToString produces for booleans and small integers, so
+ * comparing two of them is a pointer comparison: interned strings carry
+ * STRING_INTERNED, and stringEquals() never looks at the characters of two
+ * different interned strings.
+ *
+ * The table either adopts a string that already exists, such as a constant in
+ * a mapped .ambc image (which is written with STRING_INTERNED set), or pins a
+ * copy of its own. Adopted strings must outlive the table's contents, so a VM
+ * clears its table whenever it loads another program.
+ *
+ * Strings built while the program runs (concatenations, large numbers) stay
+ * in the StringHeap and are compared by content.
+ *
+ * A table can fall back on a shared one that no longer changes, such as the
+ * constants of a program several VMs run at once: text already interned
+ * there is returned from there, so it stays one object, and only new text
+ * is added to this table. Lookups in the shared table never modify it.
+ */
+
+#pragma once
+
+#include "runtime/string_heap.h"
+#include "vm/value.h"
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class StringTable
+{
+  public:
+    /** @brief Smallest integer whose decimal text smallInt() interns */
+    static constexpr int32_t SMALL_INT_MIN = -128;
+    /** @brief Largest integer whose decimal text smallInt() interns */
+    static constexpr int32_t SMALL_INT_MAX = 1023;
+
+    StringTable();
+
+    StringTable(const StringTable&) = delete;
+    StringTable& operator=(const StringTable&) = delete;
+
+    /**
+     * @brief The interned string with this text, pinning a copy if there is none
+     */
+    const StringObject* intern(std::string_view text);
+
+    /**
+     * @brief The interned string with the text of `s`, adopting `s` if there is none
+     * @param s A string with STRING_INTERNED set that outlives the table's contents
+     */
+    const StringObject* intern(const StringObject* s);
+
+    /** @brief The interned string with this text, or nullptr; never modifies the table */
+    const StringObject* find(std::string_view text) const;
+
+    /**
+     * @brief The interned decimal text of `value`
+     * @param value Between SMALL_INT_MIN and SMALL_INT_MAX
+     */
+    const StringObject* smallInt(int32_t value);
+
+    /**
+     * @brief Forget every string; copies made by the table are freed
+     * @param shared Table to fall back on from now on, or nullptr; it must
+     *        not change while this table uses it
+     */
+    void clear(const StringTable* shared = nullptr);
+
+    /** @brief Number of interned strings */
+    size_t size() const
+    {
+        return index.size();
+    }
+
+  private:
+    /** @brief Interned strings by text; keys view the strings' own characters */
+    std::unordered_map<std::string_view, const StringObject*> index;
+
+    /** @brief smallInt() results so far, by value - SMALL_INT_MIN */
+    std::vector<const StringObject*> smallInts;
+
+    /** @brief Owner of the copies; replaced by clear() */
+    std::unique_ptr<StringHeap> copies;
+
+    /** @brief Consulted before adding a string; set by clear() */
+    const StringTable* shared = nullptr;
+};
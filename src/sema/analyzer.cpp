@@ -3,13 +3,91 @@
 
 #include "ast/expr.h"
 #include "ast/stmt.h"
+#include "utils/thread_pool.h"
 
+#include <algorithm>
 #include <cassert>
 #include <memory>
 #include <utility>
 
+/** Tasks per thread in a parallel run, so that runs of uneven cost even out. */
+static constexpr size_t SHARDS_PER_THREAD = 4;
+
+/** Whether a top-level statement declares nothing in the root scope (see DeferredStatement). */
+static bool isDeferrable(const Stmt& stmt)
+{
+    return stmt.kind == Block || stmt.kind == IfChain || stmt.kind == While;
+}
+
+/** Whether a run allowed `threads` threads should spread `program` over them. */
+static bool worthParallel(const Program& program, size_t threads)
+{
+    if (threads < 2 || program.getArena() == nullptr ||
+        program.getArena()->nodeCount() < PARALLEL_ANALYSIS_MIN_NODES)
+    {
+        return false;
+    }
+    return std::count_if(program.begin(), program.end(),
+                         [](const auto& stmt) { return isDeferrable(*stmt); }) > 1;
+}
+
+/**
+ * Calls `work(shard, first, last)` on a pool of `threads` threads, for
+ * contiguous runs [first, last) that together cover `count` deferred
+ * statements, and returns once all are done.
+ */
+template <typename Work> static void forEachShard(size_t threads, size_t shards, size_t count,
+                                                  const Work& work)
+{
+    ThreadPool pool(std::min(threads, shards));
+    for (size_t shard = 0; shard < shards; shard++)
+    {
+        size_t first = count * shard / shards;
+        size_t last = count * (shard + 1) / shards;
+        pool.submit([&work, shard, first, last] { work(shard, first, last); });
+    }
+    pool.wait();
+}
+
+/**
+ * Puts what deferred statements produced (diagnostics or root scopes) back
+ * among what the in-order statements did, so that it comes out in program
+ * order as in a run on one thread.
+ * @param before How many of `inOrder` precede each deferred statement
+ */
+template <typename T>
+static std::vector<T> inProgramOrder(std::vector<T>& inOrder,
+                                     const std::vector<DeferredStatement>& deferred,
+                                     size_t DeferredStatement::*before,
+                                     std::vector<std::vector<T>>& found)
+{
+    std::vector<T> all;
+    size_t         next = 0;
+    for (size_t i = 0; i < deferred.size(); i++)
+    {
+        for (; next < deferred[i].*before; next++)
+        {
+            all.push_back(std::move(inOrder[next]));
+        }
+        for (T& item : found[i])
+        {
+            all.push_back(std::move(item));
+        }
+    }
+    for (; next < inOrder.size(); next++)
+    {
+        all.push_back(std::move(inOrder[next]));
+    }
+    return all;
+}
+
 Resolver::Resolver() : currentScope(nullptr), rootScope(nullptr) {}
 
+void Resolver::setThreads(size_t count)
+{
+    threads = count == 0 ? ThreadPool::defaultThreadCount() : count;
+}
+
 void Resolver::reportError(const std::string& message, SourceLoc loc)
 {
     diagnostics.emplace_back(Diagnostic{message, loc});
@@ -20,7 +98,14 @@ void Resolver::enterScope()
     auto newScope = std::make_unique<Scope>();
     newScope->parent = currentScope;
     Scope* scopePtr = newScope.get();
-    currentScope->children.push_back(std::move(newScope));
+    if (detached && currentScope == outermostScope)
+    {
+        detachedScopes.push_back(std::move(newScope));
+    }
+    else
+    {
+        currentScope->children.push_back(std::move(newScope));
+    }
 
     currentScope = scopePtr;
 }
@@ -29,28 +114,64 @@ void Resolver::exitScope()
 {
     assert(currentScope && "exitScope called with null currentScope");
     assert(currentScope->parent && "attempted to exit root scope");
+
+    // Uncover whatever the block's declarations were hiding.
+    for (auto& [name, symbol] : currentScope->table)
+    {
+        visible[name] = symbol->shadowed;
+    }
     currentScope = currentScope->parent;
 }
 
+const Symbol* Resolver::lookup(NameId name) const
+{
+    if (name < visible.size() && visible[name] != nullptr)
+    {
+        return visible[name];
+    }
+    const Symbol* symbol = outermostScope->lookup(name);
+    if (symbol != nullptr && symbol->rootIndex >= visibleRootDeclarations)
+    {
+        return nullptr; // declared after the statement a parallel worker is resolving
+    }
+    return symbol;
+}
+
 void Resolver::resolveSummonStmt(const SummonStmt& stmt)
 {
     resolveExpression(stmt.getInitializer());
-    auto identifier = stmt.getIdentifier();
+    auto& identifier = stmt.getIdentifier();
 
     auto symbol = std::make_unique<Symbol>();
     symbol->kind = Symbol::VARIABLE;
     symbol->name = identifier.getName();
-    symbol->declLoc = identifier.loc;
+    symbol->declLoc = identifier.getLoc();
     symbol->declStmt = &stmt;
 
     stmt.setSymbol(symbol.get());
 
-    bool isDeclared = currentScope->declare(identifier.getName(), std::move(symbol));
+    NameId  name = identifier.getNameId();
+    Symbol* declared = symbol.get();
+    bool    isDeclared = currentScope->declare(name, std::move(symbol));
+
+    if (isDeclared && currentScope == outermostScope)
+    {
+        declared->rootIndex = rootDeclarations++;
+    }
+    else if (isDeclared)
+    {
+        if (name >= visible.size())
+        {
+            visible.resize(static_cast<size_t>(name) + 1, nullptr);
+        }
+        declared->shadowed = visible[name];
+        visible[name] = declared;
+    }
 
     if (!isDeclared)
     {
         reportError("Redeclaration of variable " + identifier.getName() + " in the same scope",
-                    stmt.loc);
+                    stmt.getLoc());
     }
 }
 
@@ -149,16 +270,14 @@ void Resolver::resolveExpression(const Expr& expr)
 void Resolver::resolveIdentifierExpression(const IdentifierExpr& expr)
 {
 
-    std::string name = expr.getName();
-
-    const Symbol* symbol = currentScope->lookup(name);
+    const Symbol* symbol = lookup(expr.getNameId());
     if (symbol)
     {
         resolutionTable.mapping.emplace(&expr, symbol);
         return;
     }
 
-    reportError("undeclared identifier", expr.loc);
+    reportError("undeclared identifier", expr.getLoc());
 };
 
 void Resolver::resolveStatement(const Stmt& stmt)
@@ -209,15 +328,78 @@ void Resolver::resolveProgram(const Program& program)
     }
 }
 
+void Resolver::resolveProgramInParallel(const Program& program)
+{
+    // Declarations first, in order: together they make up the root scope
+    // that the deferred statements read.
+    std::vector<DeferredStatement> deferred;
+    for (auto& stmt : program)
+    {
+        if (isDeferrable(*stmt))
+        {
+            deferred.push_back({stmt.get(), rootDeclarations, diagnostics.size(),
+                                currentScope->children.size()});
+            continue;
+        }
+        resolveStatement(*stmt);
+    }
+
+    size_t shards = std::min(deferred.size(), threads * SHARDS_PER_THREAD);
+
+    std::vector<Resolver>                            workers(shards);
+    std::vector<std::vector<Diagnostic>>             found(deferred.size());
+    std::vector<std::vector<std::unique_ptr<Scope>>> opened(deferred.size());
+    forEachShard(threads, shards, deferred.size(),
+                 [&](size_t shard, size_t first, size_t last)
+                 {
+                     Resolver& worker = workers[shard];
+                     worker.currentScope = currentScope;
+                     worker.outermostScope = currentScope;
+                     worker.detached = true;
+                     for (size_t i = first; i < last; i++)
+                     {
+                         worker.visibleRootDeclarations = deferred[i].rootDeclarations;
+                         worker.resolveStatement(*deferred[i].stmt);
+                         found[i] = std::move(worker.diagnostics);
+                         worker.diagnostics.clear();
+                         opened[i] = std::move(worker.detachedScopes);
+                         worker.detachedScopes.clear();
+                     }
+                 });
+
+    for (Resolver& worker : workers)
+    {
+        resolutionTable.mapping.merge(worker.resolutionTable.mapping);
+    }
+    currentScope->children = inProgramOrder(currentScope->children, deferred,
+                                            &DeferredStatement::scopesBefore, opened);
+    diagnostics =
+        inProgramOrder(diagnostics, deferred, &DeferredStatement::diagnosticsBefore, found);
+}
+
 SemanticResult Resolver::resolve(const Program& program)
 {
     rootScope = std::make_unique<Scope>();
     currentScope = rootScope.get();
+    outermostScope = currentScope;
+    visible.clear();
+    rootDeclarations = 0;
 
     diagnostics.clear();
     resolutionTable.mapping.clear();
+    if (program.getArena() != nullptr)
+    {
+        resolutionTable.mapping.reserve(program.getArena()->nodeCount());
+    }
 
-    resolveProgram(program);
+    if (worthParallel(program, threads))
+    {
+        resolveProgramInParallel(program);
+    }
+    else
+    {
+        resolveProgram(program);
+    }
 
     SemanticResult result;
     result.rootScope = std::move(rootScope);
@@ -226,21 +408,72 @@ SemanticResult Resolver::resolve(const Program& program)
     return result;
 }
 
+SemanticResult Resolver::resolveTopLevelStatement(const Stmt& stmt, Scope& scope)
+{
+    currentScope = &scope;
+    outermostScope = currentScope;
+    visible.clear();
+
+    diagnostics.clear();
+    resolutionTable.mapping.clear();
+
+    resolveStatement(stmt);
+    currentScope = nullptr;
+
+    SemanticResult result;
+    result.diagnostics = std::move(diagnostics);
+    result.resolutionTable = std::move(resolutionTable);
+    diagnostics.clear();
+    resolutionTable.mapping.clear();
+    return result;
+}
+
 TypeChecker::TypeChecker(const ResolutionTable& resolutionTable, const Scope* rootScope)
     : resolutionTable(resolutionTable)
 {
 }
 
+void TypeChecker::setThreads(size_t count)
+{
+    threads = count == 0 ? ThreadPool::defaultThreadCount() : count;
+}
+
 TypeCheckerResults TypeChecker::typeCheck(const Program& program)
 {
     diagnostics.clear();
     typeTable.mapping.clear();
+    if (program.getArena() != nullptr)
+    {
+        typeTable.mapping.reserve(program.getArena()->nodeCount());
+    }
 
-    checkProgram(program);
+    if (worthParallel(program, threads))
+    {
+        checkProgramInParallel(program);
+    }
+    else
+    {
+        checkProgram(program);
+    }
 
     return TypeCheckerResults{typeTable, diagnostics};
 };
 
+std::vector<Diagnostic> TypeChecker::typeCheckTopLevelStatement(const Stmt& stmt,
+                                                                TypeTable& table)
+{
+    diagnostics.clear();
+
+    // Check against the caller's table so identifiers see earlier statements' types.
+    std::swap(typeTable, table);
+    checkStatement(stmt);
+    std::swap(typeTable, table);
+
+    std::vector<Diagnostic> result = std::move(diagnostics);
+    diagnostics.clear();
+    return result;
+}
+
 void TypeChecker::checkProgram(const Program& program)
 {
     for (auto& stmt : program.getStatements())
@@ -248,6 +481,51 @@ void TypeChecker::checkProgram(const Program& program)
         checkStatement(*stmt);
     }
 };
+
+void TypeChecker::checkProgramInParallel(const Program& program)
+{
+    // Declarations first, in order, so every type a deferred statement can
+    // refer to is in `typeTable` before the workers start.
+    std::vector<DeferredStatement> deferred;
+    for (auto& stmt : program.getStatements())
+    {
+        if (isDeferrable(*stmt))
+        {
+            deferred.push_back({stmt.get(), 0, diagnostics.size()});
+            continue;
+        }
+        checkStatement(*stmt);
+    }
+
+    size_t shards = std::min(deferred.size(), threads * SHARDS_PER_THREAD);
+
+    std::vector<TypeChecker> workers;
+    workers.reserve(shards);
+    for (size_t shard = 0; shard < shards; shard++)
+    {
+        workers.emplace_back(resolutionTable, nullptr);
+        workers.back().shared = &typeTable;
+    }
+    std::vector<std::vector<Diagnostic>> found(deferred.size());
+    forEachShard(threads, shards, deferred.size(),
+                 [&](size_t shard, size_t first, size_t last)
+                 {
+                     TypeChecker& worker = workers[shard];
+                     for (size_t i = first; i < last; i++)
+                     {
+                         worker.checkStatement(*deferred[i].stmt);
+                         found[i] = std::move(worker.diagnostics);
+                         worker.diagnostics.clear();
+                     }
+                 });
+
+    for (TypeChecker& worker : workers)
+    {
+        typeTable.mapping.merge(worker.typeTable.mapping);
+    }
+    diagnostics =
+        inProgramOrder(diagnostics, deferred, &DeferredStatement::diagnosticsBefore, found);
+}
 void TypeChecker::checkStatement(const Stmt& stmt)
 {
     switch (stmt.kind)
@@ -294,7 +572,7 @@ void TypeChecker::checkSummonStatement(const SummonStmt& stmt)
     if (type == Void)
     {
         diagnostics.emplace_back(
-            Diagnostic{"Variable initializer cannot be void", initializer.loc});
+            Diagnostic{"Variable initializer cannot be void", initializer.getLoc()});
     }
 };
 void TypeChecker::checkSayStatement(const SayStmt& stmt)
@@ -320,7 +598,7 @@ void TypeChecker::checkIfChainStatement(const IfChainStmt& stmt)
         if (t != Bool && t != Error)
         {
             diagnostics.emplace_back(
-                Diagnostic{"If condition expression must be Bool", condition.loc});
+                Diagnostic{"If condition expression must be Bool", condition.getLoc()});
         }
         auto& block = std::get<1>(branch);
         checkBlockStatement(*block);
@@ -340,7 +618,7 @@ void TypeChecker::checkWhileStatement(const WhileStmt& stmt)
     if (t != Bool && t != Error)
     {
         diagnostics.emplace_back(
-            Diagnostic{"While condition expression must be Bool", condition.loc});
+            Diagnostic{"While condition expression must be Bool", condition.getLoc()});
     }
 
     auto& block = stmt.getBody();
@@ -413,7 +691,7 @@ Type TypeChecker::checkUnaryExpression(const UnaryExpr& expr)
         {
             return Bool;
         }
-        diagnostics.emplace_back(Diagnostic{"Unary 'not' expects a Bool operand", expr.loc});
+        diagnostics.emplace_back(Diagnostic{"Unary 'not' expects a Bool operand", expr.getLoc()});
         return Error;
     }
 
@@ -424,7 +702,7 @@ Type TypeChecker::checkUnaryExpression(const UnaryExpr& expr)
         {
             return Int;
         }
-        diagnostics.emplace_back(Diagnostic{"Unary '-' expects an Int operand", expr.loc});
+        diagnostics.emplace_back(Diagnostic{"Unary '-' expects an Int operand", expr.getLoc()});
         return Error;
     }
     return Error;
@@ -452,7 +730,7 @@ Type TypeChecker::checkBinaryExpression(const BinaryExpr& expr)
         if (leftType != Int || rightType != Int)
         {
             diagnostics.emplace_back(
-                Diagnostic{"Arithmetic operators require Int operands", expr.loc});
+                Diagnostic{"Arithmetic operators require Int operands", expr.getLoc()});
             return Error;
         }
         return Int;
@@ -465,7 +743,7 @@ Type TypeChecker::checkBinaryExpression(const BinaryExpr& expr)
         if (leftType != Int || rightType != Int)
         {
             diagnostics.emplace_back(
-                Diagnostic{"Comparison operators require Int operands", expr.loc});
+                Diagnostic{"Comparison operators require Int operands", expr.getLoc()});
             return Error;
         }
         return Bool;
@@ -476,7 +754,18 @@ Type TypeChecker::checkBinaryExpression(const BinaryExpr& expr)
         if (leftType != rightType)
         {
             diagnostics.emplace_back(
-                Diagnostic{"Equality operands must have the same type", expr.loc});
+                Diagnostic{"Equality operands must have the same type", expr.getLoc()});
+            return Error;
+        }
+        return Bool;
+    }
+    case LogicalAnd:
+    case LogicalOr:
+    {
+        if (leftType != Bool || rightType != Bool)
+        {
+            diagnostics.emplace_back(
+                Diagnostic{"Logical operators require Bool operands", expr.getLoc()});
             return Error;
         }
         return Bool;
@@ -494,33 +783,37 @@ Type TypeChecker::checkGroupingExpression(const GroupingExpr& expr)
 
 Type TypeChecker::checkIdentifierExpression(const IdentifierExpr& expr)
 {
-    auto it = resolutionTable.mapping.find(&expr);
-    if (it == resolutionTable.mapping.end())
+    const Symbol* const* resolved = resolutionTable.mapping.find(&expr);
+    if (resolved == nullptr)
     {
         diagnostics.emplace_back(
-            Diagnostic{"Unresolved identifier '" + expr.getName() + "'", expr.loc});
+            Diagnostic{"Unresolved identifier '" + expr.getName() + "'", expr.getLoc()});
         return Error;
     }
-    const Symbol* symbol = it->second;
+    const Symbol* symbol = *resolved;
 
     const SummonStmt* decl = symbol->declStmt;
     if (!decl)
     {
         diagnostics.emplace_back(
-            Diagnostic{"Internal error: missing declaration for identifier", expr.loc});
+            Diagnostic{"Internal error: missing declaration for identifier", expr.getLoc()});
         return Error;
     }
 
     auto& initializer = decl->getInitializer();
-    auto  iterator = typeTable.mapping.find(&initializer);
-    if (iterator != typeTable.mapping.end())
+    const Type* known = typeTable.mapping.find(&initializer);
+    if (known == nullptr && shared != nullptr)
+    {
+        known = shared->mapping.find(&initializer);
+    }
+    if (known != nullptr)
     {
-        return iterator->second;
+        return *known;
     }
 
     if (activeDeclarations.find(&initializer) != activeDeclarations.end())
     {
-        diagnostics.emplace_back(Diagnostic{"Circular type dependency detected", initializer.loc});
+        diagnostics.emplace_back(Diagnostic{"Circular type dependency detected", initializer.getLoc()});
         return Error;
     }
     activeDeclarations.emplace(&initializer);
@@ -543,7 +836,7 @@ Type TypeChecker::checkStringExpression(const StringExpr& expr)
             if (t == Void)
             {
                 diagnostics.emplace_back(Diagnostic{
-                    "Void expression cannot appear in string interpolation", part.expr->loc});
+                    "Void expression cannot appear in string interpolation", part.expr->getLoc()});
                 return Error;
             }
         }
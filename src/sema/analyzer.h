@@ -9,9 +9,12 @@
 #pragma once
 
 #include "ast/expr.h"
+#include "ast/node_table.h"
 #include "ast/prog.h"
 #include "ast/stmt.h"
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -60,6 +63,18 @@ struct Symbol
     SourceLoc declLoc;
 
     const SummonStmt* declStmt;
+
+    /**
+     * While the Resolver is inside this symbol's block: the block-scoped
+     * symbol of the same name it hides, if any. Restored on leaving the block.
+     */
+    const Symbol* shadowed = nullptr;
+
+    /**
+     * Position among the root scope's declarations, in program order. Lets a
+     * parallel run hide root symbols from the statements before them.
+     */
+    uint32_t rootIndex = 0;
 };
 
 struct Scope
@@ -67,7 +82,8 @@ struct Scope
     // Non-owning link to the lexically enclosing scope (nullptr for root).
     Scope* parent = nullptr;
 
-    std::unordered_map<std::string, std::unique_ptr<Symbol>> table;
+    // Keyed by interned name (see utils/interner.h).
+    std::unordered_map<NameId, std::unique_ptr<Symbol>> table;
 
     std::vector<std::unique_ptr<Scope>> children;
 
@@ -83,12 +99,12 @@ struct Scope
      * Scope does not emit diagnostics; the caller is responsible for reporting
      * redeclaration errors.
      *
-     * @param name Symbol name to declare (current-scope only)
+     * @param name Interned symbol name to declare (current-scope only)
      * @param symbol The symbol to insert on success
      * @return true if the declaration succeeds, false if the name already exists
      *         in the current scope
      */
-    bool declare(const std::string& name, std::unique_ptr<Symbol> symbol)
+    bool declare(NameId name, std::unique_ptr<Symbol> symbol)
     {
         if (table.find(name) != table.end())
         {
@@ -104,11 +120,11 @@ struct Scope
      * This function searches only the current scope's symbol table and does
      * not inspect parent scopes.
      *
-     * @param name Symbol name to search for
+     * @param name Interned symbol name to search for
      * @return Pointer to the symbol if found in the current scope, otherwise
      *         nullptr
      */
-    const Symbol* lookupLocal(const std::string& name) const
+    const Symbol* lookupLocal(NameId name) const
     {
         auto found = table.find(name);
         if (found != table.end())
@@ -125,11 +141,11 @@ struct Scope
      * then parent's parent, and so on until the root scope. The search stops
      * at the first match, naturally implementing shadowing.
      *
-     * @param name Symbol name to resolve
+     * @param name Interned symbol name to resolve
      * @return Pointer to the resolved symbol if found in any reachable scope,
      *         otherwise nullptr
      */
-    const Symbol* lookup(const std::string& name) const
+    const Symbol* lookup(NameId name) const
     {
 
         auto foundLocal = lookupLocal(name);
@@ -152,7 +168,29 @@ struct Scope
  */
 struct ResolutionTable
 {
-    std::unordered_map<const IdentifierExpr*, const Symbol*> mapping;
+    NodeTable<IdentifierExpr, const Symbol*> mapping;
+};
+
+/**
+ * Programs with fewer AST nodes are analyzed on the calling thread even when
+ * more threads are allowed: starting the threads would cost more than it saves.
+ */
+constexpr size_t PARALLEL_ANALYSIS_MIN_NODES = 20000;
+
+/**
+ * A top-level statement that a parallel run analyzes on a worker thread.
+ *
+ * Blocks, if-chains and while loops declare nothing in the root scope, so no
+ * later statement depends on them. Both phases first analyze every other
+ * top-level statement in order on the calling thread, then these, split into
+ * contiguous runs with a table shard per run, and merge the shards.
+ */
+struct DeferredStatement
+{
+    const Stmt* stmt;
+    uint32_t    rootDeclarations;  ///< Root declarations before it
+    size_t      diagnosticsBefore; ///< Diagnostics of in-order statements before it
+    size_t      scopesBefore = 0;  ///< Root scopes of in-order statements before it
 };
 
 /**
@@ -195,9 +233,39 @@ class Resolver
     ResolutionTable         resolutionTable;
     std::vector<Diagnostic> diagnostics;
 
+    /** Scope the current run started in; its names are looked up in its table. */
+    Scope* outermostScope = nullptr;
+
+    /**
+     * Innermost visible symbol of each name declared in an open block scope,
+     * indexed by NameId (nullptr if none). Each entry heads a chain through
+     * Symbol::shadowed, so lookups cost the same at any nesting depth.
+     */
+    std::vector<const Symbol*> visible;
+
+    /** Threads a run may use; see setThreads(). */
+    size_t threads = 1;
+
+    /** Root declarations made so far; the next one gets this rootIndex. */
+    uint32_t rootDeclarations = 0;
+
+    /** Root symbols whose rootIndex is not below this are hidden from lookups. */
+    uint32_t visibleRootDeclarations = UINT32_MAX;
+
+    /**
+     * In a worker of a parallel run, scopes opened directly in the shared root
+     * scope are collected here and spliced into it, at their statement's
+     * position, after the workers finish.
+     */
+    bool                                detached = false;
+    std::vector<std::unique_ptr<Scope>> detachedScopes;
+
     /** Initiates symbol resolution by processing the program's statements. */
     void resolveProgram(const Program& program);
 
+    /** Resolves the program with deferred statements spread over threads. */
+    void resolveProgramInParallel(const Program& program);
+
     /** Dispatches statement resolution to the appropriate statement handler. */
     void resolveStatement(const Stmt& stmt);
 
@@ -228,6 +296,9 @@ class Resolver
     /** Restores the parent scope as the current scope. */
     void exitScope();
 
+    /** Finds the symbol a name refers to at the current point. */
+    const Symbol* lookup(NameId name) const;
+
     /** Records a diagnostic error with location information. */
     void reportError(const std::string& message, SourceLoc loc);
 
@@ -239,6 +310,17 @@ class Resolver
     Resolver();
     ~Resolver() = default;
 
+    /**
+     * Resolve deferrable top-level statements on up to `threads` threads.
+     *
+     * The results are the same as on one thread, diagnostics included and in
+     * the same order. Programs below PARALLEL_ANALYSIS_MIN_NODES nodes always
+     * use the calling thread only.
+     *
+     * @param threads 0 means one per hardware thread; 1, the default, means no extra threads
+     */
+    void setThreads(size_t threads);
+
     /**
      * Performs symbol resolution on the given AST.
      *
@@ -250,6 +332,20 @@ class Resolver
      * @return SemanticResult containing scope tree, resolution table, and diagnostics
      */
     SemanticResult resolve(const Program& program);
+
+    /**
+     * Resolves a single top-level statement against an existing root scope.
+     *
+     * Used by IncrementalAnalyzer to re-resolve edited statements. The
+     * statement's declarations and block scopes are added to `rootScope`,
+     * which must contain exactly the declarations of the statements before
+     * it.
+     *
+     * @param stmt The top-level statement to resolve
+     * @param rootScope The program's root scope
+     * @return The statement's resolutions and diagnostics (rootScope is null)
+     */
+    SemanticResult resolveTopLevelStatement(const Stmt& stmt, Scope& rootScope);
 };
 
 /**
@@ -260,7 +356,7 @@ class Resolver
  */
 struct TypeTable
 {
-    std::unordered_map<const Expr*, Type> mapping;
+    NodeTable<Expr, Type> mapping;
 };
 
 /**
@@ -304,9 +400,18 @@ class TypeChecker
     /** Tracks expressions currently being type-checked to detect circular dependencies. */
     std::unordered_set<const Expr*> activeDeclarations;
 
+    /** Threads a run may use; see setThreads(). */
+    size_t threads = 1;
+
+    /** In a worker of a parallel run: the types of the in-order statements, read-only. */
+    const TypeTable* shared = nullptr;
+
     /** Initiates type checking by processing the program's statements. */
     void checkProgram(const Program& program);
 
+    /** Type checks the program with deferred statements spread over threads. */
+    void checkProgramInParallel(const Program& program);
+
     /** Dispatches statement type checking to the appropriate statement handler. */
     void checkStatement(const Stmt& stmt);
 
@@ -355,6 +460,15 @@ class TypeChecker
      */
     TypeChecker(const ResolutionTable& resolutionTable, const Scope* rootScope);
 
+    /**
+     * Type check deferrable top-level statements on up to `threads` threads.
+     *
+     * Same contract as Resolver::setThreads().
+     *
+     * @param threads 0 means one per hardware thread; 1, the default, means no extra threads
+     */
+    void setThreads(size_t threads);
+
     /**
      * Performs type checking on the given AST.
      *
@@ -366,4 +480,16 @@ class TypeChecker
      * @return TypeCheckerResults containing type table and diagnostics
      */
     TypeCheckerResults typeCheck(const Program& program);
+
+    /**
+     * Type checks a single top-level statement.
+     *
+     * Used by IncrementalAnalyzer to re-check edited statements.
+     *
+     * @param stmt The top-level statement to check
+     * @param typeTable Types recorded for the statements before `stmt`; receives
+     *        the types of the statement's expressions
+     * @return Diagnostics for this statement
+     */
+    std::vector<Diagnostic> typeCheckTopLevelStatement(const Stmt& stmt, TypeTable& typeTable);
 };
\ No newline at end of file
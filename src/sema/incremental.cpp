@@ -0,0 +1,353 @@
+#include "sema/incremental.h"
+
+#include <algorithm>
+#include <unordered_set>
+#include <utility>
+
+/**
+ * Every node below (and including) a statement, and the identifier uses
+ * among its expressions.
+ */
+struct StatementNodes
+{
+    std::vector<const Stmt*>           statements;
+    std::vector<const Expr*>           expressions;
+    std::vector<const IdentifierExpr*> identifiers;
+};
+
+static void collectExpression(const Expr& expr, StatementNodes& nodes)
+{
+    nodes.expressions.push_back(&expr);
+    switch (expr.kind)
+    {
+    case Identifier:
+        nodes.identifiers.push_back(static_cast<const IdentifierExpr*>(&expr));
+        return;
+    case Unary:
+        collectExpression(static_cast<const UnaryExpr&>(expr).getOperand(), nodes);
+        return;
+    case Binary:
+    {
+        auto& binary = static_cast<const BinaryExpr&>(expr);
+        collectExpression(binary.getLeft(), nodes);
+        collectExpression(binary.getRight(), nodes);
+        return;
+    }
+    case Grouping:
+        collectExpression(static_cast<const GroupingExpr&>(expr).getExpression(), nodes);
+        return;
+    case InterpolatedString:
+        for (auto& part : static_cast<const StringExpr&>(expr).getParts())
+        {
+            if (part.kind == StringPart::EXPR)
+            {
+                collectExpression(*part.expr, nodes);
+            }
+        }
+        return;
+    default:
+        return;
+    }
+}
+
+static void collectStatement(const Stmt& stmt, StatementNodes& nodes)
+{
+    nodes.statements.push_back(&stmt);
+    switch (stmt.kind)
+    {
+    case Summon:
+    {
+        // The declared identifier is neither resolved nor typed, so it is not a use.
+        auto& summon = static_cast<const SummonStmt&>(stmt);
+        nodes.expressions.push_back(&summon.getIdentifier());
+        collectExpression(summon.getInitializer(), nodes);
+        return;
+    }
+    case Say:
+        collectExpression(static_cast<const SayStmt&>(stmt).getExpression(), nodes);
+        return;
+    case Block:
+        for (auto& inner : static_cast<const BlockStmt&>(stmt))
+        {
+            collectStatement(*inner, nodes);
+        }
+        return;
+    case IfChain:
+    {
+        auto& chain = static_cast<const IfChainStmt&>(stmt);
+        for (auto& branch : chain.getBranches())
+        {
+            collectExpression(*std::get<0>(branch), nodes);
+            collectStatement(*std::get<1>(branch), nodes);
+        }
+        if (chain.getElseBranch())
+        {
+            collectStatement(*chain.getElseBranch(), nodes);
+        }
+        return;
+    }
+    case While:
+    {
+        auto& loop = static_cast<const WhileStmt&>(stmt);
+        collectExpression(loop.getCondition(), nodes);
+        collectStatement(loop.getBody(), nodes);
+        return;
+    }
+    default:
+        return;
+    }
+}
+
+IncrementalAnalyzer::IncrementalAnalyzer()
+    : program({}, false, SourceLoc{1, 1}, SourceLoc{1, 1}),
+      checker(semantics.resolutionTable, nullptr)
+{
+    semantics.rootScope = std::make_unique<Scope>();
+}
+
+void IncrementalAnalyzer::park()
+{
+    Scope& root = *semantics.rootScope;
+
+    auto next = root.children.begin();
+    for (Unit& unit : units)
+    {
+        unit.parkedScopes.assign(std::make_move_iterator(next),
+                                 std::make_move_iterator(next + unit.scopeCount));
+        next += unit.scopeCount;
+
+        if (unit.symbol != nullptr)
+        {
+            auto entry = root.table.find(internName(unit.declares));
+            unit.parkedSymbol = std::move(entry->second);
+            root.table.erase(entry);
+        }
+    }
+    root.children.clear();
+}
+
+void IncrementalAnalyzer::restore(Unit& unit)
+{
+    Scope& root = *semantics.rootScope;
+    for (auto& scope : unit.parkedScopes)
+    {
+        root.children.push_back(std::move(scope));
+    }
+    unit.parkedScopes.clear();
+
+    // Its name is not dirty, so no earlier statement claims it now either.
+    if (unit.parkedSymbol)
+    {
+        root.declare(internName(unit.declares), std::move(unit.parkedSymbol));
+    }
+}
+
+void IncrementalAnalyzer::number(Stmt& stmt)
+{
+    StatementNodes nodes;
+    collectStatement(stmt, nodes);
+
+    auto take = [this]
+    {
+        if (freeIds.empty())
+        {
+            return nextId++;
+        }
+        NodeId id = freeIds.back();
+        freeIds.pop_back();
+        return id;
+    };
+    // The walk hands out const pointers, but every node belongs to `stmt`.
+    for (const Stmt* node : nodes.statements)
+    {
+        const_cast<Stmt*>(node)->id = take();
+    }
+    for (const Expr* node : nodes.expressions)
+    {
+        const_cast<Expr*>(node)->id = take();
+    }
+}
+
+void IncrementalAnalyzer::retire(const Stmt& stmt)
+{
+    forget(stmt);
+
+    StatementNodes nodes;
+    collectStatement(stmt, nodes);
+    for (const Stmt* node : nodes.statements)
+    {
+        freeIds.push_back(node->id);
+    }
+    for (const Expr* node : nodes.expressions)
+    {
+        freeIds.push_back(node->id);
+    }
+}
+
+void IncrementalAnalyzer::forget(const Stmt& stmt)
+{
+    StatementNodes nodes;
+    collectStatement(stmt, nodes);
+    for (const IdentifierExpr* identifier : nodes.identifiers)
+    {
+        semantics.resolutionTable.mapping.erase(identifier);
+    }
+    for (const Expr* expr : nodes.expressions)
+    {
+        types.typeTable.mapping.erase(expr);
+    }
+}
+
+void IncrementalAnalyzer::analyze(const Stmt& stmt, Unit& unit)
+{
+    Scope& root = *semantics.rootScope;
+    size_t scopesBefore = root.children.size();
+
+    StatementNodes nodes;
+    collectStatement(stmt, nodes);
+
+    SemanticResult resolved = resolver.resolveTopLevelStatement(stmt, root);
+    for (const IdentifierExpr* identifier : nodes.identifiers)
+    {
+        if (const Symbol* const* symbol = resolved.resolutionTable.mapping.find(identifier))
+        {
+            semantics.resolutionTable.mapping.emplace(identifier, *symbol);
+        }
+    }
+    unit.resolveDiagnostics = std::move(resolved.diagnostics);
+    unit.typeDiagnostics = checker.typeCheckTopLevelStatement(stmt, types.typeTable);
+
+    unit.scopeCount = root.children.size() - scopesBefore;
+    unit.declares.clear();
+    unit.symbol = nullptr;
+    if (stmt.kind == Summon)
+    {
+        auto& summon = static_cast<const SummonStmt&>(stmt);
+        unit.declares = summon.getIdentifier().getName();
+
+        // A redeclaration leaves the earlier statement's symbol in place.
+        const Symbol* symbol = root.lookupLocal(summon.getIdentifier().getNameId());
+        if (symbol != nullptr && symbol->declStmt == &summon)
+        {
+            unit.symbol = symbol;
+        }
+    }
+
+    unit.references.clear();
+    for (const IdentifierExpr* identifier : nodes.identifiers)
+    {
+        unit.references.push_back(identifier->getName());
+    }
+    reanalyzed++;
+}
+
+void IncrementalAnalyzer::update(Program next)
+{
+    std::shared_ptr<AstArena>          arena = next.releaseArena();
+    std::vector<std::unique_ptr<Stmt>> incoming = next.releaseStatements();
+    std::vector<std::unique_ptr<Stmt>> previous = program.releaseStatements();
+
+    // The edit is assumed to be one contiguous region: keep the longest
+    // common prefix and suffix, and analyze what lies between them afresh.
+    size_t limit = std::min(previous.size(), incoming.size());
+    size_t prefix = 0;
+    while (prefix < limit && *previous[prefix] == *incoming[prefix])
+    {
+        prefix++;
+    }
+    size_t suffix = 0;
+    while (suffix < limit - prefix &&
+           *previous[previous.size() - 1 - suffix] == *incoming[incoming.size() - 1 - suffix])
+    {
+        suffix++;
+    }
+
+    park();
+    reanalyzed = 0;
+
+    std::vector<std::unique_ptr<Stmt>> statements;
+    std::vector<Unit>                  nextUnits;
+    std::vector<bool>                  fresh;
+    statements.reserve(incoming.size());
+    nextUnits.reserve(incoming.size());
+
+    // Names whose meaning may differ for statements from here on.
+    std::unordered_set<std::string> dirty;
+    auto                            keep = [&](size_t index)
+    {
+        statements.push_back(std::move(previous[index]));
+        nextUnits.push_back(std::move(units[index]));
+        fresh.push_back(false);
+    };
+
+    for (size_t i = 0; i < prefix; i++)
+    {
+        keep(i);
+    }
+    for (size_t i = prefix; i < previous.size() - suffix; i++)
+    {
+        retire(*previous[i]);
+        if (!units[i].declares.empty())
+        {
+            dirty.insert(units[i].declares);
+        }
+    }
+    for (size_t i = prefix; i < incoming.size() - suffix; i++)
+    {
+        number(*incoming[i]);
+        statements.push_back(std::move(incoming[i]));
+        nextUnits.emplace_back();
+        nextUnits.back().arena = arena;
+        fresh.push_back(true);
+    }
+    for (size_t i = previous.size() - suffix; i < previous.size(); i++)
+    {
+        keep(i);
+    }
+
+    for (size_t i = 0; i < statements.size(); i++)
+    {
+        Unit& unit = nextUnits[i];
+        bool  stale = fresh[i] || (!unit.declares.empty() && dirty.count(unit.declares) > 0) ||
+                     std::any_of(unit.references.begin(), unit.references.end(),
+                                 [&](const std::string& name) { return dirty.count(name) > 0; });
+        if (!stale)
+        {
+            restore(unit);
+            continue;
+        }
+
+        if (!fresh[i])
+        {
+            forget(*statements[i]);
+            unit.parkedSymbol.reset();
+            unit.parkedScopes.clear();
+            if (!unit.declares.empty())
+            {
+                dirty.insert(unit.declares);
+            }
+        }
+        analyze(*statements[i], unit);
+        if (!unit.declares.empty())
+        {
+            dirty.insert(unit.declares);
+        }
+    }
+
+    // Replaced statements go before the arenas that hold them.
+    previous.clear();
+    incoming.clear();
+    units = std::move(nextUnits);
+
+    semantics.diagnostics.clear();
+    types.diagnostics.clear();
+    for (const Unit& unit : units)
+    {
+        semantics.diagnostics.insert(semantics.diagnostics.end(), unit.resolveDiagnostics.begin(),
+                                     unit.resolveDiagnostics.end());
+        types.diagnostics.insert(types.diagnostics.end(), unit.typeDiagnostics.begin(),
+                                 unit.typeDiagnostics.end());
+    }
+
+    program = Program(std::move(statements), next.hadError(), next.getStartLoc(), next.getEndLoc());
+}
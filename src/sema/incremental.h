@@ -0,0 +1,129 @@
+/**
+ * Incremental semantic analysis for editor integrations.
+ *
+ * An IncrementalAnalyzer holds one file's Program together with its scope
+ * tree, resolution table and type table, and brings them up to date with
+ * each new parse of the file. Work is reused at the granularity of top-level
+ * statements:
+ *
+ * - The new statements are matched against the previous ones by structural
+ *   equality (including source locations). Matching statements keep their
+ *   previous AST nodes, so node identity is stable across updates and every
+ *   table entry for them stays valid.
+ * - A kept statement is re-analyzed only if it refers to a name whose
+ *   top-level declaration was added, removed or re-analyzed before it.
+ *   Re-analyzing a statement makes the name it declares dirty in turn.
+ * - Everything else is resolved and type checked from scratch with the
+ *   ordinary Resolver and TypeChecker, one statement at a time.
+ *
+ * The results are the same as running the Resolver and TypeChecker over the
+ * whole program (both phases always run; the type checker tolerates
+ * unresolved identifiers).
+ */
+
+#pragma once
+
+#include "sema/analyzer.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class IncrementalAnalyzer
+{
+  public:
+    IncrementalAnalyzer();
+
+    IncrementalAnalyzer(const IncrementalAnalyzer&) = delete;
+    IncrementalAnalyzer& operator=(const IncrementalAnalyzer&) = delete;
+
+    /**
+     * Replace the analyzed program with a new parse of the file.
+     *
+     * Statements of `program` that equal a previous statement are discarded
+     * in favour of the previous node.
+     *
+     * @param program The freshly parsed program
+     */
+    void update(Program program);
+
+    /** The current program; unchanged statements are the nodes of earlier updates. */
+    const Program& getProgram() const
+    {
+        return program;
+    }
+
+    /** Resolution results for the current program. */
+    const SemanticResult& getSemantics() const
+    {
+        return semantics;
+    }
+
+    /** Type checking results for the current program. */
+    const TypeCheckerResults& getTypes() const
+    {
+        return types;
+    }
+
+    /** Number of top-level statements analyzed by the last update (the rest were reused). */
+    size_t getReanalyzedCount() const
+    {
+        return reanalyzed;
+    }
+
+  private:
+    /**
+     * Analysis state of one top-level statement.
+     *
+     * Between updates a unit's declared symbol and block scopes live in the
+     * root scope; update() parks them here while it rebuilds the root scope.
+     */
+    struct Unit
+    {
+        std::shared_ptr<AstArena>           arena;            ///< Keeps the node storage alive
+        std::string                         declares;         ///< Top-level name declared, if any
+        std::vector<std::string>            references;       ///< Identifier names used
+        const Symbol*                       symbol = nullptr; ///< Declared symbol, if accepted
+        std::unique_ptr<Symbol>             parkedSymbol;     ///< `symbol` while parked
+        size_t                              scopeCount = 0;   ///< Block scopes under the root
+        std::vector<std::unique_ptr<Scope>> parkedScopes;     ///< Those scopes while parked
+        std::vector<Diagnostic>             resolveDiagnostics; ///< From the Resolver
+        std::vector<Diagnostic>             typeDiagnostics;    ///< From the TypeChecker
+    };
+
+    /** Move every unit's symbol and scopes out of the root scope. */
+    void park();
+
+    /** Put a reused unit's symbol and scopes back into the root scope. */
+    void restore(Unit& unit);
+
+    /**
+     * Renumber a new statement's nodes with ids no kept node uses.
+     *
+     * Each parse numbers its nodes from 0, but the tables here are indexed by
+     * node id and hold kept nodes of earlier parses too. Ids given back by
+     * retire() are used first, so the ids in use, and with them the windows
+     * of the tables, stay as compact as the program over a whole session.
+     */
+    void number(Stmt& stmt);
+
+    /** Remove a unit's entries from the resolution and type tables. */
+    void forget(const Stmt& stmt);
+
+    /** forget() a replaced statement and give its ids back to number(). */
+    void retire(const Stmt& stmt);
+
+    /** Resolve and type check one statement from scratch. */
+    void analyze(const Stmt& stmt, Unit& unit);
+
+    // `units` is declared first so the arenas outlive the statements in `program`.
+    std::vector<Unit>   units;     ///< One per statement of `program`
+    Program             program;   ///< Current statements (storage owned by the units' arenas)
+    SemanticResult      semantics; ///< Root scope and tables, kept across updates
+    TypeCheckerResults  types;     ///< Type table, kept across updates
+    Resolver            resolver;
+    TypeChecker         checker;
+    size_t              reanalyzed = 0;
+    NodeId              nextId = 0; ///< First id not given to any node yet
+    std::vector<NodeId> freeIds;    ///< Ids of retired nodes, for reuse
+};
@@ -0,0 +1,124 @@
+/**
+ * @file alloc_hooks.cpp
+ * @brief Replacement global operator new and delete that feed utils/stats.h
+ *
+ * Linked into executables that report allocations (ambra_compiler), never into
+ * the library: replacing the global allocator is a whole-program decision.
+ * Configuring with -DAMBRA_STATS=OFF leaves this file out altogether.
+ *
+ * Only threads with an active StatsRegistry are accounted; everywhere else
+ * the hooks cost one thread-local load on top of malloc and free.
+ *
+ * Sizes are what the C allocator actually handed out, so they include its
+ * rounding. Where it cannot say (neither glibc nor macOS), frees are not seen
+ * and peak bytes become an upper bound. Over-aligned allocations keep the
+ * standard library's operators and are not counted.
+ */
+
+#include "utils/stats.h"
+
+#if !defined(AMBRA_NO_STATS)
+
+#include <cstdlib>
+#include <new>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+static size_t blockSize(void* block)
+{
+    return malloc_usable_size(block);
+}
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+static size_t blockSize(void* block)
+{
+    return malloc_size(block);
+}
+#else
+static size_t blockSize(void*)
+{
+    return 0;
+}
+#endif
+
+[[maybe_unused]] static const bool registered = (statsEnableAllocationTracking(), true);
+
+static void* allocate(size_t bytes) noexcept
+{
+    void* block = std::malloc(bytes == 0 ? 1 : bytes);
+    if (block != nullptr && StatsRegistry::active() != nullptr)
+    {
+        size_t size = blockSize(block);
+        statsRecordAllocation(size == 0 ? bytes : size);
+    }
+    return block;
+}
+
+static void release(void* block) noexcept
+{
+    if (block != nullptr)
+    {
+        if (StatsRegistry::active() != nullptr)
+        {
+            statsRecordFree(blockSize(block));
+        }
+        std::free(block);
+    }
+}
+
+void* operator new(size_t bytes)
+{
+    void* block = allocate(bytes);
+    if (block == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return block;
+}
+
+void* operator new[](size_t bytes)
+{
+    return operator new(bytes);
+}
+
+void* operator new(size_t bytes, const std::nothrow_t&) noexcept
+{
+    return allocate(bytes);
+}
+
+void* operator new[](size_t bytes, const std::nothrow_t&) noexcept
+{
+    return allocate(bytes);
+}
+
+void operator delete(void* block) noexcept
+{
+    release(block);
+}
+
+void operator delete[](void* block) noexcept
+{
+    release(block);
+}
+
+void operator delete(void* block, size_t) noexcept
+{
+    release(block);
+}
+
+void operator delete[](void* block, size_t) noexcept
+{
+    release(block);
+}
+
+void operator delete(void* block, const std::nothrow_t&) noexcept
+{
+    release(block);
+}
+
+void operator delete[](void* block, const std::nothrow_t&) noexcept
+{
+    release(block);
+}
+
+#endif
@@ -0,0 +1,56 @@
+/**
+ * @file interner.cpp
+ * @brief Implementation of the identifier name table.
+ */
+
+#include "utils/interner.h"
+
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+struct NameTable
+{
+    std::shared_mutex                            mutex;
+    std::deque<std::string>                      names; ///< By id; a deque never moves them
+    std::unordered_map<std::string_view, NameId> ids;   ///< Views into `names`
+};
+
+static NameTable& nameTable()
+{
+    static NameTable table;
+    return table;
+}
+
+NameId internName(std::string_view name)
+{
+    NameTable& table = nameTable();
+    {
+        // Almost every call finds a name seen before.
+        std::shared_lock<std::shared_mutex> reading(table.mutex);
+        auto                                found = table.ids.find(name);
+        if (found != table.ids.end())
+        {
+            return found->second;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> writing(table.mutex);
+    auto                                found = table.ids.find(name);
+    if (found != table.ids.end())
+    {
+        return found->second;
+    }
+    NameId id = static_cast<NameId>(table.names.size());
+    table.names.emplace_back(name);
+    table.ids.emplace(table.names.back(), id);
+    return id;
+}
+
+const std::string& nameOf(NameId id)
+{
+    NameTable&                          table = nameTable();
+    std::shared_lock<std::shared_mutex> reading(table.mutex);
+    return table.names[id];
+}
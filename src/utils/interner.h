@@ -0,0 +1,31 @@
+/**
+ * @file interner.h
+ * @brief Process-wide table of interned identifier names
+ *
+ * Each distinct name is stored once and numbered densely from 0. An
+ * IdentifierExpr interns its name when it is created, so name resolution
+ * compares and indexes small integers instead of hashing strings at every
+ * scope.
+ *
+ * The table only grows; names stay valid for the lifetime of the process.
+ * Both functions are safe to call from several threads at once.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/** @brief Dense number of an interned name */
+using NameId = uint32_t;
+
+/**
+ * @brief Number of `name`, adding it to the table if it is new
+ *
+ * Equal names always get the same id.
+ */
+NameId internName(std::string_view name);
+
+/** @brief The name interned as `id` */
+const std::string& nameOf(NameId id);
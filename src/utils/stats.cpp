@@ -0,0 +1,196 @@
+/**
+ * @file stats.cpp
+ * @brief Implementation of the phase timers and counter registry.
+ */
+
+#include "utils/stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+
+/** @brief Allocation totals of one thread, kept by the allocation hooks */
+struct AllocationCounters
+{
+    uint64_t count = 0; ///< Allocations so far
+    uint64_t live = 0;  ///< Bytes currently allocated
+    uint64_t peak = 0;  ///< Highest `live` since the innermost timer started
+};
+
+// Plain data, so it is constant-initialized and safe to touch from operator new.
+static thread_local AllocationCounters allocations;
+static thread_local StatsRegistry*     activeRegistry = nullptr;
+static std::atomic<bool>               allocationsTracked{false};
+
+void statsRecordAllocation(size_t bytes)
+{
+    allocations.count++;
+    allocations.live += bytes;
+    if (allocations.live > allocations.peak)
+    {
+        allocations.peak = allocations.live;
+    }
+}
+
+void statsRecordFree(size_t bytes)
+{
+    // Memory freed on another thread than it was allocated on would underflow.
+    allocations.live -= std::min<uint64_t>(bytes, allocations.live);
+}
+
+void statsEnableAllocationTracking()
+{
+    allocationsTracked.store(true, std::memory_order_relaxed);
+}
+
+bool statsTracksAllocations()
+{
+    return allocationsTracked.load(std::memory_order_relaxed);
+}
+
+// ==================================================================================
+// REGISTRY
+// ==================================================================================
+
+void StatsRegistry::recordPhase(const PhaseRecord& phase)
+{
+    for (PhaseRecord& existing : phases)
+    {
+        if (std::strcmp(existing.name, phase.name) == 0)
+        {
+            existing.seconds += phase.seconds;
+            existing.allocations += phase.allocations;
+            existing.peakBytes = std::max(existing.peakBytes, phase.peakBytes);
+            return;
+        }
+    }
+    phases.push_back(phase);
+}
+
+void StatsRegistry::count(const char* name, uint64_t amount)
+{
+    for (CounterRecord& existing : counters)
+    {
+        if (std::strcmp(existing.name, name) == 0)
+        {
+            existing.value += amount;
+            return;
+        }
+    }
+    counters.push_back({name, amount});
+}
+
+uint64_t StatsRegistry::counter(const char* name) const
+{
+    for (const CounterRecord& existing : counters)
+    {
+        if (std::strcmp(existing.name, name) == 0)
+        {
+            return existing.value;
+        }
+    }
+    return 0;
+}
+
+static void printPhaseLine(std::ostream& out, const char* name, double seconds,
+                           uint64_t allocations, uint64_t peakBytes, bool tracked)
+{
+    char line[128];
+    if (tracked)
+    {
+        std::snprintf(line, sizeof(line), "  %-12s %10.3f %12llu %12.1f\n", name, seconds * 1e3,
+                      static_cast<unsigned long long>(allocations), peakBytes / 1024.0);
+    }
+    else
+    {
+        std::snprintf(line, sizeof(line), "  %-12s %10.3f %12s %12s\n", name, seconds * 1e3, "-",
+                      "-");
+    }
+    out << line;
+}
+
+void StatsRegistry::printPhases(std::ostream& out) const
+{
+    bool tracked = statsTracksAllocations();
+    char header[128];
+    std::snprintf(header, sizeof(header), "  %-12s %10s %12s %12s\n", "phase", "wall ms", "allocs",
+                  "peak KiB");
+    out << header;
+
+    PhaseRecord total{"total"};
+    for (const PhaseRecord& phase : phases)
+    {
+        printPhaseLine(out, phase.name, phase.seconds, phase.allocations, phase.peakBytes, tracked);
+        total.seconds += phase.seconds;
+        total.allocations += phase.allocations;
+        total.peakBytes = std::max(total.peakBytes, phase.peakBytes);
+    }
+    printPhaseLine(out, total.name, total.seconds, total.allocations, total.peakBytes, tracked);
+}
+
+void StatsRegistry::printCounters(std::ostream& out) const
+{
+    for (const CounterRecord& counter : counters)
+    {
+        char line[128];
+        std::snprintf(line, sizeof(line), "  %-12s %12llu\n", counter.name,
+                      static_cast<unsigned long long>(counter.value));
+        out << line;
+    }
+}
+
+StatsRegistry* StatsRegistry::active()
+{
+    return activeRegistry;
+}
+
+StatsRegistry::Scope::Scope(StatsRegistry& registry) : previous(activeRegistry)
+{
+    activeRegistry = &registry;
+}
+
+StatsRegistry::Scope::~Scope()
+{
+    activeRegistry = previous;
+}
+
+// ==================================================================================
+// TIMERS
+// ==================================================================================
+
+#if !defined(AMBRA_NO_STATS)
+
+PhaseTimer::PhaseTimer(const char* name) : registry(activeRegistry), name(name)
+{
+    if (registry == nullptr)
+    {
+        return;
+    }
+    allocationsAtStart = allocations.count;
+    liveAtStart = allocations.live;
+    outerPeak = allocations.peak;
+    allocations.peak = allocations.live;
+    start = std::chrono::steady_clock::now();
+}
+
+PhaseTimer::~PhaseTimer()
+{
+    if (registry == nullptr)
+    {
+        return;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    PhaseRecord phase{name};
+    phase.seconds = elapsed.count();
+    phase.allocations = allocations.count - allocationsAtStart;
+    phase.peakBytes = allocations.peak - std::min(allocations.peak, liveAtStart);
+    registry->recordPhase(phase);
+
+    // An enclosing timer still wants the highest point over its whole span.
+    allocations.peak = std::max(outerPeak, allocations.peak);
+}
+
+#endif
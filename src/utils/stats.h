@@ -0,0 +1,178 @@
+/**
+ * @file stats.h
+ * @brief Phase timers and counters for compiler instrumentation
+ *
+ * A StatsRegistry collects the numbers of one compilation: the wall time,
+ * allocation count and peak allocated bytes of each phase, and named counts
+ * such as tokens or instructions. Code reports to the registry made active on
+ * the current thread with StatsRegistry::Scope, so parallel compile jobs keep
+ * separate numbers; with no registry active, reporting is one thread-local
+ * load and a branch.
+ *
+ * Allocations are only seen when the executable also links
+ * utils/alloc_hooks.cpp, which replaces the global operator new and delete
+ * (ambra_compiler does; the library and the tests do not). Without it the
+ * allocation columns are reported as unknown. The hooks only account for
+ * threads with an active registry.
+ *
+ * Defining AMBRA_NO_STATS compiles the instrumentation out: PhaseTimer,
+ * timePhase() and AMBRA_COUNT do nothing, and registries stay empty. The
+ * AMBRA_STATS=OFF CMake option defines it and drops the allocation hooks.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+/** @brief True unless instrumentation is compiled out with AMBRA_NO_STATS */
+#if defined(AMBRA_NO_STATS)
+constexpr bool STATS_ENABLED = false;
+#else
+constexpr bool STATS_ENABLED = true;
+#endif
+
+/** @brief Cost of one phase; phases reported more than once are summed */
+struct PhaseRecord
+{
+    const char* name;
+    double      seconds = 0;     ///< Wall time
+    uint64_t    allocations = 0; ///< Calls to operator new
+    uint64_t    peakBytes = 0;   ///< Most bytes allocated at once, above the phase's start
+};
+
+/** @brief A named count; counts reported more than once are summed */
+struct CounterRecord
+{
+    const char* name;
+    uint64_t    value = 0;
+};
+
+class StatsRegistry
+{
+  public:
+    /** @brief Add a phase's cost, merging with an earlier phase of the same name */
+    void recordPhase(const PhaseRecord& phase);
+
+    /** @brief Add `amount` to the counter `name`, creating it at 0 */
+    void count(const char* name, uint64_t amount);
+
+    /** @brief Phases in the order they were first reported */
+    const std::vector<PhaseRecord>& getPhases() const
+    {
+        return phases;
+    }
+
+    /** @brief Counters in the order they were first reported */
+    const std::vector<CounterRecord>& getCounters() const
+    {
+        return counters;
+    }
+
+    /** @brief Value of the counter `name`, 0 if it was never reported */
+    uint64_t counter(const char* name) const;
+
+    /** @brief Print a table of phases with a total line */
+    void printPhases(std::ostream& out) const;
+
+    /** @brief Print one line per counter */
+    void printCounters(std::ostream& out) const;
+
+    /** @brief Registry that reports on this thread go to, or nullptr */
+    static StatsRegistry* active();
+
+    /**
+     * @brief Makes a registry active on this thread for its lifetime
+     *
+     * Scopes nest; the previous registry is active again afterwards.
+     */
+    class Scope
+    {
+      public:
+        explicit Scope(StatsRegistry& registry);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+      private:
+        StatsRegistry* previous;
+    };
+
+  private:
+    std::vector<PhaseRecord>   phases;
+    std::vector<CounterRecord> counters;
+};
+
+/**
+ * @brief Reports the phase `name` to the active registry when it goes out of scope
+ *
+ * The name must outlive the registry; string literals are the intended use.
+ */
+class PhaseTimer
+{
+  public:
+#if defined(AMBRA_NO_STATS)
+    explicit PhaseTimer(const char*) {}
+#else
+    explicit PhaseTimer(const char* name);
+    ~PhaseTimer();
+#endif
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+#if !defined(AMBRA_NO_STATS)
+  private:
+    StatsRegistry*                        registry;
+    const char*                           name;
+    std::chrono::steady_clock::time_point start;
+    uint64_t                              allocationsAtStart = 0;
+    uint64_t                              liveAtStart = 0;
+    uint64_t                              outerPeak = 0; ///< Peak to restore for enclosing timers
+#endif
+};
+
+/** @brief Run `work` as the phase `name` and return what it returns */
+template <typename Work> decltype(auto) timePhase(const char* name, Work&& work)
+{
+    PhaseTimer timer(name);
+    return work();
+}
+
+#if defined(AMBRA_NO_STATS)
+#define AMBRA_COUNT(name, amount) ((void)0)
+#else
+/** @brief Add `amount` to the counter `name` of the active registry, if any */
+#define AMBRA_COUNT(name, amount)                                                                  \
+    do                                                                                             \
+    {                                                                                              \
+        if (StatsRegistry* ambraStats = StatsRegistry::active())                                   \
+        {                                                                                          \
+            ambraStats->count(name, static_cast<uint64_t>(amount));                                \
+        }                                                                                          \
+    } while (0)
+#endif
+
+// ==================================================================================
+// ALLOCATION HOOKS
+// ==================================================================================
+
+/**
+ * @brief Note an allocation of `bytes` on this thread
+ *
+ * Called by the replacement operator new; must not allocate.
+ */
+void statsRecordAllocation(size_t bytes);
+
+/** @brief Note that `bytes` allocated earlier were freed */
+void statsRecordFree(size_t bytes);
+
+/** @brief Called once by the allocation hooks, so reports show the allocation columns */
+void statsEnableAllocationTracking();
+
+/** @brief Whether allocations are being recorded */
+bool statsTracksAllocations();
@@ -0,0 +1,133 @@
+/**
+ * @file thread_pool.cpp
+ * @brief Implementation of the work-stealing thread pool.
+ */
+
+#include "utils/thread_pool.h"
+
+#include <utility>
+
+// Index of the pool queue owned by the current thread, if it is a worker.
+static thread_local const ThreadPool* currentPool = nullptr;
+static thread_local size_t            currentQueue = 0;
+
+size_t ThreadPool::defaultThreadCount()
+{
+    unsigned hardware = std::thread::hardware_concurrency();
+    return hardware == 0 ? 1 : hardware;
+}
+
+ThreadPool::ThreadPool(size_t threadCount) : nextQueue(0)
+{
+    if (threadCount == 0)
+    {
+        threadCount = defaultThreadCount();
+    }
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    threads.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        threads.emplace_back([this, i] { workerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+void ThreadPool::submit(Task task)
+{
+    size_t target = currentPool == this ? currentQueue
+                                        : nextQueue.fetch_add(1, std::memory_order_relaxed) %
+                                              queues.size();
+    {
+        std::lock_guard<std::mutex> lock(queues[target]->mutex);
+        queues[target]->tasks.push_back(std::move(task));
+    }
+    // Counted only once the task is visible, so a worker that claims it will find it.
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        queued++;
+        pending++;
+    }
+    wake.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(stateMutex);
+    idle.wait(lock, [this] { return pending == 0; });
+}
+
+bool ThreadPool::take(size_t self, Task& task)
+{
+    {
+        Queue&                      own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t offset = 1; offset < queues.size(); offset++)
+    {
+        Queue&                      victim = *queues[(self + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t self)
+{
+    currentPool = this;
+    currentQueue = self;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(stateMutex);
+            wake.wait(lock, [this] { return queued > 0 || stopping; });
+            if (queued == 0)
+            {
+                return;
+            }
+            queued--;
+        }
+
+        // The claim above guarantees an unclaimed task sits in some queue,
+        // though another worker may take it first and leave us a later one.
+        Task task;
+        while (!take(self, task))
+        {
+            std::this_thread::yield();
+        }
+        task();
+
+        std::lock_guard<std::mutex> lock(stateMutex);
+        if (--pending == 0)
+        {
+            idle.notify_all();
+        }
+    }
+}
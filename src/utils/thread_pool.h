@@ -0,0 +1,79 @@
+/**
+ * @file thread_pool.h
+ * @brief Work-stealing thread pool for running independent jobs
+ *
+ * Every worker owns a deque of tasks. A worker takes its newest task first
+ * (tasks it submits itself go to its own deque, so related work stays on one
+ * core) and, when its deque is empty, steals the oldest task of another
+ * worker. Tasks submitted from outside the pool are spread round-robin.
+ *
+ * Tasks must not throw. Results are returned through state captured by the
+ * task, typically a slot per job in a vector owned by the caller, which keeps
+ * the order of results independent of scheduling.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+  public:
+    using Task = std::function<void()>;
+
+    /**
+     * @brief Start `threads` workers
+     * @param threads Number of workers; 0 means one per hardware thread
+     */
+    explicit ThreadPool(size_t threads = 0);
+
+    /** @brief Finish every submitted task, then stop the workers */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /** @brief Queue a task (may be called from inside another task) */
+    void submit(Task task);
+
+    /** @brief Block until every task submitted so far has finished */
+    void wait();
+
+    /** @brief Number of worker threads */
+    size_t size() const
+    {
+        return threads.size();
+    }
+
+    /** @brief One per hardware thread, at least 1 */
+    static size_t defaultThreadCount();
+
+  private:
+    struct Queue
+    {
+        std::mutex       mutex;
+        std::deque<Task> tasks;
+    };
+
+    /// Take the newest task of queue `self`, or else steal the oldest of another queue.
+    bool take(size_t self, Task& task);
+    void workerLoop(size_t self);
+
+    std::vector<std::unique_ptr<Queue>> queues;           ///< One per worker
+    std::vector<std::thread>            threads;          ///< The workers
+    std::atomic<size_t>                 nextQueue;        ///< Round-robin target for outside tasks
+    std::mutex                          stateMutex;       ///< Guards the counters below
+    std::condition_variable             wake;             ///< Signalled on new work or on stop
+    std::condition_variable             idle;             ///< Signalled when `pending` hits zero
+    size_t                              queued = 0;       ///< Tasks not yet claimed by a worker
+    size_t                              pending = 0;      ///< Tasks not yet finished
+    bool                                stopping = false; ///< Set by the destructor
+};
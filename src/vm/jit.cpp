@@ -0,0 +1,808 @@
+/**
+ * @file jit.cpp
+ * @brief x86-64 code generation for hot loops.
+ */
+
+#include "vm/jit.h"
+
+#include <cstring>
+#include <deque>
+#include <utility>
+
+#if AMBRA_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+LoopJit::LoopJit(const uint8_t* code, uint32_t size, const JitHelpers& helpers,
+                 uint32_t threshold)
+    : code(code), size(size), helpers(helpers), threshold(threshold), loops(size)
+{
+}
+
+#if !AMBRA_JIT
+
+LoopJit::~LoopJit() = default;
+
+JitLoop LoopJit::compile(uint32_t, uint32_t)
+{
+    return nullptr;
+}
+
+#else
+
+LoopJit::~LoopJit()
+{
+    for (const Region& region : regions)
+    {
+        munmap(region.memory, region.size);
+    }
+}
+
+// ==================================================================================
+// ASSEMBLER
+// ==================================================================================
+
+enum Reg : uint8_t
+{
+    RAX = 0,
+    RCX = 1,
+    RDX = 2,
+    RBX = 3,
+    RSI = 6,
+    RDI = 7,
+    R12 = 12,
+    R13 = 13,
+    R14 = 14,
+    R15 = 15,
+};
+
+// Fixed roles in generated code; all three are callee-saved, so they survive helper calls.
+static constexpr Reg CONTEXT = RBX; ///< First argument, passed on to helpers
+static constexpr Reg LOCALS = R12;
+static constexpr Reg STACK = R13; ///< Operand stack on entry; slot k is at STACK + 8k
+static constexpr Reg POOL = R14;
+
+/** @brief x86 condition codes, as used in Jcc and SETcc */
+enum Cond : uint8_t
+{
+    CC_B = 0x2,
+    CC_AE = 0x3,
+    CC_E = 0x4,
+    CC_NE = 0x5,
+    CC_L = 0xC,
+    CC_GE = 0xD,
+    CC_LE = 0xE,
+    CC_G = 0xF,
+};
+
+/** @brief Just the instructions the loop compiler needs */
+class Assembler
+{
+  public:
+    std::vector<uint8_t> bytes;
+
+    size_t position() const
+    {
+        return bytes.size();
+    }
+
+    void byte(uint8_t b)
+    {
+        bytes.push_back(b);
+    }
+
+    void u32(uint32_t v)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            byte(static_cast<uint8_t>(v >> (8 * i)));
+        }
+    }
+
+    void u64(uint64_t v)
+    {
+        u32(static_cast<uint32_t>(v));
+        u32(static_cast<uint32_t>(v >> 32));
+    }
+
+    /** @brief REX prefix; `w` selects 64-bit operands. Omitted when it would be empty. */
+    void rex(bool w, uint8_t reg, uint8_t rm)
+    {
+        uint8_t prefix = 0x40 | (w ? 8 : 0) | ((reg >> 3) << 2) | (rm >> 3);
+        if (prefix != 0x40)
+        {
+            byte(prefix);
+        }
+    }
+
+    void modrmReg(uint8_t reg, uint8_t rm)
+    {
+        byte(static_cast<uint8_t>(0xC0 | ((reg & 7) << 3) | (rm & 7)));
+    }
+
+    /** @brief [base + disp32]; r12 needs a SIB byte, and r13/rbp always take a displacement */
+    void modrmMem(uint8_t reg, uint8_t base, int32_t disp)
+    {
+        byte(static_cast<uint8_t>(0x80 | ((reg & 7) << 3) | (base & 7)));
+        if ((base & 7) == 4)
+        {
+            byte(0x24);
+        }
+        u32(static_cast<uint32_t>(disp));
+    }
+
+    void load(Reg dst, Reg base, int32_t disp) ///< mov dst, [base + disp]
+    {
+        rex(true, dst, base);
+        byte(0x8B);
+        modrmMem(dst, base, disp);
+    }
+
+    void store(Reg base, int32_t disp, Reg src) ///< mov [base + disp], src
+    {
+        rex(true, src, base);
+        byte(0x89);
+        modrmMem(src, base, disp);
+    }
+
+    void move(Reg dst, Reg src) ///< mov dst, src
+    {
+        rex(true, src, dst);
+        byte(0x89);
+        modrmReg(src, dst);
+    }
+
+    void moveImm64(Reg dst, uint64_t imm) ///< mov dst, imm64
+    {
+        rex(true, 0, dst);
+        byte(static_cast<uint8_t>(0xB8 | (dst & 7)));
+        u64(imm);
+    }
+
+    void moveImm32(Reg dst, uint32_t imm) ///< mov dst32, imm32 (zero-extends)
+    {
+        rex(false, 0, dst);
+        byte(static_cast<uint8_t>(0xB8 | (dst & 7)));
+        u32(imm);
+    }
+
+    void lea(Reg dst, Reg base, int32_t disp) ///< lea dst, [base + disp]
+    {
+        rex(true, dst, base);
+        byte(0x8D);
+        modrmMem(dst, base, disp);
+    }
+
+    void shift(uint8_t ext, Reg reg, uint8_t amount) ///< shl (4), shr (5), sar (7) by imm8
+    {
+        rex(true, 0, reg);
+        byte(0xC1);
+        modrmReg(ext, reg);
+        byte(amount);
+    }
+
+    void orImm8(Reg reg, int8_t imm) ///< or reg, imm8
+    {
+        rex(true, 0, reg);
+        byte(0x83);
+        modrmReg(1, reg);
+        byte(static_cast<uint8_t>(imm));
+    }
+
+    /** @brief add (0x01), sub (0x29), cmp (0x39) or test (0x85) on 32-bit registers */
+    void alu32(uint8_t opcode, Reg dst, Reg src)
+    {
+        rex(false, src, dst);
+        byte(opcode);
+        modrmReg(src, dst);
+    }
+
+    void cmp64(Reg a, Reg b) ///< cmp a, b
+    {
+        rex(true, b, a);
+        byte(0x39);
+        modrmReg(b, a);
+    }
+
+    void cmp64Mem(Reg a, Reg base, int32_t disp) ///< cmp a, [base + disp]
+    {
+        rex(true, a, base);
+        byte(0x3B);
+        modrmMem(a, base, disp);
+    }
+
+    void imul32(Reg dst, Reg src) ///< imul dst32, src32
+    {
+        rex(false, dst, src);
+        byte(0x0F);
+        byte(0xAF);
+        modrmReg(dst, src);
+    }
+
+    void unary32(uint8_t ext, Reg reg) ///< neg (3), idiv (7) on a 32-bit register
+    {
+        rex(false, 0, reg);
+        byte(0xF7);
+        modrmReg(ext, reg);
+    }
+
+    void cmp32Imm8(Reg reg, int8_t imm) ///< cmp reg32, imm8
+    {
+        rex(false, 0, reg);
+        byte(0x83);
+        modrmReg(7, reg);
+        byte(static_cast<uint8_t>(imm));
+    }
+
+    void bitOp(uint8_t ext, Reg reg, uint8_t bit) ///< bt (4), btc (7) reg, imm8
+    {
+        rex(true, 0, reg);
+        byte(0x0F);
+        byte(0xBA);
+        modrmReg(ext, reg);
+        byte(bit);
+    }
+
+    void setAndZeroExtend(Cond cc) ///< setcc al; movzx eax, al
+    {
+        byte(0x0F);
+        byte(static_cast<uint8_t>(0x90 | cc));
+        byte(0xC0);
+        byte(0x0F);
+        byte(0xB6);
+        byte(0xC0);
+    }
+
+    /** @brief jmp rel32; returns where the displacement goes */
+    size_t jump()
+    {
+        byte(0xE9);
+        u32(0);
+        return position() - 4;
+    }
+
+    /** @brief jcc rel32; returns where the displacement goes */
+    size_t jumpIf(Cond cc)
+    {
+        byte(0x0F);
+        byte(static_cast<uint8_t>(0x80 | cc));
+        u32(0);
+        return position() - 4;
+    }
+
+    /** @brief Point the rel32 at `at` to `target` */
+    void patch(size_t at, size_t target)
+    {
+        int32_t rel = static_cast<int32_t>(static_cast<int64_t>(target) -
+                                           static_cast<int64_t>(at + 4));
+        std::memcpy(bytes.data() + at, &rel, sizeof(rel));
+    }
+
+    void call(Reg target) ///< call reg
+    {
+        rex(false, 0, target);
+        byte(0xFF);
+        modrmReg(2, target);
+    }
+
+    void push(Reg reg)
+    {
+        rex(false, 0, reg);
+        byte(static_cast<uint8_t>(0x50 | (reg & 7)));
+    }
+
+    void pop(Reg reg)
+    {
+        rex(false, 0, reg);
+        byte(static_cast<uint8_t>(0x58 | (reg & 7)));
+    }
+
+    void cdq()
+    {
+        byte(0x99);
+    }
+
+    void ret()
+    {
+        byte(0xC3);
+    }
+};
+
+// ==================================================================================
+// LOOP COMPILER
+// ==================================================================================
+
+static int32_t slot(int depth)
+{
+    return 8 * depth;
+}
+
+/** @brief Jump target of a branch instruction, if `ip` is one */
+static bool branchTarget(const uint8_t* ip, uint32_t& target)
+{
+    switch (*ip)
+    {
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_JUMP_IF_TRUE:
+        target = readU32(ip + 1);
+        return true;
+    case OP_JUMP_IF_NOT_LT_LOCALS:
+        target = readU32(ip + 3);
+        return true;
+    default:
+        return false;
+    }
+}
+
+/** @brief Offset of the instruction after the one at `offset` */
+static uint32_t nextOffset(const uint8_t* code, uint32_t offset)
+{
+    return offset + 1 + static_cast<uint32_t>(operandWidth(static_cast<BytecodeOp>(code[offset])));
+}
+
+/** @brief Byte offset of local or constant `index`, if it fits a displacement */
+static bool displacement(uint32_t index, int32_t& disp)
+{
+    if (index > static_cast<uint32_t>(INT32_MAX / 8))
+    {
+        return false;
+    }
+    disp = static_cast<int32_t>(8 * index);
+    return true;
+}
+
+/** @brief Translation of one loop region: [head, end) of the code section */
+class LoopCompiler
+{
+  public:
+    LoopCompiler(const uint8_t* code, uint32_t head, uint32_t end, const JitHelpers& helpers)
+        : code(code), head(head), end(end), helpers(helpers)
+    {
+    }
+
+    /** @brief Generate the loop; false if it cannot be compiled */
+    bool compile()
+    {
+        if (!computeDepths())
+        {
+            return false;
+        }
+
+        // r15 is unused; saving it as well keeps the stack 16-byte aligned for calls.
+        as.push(RBX);
+        as.push(R12);
+        as.push(R13);
+        as.push(R14);
+        as.push(R15);
+        as.move(CONTEXT, RDI);
+        as.move(LOCALS, RSI);
+        as.move(STACK, RDX);
+        as.move(POOL, RCX);
+
+        for (uint32_t offset = head; offset < end; offset = next(offset))
+        {
+            native[offset - head] = as.position();
+            if (depth[offset - head] >= 0 && !emit(offset, depth[offset - head]))
+            {
+                return false;
+            }
+        }
+
+        for (const Exit& exit : exits)
+        {
+            as.patch(exit.at, as.position());
+            leave(exit.offset, exit.depth);
+        }
+
+        size_t epilogue = as.position();
+        as.pop(R15);
+        as.pop(R14);
+        as.pop(R13);
+        as.pop(R12);
+        as.pop(RBX);
+        as.ret();
+
+        for (size_t at : returns)
+        {
+            as.patch(at, epilogue);
+        }
+        for (const Fixup& fixup : fixups)
+        {
+            as.patch(fixup.at, native[fixup.target - head]);
+        }
+        return true;
+    }
+
+    const std::vector<uint8_t>& bytes() const
+    {
+        return as.bytes;
+    }
+
+  private:
+    /** @brief A rel32 that must reach the code of the instruction at `target` */
+    struct Fixup
+    {
+        size_t   at;
+        uint32_t target;
+    };
+
+    /** @brief A rel32 that must reach a return to the interpreter */
+    struct Exit
+    {
+        size_t   at;
+        uint32_t offset;
+        int      depth;
+    };
+
+    uint32_t next(uint32_t offset) const
+    {
+        return nextOffset(code, offset);
+    }
+
+    bool inRegion(uint32_t offset) const
+    {
+        return offset >= head && offset < end;
+    }
+
+    /**
+     * @brief Operand stack depth before every reachable instruction, relative to the head
+     *
+     * Fails if the region does not split into whole instructions, a jump lands
+     * inside an instruction, an instruction pops below the loop's entry depth,
+     * or two paths reach an instruction with different depths.
+     */
+    bool computeDepths()
+    {
+        depth.assign(end - head, -1);
+        native.assign(end - head, 0);
+        std::vector<bool> starts(end - head, false);
+        uint32_t          offset = head;
+        for (; offset < end; offset = next(offset))
+        {
+            if (code[offset] >= OP_COUNT)
+            {
+                return false;
+            }
+            starts[offset - head] = true;
+        }
+        if (offset != end)
+        {
+            return false;
+        }
+
+        std::deque<uint32_t> work{head};
+        depth[0] = 0;
+        auto reach = [&](uint32_t target, int incoming)
+        {
+            if (!inRegion(target))
+            {
+                return true;
+            }
+            int& known = depth[target - head];
+            if (!starts[target - head] || (known >= 0 && known != incoming))
+            {
+                return false;
+            }
+            if (known < 0)
+            {
+                known = incoming;
+                work.push_back(target);
+            }
+            return true;
+        };
+
+        while (!work.empty())
+        {
+            uint32_t at = work.front();
+            work.pop_front();
+
+            const uint8_t* ip = code + at;
+            int            pops = 0;
+            int            pushes = 0;
+            if (!stackEffect(ip, pops, pushes) || depth[at - head] < pops)
+            {
+                return false;
+            }
+            if (*ip == OP_HALT)
+            {
+                continue;
+            }
+            int      after = depth[at - head] - pops + pushes;
+            uint32_t target = 0;
+            if (branchTarget(ip, target) && !reach(target, after))
+            {
+                return false;
+            }
+            if (*ip != OP_JUMP && !reach(next(at), after))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /** @brief Return to the interpreter at `offset` with `depth` values on the stack */
+    void leave(uint32_t offset, int depth)
+    {
+        as.moveImm64(RAX, (static_cast<uint64_t>(depth) << 32) | offset);
+        returns.push_back(as.jump());
+    }
+
+    /** @brief Continue at `target`: inside the region, or back in the interpreter */
+    void jumpTo(uint32_t target, int depth)
+    {
+        if (inRegion(target))
+        {
+            fixups.push_back({as.jump(), target});
+        }
+        else
+        {
+            leave(target, depth);
+        }
+    }
+
+    /** @brief Continue at `target` if `cc` holds */
+    void jumpIf(Cond cc, uint32_t target, int depth)
+    {
+        if (inRegion(target))
+        {
+            fixups.push_back({as.jumpIf(cc), target});
+        }
+        else
+        {
+            exits.push_back({as.jumpIf(cc), target, depth});
+        }
+    }
+
+    /** @brief Re-tag the I32 payload in eax as a Value in rax */
+    void boxI32()
+    {
+        as.shift(4, RAX, 32);
+        as.orImm8(RAX, 1);
+    }
+
+    /** @brief Load the I32 payloads of the top two values into eax and ecx */
+    void loadOperands(int depth)
+    {
+        as.load(RAX, STACK, slot(depth - 2));
+        as.load(RCX, STACK, slot(depth - 1));
+        as.shift(5, RAX, 32);
+        as.shift(5, RCX, 32);
+    }
+
+    /** @brief Replace the top two values with the Bool result of comparing them */
+    void compare(Cond cc, int depth)
+    {
+        // Both operands carry the same tag in their low bits, so comparing the
+        // whole words orders them exactly as their signed payloads.
+        as.load(RAX, STACK, slot(depth - 2));
+        as.cmp64Mem(RAX, STACK, slot(depth - 1));
+        as.setAndZeroExtend(cc);
+        as.shift(4, RAX, 32);
+        as.orImm8(RAX, 2);
+        as.store(STACK, slot(depth - 2), RAX);
+    }
+
+    /** @brief Emit the instruction at `offset`, entered with `depth` values on the stack */
+    bool emit(uint32_t offset, int depth)
+    {
+        const uint8_t* ip = code + offset;
+        BytecodeOp     op = static_cast<BytecodeOp>(*ip);
+        int32_t        disp = 0;
+
+        switch (op)
+        {
+        case OP_PUSH_CONST:
+        case OP_PUSH_CONST_W:
+        case OP_PUSH_CONST_L:
+            if (!displacement(decodeOperand(ip), disp))
+            {
+                return false;
+            }
+            as.load(RAX, POOL, disp);
+            as.store(STACK, slot(depth), RAX);
+            break;
+        case OP_LOAD_LOCAL:
+        case OP_LOAD_LOCAL_W:
+        case OP_LOAD_LOCAL_L:
+            if (!displacement(decodeOperand(ip), disp))
+            {
+                return false;
+            }
+            as.load(RAX, LOCALS, disp);
+            as.store(STACK, slot(depth), RAX);
+            break;
+        case OP_STORE_LOCAL:
+        case OP_STORE_LOCAL_W:
+        case OP_STORE_LOCAL_L:
+            if (!displacement(decodeOperand(ip), disp))
+            {
+                return false;
+            }
+            as.load(RAX, STACK, slot(depth - 1));
+            as.store(LOCALS, disp, RAX);
+            break;
+        case OP_POP:
+        case OP_NOP:
+            break;
+        case OP_ADD_I32:
+        case OP_SUB_I32:
+        case OP_MUL_I32:
+            loadOperands(depth);
+            if (op == OP_MUL_I32)
+            {
+                as.imul32(RAX, RCX);
+            }
+            else
+            {
+                as.alu32(op == OP_ADD_I32 ? 0x01 : 0x29, RAX, RCX);
+            }
+            boxI32();
+            as.store(STACK, slot(depth - 2), RAX);
+            break;
+        case OP_DIV_I32:
+        {
+            // The interpreter reports division by zero; INT32_MIN / -1 wraps
+            // there but would fault in idiv.
+            loadOperands(depth);
+            as.alu32(0x85, RCX, RCX);
+            exits.push_back({as.jumpIf(CC_E), offset, depth});
+            as.cmp32Imm8(RCX, -1);
+            size_t divide = as.jumpIf(CC_NE);
+            as.unary32(3, RAX);
+            size_t done = as.jump();
+            as.patch(divide, as.position());
+            as.cdq();
+            as.unary32(7, RCX);
+            as.patch(done, as.position());
+            boxI32();
+            as.store(STACK, slot(depth - 2), RAX);
+            break;
+        }
+        case OP_NOT_BOOL:
+            as.load(RAX, STACK, slot(depth - 1));
+            as.bitOp(7, RAX, 32);
+            as.store(STACK, slot(depth - 1), RAX);
+            break;
+        case OP_NEG_I32:
+            as.load(RAX, STACK, slot(depth - 1));
+            as.shift(5, RAX, 32);
+            as.unary32(3, RAX);
+            boxI32();
+            as.store(STACK, slot(depth - 1), RAX);
+            break;
+        case OP_CMP_EQ_I32:
+        case OP_CMP_EQ_BOOL:
+            compare(CC_E, depth);
+            break;
+        case OP_CMP_NEQ_I32:
+        case OP_CMP_NEQ_BOOL:
+            compare(CC_NE, depth);
+            break;
+        case OP_CMP_LT_I32:
+            compare(CC_L, depth);
+            break;
+        case OP_CMP_LTEQ_I32:
+            compare(CC_LE, depth);
+            break;
+        case OP_CMP_GT_I32:
+            compare(CC_G, depth);
+            break;
+        case OP_CMP_GTEQ_I32:
+            compare(CC_GE, depth);
+            break;
+        case OP_JUMP:
+            jumpTo(readU32(ip + 1), depth);
+            return true;
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_TRUE:
+            // Bit 32 is the Bool payload; bt copies it into the carry flag.
+            as.load(RAX, STACK, slot(depth - 1));
+            as.bitOp(4, RAX, 32);
+            jumpIf(op == OP_JUMP_IF_FALSE ? CC_AE : CC_B, readU32(ip + 1), depth - 1);
+            depth--;
+            break;
+        case OP_JUMP_IF_NOT_LT_LOCALS:
+        {
+            int32_t other = 0;
+            if (!displacement(ip[1], disp) || !displacement(ip[2], other))
+            {
+                return false;
+            }
+            as.load(RAX, LOCALS, disp);
+            as.cmp64Mem(RAX, LOCALS, other);
+            jumpIf(CC_GE, readU32(ip + 3), depth);
+            break;
+        }
+        case OP_ADD_LOCAL_CONST:
+        {
+            int32_t constant = 0;
+            int32_t result = 0;
+            if (!displacement(ip[1], disp) || !displacement(ip[2], constant) ||
+                !displacement(ip[3], result))
+            {
+                return false;
+            }
+            as.load(RAX, LOCALS, disp);
+            as.load(RCX, POOL, constant);
+            as.shift(5, RAX, 32);
+            as.shift(5, RCX, 32);
+            as.alu32(0x01, RAX, RCX);
+            boxI32();
+            as.store(LOCALS, result, RAX);
+            break;
+        }
+        default:
+            if (op == OP_HALT || helpers.ops[op] == nullptr)
+            {
+                // The interpreter runs this instruction and whatever follows.
+                leave(offset, depth);
+                return true;
+            }
+            as.move(RDI, CONTEXT);
+            as.lea(RSI, STACK, slot(depth));
+            as.moveImm32(RDX, decodeOperand(ip));
+            as.moveImm64(RAX, reinterpret_cast<uint64_t>(helpers.ops[op]));
+            as.call(RAX);
+            break;
+        }
+
+        int pops = 0;
+        int pushes = 0;
+        stackEffect(ip, pops, pushes);
+        if (next(offset) >= end)
+        {
+            leave(next(offset), depth - pops + pushes);
+        }
+        return true;
+    }
+
+    const uint8_t*      code;
+    uint32_t            head;
+    uint32_t            end;
+    const JitHelpers&   helpers;
+    Assembler           as;
+    std::vector<int>    depth;  ///< Before each instruction, by offset - head; -1 if unreachable
+    std::vector<size_t> native; ///< Position of each instruction's code, by offset - head
+    std::vector<Fixup>  fixups;
+    std::vector<Exit>   exits;   ///< Conditional returns, emitted after the loop body
+    std::vector<size_t> returns; ///< Jumps to the epilogue
+};
+
+JitLoop LoopJit::compile(uint32_t head, uint32_t from)
+{
+    uint32_t end = nextOffset(code, from);
+    if (head > from || end > size)
+    {
+        return nullptr;
+    }
+
+    LoopCompiler compiler(code, head, end, helpers);
+    if (!compiler.compile())
+    {
+        return nullptr;
+    }
+
+    // Written while writable, then switched to executable: never both at once.
+    const std::vector<uint8_t>& bytes = compiler.bytes();
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t length = (bytes.size() + page - 1) / page * page;
+    void*  memory =
+        mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+        return nullptr;
+    }
+    std::memcpy(memory, bytes.data(), bytes.size());
+    if (mprotect(memory, length, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(memory, length);
+        return nullptr;
+    }
+    regions.push_back({memory, length});
+    return reinterpret_cast<JitLoop>(memory);
+}
+
+#endif
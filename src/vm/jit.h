@@ -0,0 +1,140 @@
+/**
+ * @file jit.h
+ * @brief Baseline JIT that compiles hot loops of the stack VM to x86-64 code
+ *
+ * The VM counts how often each backward OP_JUMP is taken (the closing jump
+ * of every `aslongas` loop). Once a loop head reaches the threshold, the
+ * bytecode from the head up to and including that jump is translated, one
+ * instruction at a time, into machine code, and later iterations enter the
+ * native loop instead of the interpreter.
+ *
+ * Bytecode opcodes are already typed (ADD_I32, CMP_EQ_BOOL, ...), so the
+ * generated code does no type checks: I32 arithmetic and comparisons, local
+ * loads and stores, and jumps are emitted inline. Operations on strings
+ * call back into the VM through JitHelpers. The operand stack stays in the
+ * VM's own stack memory at depths known at compile time, which keeps every
+ * heap string visible to the garbage collector during a helper call, and
+ * makes leaving native code trivial at any instruction:
+ *
+ * - A jump out of the region returns to the interpreter at its target.
+ * - An opcode the JIT does not handle, division by zero and OP_HALT return
+ *   to the interpreter at that instruction, which then executes it.
+ *
+ * A loop the JIT refuses (for example one whose stack depth it cannot
+ * follow) is marked and stays interpreted.
+ *
+ * Native code is generated for x86-64 with the System V calling convention
+ * only; elsewhere supported() is false and the VM never tiers up. Define
+ * AMBRA_NO_JIT to leave the JIT out of the build.
+ */
+
+#pragma once
+
+#include "bytecode/bytecode.h"
+#include "vm/value.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) && !defined(_WIN32) && !defined(AMBRA_NO_JIT)
+#define AMBRA_JIT 1
+#else
+#define AMBRA_JIT 0
+#endif
+
+/**
+ * @brief Performs one instruction for native code
+ * @param context The VM
+ * @param sp Top of the operand stack (one past the last value) before the instruction
+ * @param operand The instruction's operand, decoded, or 0
+ *
+ * The helper leaves its results where the interpreter's handler would.
+ */
+using JitHelper = void (*)(void* context, Value* sp, uint32_t operand);
+
+/** @brief Helpers by opcode; native code calls these instead of inlining the operation */
+struct JitHelpers
+{
+    JitHelper ops[OP_COUNT] = {};
+};
+
+/**
+ * @brief Entry point of a compiled loop
+ * @param context Passed through to the helpers
+ * @param locals The VM's local slots
+ * @param stack Top of the operand stack on entry; the loop's depths are relative to it
+ * @param pool The VM's constant pool
+ * @return Where the interpreter resumes: code offset in the low 32 bits, and
+ *         the operand stack depth relative to `stack` in the high 32 bits
+ */
+using JitLoop = uint64_t (*)(void* context, Value* locals, Value* stack, const Value* pool);
+
+class LoopJit
+{
+  public:
+    /** @brief Whether native code can be generated for this build and machine */
+    static bool supported()
+    {
+        return AMBRA_JIT != 0;
+    }
+
+    /**
+     * @param code Code section the loops are compiled from (must outlive the JIT)
+     * @param size Size of the code section in bytes
+     * @param helpers Callbacks for the opcodes not emitted inline
+     * @param threshold Backward jumps to a loop head before it is compiled
+     */
+    LoopJit(const uint8_t* code, uint32_t size, const JitHelpers& helpers, uint32_t threshold);
+    ~LoopJit();
+
+    LoopJit(const LoopJit&) = delete;
+    LoopJit& operator=(const LoopJit&) = delete;
+
+    /**
+     * @brief Count a backward jump from `from` to `head`
+     * @return The compiled loop to enter at `head`, or nullptr to keep interpreting
+     */
+    JitLoop onBackEdge(uint32_t head, uint32_t from)
+    {
+        LoopState& state = loops[head];
+        if (state.entry != nullptr || state.refused || ++state.count < threshold)
+        {
+            return state.entry;
+        }
+        state.entry = compile(head, from);
+        state.refused = state.entry == nullptr;
+        return state.entry;
+    }
+
+    /** @brief Number of loops compiled so far */
+    size_t compiledCount() const
+    {
+        return regions.size();
+    }
+
+  private:
+    struct LoopState
+    {
+        JitLoop  entry = nullptr;
+        uint32_t count = 0;
+        bool     refused = false;
+    };
+
+    /** @brief Executable memory holding one compiled loop */
+    struct Region
+    {
+        void*  memory;
+        size_t size;
+    };
+
+    /** @brief Translate [head, end of the jump at `from`]; nullptr if refused */
+    JitLoop compile(uint32_t head, uint32_t from);
+
+    const uint8_t*         code;
+    uint32_t               size;
+    JitHelpers             helpers;
+    uint32_t               threshold;
+    std::vector<LoopState> loops; ///< Indexed by code offset of the loop head
+    std::vector<Region>    regions;
+};
@@ -0,0 +1,203 @@
+/**
+ * @file profile.cpp
+ * @brief Implementation of the VM execution profile and its reports.
+ */
+
+#include "vm/profile.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <iterator>
+#include <map>
+#include <ostream>
+#include <string>
+
+void VmProfile::begin(const BytecodeImage& image)
+{
+    uint32_t size = image.codeSize();
+    executions.assign(size + 1, 0);
+    ticks.assign(size + 1, 0);
+    backEdges.assign(size + 1, 0);
+    backEdgeTargets.assign(size + 1, 0);
+    code.assign(image.code(), image.code() + size);
+    lines = image.lineEntries();
+    current = size;
+    last = readTicks();
+}
+
+void VmProfile::finish()
+{
+    ticks[current] += readTicks() - last;
+}
+
+SourceLoc VmProfile::locationOf(uint32_t offset) const
+{
+    auto after = std::upper_bound(lines.begin(), lines.end(), offset,
+                                  [](uint32_t at, const LineEntry& entry)
+                                  { return at < entry.offset; });
+    return after == lines.begin() ? SourceLoc{0, 0} : std::prev(after)->loc;
+}
+
+std::vector<OpcodeProfile> VmProfile::opcodes() const
+{
+    std::vector<OpcodeProfile> byOpcode;
+    for (int op = 0; op < OP_COUNT; op++)
+    {
+        byOpcode.push_back({static_cast<BytecodeOp>(op)});
+    }
+    for (uint32_t offset = 0; offset < code.size(); offset++)
+    {
+        if (executions[offset] > 0)
+        {
+            OpcodeProfile& entry = byOpcode[code[offset]];
+            entry.executions += executions[offset];
+            entry.ticks += ticks[offset];
+        }
+    }
+
+    byOpcode.erase(std::remove_if(byOpcode.begin(), byOpcode.end(),
+                                  [](const OpcodeProfile& entry) { return entry.executions == 0; }),
+                   byOpcode.end());
+    std::stable_sort(byOpcode.begin(), byOpcode.end(),
+                     [](const OpcodeProfile& a, const OpcodeProfile& b)
+                     { return a.ticks > b.ticks; });
+    return byOpcode;
+}
+
+std::vector<InstructionProfile> VmProfile::hotInstructions(size_t count) const
+{
+    std::vector<InstructionProfile> instructions;
+    for (uint32_t offset = 0; offset < code.size(); offset++)
+    {
+        if (executions[offset] > 0)
+        {
+            instructions.push_back({offset, static_cast<BytecodeOp>(code[offset]),
+                                    locationOf(offset), executions[offset], ticks[offset]});
+        }
+    }
+    std::stable_sort(instructions.begin(), instructions.end(),
+                     [](const InstructionProfile& a, const InstructionProfile& b)
+                     { return a.ticks > b.ticks; });
+    if (instructions.size() > count)
+    {
+        instructions.erase(instructions.begin() + static_cast<std::ptrdiff_t>(count),
+                           instructions.end());
+    }
+    return instructions;
+}
+
+std::vector<LineProfile> VmProfile::hotLines(size_t count) const
+{
+    std::map<int, LineProfile> byLine;
+    for (uint32_t offset = 0; offset < code.size(); offset++)
+    {
+        if (executions[offset] > 0)
+        {
+            int          line = locationOf(offset).line;
+            LineProfile& entry = byLine.emplace(line, LineProfile{line}).first->second;
+            entry.executions += executions[offset];
+            entry.ticks += ticks[offset];
+        }
+    }
+
+    std::vector<LineProfile> lines;
+    for (const auto& entry : byLine)
+    {
+        lines.push_back(entry.second);
+    }
+    std::stable_sort(lines.begin(), lines.end(),
+                     [](const LineProfile& a, const LineProfile& b) { return a.ticks > b.ticks; });
+    if (lines.size() > count)
+    {
+        lines.erase(lines.begin() + static_cast<std::ptrdiff_t>(count), lines.end());
+    }
+    return lines;
+}
+
+std::vector<BackEdgeProfile> VmProfile::hotBackEdges(size_t count) const
+{
+    std::vector<BackEdgeProfile> edges;
+    for (uint32_t offset = 0; offset < code.size(); offset++)
+    {
+        if (backEdges[offset] > 0)
+        {
+            uint32_t target = backEdgeTargets[offset];
+            edges.push_back(
+                {offset, target, locationOf(offset), locationOf(target), backEdges[offset]});
+        }
+    }
+    std::stable_sort(edges.begin(), edges.end(),
+                     [](const BackEdgeProfile& a, const BackEdgeProfile& b)
+                     { return a.taken > b.taken; });
+    if (edges.size() > count)
+    {
+        edges.erase(edges.begin() + static_cast<std::ptrdiff_t>(count), edges.end());
+    }
+    return edges;
+}
+
+// ==================================================================================
+// REPORT
+// ==================================================================================
+
+static double perExecution(uint64_t ticks, uint64_t executions)
+{
+    return executions == 0 ? 0.0 : static_cast<double>(ticks) / static_cast<double>(executions);
+}
+
+void VmProfile::print(std::ostream& out, size_t count) const
+{
+    char line[160];
+
+    out << "opcodes:\n";
+    std::snprintf(line, sizeof(line), "  %-24s %14s %16s %10s\n", "opcode", "executions",
+                  "ticks", "ticks/exec");
+    out << line;
+    for (const OpcodeProfile& entry : opcodes())
+    {
+        std::snprintf(line, sizeof(line), "  %-24s %14llu %16llu %10.1f\n", opcodeName(entry.op),
+                      static_cast<unsigned long long>(entry.executions),
+                      static_cast<unsigned long long>(entry.ticks),
+                      perExecution(entry.ticks, entry.executions));
+        out << line;
+    }
+
+    out << "hot instructions:\n";
+    std::snprintf(line, sizeof(line), "  %-8s %-10s %-24s %14s %16s\n", "offset", "line:col",
+                  "opcode", "executions", "ticks");
+    out << line;
+    for (const InstructionProfile& entry : hotInstructions(count))
+    {
+        std::string where = std::to_string(entry.loc.line) + ":" + std::to_string(entry.loc.col);
+        std::snprintf(line, sizeof(line), "  %-8u %-10s %-24s %14llu %16llu\n", entry.offset,
+                      where.c_str(), opcodeName(entry.op),
+                      static_cast<unsigned long long>(entry.executions),
+                      static_cast<unsigned long long>(entry.ticks));
+        out << line;
+    }
+
+    out << "hot lines:\n";
+    std::snprintf(line, sizeof(line), "  %-8s %14s %16s\n", "line", "executions", "ticks");
+    out << line;
+    for (const LineProfile& entry : hotLines(count))
+    {
+        std::snprintf(line, sizeof(line), "  %-8d %14llu %16llu\n", entry.line,
+                      static_cast<unsigned long long>(entry.executions),
+                      static_cast<unsigned long long>(entry.ticks));
+        out << line;
+    }
+
+    out << "hot back-edges:\n";
+    std::snprintf(line, sizeof(line), "  %-20s %-20s %14s\n", "from (line)", "to (line)", "taken");
+    out << line;
+    for (const BackEdgeProfile& entry : hotBackEdges(count))
+    {
+        std::string from = std::to_string(entry.from) + " (" + std::to_string(entry.fromLoc.line) +
+                           ")";
+        std::string to = std::to_string(entry.to) + " (" + std::to_string(entry.toLoc.line) + ")";
+        std::snprintf(line, sizeof(line), "  %-20s %-20s %14llu\n", from.c_str(), to.c_str(),
+                      static_cast<unsigned long long>(entry.taken));
+        out << line;
+    }
+}
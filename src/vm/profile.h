@@ -0,0 +1,135 @@
+/**
+ * @file profile.h
+ * @brief Per-instruction execution profile of the stack VM
+ *
+ * A VM given a VmProfile (VM::setProfile) runs a second instantiation of its
+ * run loop that reports every dispatch here; without one, the ordinary loop
+ * runs unchanged, so profiling costs nothing when it is off.
+ *
+ * For every instruction the profile counts executions and the ticks spent
+ * from its dispatch to the next one. Ticks are TSC cycles on x86 and
+ * nanoseconds elsewhere. A dispatch to an offset at or before the previous
+ * instruction is a taken back-edge, counted against the jumping instruction;
+ * with no calls in the language, those are exactly the loop iterations.
+ *
+ * The reports attribute the counts to source through the image's line table,
+ * which the emitter builds from Instruction::loc.
+ */
+
+#pragma once
+
+#include "bytecode/bytecode.h"
+#include "bytecode/image.h"
+
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+/** @brief Totals of one opcode over all its instructions */
+struct OpcodeProfile
+{
+    BytecodeOp op;
+    uint64_t   executions = 0;
+    uint64_t   ticks = 0;
+};
+
+/** @brief Totals of one instruction */
+struct InstructionProfile
+{
+    uint32_t   offset;
+    BytecodeOp op;
+    SourceLoc  loc;
+    uint64_t   executions = 0;
+    uint64_t   ticks = 0;
+};
+
+/** @brief Totals of every instruction on one source line */
+struct LineProfile
+{
+    int      line;
+    uint64_t executions = 0;
+    uint64_t ticks = 0;
+};
+
+/** @brief A backward jump and how often it was taken */
+struct BackEdgeProfile
+{
+    uint32_t  from; ///< Offset of the jumping instruction
+    uint32_t  to;   ///< Offset of the loop head
+    SourceLoc fromLoc;
+    SourceLoc toLoc;
+    uint64_t  taken = 0;
+};
+
+class VmProfile
+{
+  public:
+    /** @brief Reset the counters for a run of `image` */
+    void begin(const BytecodeImage& image);
+
+    /** @brief Record that the instruction at `offset` is about to execute */
+    void enter(uint32_t offset)
+    {
+        uint64_t now = readTicks();
+        ticks[current] += now - last;
+        if (offset <= current)
+        {
+            backEdges[current]++;
+            backEdgeTargets[current] = offset;
+        }
+        executions[offset]++;
+        current = offset;
+        last = now;
+    }
+
+    /** @brief Charge the time since the last dispatch to the last instruction */
+    void finish();
+
+    /** @brief Every opcode that ran, most ticks first */
+    std::vector<OpcodeProfile> opcodes() const;
+
+    /** @brief The `count` instructions with the most ticks */
+    std::vector<InstructionProfile> hotInstructions(size_t count) const;
+
+    /** @brief The `count` source lines with the most ticks */
+    std::vector<LineProfile> hotLines(size_t count) const;
+
+    /** @brief The `count` most taken back-edges */
+    std::vector<BackEdgeProfile> hotBackEdges(size_t count) const;
+
+    /** @brief Print all four reports, the last three cut to `count` entries */
+    void print(std::ostream& out, size_t count) const;
+
+  private:
+    static uint64_t readTicks()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                         std::chrono::steady_clock::now().time_since_epoch())
+                                         .count());
+#endif
+    }
+
+    /** @brief Source location of the instruction at `offset` */
+    SourceLoc locationOf(uint32_t offset) const;
+
+    // Indexed by code offset, with one extra slot standing for "before the
+    // first instruction" so enter() needs no special case.
+    std::vector<uint64_t> executions;
+    std::vector<uint64_t> ticks;
+    std::vector<uint64_t> backEdges;       ///< Times the instruction jumped backwards
+    std::vector<uint32_t> backEdgeTargets; ///< Where it jumped to
+
+    std::vector<uint8_t>   code;  ///< Copy of the code, for opcodes in reports
+    std::vector<LineEntry> lines; ///< Decoded line table
+    uint32_t               current = 0;
+    uint64_t               last = 0;
+};
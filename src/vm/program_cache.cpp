@@ -0,0 +1,122 @@
+/**
+ * @file program_cache.cpp
+ * @brief Implementation of the in-process program cache.
+ */
+
+#include "vm/program_cache.h"
+
+#include <string>
+#include <utility>
+
+ProgramCache::ProgramCache(size_t capacity) : capacity(capacity == 0 ? 1 : capacity) {}
+
+ImageCacheKey ProgramCache::sourceKey(std::string_view source)
+{
+    // Compiled output changes with the format, so the version is part of the key.
+    return contentKey("source:" + std::to_string(AMBC_VERSION) + ":", source);
+}
+
+ImageCacheKey ProgramCache::imageKey(std::string_view image)
+{
+    return contentKey("image:", image);
+}
+
+void ProgramCache::touch(Entry& entry)
+{
+    recency.splice(recency.begin(), recency, entry.use);
+}
+
+std::shared_ptr<const VmProgram> ProgramCache::get(const ImageCacheKey& key, const Loader& loader,
+                                                   VmResult& result)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (auto found = entries.find(key); found != entries.end(); found = entries.find(key))
+    {
+        if (found->second.program != nullptr)
+        {
+            hitCount++;
+            touch(found->second);
+            return found->second.program;
+        }
+        loaded.wait(lock); // another thread is loading it
+    }
+    missCount++;
+    entries.emplace(key, Entry{});
+    lock.unlock();
+
+    // Waiters block until the placeholder goes, so it must not outlive a throwing loader.
+    std::shared_ptr<VmProgram> program;
+    try
+    {
+        program = std::make_shared<VmProgram>();
+        result = loader(*program);
+    }
+    catch (...)
+    {
+        lock.lock();
+        entries.erase(key);
+        loaded.notify_all();
+        throw;
+    }
+
+    lock.lock();
+    if (result.hadError())
+    {
+        entries.erase(key);
+        loaded.notify_all();
+        return nullptr;
+    }
+
+    Entry& entry = entries[key];
+    entry.program = program;
+    recency.push_front(key);
+    entry.use = recency.begin();
+    while (recency.size() > capacity)
+    {
+        entries.erase(recency.back());
+        recency.pop_back();
+    }
+    loaded.notify_all();
+    return program;
+}
+
+std::shared_ptr<const VmProgram> ProgramCache::find(const ImageCacheKey& key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto                        found = entries.find(key);
+    if (found == entries.end() || found->second.program == nullptr)
+    {
+        return nullptr;
+    }
+    hitCount++;
+    touch(found->second);
+    return found->second.program;
+}
+
+void ProgramCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const ImageCacheKey& key : recency)
+    {
+        entries.erase(key);
+    }
+    recency.clear();
+}
+
+size_t ProgramCache::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return recency.size();
+}
+
+size_t ProgramCache::hits() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return hitCount;
+}
+
+size_t ProgramCache::misses() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return missCount;
+}
@@ -0,0 +1,108 @@
+/**
+ * @file program_cache.h
+ * @brief In-process cache of loaded programs, shared by every VM
+ *
+ * Loading a program from source runs the whole frontend, and even a mapped
+ * .ambc image is verified and has its constants converted and interned.
+ * A ProgramCache keeps the resulting VmPrograms (see vm/vm.h), keyed on a
+ * hash of the source or image bytes, so a server that runs the same script
+ * many times, on many threads at once, does that work once.
+ *
+ * Programs are reference counted: the cache holds one reference and every
+ * VM running the program holds another. Once more than `capacity` programs
+ * are cached, the least recently used one is dropped from the cache, and it
+ * is freed when the last VM running it moves on.
+ *
+ * Every member function is safe to call from any thread. When several
+ * threads miss on the same key at once, one of them loads the program and
+ * the others wait for it. Failed loads are not cached.
+ */
+
+#pragma once
+
+#include "bytecode/image_cache.h"
+#include "vm/vm.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+class ProgramCache
+{
+  public:
+    /** @brief Programs kept when no capacity is given */
+    static constexpr size_t DEFAULT_CAPACITY = 256;
+
+    /** @brief Fills in a VmProgram on a miss, e.g. by compiling the source */
+    using Loader = std::function<VmResult(VmProgram&)>;
+
+    /** @param capacity Most programs kept at once; at least 1 */
+    explicit ProgramCache(size_t capacity = DEFAULT_CAPACITY);
+
+    ProgramCache(const ProgramCache&) = delete;
+    ProgramCache& operator=(const ProgramCache&) = delete;
+
+    /** @brief Key of the program compiled from `source` */
+    static ImageCacheKey sourceKey(std::string_view source);
+
+    /** @brief Key of the program loaded from the .ambc bytes `image` */
+    static ImageCacheKey imageKey(std::string_view image);
+
+    /**
+     * @brief The cached program for `key`, loading it on a miss
+     * @param loader Called at most once per miss, without the cache locked; if it
+     *        throws, the exception propagates and the key is left uncached
+     * @param result Receives the loader's diagnostics if it fails
+     * @return The program, or nullptr if loading failed
+     */
+    std::shared_ptr<const VmProgram> get(const ImageCacheKey& key, const Loader& loader,
+                                         VmResult& result);
+
+    /** @brief The cached program for `key`, or nullptr; never loads */
+    std::shared_ptr<const VmProgram> find(const ImageCacheKey& key);
+
+    /** @brief Drop every cached program; VMs running one keep it alive */
+    void clear();
+
+    /** @brief Number of programs cached */
+    size_t size() const;
+
+    /** @brief get() and find() calls answered from the cache */
+    size_t hits() const;
+
+    /** @brief get() calls that had to load */
+    size_t misses() const;
+
+  private:
+    struct KeyHash
+    {
+        size_t operator()(const ImageCacheKey& key) const
+        {
+            return static_cast<size_t>(key.low);
+        }
+    };
+
+    /** @brief A cached program, or a program being loaded if `program` is null */
+    struct Entry
+    {
+        std::shared_ptr<const VmProgram>   program;
+        std::list<ImageCacheKey>::iterator use; ///< Position in `recency`, once loaded
+    };
+
+    /** @brief Move a loaded entry to the front of `recency`; the lock must be held */
+    void touch(Entry& entry);
+
+    size_t                  capacity;
+    mutable std::mutex      mutex;
+    std::condition_variable loaded; ///< Signalled whenever a load finishes
+
+    std::unordered_map<ImageCacheKey, Entry, KeyHash> entries;
+    std::list<ImageCacheKey> recency; ///< Loaded entries, most recently used first
+    size_t                   hitCount = 0;
+    size_t                   missCount = 0;
+};
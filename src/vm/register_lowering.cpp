@@ -0,0 +1,328 @@
+/**
+ * @file register_lowering.cpp
+ * @brief Translation of stack IR into three-address register code.
+ */
+
+#include "vm/register_vm.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+
+/**
+ * @brief Register opcode for IR operators that read two values and write one
+ */
+static bool binaryOp(Opcode op, RegisterOp& out)
+{
+    switch (op)
+    {
+    case AddI32:
+        out = REG_ADD_I32;
+        return true;
+    case SubI32:
+        out = REG_SUB_I32;
+        return true;
+    case MulI32:
+        out = REG_MUL_I32;
+        return true;
+    case DivI32:
+        out = REG_DIV_I32;
+        return true;
+    case CmpEqI32:
+        out = REG_CMP_EQ_I32;
+        return true;
+    case CmpNEqI32:
+        out = REG_CMP_NEQ_I32;
+        return true;
+    case CmpLtI32:
+        out = REG_CMP_LT_I32;
+        return true;
+    case CmpLtEqI32:
+        out = REG_CMP_LTEQ_I32;
+        return true;
+    case CmpGtI32:
+        out = REG_CMP_GT_I32;
+        return true;
+    case CmpGtEqI32:
+        out = REG_CMP_GTEQ_I32;
+        return true;
+    case CmpEqBool32:
+        out = REG_CMP_EQ_BOOL;
+        return true;
+    case CmpNEqBool32:
+        out = REG_CMP_NEQ_BOOL;
+        return true;
+    case CmpEqString32:
+        out = REG_CMP_EQ_STRING;
+        return true;
+    case CmpNEqString32:
+        out = REG_CMP_NEQ_STRING;
+        return true;
+    case ConcatString:
+        out = REG_CONCAT;
+        return true;
+    default:
+        return false;
+    }
+}
+
+RegisterCode RegisterLowering::lower(const IrFunction& function)
+{
+    diagnostics.clear();
+
+    RegisterCode result;
+    result.constants = program.constants;
+    result.constantBase = function.frameSlots();
+    result.tempBase = result.constantBase + static_cast<uint32_t>(program.constants.size());
+
+    // Register currently holding each operand-stack slot.
+    std::vector<uint32_t> stack;
+    size_t                maxDepth = 0;
+
+    // Jumps whose target index is patched in once all labels are placed.
+    struct Fixup
+    {
+        size_t  ip;
+        size_t  at;
+        bool    inB; ///< Target goes in operand b (conditional) rather than a
+        LabelId target;
+    };
+    std::vector<Fixup>                    fixups;
+    std::unordered_map<LabelId, uint32_t> labelIndex;
+    std::unordered_map<LabelId, size_t>   labelDepth;
+    bool                                  fallsThrough = true;
+
+    // Index of the last instruction whose destination a StoreLocal may retarget;
+    // reset at labels, where the producing instruction may be on another path.
+    size_t producer = SIZE_MAX;
+
+    auto temp = [&](size_t depth) { return result.tempBase + static_cast<uint32_t>(depth); };
+
+    auto emit = [&](RegisterOp op, uint32_t a, uint32_t b, uint32_t c, SourceLoc loc)
+    {
+        result.code.push_back(RegisterInstruction{op, a, b, c});
+        result.locs.push_back(loc);
+    };
+
+    auto push = [&](uint32_t reg)
+    {
+        stack.push_back(reg);
+        maxDepth = std::max(maxDepth, stack.size());
+    };
+
+    // Validated IR never underflows; report rather than crash if it does.
+    size_t ip = 0;
+    auto   pop = [&]()
+    {
+        if (stack.empty())
+        {
+            diagnostics.push_back({"Stack underflow", ip});
+            return temp(0);
+        }
+        uint32_t reg = stack.back();
+        stack.pop_back();
+        return reg;
+    };
+
+    // Move the slots from `from` up into their own temporaries. A temporary
+    // only ever holds the slot of its own depth, so the moves never clobber
+    // each other.
+    auto canonicalize = [&](size_t from, SourceLoc loc)
+    {
+        for (size_t i = from; i < stack.size(); i++)
+        {
+            if (stack[i] != temp(i))
+            {
+                emit(REG_MOVE, temp(i), stack[i], 0, loc);
+                stack[i] = temp(i);
+            }
+        }
+    };
+
+    const auto& instrs = function.instructions;
+    for (ip = 0; ip < instrs.size() && !hadError(); ip++)
+    {
+        const Instruction& inst = instrs[ip];
+        RegisterOp         op;
+
+        if (binaryOp(inst.opcode, op))
+        {
+            uint32_t rhs = pop();
+            uint32_t lhs = pop();
+            producer = result.code.size();
+            emit(op, temp(stack.size()), lhs, rhs, inst.loc);
+            push(temp(stack.size()));
+            fallsThrough = true;
+            continue;
+        }
+
+        switch (inst.opcode)
+        {
+        case PushConst:
+        {
+            uint32_t index = std::get<ConstId>(inst.operand).value;
+            if (index >= program.constants.size())
+            {
+                diagnostics.push_back({"Invalid ConstId", ip});
+                return result;
+            }
+            push(result.constantBase + index);
+            break;
+        }
+        case LoadLocal:
+        {
+            LocalId id = std::get<LocalId>(inst.operand);
+            if (id.value >= function.localTable.locals.size())
+            {
+                diagnostics.push_back({"Invalid LocalId", ip});
+                return result;
+            }
+            uint32_t slot = function.slotOf(id);
+            push(slot);
+            break;
+        }
+        case StoreLocal:
+        {
+            LocalId id = std::get<LocalId>(inst.operand);
+            if (id.value >= function.localTable.locals.size())
+            {
+                diagnostics.push_back({"Invalid LocalId", ip});
+                return result;
+            }
+            uint32_t slot = function.slotOf(id);
+            uint32_t value = pop();
+
+            // Values still pending on the stack may name the old contents of
+            // this local; give them their own copy first.
+            for (size_t i = 0; i < stack.size(); i++)
+            {
+                if (stack[i] == slot)
+                {
+                    emit(REG_MOVE, temp(i), slot, 0, inst.loc);
+                    stack[i] = temp(i);
+                }
+            }
+
+            if (value == temp(stack.size()) && producer == result.code.size() - 1)
+            {
+                result.code.back().a = slot;
+            }
+            else
+            {
+                emit(REG_MOVE, slot, value, 0, inst.loc);
+            }
+            producer = SIZE_MAX;
+            break;
+        }
+        case Pop:
+            pop();
+            break;
+        case NotBool:
+        case NegI32:
+        case ToString:
+        {
+            uint32_t operand = pop();
+            producer = result.code.size();
+            emit(inst.opcode == NotBool  ? REG_NOT_BOOL
+                 : inst.opcode == NegI32 ? REG_NEG_I32
+                                         : REG_TO_STRING,
+                 temp(stack.size()), operand, 0, inst.loc);
+            push(temp(stack.size()));
+            break;
+        }
+        case ConcatN:
+        {
+            uint32_t count = std::get<Arity>(inst.operand).value;
+            if (count > stack.size())
+            {
+                diagnostics.push_back({"Stack underflow", ip});
+                return result;
+            }
+            size_t first = stack.size() - count;
+            canonicalize(first, inst.loc);
+            stack.resize(first);
+            producer = result.code.size();
+            emit(REG_CONCAT_N, temp(first), temp(first), count, inst.loc);
+            push(temp(first));
+            break;
+        }
+        case PrintString:
+            emit(REG_PRINT, pop(), 0, 0, inst.loc);
+            break;
+        case Jump:
+        {
+            LabelId target = std::get<LabelId>(inst.operand);
+            canonicalize(0, inst.loc);
+            labelDepth[target] = stack.size();
+            fixups.push_back({ip, result.code.size(), false, target});
+            emit(REG_JUMP, 0, 0, 0, inst.loc);
+            fallsThrough = false;
+            continue;
+        }
+        case JumpIfFalse:
+        case JumpIfTrue:
+        {
+            LabelId  target = std::get<LabelId>(inst.operand);
+            uint32_t condition = pop();
+            canonicalize(0, inst.loc);
+            labelDepth[target] = stack.size();
+            fixups.push_back({ip, result.code.size(), true, target});
+            emit(inst.opcode == JumpIfFalse ? REG_JUMP_IF_FALSE : REG_JUMP_IF_TRUE, condition, 0,
+                 0, inst.loc);
+            break;
+        }
+        case JLabel:
+        {
+            LabelId id = std::get<LabelId>(inst.operand);
+            if (fallsThrough)
+            {
+                canonicalize(0, inst.loc);
+            }
+            else
+            {
+                // Only reached by jumps: take the stack shape they recorded.
+                auto   known = labelDepth.find(id);
+                size_t depth = known != labelDepth.end() ? known->second : 0;
+                stack.clear();
+                for (size_t i = 0; i < depth; i++)
+                {
+                    push(temp(i));
+                }
+            }
+            labelIndex[id] = static_cast<uint32_t>(result.code.size());
+            producer = SIZE_MAX;
+            continue;
+        }
+        case Halt:
+            emit(REG_HALT, 0, 0, 0, inst.loc);
+            break;
+        case Nop:
+            continue;
+        default:
+            diagnostics.push_back({"Unexpected opcode", ip});
+            return result;
+        }
+        fallsThrough = true;
+    }
+
+    if (hadError())
+    {
+        return result;
+    }
+    emit(REG_HALT, 0, 0, 0, SourceLoc{0, 0});
+
+    for (const Fixup& fixup : fixups)
+    {
+        auto it = labelIndex.find(fixup.target);
+        if (it == labelIndex.end())
+        {
+            diagnostics.push_back({"Jump to undefined label", fixup.ip});
+            continue;
+        }
+        RegisterInstruction& inst = result.code[fixup.at];
+        (fixup.inB ? inst.b : inst.a) = it->second;
+    }
+
+    result.registerCount = result.tempBase + static_cast<uint32_t>(maxDepth);
+    return result;
+}
@@ -0,0 +1,370 @@
+/**
+ * @file register_vm.cpp
+ * @brief Implementation of the register-machine loader and run loop.
+ */
+
+#include "vm/register_vm.h"
+
+#include "runtime/builtins.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+RegisterVM::RegisterVM(std::ostream& out) : out(out) {}
+
+RegisterVM::RegisterVM(int fd) : out(fd) {}
+
+void RegisterVM::collectGarbage()
+{
+    heap.mark(registers.data(), registers.data() + registers.size());
+    heap.sweep();
+}
+
+VmResult RegisterVM::load(const IrProgram& ir)
+{
+    RegisterLowering lowering{ir};
+    program = lowering.lower(ir.main);
+
+    VmResult result;
+    for (const EmitterDiagnostic& d : lowering.diagnostics)
+    {
+        SourceLoc loc = d.ip < ir.main.instructions.size() ? ir.main.instructions[d.ip].loc
+                                                            : SourceLoc{0, 0};
+        result.diagnostics.push_back({d.message, d.ip, loc});
+    }
+    if (result.hadError())
+    {
+        program = RegisterCode{};
+        return result;
+    }
+
+    // String constants are interned for exactly as long as this program stays loaded.
+    strings.clear();
+    constants.clear();
+    constants.reserve(program.constants.size());
+    for (const Constant& c : program.constants)
+    {
+        switch (c.type)
+        {
+        case I32:
+            constants.push_back(Value::fromI32(std::get<int>(c.value)));
+            break;
+        case Bool32:
+            constants.push_back(Value::fromBool(std::get<bool>(c.value)));
+            break;
+        case String32:
+        default:
+            constants.push_back(Value::fromString(strings.intern(std::get<std::string>(c.value))));
+            break;
+        }
+    }
+    boolStrings[0] = strings.intern("negative");
+    boolStrings[1] = strings.intern("affirmative");
+
+    heap.clear();
+    registers.assign(program.registerCount, Value{});
+    return result;
+}
+
+VmResult RegisterVM::run()
+{
+    if (program.code.empty())
+    {
+        return VmResult{};
+    }
+    VmResult result = execute();
+    if (!out.flush())
+    {
+        result.diagnostics.push_back({"Output could not be written", 0});
+    }
+    return result;
+}
+
+VmResult RegisterVM::execute()
+{
+    VmResult result;
+
+    std::fill(registers.begin(), registers.end(), Value{});
+    std::copy(constants.begin(), constants.end(), registers.begin() + program.constantBase);
+
+#if AMBRA_COMPUTED_GOTO
+    // Must list every RegisterOp in order.
+    static const void* const dispatchTable[] = {
+        &&op_REG_MOVE,          &&op_REG_ADD_I32,          &&op_REG_SUB_I32,
+        &&op_REG_MUL_I32,       &&op_REG_DIV_I32,          &&op_REG_NOT_BOOL,
+        &&op_REG_NEG_I32,       &&op_REG_CMP_EQ_I32,       &&op_REG_CMP_NEQ_I32,
+        &&op_REG_CMP_LT_I32,    &&op_REG_CMP_LTEQ_I32,     &&op_REG_CMP_GT_I32,
+        &&op_REG_CMP_GTEQ_I32,  &&op_REG_CMP_EQ_BOOL,      &&op_REG_CMP_NEQ_BOOL,
+        &&op_REG_CMP_EQ_STRING, &&op_REG_CMP_NEQ_STRING,   &&op_REG_JUMP,
+        &&op_REG_JUMP_IF_FALSE, &&op_REG_JUMP_IF_TRUE,     &&op_REG_PRINT,
+        &&op_REG_TO_STRING,     &&op_REG_CONCAT,           &&op_REG_CONCAT_N,
+        &&op_REG_HALT};
+    static_assert(sizeof(dispatchTable) / sizeof(dispatchTable[0]) == REG_COUNT,
+                  "dispatchTable must cover every RegisterOp");
+
+#define CASE(op) op_##op:
+#define DISPATCH() goto* dispatchTable[ip->op]
+#else
+#define CASE(op) case op:
+#define DISPATCH() continue
+#endif
+
+// Not wrapped in do/while: DISPATCH() may be a `continue` of the switch loop.
+#define NEXT()                                                                                     \
+    {                                                                                              \
+        ++ip;                                                                                      \
+        DISPATCH();                                                                                \
+    }
+
+#define BINARY_I32(make, expr)                                                                     \
+    do                                                                                             \
+    {                                                                                              \
+        int32_t a = r[ip->b].asI32();                                                              \
+        int32_t b = r[ip->c].asI32();                                                              \
+        r[ip->a] = Value::make(expr);                                                              \
+    } while (0)
+
+#define BINARY_BOOL(expr)                                                                          \
+    do                                                                                             \
+    {                                                                                              \
+        bool a = r[ip->b].asBool();                                                                \
+        bool b = r[ip->c].asBool();                                                                \
+        r[ip->a] = Value::fromBool(expr);                                                          \
+    } while (0)
+
+#define BINARY_STRING(expr)                                                                        \
+    do                                                                                             \
+    {                                                                                              \
+        const StringObject* a = r[ip->b].asString();                                               \
+        const StringObject* b = r[ip->c].asString();                                               \
+        r[ip->a] = Value::fromBool(expr);                                                          \
+    } while (0)
+
+    const RegisterInstruction* const base = program.code.data();
+    const RegisterInstruction*       ip = base;
+    Value* const                     r = registers.data();
+
+#if AMBRA_COMPUTED_GOTO
+    DISPATCH();
+#else
+    for (;;)
+    {
+        switch (ip->op)
+        {
+#endif
+
+    CASE(REG_MOVE)
+    {
+        r[ip->a] = r[ip->b];
+        NEXT();
+    }
+    CASE(REG_ADD_I32)
+    {
+        BINARY_I32(fromI32,
+                   static_cast<int32_t>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b)));
+        NEXT();
+    }
+    CASE(REG_SUB_I32)
+    {
+        BINARY_I32(fromI32,
+                   static_cast<int32_t>(static_cast<uint32_t>(a) - static_cast<uint32_t>(b)));
+        NEXT();
+    }
+    CASE(REG_MUL_I32)
+    {
+        BINARY_I32(fromI32,
+                   static_cast<int32_t>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b)));
+        NEXT();
+    }
+    CASE(REG_DIV_I32)
+    {
+        if (r[ip->c].asI32() == 0)
+        {
+            size_t index = static_cast<size_t>(ip - base);
+            result.diagnostics.push_back({"Division by zero", index, program.locs[index]});
+            return result;
+        }
+        BINARY_I32(fromI32, (a == INT32_MIN && b == -1) ? INT32_MIN : a / b);
+        NEXT();
+    }
+    CASE(REG_NOT_BOOL)
+    {
+        r[ip->a] = Value::fromBool(!r[ip->b].asBool());
+        NEXT();
+    }
+    CASE(REG_NEG_I32)
+    {
+        uint32_t operand = static_cast<uint32_t>(r[ip->b].asI32());
+        r[ip->a] = Value::fromI32(static_cast<int32_t>(0u - operand));
+        NEXT();
+    }
+    CASE(REG_CMP_EQ_I32)
+    {
+        BINARY_I32(fromBool, a == b);
+        NEXT();
+    }
+    CASE(REG_CMP_NEQ_I32)
+    {
+        BINARY_I32(fromBool, a != b);
+        NEXT();
+    }
+    CASE(REG_CMP_LT_I32)
+    {
+        BINARY_I32(fromBool, a < b);
+        NEXT();
+    }
+    CASE(REG_CMP_LTEQ_I32)
+    {
+        BINARY_I32(fromBool, a <= b);
+        NEXT();
+    }
+    CASE(REG_CMP_GT_I32)
+    {
+        BINARY_I32(fromBool, a > b);
+        NEXT();
+    }
+    CASE(REG_CMP_GTEQ_I32)
+    {
+        BINARY_I32(fromBool, a >= b);
+        NEXT();
+    }
+    CASE(REG_CMP_EQ_BOOL)
+    {
+        BINARY_BOOL(a == b);
+        NEXT();
+    }
+    CASE(REG_CMP_NEQ_BOOL)
+    {
+        BINARY_BOOL(a != b);
+        NEXT();
+    }
+    CASE(REG_CMP_EQ_STRING)
+    {
+        BINARY_STRING(stringEquals(a, b));
+        NEXT();
+    }
+    CASE(REG_CMP_NEQ_STRING)
+    {
+        BINARY_STRING(!stringEquals(a, b));
+        NEXT();
+    }
+    CASE(REG_JUMP)
+    {
+        ip = base + ip->a;
+        DISPATCH();
+    }
+    CASE(REG_JUMP_IF_FALSE)
+    {
+        if (r[ip->a].asBool())
+        {
+            NEXT();
+        }
+        ip = base + ip->b;
+        DISPATCH();
+    }
+    CASE(REG_JUMP_IF_TRUE)
+    {
+        if (!r[ip->a].asBool())
+        {
+            NEXT();
+        }
+        ip = base + ip->b;
+        DISPATCH();
+    }
+    CASE(REG_PRINT)
+    {
+        const StringObject* s = r[ip->a].asString();
+        out.writeLine(s->chars(), s->length);
+        NEXT();
+    }
+    CASE(REG_TO_STRING)
+    {
+        Value v = r[ip->b];
+        if (v.isI32() && v.asI32() >= StringTable::SMALL_INT_MIN &&
+            v.asI32() <= StringTable::SMALL_INT_MAX)
+        {
+            v = Value::fromString(strings.smallInt(v.asI32()));
+        }
+        else if (v.isI32())
+        {
+            if (heap.shouldCollect())
+            {
+                collectGarbage();
+            }
+            v = Value::fromString(makeI32String(heap, v.asI32()));
+        }
+        else if (v.isBool())
+        {
+            v = Value::fromString(boolStrings[v.asBool()]);
+        }
+        r[ip->a] = v;
+        NEXT();
+    }
+    CASE(REG_CONCAT)
+    {
+        // Operands stay in their registers, so they are roots during collection.
+        if (heap.shouldCollect())
+        {
+            collectGarbage();
+        }
+        const StringObject* a = r[ip->b].asString();
+        const StringObject* b = r[ip->c].asString();
+        if (b->length == 0 || a->length == 0)
+        {
+            r[ip->a] = b->length == 0 ? r[ip->b] : r[ip->c];
+            NEXT();
+        }
+        StringObject* joined = heap.allocate(a->length + b->length);
+        char*         chars = const_cast<char*>(joined->chars());
+        std::memcpy(chars, a->chars(), a->length);
+        std::memcpy(chars + a->length, b->chars(), b->length);
+        r[ip->a] = Value::fromString(joined);
+        NEXT();
+    }
+    CASE(REG_CONCAT_N)
+    {
+        if (heap.shouldCollect())
+        {
+            collectGarbage();
+        }
+        const Value* parts = r + ip->b;
+        uint32_t     total = 0;
+        for (uint32_t i = 0; i < ip->c; i++)
+        {
+            total += parts[i].asString()->length;
+        }
+        StringObject* joined = heap.allocate(total);
+        char*         chars = const_cast<char*>(joined->chars());
+        for (uint32_t i = 0; i < ip->c; i++)
+        {
+            const StringObject* part = parts[i].asString();
+            std::memcpy(chars, part->chars(), part->length);
+            chars += part->length;
+        }
+        r[ip->a] = Value::fromString(joined);
+        NEXT();
+    }
+    CASE(REG_HALT)
+    {
+        goto halt;
+    }
+
+#if !AMBRA_COMPUTED_GOTO
+        default:
+            result.diagnostics.push_back({"Unexpected opcode", static_cast<size_t>(ip - base)});
+            return result;
+        }
+    }
+#endif
+
+halt:
+    return result;
+
+#undef CASE
+#undef DISPATCH
+#undef NEXT
+#undef BINARY_I32
+#undef BINARY_BOOL
+#undef BINARY_STRING
+}
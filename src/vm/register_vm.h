@@ -0,0 +1,214 @@
+/**
+ * @file register_vm.h
+ * @brief Three-address register form of the IR and its interpreter
+ *
+ * An alternative to the stack VM (vm.h), selected with
+ * `ambra_vm --engine=register`. The stack engine remains the reference; this
+ * one exists to measure how much a register encoding saves in dispatches.
+ *
+ * RegisterLowering translates an IrFunction by abstractly interpreting its
+ * operand stack:
+ *
+ * - The register file is laid out as [local slots | constants | temporaries].
+ *   Each local lives in its frame slot (IrFunction::slotOf), every pool
+ *   constant gets a register filled once when the program is loaded, and
+ *   operand-stack depth d maps to temporary d.
+ * - PushConst and LoadLocal emit nothing: they push the name of an existing
+ *   register onto a compile-time stack, and the operator that consumes the
+ *   value reads that register directly.
+ * - StoreLocal retargets the instruction that produced the value, so
+ *   `summon y = x + 1;` becomes a single ADD_I32 into y's register.
+ * - Before a branch or label every pending value is moved into its own
+ *   temporary, so all paths into a label agree on where values live.
+ */
+
+#pragma once
+
+#include "bytecode/emitter.h"
+#include "ir/program.h"
+#include "runtime/output.h"
+#include "runtime/string_heap.h"
+#include "runtime/string_table.h"
+#include "vm/value.h"
+#include "vm/vm.h"
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Register machine opcodes
+ *
+ * Operands are register indices (r[a], r[b], r[c]) unless noted. Jump targets
+ * are instruction indices.
+ */
+enum RegisterOp : uint8_t
+{
+    REG_MOVE, ///< r[a] = r[b]
+
+    // Arithmetic: r[a] = r[b] op r[c]
+    REG_ADD_I32,
+    REG_SUB_I32,
+    REG_MUL_I32,
+    REG_DIV_I32,
+
+    // Unary: r[a] = op r[b]
+    REG_NOT_BOOL,
+    REG_NEG_I32,
+
+    // Comparison: r[a] = r[b] op r[c]
+    REG_CMP_EQ_I32,
+    REG_CMP_NEQ_I32,
+    REG_CMP_LT_I32,
+    REG_CMP_LTEQ_I32,
+    REG_CMP_GT_I32,
+    REG_CMP_GTEQ_I32,
+    REG_CMP_EQ_BOOL,
+    REG_CMP_NEQ_BOOL,
+    REG_CMP_EQ_STRING,
+    REG_CMP_NEQ_STRING,
+
+    // Control flow
+    REG_JUMP,          ///< goto a
+    REG_JUMP_IF_FALSE, ///< if !r[a] goto b
+    REG_JUMP_IF_TRUE,  ///< if r[a] goto b
+
+    // Side effects
+    REG_PRINT, ///< print r[a]
+
+    // Strings
+    REG_TO_STRING, ///< r[a] = string(r[b])
+    REG_CONCAT,    ///< r[a] = r[b] + r[c]
+    REG_CONCAT_N,  ///< r[a] = r[b] + ... + r[b + c - 1]
+
+    REG_HALT,
+
+    /// Number of opcodes; not a valid instruction.
+    REG_COUNT
+};
+
+/**
+ * @brief One three-address instruction
+ */
+struct RegisterInstruction
+{
+    RegisterOp op;
+    uint32_t   a = 0;
+    uint32_t   b = 0;
+    uint32_t   c = 0;
+};
+
+/**
+ * @brief A function lowered to register form
+ */
+struct RegisterCode
+{
+    /** @brief Instructions, terminated by REG_HALT */
+    std::vector<RegisterInstruction> code;
+
+    /** @brief Source location of each instruction in `code` */
+    std::vector<SourceLoc> locs;
+
+    /** @brief Constant pool; constant i lives in register constantBase + i */
+    std::vector<Constant> constants;
+
+    uint32_t constantBase = 0;  ///< First constant register (= frame slots of the locals)
+    uint32_t tempBase = 0;      ///< First temporary register
+    uint32_t registerCount = 0; ///< Size of the register file
+};
+
+/**
+ * @brief Lowers IR functions to register form
+ *
+ * Example usage:
+ * @code
+ * RegisterLowering lowering{program};
+ * RegisterCode     code = lowering.lower(program.main);
+ * if (lowering.hadError()) { ... }
+ * @endcode
+ */
+struct RegisterLowering
+{
+    /** @brief Program whose constant pool the code refers to */
+    const IrProgram& program;
+
+    /** @brief Problems found during the last lower() call */
+    std::vector<EmitterDiagnostic> diagnostics;
+
+    bool hadError() const
+    {
+        return diagnostics.size() > 0;
+    }
+
+    /**
+     * @brief Lower one validated function to register form
+     * @return Code ending in REG_HALT; incomplete if hadError()
+     */
+    RegisterCode lower(const IrFunction& function);
+};
+
+/**
+ * @brief Interpreter for RegisterCode
+ *
+ * Mirrors the VM interface so the two engines are interchangeable:
+ * @code
+ * RegisterVM vm(std::cout);
+ * if (!vm.load(program).hadError())
+ *     vm.run();
+ * @endcode
+ */
+class RegisterVM
+{
+  public:
+    /**
+     * @brief Construct a VM that writes `say` output to `out`
+     */
+    explicit RegisterVM(std::ostream& out = std::cout);
+
+    /**
+     * @brief Construct a VM that writes `say` output to a file descriptor
+     */
+    explicit RegisterVM(int fd);
+
+    /**
+     * @brief Lower a program to register form and prepare it for execution
+     * @param program The validated IR program to load
+     * @return Diagnostics for malformed control flow (e.g. undefined labels)
+     */
+    VmResult load(const IrProgram& program);
+
+    /**
+     * @brief Execute the loaded program from its first instruction
+     * @return Diagnostics for runtime errors (e.g. division by zero), or for
+     *         output that could not be written; output is flushed either way
+     */
+    VmResult run();
+
+    /** @brief Write every `say` line out as soon as it is printed */
+    void setUnbuffered(bool enabled)
+    {
+        out.setUnbuffered(enabled);
+    }
+
+    /** @brief The loaded code, for inspection */
+    const RegisterCode& loaded() const
+    {
+        return program;
+    }
+
+  private:
+    /** @brief The run loop */
+    VmResult execute();
+
+    /** @brief Reclaim heap strings not referenced from any register */
+    void collectGarbage();
+
+    OutputBuffer                out;            ///< Destination of REG_PRINT
+    RegisterCode                program;        ///< Loaded code
+    std::vector<Value>          registers;      ///< Register file
+    std::vector<Value>          constants;      ///< Initial values of the constant registers
+    StringTable                 strings;        ///< Interned constants and conversions
+    StringHeap                  heap;           ///< Strings created at runtime
+    const StringObject*         boolStrings[2] = {}; ///< Interned "negative" / "affirmative"
+};
@@ -0,0 +1,157 @@
+/**
+ * @file value.h
+ * @brief Runtime value representation for the Ambra VM
+ *
+ * Every slot on the operand stack and every local variable holds a Value.
+ * The IR is statically typed, so the VM never has to decide at runtime which
+ * kind a Value holds: the opcode already knows (AddI32 reads two I32 values,
+ * CmpEqString32 reads two strings, and so on).
+ *
+ * A Value is a single 64-bit word:
+ *
+ * @code
+ * I32        [ int32 bits | 0 ... 0 001 ]
+ * Bool32     [ 0 or 1     | 0 ... 0 010 ]
+ * String32   [ StringObject* (8-aligned, low 3 bits 0) ]
+ * empty      [ 0 ]
+ * @endcode
+ *
+ * Values are trivially copyable, so pushing, popping and moving between the
+ * stack and locals are plain word moves. Strings are never owned by a Value:
+ * they live in the loaded image or the VM's StringTable (both immortal while
+ * the program is loaded), or in the VM's StringHeap, which reclaims them by
+ * tracing the stack and locals.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+/**
+ * @brief Header of an immutable runtime string
+ *
+ * `length` characters and a terminating NUL follow the header directly. The
+ * layout matches AmbcString, so string constants in a mapped .ambc image are
+ * used as StringObjects without copying.
+ */
+struct alignas(8) StringObject
+{
+    uint32_t length;
+    uint32_t flags; ///< StringFlags; STRING_INTERNED for image-owned strings
+
+    const char* chars() const
+    {
+        return reinterpret_cast<const char*>(this + 1);
+    }
+
+    std::string_view view() const
+    {
+        return std::string_view(chars(), length);
+    }
+};
+
+static_assert(sizeof(StringObject) == 8, "StringObject header must match AmbcString");
+
+/**
+ * @brief Bits of StringObject::flags
+ */
+enum StringFlags : uint32_t
+{
+    STRING_HEAP = 1u << 0,     ///< Allocated by a StringHeap and collectable
+    STRING_MARKED = 1u << 1,   ///< Reached during the current collection
+    STRING_INTERNED = 1u << 2, ///< The only string with its text in the VM's StringTable
+};
+
+/**
+ * @brief A single 8-byte runtime value
+ */
+class Value
+{
+  public:
+    Value() = default;
+
+    static Value fromI32(int32_t v)
+    {
+        return Value((static_cast<uint64_t>(static_cast<uint32_t>(v)) << 32) | TAG_I32);
+    }
+
+    static Value fromBool(bool b)
+    {
+        return Value((static_cast<uint64_t>(b) << 32) | TAG_BOOL);
+    }
+
+    static Value fromString(const StringObject* s)
+    {
+        return Value(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(s)));
+    }
+
+    bool isI32() const
+    {
+        return (bits & TAG_MASK) == TAG_I32;
+    }
+
+    bool isBool() const
+    {
+        return (bits & TAG_MASK) == TAG_BOOL;
+    }
+
+    bool isString() const
+    {
+        return bits != 0 && (bits & TAG_MASK) == 0;
+    }
+
+    int32_t asI32() const
+    {
+        return static_cast<int32_t>(static_cast<uint32_t>(bits >> 32));
+    }
+
+    bool asBool() const
+    {
+        return (bits >> 32) != 0;
+    }
+
+    const StringObject* asString() const
+    {
+        return reinterpret_cast<const StringObject*>(static_cast<uintptr_t>(bits));
+    }
+
+    /** @brief Raw encoding, for identity comparisons */
+    uint64_t raw() const
+    {
+        return bits;
+    }
+
+  private:
+    static constexpr uint64_t TAG_MASK = 0x7;
+    static constexpr uint64_t TAG_I32 = 0x1;
+    static constexpr uint64_t TAG_BOOL = 0x2;
+
+    explicit Value(uint64_t bits) : bits(bits) {}
+
+    uint64_t bits = 0;
+};
+
+static_assert(sizeof(Value) == 8, "Value must stay one machine word");
+static_assert(std::is_trivially_copyable<Value>::value, "Value copies must be plain word moves");
+
+/**
+ * @brief Compare two strings by content
+ *
+ * Two different interned strings never have the same text, so they compare
+ * unequal without looking at the characters.
+ */
+inline bool stringEquals(const StringObject* a, const StringObject* b)
+{
+    if (a == b)
+    {
+        return true;
+    }
+    if ((a->flags & b->flags & STRING_INTERNED) != 0)
+    {
+        return false;
+    }
+    return a->length == b->length && std::memcmp(a->chars(), b->chars(), a->length) == 0;
+}
@@ -0,0 +1,896 @@
+/**
+ * @file vm.cpp
+ * @brief Implementation of the Ambra VM loader and bytecode run loop.
+ */
+
+#include "vm/vm.h"
+
+#include "bytecode/emitter.h"
+#include "bytecode/verifier.h"
+#include "runtime/builtins.h"
+#include "vm/profile.h"
+
+#include <cstring>
+#include <string>
+#include <utility>
+
+VM::VM(std::ostream& out) : out(out) {}
+
+VM::VM(int fd) : out(fd) {}
+
+void VM::collectGarbage(const Value* sp)
+{
+    heap.mark(stack.data(), sp);
+    heap.mark(locals.data(), locals.data() + locals.size());
+    heap.sweep();
+}
+
+Value* VM::concatN(Value* sp, uint32_t count)
+{
+    // Collect first, while every part is still on the stack and therefore a root.
+    if (heap.shouldCollect())
+    {
+        collectGarbage(sp);
+    }
+
+    Value*   parts = sp - count;
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        total += parts[i].asString()->length;
+    }
+
+    StringObject* joined = heap.allocate(total);
+    char*         chars = const_cast<char*>(joined->chars());
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const StringObject* part = parts[i].asString();
+        std::memcpy(chars, part->chars(), part->length);
+        chars += part->length;
+    }
+
+    parts[0] = Value::fromString(joined);
+    return parts + 1;
+}
+
+void VM::print(const StringObject* s)
+{
+    out.writeLine(s->chars(), s->length);
+}
+
+void VM::printI32(int32_t value)
+{
+    char* end = formatI32(value, out.claim(I32_TEXT_MAX + 1));
+    *end++ = '\n';
+    out.commit(end);
+}
+
+void VM::toString(Value* sp)
+{
+    int32_t value = sp[-1].asI32();
+    if (value >= StringTable::SMALL_INT_MIN && value <= StringTable::SMALL_INT_MAX)
+    {
+        sp[-1] = Value::fromString(strings.smallInt(value));
+        return;
+    }
+    if (heap.shouldCollect())
+    {
+        collectGarbage(sp);
+    }
+    sp[-1] = Value::fromString(makeI32String(heap, value));
+}
+
+Value* VM::concat(Value* sp)
+{
+    // Collect before popping so both operands are still roots.
+    if (heap.shouldCollect())
+    {
+        collectGarbage(sp);
+    }
+    const StringObject* b = (*--sp).asString();
+    const StringObject* a = sp[-1].asString();
+    if (b->length == 0)
+    {
+        return sp;
+    }
+    if (a->length == 0)
+    {
+        sp[-1] = Value::fromString(b);
+        return sp;
+    }
+    StringObject* joined = heap.allocate(a->length + b->length);
+    char*         chars = const_cast<char*>(joined->chars());
+    std::memcpy(chars, a->chars(), a->length);
+    std::memcpy(chars + a->length, b->chars(), b->length);
+    sp[-1] = Value::fromString(joined);
+    return sp;
+}
+
+JitHelpers VM::jitHelpers()
+{
+    // Each one does what the interpreter's handler does, at the stack pointer
+    // native code passes in.
+    auto printString = [](void* vm, Value* sp, uint32_t)
+    { static_cast<VM*>(vm)->print(sp[-1].asString()); };
+    auto printConst = [](void* vm, Value*, uint32_t index)
+    {
+        VM* self = static_cast<VM*>(vm);
+        self->print(self->program->constants[index].asString());
+    };
+    auto printI32 = [](void* vm, Value* sp, uint32_t)
+    { static_cast<VM*>(vm)->printI32(sp[-1].asI32()); };
+    auto toString = [](void* vm, Value* sp, uint32_t) { static_cast<VM*>(vm)->toString(sp); };
+    auto boolToString = [](void* vm, Value* sp, uint32_t)
+    { sp[-1] = Value::fromString(static_cast<VM*>(vm)->program->boolStrings[sp[-1].asBool()]); };
+    auto concat = [](void* vm, Value* sp, uint32_t) { static_cast<VM*>(vm)->concat(sp); };
+    auto concatN = [](void* vm, Value* sp, uint32_t count)
+    { static_cast<VM*>(vm)->concatN(sp, count); };
+    auto equals = [](void*, Value* sp, uint32_t)
+    { sp[-2] = Value::fromBool(stringEquals(sp[-2].asString(), sp[-1].asString())); };
+    auto differs = [](void*, Value* sp, uint32_t)
+    { sp[-2] = Value::fromBool(!stringEquals(sp[-2].asString(), sp[-1].asString())); };
+
+    JitHelpers helpers;
+    helpers.ops[OP_PRINT_STRING] = printString;
+    helpers.ops[OP_PRINT_CONST] = printConst;
+    helpers.ops[OP_PRINT_CONST_W] = printConst;
+    helpers.ops[OP_PRINT_CONST_L] = printConst;
+    helpers.ops[OP_PRINT_I32] = printI32;
+    helpers.ops[OP_TO_STRING_I32] = toString;
+    helpers.ops[OP_TO_STRING_BOOL] = boolToString;
+    helpers.ops[OP_CONCAT_STRING] = concat;
+    helpers.ops[OP_CONCAT_N] = concatN;
+    helpers.ops[OP_CONCAT_N_W] = concatN;
+    helpers.ops[OP_CONCAT_N_L] = concatN;
+    helpers.ops[OP_CMP_EQ_STRING] = equals;
+    helpers.ops[OP_CMP_NEQ_STRING] = differs;
+    return helpers;
+}
+
+VmResult VmProgram::load(const IrProgram& program, bool verify)
+{
+    BytecodeEmitter emitter{program};
+    Bytecode        emitted = emitter.emit(program.main);
+
+    VmResult result;
+    for (const EmitterDiagnostic& d : emitter.diagnostics)
+    {
+        SourceLoc loc = d.ip < program.main.instructions.size()
+                            ? program.main.instructions[d.ip].loc
+                            : SourceLoc{0, 0};
+        result.diagnostics.push_back({d.message, d.ip, loc});
+    }
+    if (result.hadError())
+    {
+        image = BytecodeImage{};
+        return result;
+    }
+    return load(emitted, verify);
+}
+
+VmResult VmProgram::load(const Bytecode& bytecode, bool verify)
+{
+    BytecodeImage built;
+    std::string   error;
+    if (!built.fromBytes(serializeImage(bytecode), error))
+    {
+        image = BytecodeImage{};
+        VmResult result;
+        result.diagnostics.push_back({error, 0});
+        return result;
+    }
+    return load(std::move(built), verify);
+}
+
+VmResult VmProgram::load(BytecodeImage loaded, bool verify)
+{
+    VmResult result;
+
+    strings.clear(); // may hold strings of the previous image
+    image = std::move(loaded);
+    isVerified = false;
+    if (image.empty())
+    {
+        result.diagnostics.push_back({"No bytecode image to load", 0});
+        return result;
+    }
+
+    // Verified code runs with no checks at all; checked mode takes it as it is.
+    if (verify)
+    {
+        BytecodeVerifier verifier{image};
+        if (!verifier.verify())
+        {
+            for (const VerifierDiagnostic& d : verifier.diagnostics)
+            {
+                result.diagnostics.push_back(
+                    {"Malformed bytecode: " + d.message, d.offset, image.lookupLine(d.offset)});
+            }
+            image = BytecodeImage{};
+            return result;
+        }
+        isVerified = true;
+    }
+
+    // String constants point straight at their objects inside the image,
+    // which the string table adopts.
+    static_assert(sizeof(StringObject) == sizeof(AmbcString), "layouts must match");
+    static_assert(AMBC_STRING_INTERNED == STRING_INTERNED, "image strings are interned");
+
+    uint32_t count = image.constantCount();
+    constants.clear();
+    constants.reserve(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const AmbcConstant& c = image.constant(i);
+        switch (c.type)
+        {
+        case I32:
+            constants.push_back(Value::fromI32(static_cast<int32_t>(c.value)));
+            break;
+        case Bool32:
+            constants.push_back(Value::fromBool(c.value != 0));
+            break;
+        case String32:
+        default:
+            constants.push_back(Value::fromString(
+                strings.intern(reinterpret_cast<const StringObject*>(image.stringObject(i)))));
+            break;
+        }
+    }
+    boolStrings[0] = strings.intern("negative");
+    boolStrings[1] = strings.intern("affirmative");
+    return result;
+}
+
+VmResult VM::load(const IrProgram& ir)
+{
+    auto     loaded = std::make_shared<VmProgram>();
+    VmResult result = loaded->load(ir, !checked);
+    return result.hadError() ? unload(result) : load(std::move(loaded));
+}
+
+VmResult VM::load(const Bytecode& bytecode)
+{
+    auto     loaded = std::make_shared<VmProgram>();
+    VmResult result = loaded->load(bytecode, !checked);
+    return result.hadError() ? unload(result) : load(std::move(loaded));
+}
+
+VmResult VM::load(BytecodeImage image)
+{
+    auto     loaded = std::make_shared<VmProgram>();
+    VmResult result = loaded->load(std::move(image), !checked);
+    return result.hadError() ? unload(result) : load(std::move(loaded));
+}
+
+VmResult VM::load(std::shared_ptr<const VmProgram> shared)
+{
+    VmResult result;
+    if (shared == nullptr || shared->image.empty())
+    {
+        result.diagnostics.push_back({"No bytecode image to load", 0});
+        return unload(result);
+    }
+
+    // Drop everything that points into the previous program before it goes.
+    unload(result);
+    program = std::move(shared);
+    strings.clear(&program->strings);
+
+    locals.assign(program->image.header().localCount, Value{});
+    stack.assign(static_cast<size_t>(program->image.header().maxStack) + 1, Value{});
+    return result;
+}
+
+VmResult VM::unload(VmResult failure)
+{
+    isSuspended = false;
+    jit.reset();
+    heap.clear();
+    strings.clear();
+    program = nullptr;
+    return failure;
+}
+
+VmResult VM::run()
+{
+    if (program == nullptr)
+    {
+        return VmResult{};
+    }
+    resumeOffset = 0;
+    resumeDepth = 0;
+    return proceed();
+}
+
+VmResult VM::resume()
+{
+    if (program == nullptr || !isSuspended)
+    {
+        return VmResult{};
+    }
+    return proceed();
+}
+
+VmResult VM::proceed()
+{
+    isSuspended = false;
+    VmResult result = dispatch();
+    if (!isSuspended && !out.flush())
+    {
+        result.diagnostics.push_back({"Output could not be written", 0});
+    }
+    return result;
+}
+
+VmResult VM::dispatch()
+{
+    bool trusted = program->verified() && !checked;
+    if (budget != 0)
+    {
+        return trusted ? execute<false, false, false, true>() : execute<false, false, true, true>();
+    }
+    if (profile == nullptr)
+    {
+        if (!trusted)
+        {
+            return execute<false, false, true, false>();
+        }
+        if (!jitEnabled || !LoopJit::supported())
+        {
+            return execute<false, false, false, false>();
+        }
+        if (jit == nullptr)
+        {
+            jit = std::make_unique<LoopJit>(program->image.code(), program->image.codeSize(),
+                                            jitHelpers(), jitThreshold);
+        }
+        return execute<false, true, false, false>();
+    }
+    profile->begin(program->image);
+    VmResult result =
+        trusted ? execute<true, false, false, false>() : execute<true, false, true, false>();
+    profile->finish();
+    return result;
+}
+
+const char* VM::checkInstruction(const uint8_t* ip, const Value* sp) const
+{
+    const BytecodeImage&      image = program->image;
+    const std::vector<Value>& constants = program->constants;
+    const uint8_t*            base = image.code();
+    uint32_t                  size = image.codeSize();
+    if (ip < base || ip >= base + size)
+    {
+        return "Instruction pointer outside the code section";
+    }
+    BytecodeOp op = static_cast<BytecodeOp>(*ip);
+    if (op >= OP_COUNT)
+    {
+        return "Invalid opcode";
+    }
+    if (static_cast<uint64_t>(ip - base) + 1 + operandWidth(op) > size)
+    {
+        return "Truncated instruction";
+    }
+
+    int    pops = 0;
+    int    pushes = 0;
+    size_t depth = static_cast<size_t>(sp - stack.data());
+    if (!stackEffect(ip, pops, pushes) || depth < static_cast<size_t>(pops))
+    {
+        return "Operand stack underflow";
+    }
+    if (depth - pops + pushes > image.header().maxStack)
+    {
+        return "Operand stack overflow";
+    }
+
+    // The operands the instruction pops, bottom first, must all pass `is`.
+    const Value* operands = sp - pops;
+    auto         all = [&](bool (Value::*is)() const)
+    {
+        for (int i = 0; i < pops; i++)
+        {
+            if (!(operands[i].*is)())
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+    auto validLocal = [&](uint32_t index) { return index < locals.size(); };
+    auto i32Local = [&](uint32_t index) { return validLocal(index) && locals[index].isI32(); };
+    const char* wrongType = "Operand of the wrong type";
+    const char* badJump = "Jump target outside the code section";
+    uint32_t    operand = decodeOperand(ip);
+
+    switch (op)
+    {
+    case OP_PUSH_CONST:
+    case OP_PUSH_CONST_W:
+    case OP_PUSH_CONST_L:
+        return operand < constants.size() ? nullptr : "Constant index out of range";
+    case OP_LOAD_LOCAL:
+    case OP_LOAD_LOCAL_W:
+    case OP_LOAD_LOCAL_L:
+        if (!validLocal(operand))
+        {
+            return "Local index out of range";
+        }
+        return locals[operand].raw() != 0 ? nullptr : "Load of a local before it is stored";
+    case OP_STORE_LOCAL:
+    case OP_STORE_LOCAL_W:
+    case OP_STORE_LOCAL_L:
+        return validLocal(operand) ? nullptr : "Local index out of range";
+    case OP_ADD_I32:
+    case OP_SUB_I32:
+    case OP_MUL_I32:
+    case OP_DIV_I32:
+    case OP_NEG_I32:
+    case OP_CMP_EQ_I32:
+    case OP_CMP_NEQ_I32:
+    case OP_CMP_LT_I32:
+    case OP_CMP_LTEQ_I32:
+    case OP_CMP_GT_I32:
+    case OP_CMP_GTEQ_I32:
+    case OP_TO_STRING_I32:
+    case OP_PRINT_I32:
+        return all(&Value::isI32) ? nullptr : wrongType;
+    case OP_NOT_BOOL:
+    case OP_CMP_EQ_BOOL:
+    case OP_CMP_NEQ_BOOL:
+    case OP_TO_STRING_BOOL:
+        return all(&Value::isBool) ? nullptr : wrongType;
+    case OP_CMP_EQ_STRING:
+    case OP_CMP_NEQ_STRING:
+    case OP_PRINT_STRING:
+    case OP_CONCAT_STRING:
+    case OP_CONCAT_N:
+    case OP_CONCAT_N_W:
+    case OP_CONCAT_N_L:
+        return all(&Value::isString) ? nullptr : wrongType;
+    case OP_JUMP:
+        return operand < size ? nullptr : badJump;
+    case OP_JUMP_IF_FALSE:
+    case OP_JUMP_IF_TRUE:
+        if (!all(&Value::isBool))
+        {
+            return wrongType;
+        }
+        return operand < size ? nullptr : badJump;
+    case OP_PRINT_CONST:
+    case OP_PRINT_CONST_W:
+    case OP_PRINT_CONST_L:
+        if (operand >= constants.size())
+        {
+            return "Constant index out of range";
+        }
+        return constants[operand].isString() ? nullptr : wrongType;
+    case OP_ADD_LOCAL_CONST:
+        if (!validLocal(ip[1]) || !validLocal(ip[3]) || ip[2] >= constants.size())
+        {
+            return "Operand index out of range";
+        }
+        return i32Local(ip[1]) && constants[ip[2]].isI32() ? nullptr : wrongType;
+    case OP_JUMP_IF_NOT_LT_LOCALS:
+        if (!i32Local(ip[1]) || !i32Local(ip[2]))
+        {
+            return validLocal(ip[1]) && validLocal(ip[2]) ? wrongType : "Local index out of range";
+        }
+        return readU32(ip + 3) < size ? nullptr : badJump;
+    default:
+        return nullptr;
+    }
+}
+
+template <bool Profile, bool Tiered, bool Checked, bool Budgeted> VmResult VM::execute()
+{
+    VmResult                   result;
+    const BytecodeImage&       image = program->image;
+    const std::vector<Value>&  constants = program->constants;
+    const StringObject* const* boolStrings = program->boolStrings;
+
+// Stops before an instruction that cannot run safely; compiled only into the checked instance.
+#define CHECK_DISPATCH()                                                                           \
+    if constexpr (Checked)                                                                         \
+    {                                                                                              \
+        if (const char* error = checkInstruction(ip, sp))                                          \
+        {                                                                                          \
+            uint32_t offset = static_cast<uint32_t>(ip - base);                                    \
+            result.diagnostics.push_back({error, offset, image.lookupLine(offset)});               \
+            return result;                                                                         \
+        }                                                                                          \
+    }
+
+// Jumps to byte offset `offset`. A backward jump closes a loop; the budgeted
+// instance counts those and, once the budget is spent, suspends the run with
+// the jump taken, so resume() starts at the loop head.
+#define JUMP_TO(offset)                                                                            \
+    {                                                                                              \
+        const uint8_t* destination = base + (offset);                                              \
+        if constexpr (Budgeted)                                                                    \
+        {                                                                                          \
+            if (destination <= ip && --budgetLeft == 0)                                            \
+            {                                                                                      \
+                resumeOffset = static_cast<uint32_t>(destination - base);                          \
+                resumeDepth = static_cast<size_t>(sp - stack.data());                              \
+                isSuspended = true;                                                                \
+                return result;                                                                     \
+            }                                                                                      \
+        }                                                                                          \
+        ip = destination;                                                                          \
+        DISPATCH();                                                                                \
+    }
+
+// Reports the instruction about to run; compiled only into the profiling instance.
+#define PROFILE_DISPATCH()                                                                         \
+    if constexpr (Profile)                                                                         \
+    {                                                                                              \
+        profiler->enter(static_cast<uint32_t>(ip - base));                                         \
+    }
+
+#if AMBRA_COMPUTED_GOTO
+    // Handler addresses, indexed by the opcode byte. Must list every BytecodeOp
+    // in order. The packed stream has no room for cached handler pointers, so
+    // each dispatch is one table load plus an indirect jump. Each instance of
+    // execute() has its own table.
+    static const void* const dispatchTable[] = {
+        &&op_OP_PUSH_CONST,     &&op_OP_PUSH_CONST_W,    &&op_OP_PUSH_CONST_L,
+        &&op_OP_POP,            &&op_OP_LOAD_LOCAL,      &&op_OP_LOAD_LOCAL_W,
+        &&op_OP_LOAD_LOCAL_L,   &&op_OP_STORE_LOCAL,     &&op_OP_STORE_LOCAL_W,
+        &&op_OP_STORE_LOCAL_L,  &&op_OP_ADD_I32,         &&op_OP_SUB_I32,
+        &&op_OP_MUL_I32,        &&op_OP_DIV_I32,         &&op_OP_NOT_BOOL,
+        &&op_OP_NEG_I32,        &&op_OP_CMP_EQ_I32,      &&op_OP_CMP_NEQ_I32,
+        &&op_OP_CMP_LT_I32,     &&op_OP_CMP_LTEQ_I32,    &&op_OP_CMP_GT_I32,
+        &&op_OP_CMP_GTEQ_I32,   &&op_OP_CMP_EQ_BOOL,     &&op_OP_CMP_NEQ_BOOL,
+        &&op_OP_CMP_EQ_STRING,  &&op_OP_CMP_NEQ_STRING,  &&op_OP_JUMP,
+        &&op_OP_JUMP_IF_FALSE,  &&op_OP_JUMP_IF_TRUE,    &&op_OP_PRINT_STRING,
+        &&op_OP_TO_STRING_I32,  &&op_OP_TO_STRING_BOOL,  &&op_OP_CONCAT_STRING,
+        &&op_OP_CONCAT_N,       &&op_OP_CONCAT_N_W,      &&op_OP_CONCAT_N_L,
+        &&op_OP_PRINT_CONST,    &&op_OP_PRINT_CONST_W,   &&op_OP_PRINT_CONST_L,
+        &&op_OP_ADD_LOCAL_CONST, &&op_OP_JUMP_IF_NOT_LT_LOCALS, &&op_OP_PRINT_I32,
+        &&op_OP_NOP,            &&op_OP_HALT};
+    static_assert(sizeof(dispatchTable) / sizeof(dispatchTable[0]) == OP_COUNT,
+                  "dispatchTable must cover every BytecodeOp");
+
+#define CASE(op) op_##op:
+#define DISPATCH()                                                                                 \
+    {                                                                                              \
+        CHECK_DISPATCH()                                                                           \
+        PROFILE_DISPATCH()                                                                         \
+        goto* dispatchTable[*ip];                                                                  \
+    }
+#else
+#define CASE(op) case op:
+#define DISPATCH() continue
+#endif
+
+// Advance past the opcode byte and `width` operand bytes.
+// Not wrapped in do/while: DISPATCH() may be a `continue` of the switch loop.
+#define NEXT(width)                                                                                \
+    {                                                                                              \
+        ip += 1 + (width);                                                                         \
+        DISPATCH();                                                                                \
+    }
+
+// `make` is the Value factory for the result (fromI32 or fromBool).
+#define BINARY_I32(make, expr)                                                                     \
+    do                                                                                             \
+    {                                                                                              \
+        int32_t b = (*--sp).asI32();                                                               \
+        int32_t a = sp[-1].asI32();                                                                \
+        sp[-1] = Value::make(expr);                                                                \
+    } while (0)
+
+#define BINARY_BOOL(expr)                                                                          \
+    do                                                                                             \
+    {                                                                                              \
+        bool b = (*--sp).asBool();                                                                 \
+        bool a = sp[-1].asBool();                                                                  \
+        sp[-1] = Value::fromBool(expr);                                                            \
+    } while (0)
+
+#define BINARY_STRING(expr)                                                                        \
+    do                                                                                             \
+    {                                                                                              \
+        const StringObject* b = (*--sp).asString();                                                \
+        const StringObject* a = sp[-1].asString();                                                 \
+        sp[-1] = Value::fromBool(expr);                                                            \
+    } while (0)
+
+    const uint8_t* const base = image.code();
+    const uint8_t*       ip = base + resumeOffset;
+    Value*               sp = stack.data() + resumeDepth;
+    Value* const         localSlots = locals.data();
+    const Value* const   pool = constants.data();
+    [[maybe_unused]] VmProfile* const profiler = profile;
+    [[maybe_unused]] LoopJit* const   tier = jit.get();
+    [[maybe_unused]] uint64_t         budgetLeft = budget;
+
+#if AMBRA_COMPUTED_GOTO
+    DISPATCH();
+#else
+    for (;;)
+    {
+        CHECK_DISPATCH()
+        PROFILE_DISPATCH()
+        switch (*ip)
+        {
+#endif
+
+    CASE(OP_PUSH_CONST)
+    {
+        *sp++ = pool[ip[1]];
+        NEXT(1);
+    }
+    CASE(OP_PUSH_CONST_W)
+    {
+        *sp++ = pool[readU16(ip + 1)];
+        NEXT(2);
+    }
+    CASE(OP_PUSH_CONST_L)
+    {
+        *sp++ = pool[readU32(ip + 1)];
+        NEXT(4);
+    }
+    CASE(OP_POP)
+    {
+        --sp;
+        NEXT(0);
+    }
+    CASE(OP_LOAD_LOCAL)
+    {
+        *sp++ = localSlots[ip[1]];
+        NEXT(1);
+    }
+    CASE(OP_LOAD_LOCAL_W)
+    {
+        *sp++ = localSlots[readU16(ip + 1)];
+        NEXT(2);
+    }
+    CASE(OP_LOAD_LOCAL_L)
+    {
+        *sp++ = localSlots[readU32(ip + 1)];
+        NEXT(4);
+    }
+    CASE(OP_STORE_LOCAL)
+    {
+        localSlots[ip[1]] = std::move(*--sp);
+        NEXT(1);
+    }
+    CASE(OP_STORE_LOCAL_W)
+    {
+        localSlots[readU16(ip + 1)] = std::move(*--sp);
+        NEXT(2);
+    }
+    CASE(OP_STORE_LOCAL_L)
+    {
+        localSlots[readU32(ip + 1)] = std::move(*--sp);
+        NEXT(4);
+    }
+    CASE(OP_ADD_I32)
+    {
+        // Wrap on overflow instead of invoking undefined behaviour.
+        BINARY_I32(fromI32,
+                   static_cast<int32_t>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b)));
+        NEXT(0);
+    }
+    CASE(OP_SUB_I32)
+    {
+        BINARY_I32(fromI32,
+                   static_cast<int32_t>(static_cast<uint32_t>(a) - static_cast<uint32_t>(b)));
+        NEXT(0);
+    }
+    CASE(OP_MUL_I32)
+    {
+        BINARY_I32(fromI32,
+                   static_cast<int32_t>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b)));
+        NEXT(0);
+    }
+    CASE(OP_DIV_I32)
+    {
+        if (sp[-1].asI32() == 0)
+        {
+            uint32_t offset = static_cast<uint32_t>(ip - base);
+            result.diagnostics.push_back(
+                {"Division by zero", offset, image.lookupLine(offset)});
+            return result;
+        }
+        BINARY_I32(fromI32, (a == INT32_MIN && b == -1) ? INT32_MIN : a / b);
+        NEXT(0);
+    }
+    CASE(OP_NOT_BOOL)
+    {
+        sp[-1] = Value::fromBool(!sp[-1].asBool());
+        NEXT(0);
+    }
+    CASE(OP_NEG_I32)
+    {
+        sp[-1] = Value::fromI32(static_cast<int32_t>(0u - static_cast<uint32_t>(sp[-1].asI32())));
+        NEXT(0);
+    }
+    CASE(OP_CMP_EQ_I32)
+    {
+        BINARY_I32(fromBool, a == b);
+        NEXT(0);
+    }
+    CASE(OP_CMP_NEQ_I32)
+    {
+        BINARY_I32(fromBool, a != b);
+        NEXT(0);
+    }
+    CASE(OP_CMP_LT_I32)
+    {
+        BINARY_I32(fromBool, a < b);
+        NEXT(0);
+    }
+    CASE(OP_CMP_LTEQ_I32)
+    {
+        BINARY_I32(fromBool, a <= b);
+        NEXT(0);
+    }
+    CASE(OP_CMP_GT_I32)
+    {
+        BINARY_I32(fromBool, a > b);
+        NEXT(0);
+    }
+    CASE(OP_CMP_GTEQ_I32)
+    {
+        BINARY_I32(fromBool, a >= b);
+        NEXT(0);
+    }
+    CASE(OP_CMP_EQ_BOOL)
+    {
+        BINARY_BOOL(a == b);
+        NEXT(0);
+    }
+    CASE(OP_CMP_NEQ_BOOL)
+    {
+        BINARY_BOOL(a != b);
+        NEXT(0);
+    }
+    CASE(OP_CMP_EQ_STRING)
+    {
+        BINARY_STRING(stringEquals(a, b));
+        NEXT(0);
+    }
+    CASE(OP_CMP_NEQ_STRING)
+    {
+        BINARY_STRING(!stringEquals(a, b));
+        NEXT(0);
+    }
+    CASE(OP_JUMP)
+    {
+        uint32_t target = readU32(ip + 1);
+        if constexpr (Tiered)
+        {
+            uint32_t offset = static_cast<uint32_t>(ip - base);
+            JitLoop  loop = target <= offset ? tier->onBackEdge(target, offset) : nullptr;
+            if (loop != nullptr)
+            {
+                uint64_t exit = loop(this, localSlots, sp, pool);
+                sp += exit >> 32;
+                ip = base + static_cast<uint32_t>(exit);
+                DISPATCH();
+            }
+        }
+        JUMP_TO(target);
+    }
+    CASE(OP_JUMP_IF_FALSE)
+    {
+        if ((*--sp).asBool())
+        {
+            NEXT(4);
+        }
+        JUMP_TO(readU32(ip + 1));
+    }
+    CASE(OP_JUMP_IF_TRUE)
+    {
+        if (!(*--sp).asBool())
+        {
+            NEXT(4);
+        }
+        JUMP_TO(readU32(ip + 1));
+    }
+    CASE(OP_PRINT_STRING)
+    {
+        print((*--sp).asString());
+        NEXT(0);
+    }
+    CASE(OP_TO_STRING_I32)
+    {
+        toString(sp);
+        NEXT(0);
+    }
+    CASE(OP_TO_STRING_BOOL)
+    {
+        sp[-1] = Value::fromString(boolStrings[sp[-1].asBool()]);
+        NEXT(0);
+    }
+    CASE(OP_CONCAT_STRING)
+    {
+        sp = concat(sp);
+        NEXT(0);
+    }
+    CASE(OP_CONCAT_N)
+    {
+        sp = concatN(sp, ip[1]);
+        NEXT(1);
+    }
+    CASE(OP_CONCAT_N_W)
+    {
+        sp = concatN(sp, readU16(ip + 1));
+        NEXT(2);
+    }
+    CASE(OP_CONCAT_N_L)
+    {
+        sp = concatN(sp, readU32(ip + 1));
+        NEXT(4);
+    }
+    CASE(OP_PRINT_CONST)
+    {
+        print(pool[ip[1]].asString());
+        NEXT(1);
+    }
+    CASE(OP_PRINT_CONST_W)
+    {
+        print(pool[readU16(ip + 1)].asString());
+        NEXT(2);
+    }
+    CASE(OP_PRINT_CONST_L)
+    {
+        print(pool[readU32(ip + 1)].asString());
+        NEXT(4);
+    }
+    CASE(OP_ADD_LOCAL_CONST)
+    {
+        uint32_t a = static_cast<uint32_t>(localSlots[ip[1]].asI32());
+        uint32_t b = static_cast<uint32_t>(pool[ip[2]].asI32());
+        localSlots[ip[3]] = Value::fromI32(static_cast<int32_t>(a + b));
+        NEXT(3);
+    }
+    CASE(OP_JUMP_IF_NOT_LT_LOCALS)
+    {
+        if (localSlots[ip[1]].asI32() < localSlots[ip[2]].asI32())
+        {
+            NEXT(6);
+        }
+        JUMP_TO(readU32(ip + 3));
+    }
+    CASE(OP_PRINT_I32)
+    {
+        printI32((*--sp).asI32());
+        NEXT(0);
+    }
+    CASE(OP_NOP)
+    {
+        NEXT(0);
+    }
+    CASE(OP_HALT)
+    {
+        goto halt;
+    }
+
+#if !AMBRA_COMPUTED_GOTO
+        default:
+            result.diagnostics.push_back({"Unexpected opcode", static_cast<size_t>(ip - base)});
+            return result;
+        }
+    }
+#endif
+
+halt:
+    return result;
+
+#undef CHECK_DISPATCH
+#undef JUMP_TO
+#undef PROFILE_DISPATCH
+#undef CASE
+#undef DISPATCH
+#undef NEXT
+#undef BINARY_I32
+#undef BINARY_BOOL
+#undef BINARY_STRING
+}
@@ -0,0 +1,389 @@
+/**
+ * @file vm.h
+ * @brief Ambra Virtual Machine (AVM) execution engine
+ *
+ * The VM executes the packed bytecode produced by BytecodeEmitter
+ * (see bytecode.h). Execution happens in two steps:
+ *
+ * 1. load(): the program is held as a BytecodeImage (the .ambc layout, either
+ *    mapped from disk or serialized in memory). The constant pool is
+ *    converted to 8-byte Values, with string constants pointing into the
+ *    image, and the locals and operand stack are sized from the image
+ *    header. Jump operands are already absolute byte offsets, so no label is
+ *    ever looked up.
+ * 2. run(): the code section is executed in place. With GCC/Clang every handler
+ *    jumps to the next one through a computed goto indexed by the opcode byte;
+ *    other compilers fall back to a portable switch loop.
+ *
+ * With a VmProfile attached, run() uses a second instance of the loop, with
+ * its own dispatch table, that reports every dispatch to the profile. The
+ * ordinary loop has no profiling code in it at all.
+ *
+ * Where LoopJit is supported, run() uses a third instance whose backward
+ * jumps count towards compiling the loop they close (see vm/jit.h); a
+ * compiled loop runs natively until it leaves the loop or reaches an
+ * instruction it leaves to the interpreter. Profiling runs stay interpreted.
+ *
+ * load() runs BytecodeVerifier over every image and refuses one that fails
+ * it, so the ordinary instances never check a value's tag, an operand index
+ * or the stack depth: every opcode is typed, and verification proved that
+ * each instruction finds the operands it expects on every path.
+ *
+ * For bytecode that should not be trusted that far, or to debug the
+ * emitter, setChecked() skips verification and runs one more instance that
+ * checks each instruction against the actual values just before executing
+ * it, stopping with a diagnostic instead of misbehaving. Checked runs never
+ * use the JIT.
+ *
+ * With a budget set (setBudget()), run() returns after that many loop
+ * back-edges, leaving the program suspended at a loop head; resume()
+ * continues it. A scheduler can so interleave many VMs on a few threads.
+ * Only a budgeted instance of the loop counts back-edges, so straight-line
+ * code, and every run without a budget, pays nothing for it. Budgeted runs
+ * use neither the JIT nor the profiler.
+ *
+ * Everything load() derives from the image (verification, the converted
+ * constant pool, the interned constants) lives in a VmProgram, which never
+ * changes once loaded. Any number of VMs, on any threads, can run one
+ * VmProgram at the same time: each VM owns only what a run mutates (its
+ * operand stack, locals, string heap, conversions, output and compiled
+ * loops), and there is no global state.
+ */
+
+#pragma once
+
+#include "bytecode/bytecode.h"
+#include "bytecode/image.h"
+#include "ir/program.h"
+#include "runtime/output.h"
+#include "runtime/string_heap.h"
+#include "runtime/string_table.h"
+#include "vm/jit.h"
+#include "vm/value.h"
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+class VmProfile;
+
+/**
+ * @brief Whether the run loop dispatches with computed goto
+ *
+ * Enabled for compilers that support the labels-as-values extension. Define
+ * AMBRA_NO_COMPUTED_GOTO to force the portable switch-based loop.
+ */
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(AMBRA_NO_COMPUTED_GOTO)
+#define AMBRA_COMPUTED_GOTO 1
+#else
+#define AMBRA_COMPUTED_GOTO 0
+#endif
+
+/**
+ * @brief Runtime error or load error reported by the VM
+ */
+struct VmDiagnostic
+{
+    std::string message;
+    size_t      ip;        ///< Byte offset (or IR index for emitter errors)
+    SourceLoc   loc{0, 0}; ///< Source location, when known
+};
+
+/**
+ * @brief Outcome of loading or running a program
+ */
+struct VmResult
+{
+    std::vector<VmDiagnostic> diagnostics;
+
+    bool hadError() const
+    {
+        return diagnostics.size() > 0;
+    }
+};
+
+/**
+ * @brief A loaded program, shared read-only by the VMs that run it
+ *
+ * Example: one program, one VM per worker thread.
+ * @code
+ * auto program = std::make_shared<VmProgram>();
+ * if (!program->load(ir).hadError())
+ * {
+ *     // on each worker:
+ *     VM vm(out);
+ *     vm.load(program);
+ *     vm.run();
+ * }
+ * @endcode
+ */
+class VmProgram
+{
+  public:
+    VmProgram() = default;
+
+    VmProgram(const VmProgram&) = delete;
+    VmProgram& operator=(const VmProgram&) = delete;
+
+    /**
+     * @brief Emit bytecode for a program and load it
+     * @param program The validated IR program to load
+     * @param verify Whether to run BytecodeVerifier (see load(BytecodeImage, bool))
+     * @return Diagnostics for malformed control flow (e.g. undefined labels)
+     */
+    VmResult load(const IrProgram& program, bool verify = true);
+
+    /**
+     * @brief Serialize emitted bytecode into an image and load it
+     * @param bytecode Bytecode produced by BytecodeEmitter
+     * @param verify Whether to run BytecodeVerifier (see load(BytecodeImage, bool))
+     * @return Diagnostics for bytecode that cannot be executed
+     */
+    VmResult load(const Bytecode& bytecode, bool verify = true);
+
+    /**
+     * @brief Take ownership of a validated image and prepare it for execution
+     *
+     * The code section is executed where it lies, so a mapped .ambc file is
+     * never copied. Only the constant pool is converted to Values, and string
+     * constants are interned in place.
+     *
+     * @param image Image from BytecodeImage::mapFile() or fromBytes()
+     * @param verify Whether to run BytecodeVerifier; unverified programs
+     *        always run on the checked engine
+     * @return Diagnostics for an image that cannot be executed
+     */
+    VmResult load(BytecodeImage image, bool verify = true);
+
+    /** @brief Whether the loaded image passed BytecodeVerifier */
+    bool verified() const
+    {
+        return isVerified;
+    }
+
+    /** @brief The loaded image, empty until a load() succeeds */
+    const BytecodeImage& loaded() const
+    {
+        return image;
+    }
+
+  private:
+    friend class VM;
+
+    BytecodeImage       image;          ///< Code ends with OP_HALT
+    std::vector<Value>  constants;      ///< Constant pool indexed by constant operands
+    StringTable         strings;        ///< Interned constants and the bool texts
+    const StringObject* boolStrings[2] = {}; ///< Interned "negative" / "affirmative"
+    bool                isVerified = false;
+};
+
+/**
+ * @brief Stack-based interpreter for Ambra bytecode
+ *
+ * Example usage:
+ * @code
+ * VM vm(std::cout);
+ * if (!vm.load(program).hadError())
+ *     vm.run();
+ * @endcode
+ */
+class VM
+{
+  public:
+    /**
+     * @brief Construct a VM that writes `say` output to `out`
+     * @param out Stream receiving PrintString output
+     */
+    explicit VM(std::ostream& out = std::cout);
+
+    /**
+     * @brief Construct a VM that writes `say` output to a file descriptor
+     * @param fd Descriptor receiving PrintString output, e.g. STDOUT_FD
+     */
+    explicit VM(int fd);
+
+    /**
+     * @brief Emit bytecode for a program and prepare it for execution
+     * @param program The validated IR program to load
+     * @return Diagnostics for malformed control flow (e.g. undefined labels)
+     */
+    VmResult load(const IrProgram& program);
+
+    /**
+     * @brief Serialize emitted bytecode into an image and load it
+     * @param bytecode Bytecode produced by BytecodeEmitter
+     * @return Diagnostics for bytecode that cannot be executed
+     */
+    VmResult load(const Bytecode& bytecode);
+
+    /**
+     * @brief Prepare a validated image for execution (see VmProgram::load())
+     * @param image Image from BytecodeImage::mapFile() or fromBytes()
+     * @return Diagnostics for an image that cannot be executed
+     */
+    VmResult load(BytecodeImage image);
+
+    /**
+     * @brief Run a program that other VMs may be running too
+     *
+     * Only this VM's own state is reset; `program` is never modified.
+     *
+     * @param program A successfully loaded program
+     * @return Diagnostics if `program` holds no image
+     */
+    VmResult load(std::shared_ptr<const VmProgram> program);
+
+    /**
+     * @brief Execute the loaded program from its first instruction
+     *
+     * Output is buffered while the program runs and flushed before run()
+     * returns, after a runtime error too. With a budget, run() may instead
+     * return with the program suspended().
+     *
+     * @return Diagnostics for runtime errors (e.g. division by zero), or for
+     *         output that could not be written
+     */
+    VmResult run();
+
+    /**
+     * @brief Continue a program that run() or resume() left suspended
+     * @return As run(); nothing happens if the program is not suspended
+     */
+    VmResult resume();
+
+    /** @brief Whether the last run() or resume() stopped on its budget */
+    bool suspended() const
+    {
+        return isSuspended;
+    }
+
+    /**
+     * @brief Suspend runs after `backEdges` backward jumps, or never if 0
+     *
+     * Every run() and resume() call gets the whole budget. Output stays
+     * buffered while the program is suspended.
+     */
+    void setBudget(uint64_t backEdges)
+    {
+        budget = backEdges;
+    }
+
+    /** @brief Write every `say` line out as soon as it is printed */
+    void setUnbuffered(bool enabled)
+    {
+        out.setUnbuffered(enabled);
+    }
+
+    /**
+     * @brief Profile later runs into `profile`, or stop profiling if null
+     * @param profile Receives the counts; must outlive the runs (see vm/profile.h)
+     */
+    void setProfile(VmProfile* profile)
+    {
+        this->profile = profile;
+    }
+
+    /** @brief Compile hot loops to native code (on by default where supported) */
+    void setJit(bool enabled)
+    {
+        jitEnabled = enabled;
+    }
+
+    /** @brief Backward jumps to a loop head before it is compiled; drops compiled loops */
+    void setJitThreshold(uint32_t threshold)
+    {
+        jitThreshold = threshold;
+        jit.reset();
+    }
+
+    /**
+     * @brief Skip load-time verification and check every instruction as it runs
+     *
+     * Takes effect for later load() and run() calls. An image loaded without
+     * verification is always run checked, and a shared VmProgram keeps
+     * whatever verification it was loaded with.
+     */
+    void setChecked(bool enabled)
+    {
+        checked = enabled;
+    }
+
+    /** @brief Loops compiled for the loaded program so far */
+    size_t jitCompiledLoops() const
+    {
+        return jit == nullptr ? 0 : jit->compiledCount();
+    }
+
+  private:
+    /** @brief Drop the loaded program and return `failure` */
+    VmResult unload(VmResult failure);
+
+    /** @brief Run from resumeOffset, then flush the output unless suspended */
+    VmResult proceed();
+
+    /** @brief Run the instance of the loop selected by the settings */
+    VmResult dispatch();
+
+    /**
+     * @brief The run loop, from resumeOffset with resumeDepth values on the stack
+     *
+     * `Profile` selects the instance that reports to `profile`, `Tiered` the
+     * one that hands hot loops to `jit`, `Checked` the one that calls
+     * checkInstruction() before every instruction, and `Budgeted` the one
+     * that suspends after `budget` back-edges.
+     */
+    template <bool Profile, bool Tiered, bool Checked, bool Budgeted> VmResult execute();
+
+    /**
+     * @brief Whether the instruction at `ip` can run with the stack top at `sp`
+     * @return Why it cannot, or nullptr
+     */
+    const char* checkInstruction(const uint8_t* ip, const Value* sp) const;
+
+    /** @brief Callbacks that let native loops run the string and print instructions */
+    static JitHelpers jitHelpers();
+
+    /** @brief Write `s` and a newline to `out` */
+    void print(const StringObject* s);
+
+    /** @brief Write the decimal text of `value` and a newline to `out` */
+    void printI32(int32_t value);
+
+    /** @brief Replace the I32 below `sp` with its decimal string */
+    void toString(Value* sp);
+
+    /**
+     * @brief Replace the top two strings with their concatenation
+     * @return The new stack pointer
+     */
+    Value* concat(Value* sp);
+
+    /** @brief Reclaim heap strings not reachable from the stack below `sp` or locals */
+    void collectGarbage(const Value* sp);
+
+    /**
+     * @brief Replace the top `count` strings with their concatenation
+     * @return The new stack pointer
+     */
+    Value* concatN(Value* sp, uint32_t count);
+
+    std::shared_ptr<const VmProgram> program; ///< Loaded program, possibly shared
+
+    OutputBuffer       out;              ///< Destination of PrintString
+    std::vector<Value> locals;           ///< Local slots indexed by local operands
+    std::vector<Value> stack;            ///< Operand stack, sized to the program's max depth
+    StringHeap         heap;             ///< Strings created at runtime
+    StringTable        strings;          ///< Conversions; falls back to the program's table
+    VmProfile*         profile = nullptr; ///< Set by setProfile()
+    bool               checked = false;   ///< Set by setChecked()
+    uint64_t           budget = 0;        ///< Set by setBudget()
+    uint32_t           resumeOffset = 0;  ///< Where execute() starts
+    size_t             resumeDepth = 0;   ///< Values on the stack when it starts
+    bool               isSuspended = false;
+
+    bool                     jitEnabled = LoopJit::supported();
+    uint32_t                 jitThreshold = 1000;
+    std::unique_ptr<LoopJit> jit; ///< For the loaded image; created by the first tiered run
+};
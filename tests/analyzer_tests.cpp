@@ -2,6 +2,7 @@
 #include "ast/stmt.h"
 #include "parser/parser.h"
 #include "sema/analyzer.h"
+#include "sema/incremental.h"
 
 #include <gtest/gtest.h>
 #include <memory>
@@ -167,10 +168,10 @@ static std::vector<const IdentifierExpr*> collectIdentifiers(const Program& prog
  */
 static const Symbol* resolvedSymbol(const SemanticResult& res, const IdentifierExpr* id)
 {
-    auto it = res.resolutionTable.mapping.find(const_cast<IdentifierExpr*>(id));
-    if (it == res.resolutionTable.mapping.end())
+    const Symbol* const* symbol = res.resolutionTable.mapping.find(id);
+    if (symbol == nullptr)
         return nullptr;
-    return it->second;
+    return *symbol;
 }
 
 /**
@@ -191,7 +192,7 @@ static const IdentifierExpr* findIdentAt(const std::vector<const IdentifierExpr*
 {
     for (auto* id : ids)
     {
-        if (id->getName() == name && id->loc.line == line && id->loc.col == col)
+        if (id->getName() == name && id->getLoc() == SourceLoc{line, col})
         {
             return id;
         }
@@ -2125,6 +2126,70 @@ TEST(TypeChecker_Logical, DoubleNegation)
     ASSERT_FALSE(types.hadError());
 }
 
+/**
+ * Tests `and`/`or` over comparisons and literals.
+ * Verifies that logical operators accept Bool operands and produce Bool.
+ */
+TEST(TypeChecker_Logical, AndOrOverComparisons)
+{
+    // summon result = 1 < 2 and not negative or affirmative;
+
+    std::vector<Token> tokens = {
+        Token("summon", SUMMON, {}, 1, 1),     Token("result", IDENTIFIER, {}, 1, 8),
+        Token("=", EQUAL, {}, 1, 15),          Token("1", INTEGER, 1, 1, 17),
+        Token("<", LESS, {}, 1, 19),           Token("2", INTEGER, 2, 1, 21),
+        Token("and", AND, {}, 1, 23),          Token("not", NOT, {}, 1, 27),
+        Token("negative", BOOL, false, 1, 31), Token("or", OR, {}, 1, 40),
+        Token("affirmative", BOOL, true, 1, 43), Token(";", SEMI_COLON, {}, 1, 54),
+
+        Token("", EOF_TOKEN, {}, 2, 1)};
+
+    Parser  parser(tokens);
+    Program program = parser.parseProgram();
+
+    Resolver       resolver;
+    SemanticResult sema = resolver.resolve(program);
+    ASSERT_FALSE(sema.hadError());
+
+    TypeChecker        checker(sema.resolutionTable, sema.rootScope.get());
+    TypeCheckerResults types = checker.typeCheck(program);
+
+    ASSERT_FALSE(types.hadError());
+    const auto& summon = static_cast<const SummonStmt&>(**program.begin());
+    EXPECT_EQ(*types.typeTable.mapping.find(&summon.getInitializer()), Bool);
+}
+
+/**
+ * Tests `or` with an Int operand.
+ * Error: Logical operators require Bool operands.
+ */
+TEST(TypeChecker_Logical, OrRequiresBoolOperands)
+{
+    // summon result = 1 or affirmative;
+
+    std::vector<Token> tokens = {
+        Token("summon", SUMMON, {}, 1, 1), Token("result", IDENTIFIER, {}, 1, 8),
+        Token("=", EQUAL, {}, 1, 15),      Token("1", INTEGER, 1, 1, 17),
+        Token("or", OR, {}, 1, 19),        Token("affirmative", BOOL, true, 1, 22),
+        Token(";", SEMI_COLON, {}, 1, 33),
+
+        Token("", EOF_TOKEN, {}, 2, 1)};
+
+    Parser  parser(tokens);
+    Program program = parser.parseProgram();
+
+    Resolver       resolver;
+    SemanticResult sema = resolver.resolve(program);
+    ASSERT_FALSE(sema.hadError());
+
+    TypeChecker        checker(sema.resolutionTable, sema.rootScope.get());
+    TypeCheckerResults types = checker.typeCheck(program);
+
+    ASSERT_TRUE(types.hadError());
+    ASSERT_EQ(types.diagnostics.size(), 1u);
+    EXPECT_EQ(types.diagnostics[0].message, "Logical operators require Bool operands");
+}
+
 /**
  * Tests equality comparison of boolean variables.
  * Verifies that booleans can be compared for equality.
@@ -3468,4 +3533,380 @@ TEST(TypeChecker_Basics, InterpolatedStringValid)
     TypeCheckerResults types = checker.typeCheck(program);
 
     ASSERT_FALSE(types.hadError());
-}
\ No newline at end of file
+}
+
+// ----------------------
+// Incremental analysis
+// ----------------------
+
+static std::string describe(const Diagnostic& d)
+{
+    return std::to_string(d.loc.line) + ":" + std::to_string(d.loc.col) + " " + d.message;
+}
+
+static Program parseSource(const std::string& source)
+{
+    Lexer              lexer(source);
+    std::vector<Token> tokens = lexer.scanTokens();
+    Parser             parser(tokens);
+    return parser.parseProgram();
+}
+
+/**
+ * Diagnostics of a full Resolver + TypeChecker run, as strings, for comparing
+ * against the incremental results.
+ */
+static std::vector<std::string> fullAnalysisDiagnostics(const std::string& source)
+{
+    Program            program = parseSource(source);
+    Resolver           resolver;
+    SemanticResult     sema = resolver.resolve(program);
+    TypeChecker        checker(sema.resolutionTable, sema.rootScope.get());
+    TypeCheckerResults types = checker.typeCheck(program);
+
+    std::vector<std::string> out;
+    for (auto& d : sema.diagnostics)
+    {
+        out.push_back(describe(d));
+    }
+    for (auto& d : types.diagnostics)
+    {
+        out.push_back(describe(d));
+    }
+    return out;
+}
+
+static std::vector<std::string> incrementalDiagnostics(const IncrementalAnalyzer& analyzer)
+{
+    std::vector<std::string> out;
+    for (auto& d : analyzer.getSemantics().diagnostics)
+    {
+        out.push_back(describe(d));
+    }
+    for (auto& d : analyzer.getTypes().diagnostics)
+    {
+        out.push_back(describe(d));
+    }
+    return out;
+}
+
+/**
+ * Re-parsing an unchanged file reuses every statement and its nodes.
+ */
+TEST(Incremental_Analysis, UnchangedProgramReusesEverything)
+{
+    std::string source = "summon x = 1;\n"
+                         "say x + 2;\n"
+                         "should (x > 0) { summon y = x; say y; }\n";
+
+    IncrementalAnalyzer analyzer;
+    analyzer.update(parseSource(source));
+    EXPECT_EQ(analyzer.getReanalyzedCount(), 3u);
+    const Stmt* first = analyzer.getProgram().getStatements()[1].get();
+
+    analyzer.update(parseSource(source));
+    EXPECT_EQ(analyzer.getReanalyzedCount(), 0u);
+    EXPECT_EQ(analyzer.getProgram().getStatements()[1].get(), first);
+    EXPECT_TRUE(incrementalDiagnostics(analyzer).empty());
+
+    // Every identifier use still resolves, and every expression keeps its type.
+    for (const IdentifierExpr* identifier : collectIdentifiers(analyzer.getProgram()))
+    {
+        EXPECT_EQ(analyzer.getSemantics().resolutionTable.mapping.count(identifier), 1u)
+            << identifier->getName();
+    }
+    auto& say = static_cast<const SayStmt&>(*first);
+    EXPECT_EQ(analyzer.getTypes().typeTable.mapping.at(&say.getExpression()), Int);
+}
+
+/**
+ * Editing a statement nothing depends on re-analyzes that statement alone.
+ */
+TEST(Incremental_Analysis, EditedStatementOnly)
+{
+    IncrementalAnalyzer analyzer;
+    analyzer.update(parseSource("summon x = 1;\nsay x;\nsay 2;\nsay x;\n"));
+    analyzer.update(parseSource("summon x = 1;\nsay x;\nsay 3;\nsay x;\n"));
+
+    EXPECT_EQ(analyzer.getReanalyzedCount(), 1u);
+    EXPECT_TRUE(incrementalDiagnostics(analyzer).empty());
+}
+
+/**
+ * Changing a declaration re-checks the statements that use its name.
+ */
+TEST(Incremental_Analysis, DependentsOfChangedDeclarationAreRechecked)
+{
+    IncrementalAnalyzer analyzer;
+    analyzer.update(parseSource("summon x = 1;\nsay 0;\nsay x + 1;\n"));
+    EXPECT_TRUE(incrementalDiagnostics(analyzer).empty());
+
+    std::string edited = "summon x = \"s\";\nsay 0;\nsay x + 1;\n";
+    analyzer.update(parseSource(edited));
+
+    // The declaration and its use; `say 0;` is kept.
+    EXPECT_EQ(analyzer.getReanalyzedCount(), 2u);
+    EXPECT_FALSE(analyzer.getTypes().diagnostics.empty());
+    EXPECT_EQ(incrementalDiagnostics(analyzer), fullAnalysisDiagnostics(edited));
+}
+
+/**
+ * A series of edits (insertions, deletions, redeclarations, removed
+ * declarations) always ends in the same diagnostics as a full analysis.
+ */
+TEST(Incremental_Analysis, MatchesFullAnalysis)
+{
+    std::vector<std::string> versions = {
+        "summon a = 1;\nsummon b = a;\nsay a + b;\n",
+        "summon a = 1;\nsummon b = a;\nsummon a = 2;\nsay a + b;\n",
+        "summon b = a;\nsummon a = 1;\nsay a + b;\n",
+        "summon a = negative;\nsummon b = a;\nsay a + b;\nshould (b) { say a; }\n",
+        "summon a = 1;\nsay \"a is {a} and b\";\nshould (a > 0) { summon b = a; say b; }\n",
+        "say c;\n",
+        "summon c = 1;\nsay c;\naslongas (c < 3) { say c; }\n",
+    };
+
+    IncrementalAnalyzer analyzer;
+    for (const std::string& source : versions)
+    {
+        analyzer.update(parseSource(source));
+        EXPECT_EQ(incrementalDiagnostics(analyzer), fullAnalysisDiagnostics(source)) << source;
+        for (const IdentifierExpr* identifier : collectIdentifiers(analyzer.getProgram()))
+        {
+            // A use resolved in an earlier update must not pick up an entry
+            // left behind by a node that was since replaced.
+            auto found = analyzer.getSemantics().resolutionTable.mapping.find(identifier);
+            if (found != nullptr)
+            {
+                EXPECT_EQ((*found)->name, identifier->getName());
+            }
+        }
+    }
+}
+
+/**
+ * Ids of replaced statements are reused, so a long editing session does not
+ * spread node ids, and the windows of the tables indexed by them, ever wider.
+ */
+TEST(Incremental_Analysis, NodeIdsStayCompactAcrossEdits)
+{
+    IncrementalAnalyzer analyzer;
+    for (int edit = 0; edit < 500; edit++)
+    {
+        std::string source = "summon x = 1;\nsay x + " + std::to_string(edit) +
+                             ";\nshould (x > 0) { say \"{x}\"; }\n";
+        analyzer.update(parseSource(source));
+        EXPECT_TRUE(incrementalDiagnostics(analyzer).empty());
+    }
+
+    // The three statements never have more than a few dozen nodes between them.
+    for (const auto& stmt : analyzer.getProgram().getStatements())
+    {
+        EXPECT_LT(stmt->id, 64u);
+    }
+    for (const IdentifierExpr* identifier : collectIdentifiers(analyzer.getProgram()))
+    {
+        EXPECT_LT(identifier->id, 64u);
+        EXPECT_EQ(analyzer.getSemantics().resolutionTable.mapping.count(identifier), 1u);
+    }
+}
+
+// ----------------------
+// Deep nesting
+// ----------------------
+
+/**
+ * Tests resolution through many nested blocks, with every other level
+ * shadowing `x`: each use sees the innermost declaration, and leaving a
+ * block uncovers the one it hid.
+ */
+TEST(Resolver_Scoping, DeepNestingResolvesToInnermostDeclaration)
+{
+    const int   depth = 200;
+    std::string source = "summon x = 0;\n";
+    for (int level = 1; level <= depth; level++)
+    {
+        source += "{\n";
+        if (level % 2 == 0)
+        {
+            source += "summon x = " + std::to_string(level) + ";\n";
+        }
+        source += "say x;\n";
+    }
+    for (int level = depth; level >= 1; level--)
+    {
+        source += "say x;\n}\n";
+    }
+    source += "say x;\n";
+
+    Program program = parseSource(source);
+    ASSERT_FALSE(program.hadError());
+    Resolver       resolver;
+    SemanticResult sema = resolver.resolve(program);
+    ASSERT_FALSE(sema.hadError());
+
+    // Uses in source order: one per level going in, one per level coming out, then the last.
+    std::vector<const IdentifierExpr*> uses = collectIdentifiers(program);
+    ASSERT_EQ(uses.size(), static_cast<size_t>(2 * depth + 1));
+    auto declaredAt = [](int level) { return level - level % 2; };
+    for (int level = 1; level <= depth; level++)
+    {
+        const Symbol* in = resolvedSymbol(sema, uses[level - 1]);
+        const Symbol* out = resolvedSymbol(sema, uses[2 * depth - level]);
+        ASSERT_NE(in, nullptr);
+        EXPECT_EQ(in, out) << level;
+        auto& init = static_cast<const IntLiteralExpr&>(in->declStmt->getInitializer());
+        EXPECT_EQ(init.getValue(), declaredAt(level)) << level;
+    }
+    const Symbol* outer = resolvedSymbol(sema, uses.back());
+    ASSERT_NE(outer, nullptr);
+    EXPECT_EQ(static_cast<const IntLiteralExpr&>(outer->declStmt->getInitializer()).getValue(), 0);
+}
+
+// ----------------------
+// Parallel analysis
+// ----------------------
+
+/**
+ * A program above PARALLEL_ANALYSIS_MIN_NODES: top-level declarations
+ * interleaved with blocks, if-chains and loops that read them, shadow them,
+ * use a name declared only after them, and misuse types.
+ */
+static std::string largeProgram(int groups)
+{
+    std::string source = "summon v0 = 0;\n";
+    for (int i = 1; i <= groups; i++)
+    {
+        std::string v = "v" + std::to_string(i);
+        source += "summon " + v + " = " + std::to_string(i) + " + v" + std::to_string(i - 1) + ";\n";
+        source += "{ summon t = " + v + " * 2; { summon " + v + " = t < 3; say \"{" + v +
+                  "} {t}\"; } }\n";
+        source += "should (" + v + " > 3 and v0 == 0) { say " + v + "; } otherwise { say later" +
+                  std::to_string(i) + "; }\n";
+        source += "summon later" + std::to_string(i) + " = \"x\";\n";
+        source += "aslongas (" + v + " < 0) { say " + v + " + affirmative; }\n";
+    }
+    return source;
+}
+
+/**
+ * Tests that spreading a large program over threads changes nothing: the
+ * same symbols, types, scopes and diagnostics, in the same order.
+ */
+TEST(Parallel_Analysis, MatchesSingleThread)
+{
+    Program program = parseSource(largeProgram(500));
+    ASSERT_FALSE(program.hadError());
+    ASSERT_GE(program.getArena()->nodeCount(), PARALLEL_ANALYSIS_MIN_NODES);
+
+    Resolver           single;
+    SemanticResult     sema = single.resolve(program);
+    TypeChecker        singleChecker(sema.resolutionTable, sema.rootScope.get());
+    TypeCheckerResults types = singleChecker.typeCheck(program);
+
+    Resolver parallel;
+    parallel.setThreads(4);
+    SemanticResult parallelSema = parallel.resolve(program);
+    TypeChecker    parallelChecker(parallelSema.resolutionTable, parallelSema.rootScope.get());
+    parallelChecker.setThreads(4);
+    TypeCheckerResults parallelTypes = parallelChecker.typeCheck(program);
+
+    // 500 uses of a later name, each also untyped, and 500 additions of a Bool.
+    ASSERT_EQ(sema.diagnostics.size(), 500u);
+    ASSERT_EQ(types.diagnostics.size(), 1000u);
+    ASSERT_EQ(parallelSema.diagnostics.size(), sema.diagnostics.size());
+    for (size_t i = 0; i < sema.diagnostics.size(); i++)
+    {
+        EXPECT_EQ(describe(parallelSema.diagnostics[i]), describe(sema.diagnostics[i])) << i;
+    }
+    ASSERT_EQ(parallelTypes.diagnostics.size(), types.diagnostics.size());
+    for (size_t i = 0; i < types.diagnostics.size(); i++)
+    {
+        EXPECT_EQ(describe(parallelTypes.diagnostics[i]), describe(types.diagnostics[i])) << i;
+    }
+
+    EXPECT_EQ(parallelSema.resolutionTable.mapping.size(), sema.resolutionTable.mapping.size());
+    EXPECT_EQ(parallelTypes.typeTable.mapping.size(), types.typeTable.mapping.size());
+    for (const IdentifierExpr* use : collectIdentifiers(program))
+    {
+        const Symbol* expected = resolvedSymbol(sema, use);
+        const Symbol* actual = resolvedSymbol(parallelSema, use);
+        ASSERT_EQ(actual == nullptr, expected == nullptr) << use->getName();
+        if (expected != nullptr)
+        {
+            EXPECT_EQ(actual->declStmt, expected->declStmt) << use->getName();
+            EXPECT_EQ(parallelTypes.typeTable.mapping.at(use), types.typeTable.mapping.at(use));
+        }
+    }
+
+    // One scope per top-level block, if-chain branch and loop body, in program order.
+    const auto& children = sema.rootScope->children;
+    const auto& parallelChildren = parallelSema.rootScope->children;
+    ASSERT_EQ(parallelChildren.size(), children.size());
+    for (size_t i = 0; i < children.size(); i++)
+    {
+        EXPECT_EQ(parallelChildren[i]->parent, parallelSema.rootScope.get());
+        ASSERT_EQ(parallelChildren[i]->table.size(), children[i]->table.size()) << i;
+        for (const auto& [name, symbol] : children[i]->table)
+        {
+            ASSERT_NE(parallelChildren[i]->lookupLocal(name), nullptr) << i;
+            EXPECT_EQ(parallelChildren[i]->lookupLocal(name)->declStmt, symbol->declStmt);
+        }
+    }
+}
+
+/**
+ * Tests that the root's child scopes keep program order in a parallel run:
+ * every top-level block, branch and loop body declares one name, and the
+ * names come out in the order the statements were written.
+ */
+TEST(Parallel_Analysis, RootScopesKeepProgramOrder)
+{
+    std::string              source;
+    std::vector<std::string> expected;
+    for (int i = 0; i < 800; i++)
+    {
+        std::string n = std::to_string(i);
+        source += "summon v" + n + " = " + n + ";\n";
+        source += "{ summon b" + n + " = v" + n + " + 1; }\n";
+        source += "should (v" + n + " > 3) { summon c" + n + " = v" + n +
+                  "; } otherwise { summon d" + n + " = v" + n + "; }\n";
+        source += "aslongas (v" + n + " < 0) { summon w" + n + " = v" + n + "; }\n";
+        expected.insert(expected.end(), {"b" + n, "c" + n, "d" + n, "w" + n});
+    }
+    Program program = parseSource(source);
+    ASSERT_FALSE(program.hadError());
+    ASSERT_GE(program.getArena()->nodeCount(), PARALLEL_ANALYSIS_MIN_NODES);
+
+    for (size_t threads : {size_t{1}, size_t{4}})
+    {
+        Resolver resolver;
+        resolver.setThreads(threads);
+        SemanticResult sema = resolver.resolve(program);
+        ASSERT_TRUE(sema.diagnostics.empty());
+
+        const auto& children = sema.rootScope->children;
+        ASSERT_EQ(children.size(), expected.size()) << threads;
+        for (size_t i = 0; i < children.size(); i++)
+        {
+            ASSERT_EQ(children[i]->table.size(), 1u) << threads << " " << i;
+            EXPECT_EQ(children[i]->table.begin()->second->name, expected[i]) << threads;
+        }
+    }
+}
+
+/**
+ * Tests that a small program ignores extra threads and still analyzes fine.
+ */
+TEST(Parallel_Analysis, SmallProgramStaysOnCallingThread)
+{
+    Program program = parseSource(largeProgram(2));
+    ASSERT_LT(program.getArena()->nodeCount(), PARALLEL_ANALYSIS_MIN_NODES);
+
+    Resolver resolver;
+    resolver.setThreads(0);
+    SemanticResult sema = resolver.resolve(program);
+    ASSERT_EQ(sema.diagnostics.size(), 2u);
+    EXPECT_EQ(sema.diagnostics[0].message, "undeclared identifier");
+    EXPECT_EQ(sema.rootScope->table.size(), 5u);
+}
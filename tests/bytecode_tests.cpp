@@ -0,0 +1,744 @@
+/**
+ * @file bytecode_tests.cpp
+ * @brief Test suite for the bytecode emitter, line table and disassembler
+ *
+ * Test Organization:
+ * 1. Instruction encoding and operand widths
+ * 2. Label resolution and stack sizing
+ * 3. Line table
+ * 4. Disassembler
+ * 5. .ambc images
+ * 6. Image cache
+ * 7. Verifier
+ */
+
+#include "bytecode/emitter.h"
+#include "bytecode/image.h"
+#include "bytecode/image_cache.h"
+#include "bytecode/verifier.h"
+#include "ir/lowering.h"
+#include "parser/parser.h"
+#include "sema/analyzer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Compile source code through lowering and emit bytecode for main
+ * @param source Ambra source code string
+ * @param superinstructions Whether the emitter may fuse instruction sequences
+ * @return Emitted bytecode
+ */
+static Bytecode compileToBytecode(const std::string& source, bool superinstructions = true)
+{
+    Lexer              lexer(source);
+    std::vector<Token> tokenList = lexer.scanTokens();
+
+    Parser  parser(tokenList);
+    Program program = parser.parseProgram();
+    EXPECT_FALSE(program.hadError());
+
+    Resolver       resolver;
+    SemanticResult sema = resolver.resolve(program);
+    EXPECT_FALSE(sema.hadError());
+
+    TypeChecker        tc(sema.resolutionTable, sema.rootScope.get());
+    TypeCheckerResults types = tc.typeCheck(program);
+    EXPECT_FALSE(types.hadError());
+
+    LoweringContext lowerer{nullptr, nullptr, {}, &types.typeTable, &sema.resolutionTable};
+    IrProgram       ir = lowerer.lowerProgram(&program);
+    EXPECT_FALSE(lowerer.hadError);
+
+    BytecodeEmitter emitter{ir};
+    emitter.superinstructions = superinstructions;
+    Bytecode bytecode = emitter.emit(ir.main);
+    EXPECT_FALSE(emitter.hadError());
+    return bytecode;
+}
+
+/**
+ * @brief Build an IR program with `count` distinct integer constants
+ */
+static IrProgram programWithConstants(uint32_t count)
+{
+    IrProgram ir;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        ir.constants.push_back(Constant{I32, ConstId{i}, static_cast<int>(i)});
+    }
+    ir.nextConstId = ConstId{count};
+    return ir;
+}
+
+// ==================================================================================
+// 1) INSTRUCTION ENCODING
+// ==================================================================================
+
+TEST(Bytecode_Encoding, EmptyProgramIsJustHalt)
+{
+    Bytecode bytecode = compileToBytecode("");
+    EXPECT_EQ(bytecode.code, std::vector<uint8_t>{OP_HALT});
+    EXPECT_EQ(bytecode.maxStack, 0u);
+}
+
+TEST(Bytecode_Encoding, SayLiteralIsFourBytes)
+{
+    Bytecode bytecode = compileToBytecode(R"(say "hi";)", false);
+    EXPECT_EQ(bytecode.code, (std::vector<uint8_t>{OP_PUSH_CONST, 0, OP_PRINT_STRING, OP_HALT}));
+}
+
+TEST(Bytecode_Encoding, SayLiteralFusesToPrintConst)
+{
+    Bytecode bytecode = compileToBytecode(R"(say "hi";)");
+    EXPECT_EQ(bytecode.code, (std::vector<uint8_t>{OP_PRINT_CONST, 0, OP_HALT}));
+}
+
+TEST(Bytecode_Encoding, SayIntFusesToPrintI32)
+{
+    Bytecode bytecode = compileToBytecode("summon x = 7; say x; say x == 7;");
+    // x = 7; LOAD x; PRINT_I32; x == 7 still goes through TO_STRING_BOOL
+    std::vector<uint8_t> expected = {OP_PUSH_CONST, 0, OP_STORE_LOCAL, 0, OP_LOAD_LOCAL, 0,
+                                     OP_PRINT_I32,  OP_LOAD_LOCAL, 0, OP_PUSH_CONST, 0,
+                                     OP_CMP_EQ_I32, OP_TO_STRING_BOOL, OP_PRINT_STRING, OP_HALT};
+    EXPECT_EQ(bytecode.code, expected);
+}
+
+TEST(Bytecode_Encoding, IncrementFusesToAddLocalConst)
+{
+    Bytecode bytecode = compileToBytecode("summon x = 1; summon y = x + 1;");
+    std::vector<uint8_t> expected = {OP_PUSH_CONST, 0, OP_STORE_LOCAL, 0, OP_ADD_LOCAL_CONST,
+                                     0,             0, 1,              OP_HALT};
+    EXPECT_EQ(bytecode.code, expected);
+}
+
+TEST(Bytecode_Encoding, LocalLessThanBranchFuses)
+{
+    Bytecode bytecode = compileToBytecode(R"(
+        summon a = 1;
+        summon b = 2;
+        aslongas (a < b) { say "never ends"; }
+    )");
+
+    // a = 1; b = 2; loop: JUMP_IF_NOT_LT_LOCALS a b end; PRINT_CONST; JUMP loop; end: HALT
+    ASSERT_EQ(bytecode.code.size(), 4u + 4u + 7u + 2u + 5u + 1u);
+    EXPECT_EQ(bytecode.code[8], OP_JUMP_IF_NOT_LT_LOCALS);
+    EXPECT_EQ(bytecode.code[9], 0);
+    EXPECT_EQ(bytecode.code[10], 1);
+    EXPECT_EQ(readU32(&bytecode.code[11]), bytecode.code.size() - 1);
+    EXPECT_EQ(bytecode.code[17], OP_JUMP);
+    EXPECT_EQ(readU32(&bytecode.code[18]), 8u);
+}
+
+TEST(Bytecode_Encoding, ConstantOperandWidensWithIndex)
+{
+    IrProgram ir = programWithConstants(70000);
+    ir.main.instructions = {
+        Instruction{PushConst, Operand{ConstId{255}}},
+        Instruction{PushConst, Operand{ConstId{256}}},
+        Instruction{PushConst, Operand{ConstId{65536}}},
+    };
+
+    BytecodeEmitter emitter{ir};
+    Bytecode        bytecode = emitter.emit(ir.main);
+    ASSERT_FALSE(emitter.hadError());
+
+    std::vector<uint8_t> expected = {OP_PUSH_CONST,   255, OP_PUSH_CONST_W, 0x00, 0x01,
+                                     OP_PUSH_CONST_L, 0x00, 0x00,          0x01, 0x00,
+                                     OP_HALT};
+    EXPECT_EQ(bytecode.code, expected);
+}
+
+TEST(Bytecode_Encoding, LocalsUseNarrowSlots)
+{
+    Bytecode bytecode = compileToBytecode("summon x = 1; say x;");
+    EXPECT_EQ(bytecode.localCount, 1u);
+    EXPECT_EQ(bytecode.code[2], OP_STORE_LOCAL);
+    EXPECT_EQ(bytecode.code[3], 0);
+    EXPECT_EQ(bytecode.code[4], OP_LOAD_LOCAL);
+}
+
+TEST(Bytecode_Encoding, ConcatNCarriesPartCount)
+{
+    IrProgram ir;
+    ir.constants.push_back(Constant{String32, ConstId{0}, std::string("ab")});
+    ir.nextConstId = ConstId{1};
+    for (int i = 0; i < 300; i++)
+    {
+        ir.main.instructions.push_back(Instruction{PushConst, Operand{ConstId{0}}});
+    }
+    ir.main.instructions.push_back(Instruction{ConcatN, Operand{Arity{300}}});
+    ir.main.instructions.push_back(Instruction{Pop, Operand{}});
+
+    BytecodeEmitter emitter{ir};
+    Bytecode        bytecode = emitter.emit(ir.main);
+    ASSERT_FALSE(emitter.hadError());
+
+    size_t at = 300 * 2;
+    EXPECT_EQ(bytecode.code[at], OP_CONCAT_N_W);
+    EXPECT_EQ(readU16(&bytecode.code[at + 1]), 300);
+    EXPECT_EQ(bytecode.code[at + 3], OP_POP);
+    EXPECT_EQ(bytecode.maxStack, 300u);
+}
+
+TEST(Bytecode_Encoding, ToStringIsTypedByItsOperand)
+{
+    Bytecode bytecode = compileToBytecode(R"(
+        summon n = 4;
+        summon name = "n";
+        say "{name} {n} {n > 2}";
+    )");
+    std::string listing = disassemble(bytecode);
+
+    EXPECT_NE(listing.find("TO_STRING_I32"), std::string::npos) << listing;
+    EXPECT_NE(listing.find("TO_STRING_BOOL"), std::string::npos) << listing;
+
+    // A string needs no conversion at all.
+    size_t conversions = 0;
+    for (size_t at = listing.find("TO_STRING"); at != std::string::npos;
+         at = listing.find("TO_STRING", at + 1))
+    {
+        conversions++;
+    }
+    EXPECT_EQ(conversions, 2u);
+}
+
+TEST(Bytecode_Encoding, InvalidConstIdIsReported)
+{
+    IrProgram ir;
+    ir.main.instructions.push_back(Instruction{PushConst, Operand{ConstId{3}}});
+
+    BytecodeEmitter emitter{ir};
+    emitter.emit(ir.main);
+    ASSERT_TRUE(emitter.hadError());
+    EXPECT_EQ(emitter.diagnostics[0].message, "Invalid ConstId");
+}
+
+// ==================================================================================
+// 2) LABELS AND STACK SIZING
+// ==================================================================================
+
+TEST(Bytecode_Labels, JumpsTargetByteOffsets)
+{
+    IrProgram ir = programWithConstants(1);
+    ir.main.labelTable.labels.push_back(Label{LabelId{0}, "end", SourceLoc{0, 0}});
+    ir.main.nextLabelId = LabelId{1};
+    ir.main.instructions = {
+        Instruction{Jump, Operand{LabelId{0}}},
+        Instruction{PushConst, Operand{ConstId{0}}},
+        Instruction{Pop, Operand{}},
+        Instruction{JLabel, Operand{LabelId{0}}},
+    };
+
+    BytecodeEmitter emitter{ir};
+    Bytecode        bytecode = emitter.emit(ir.main);
+    ASSERT_FALSE(emitter.hadError());
+
+    // JUMP(5) PUSH_CONST(2) POP(1), so the label lands on the HALT at offset 8.
+    ASSERT_EQ(bytecode.code.size(), 9u);
+    EXPECT_EQ(bytecode.code[0], OP_JUMP);
+    EXPECT_EQ(readU32(&bytecode.code[1]), 8u);
+    EXPECT_EQ(bytecode.code[8], OP_HALT);
+}
+
+TEST(Bytecode_Labels, UndefinedLabelIsReported)
+{
+    IrProgram ir;
+    ir.main.instructions.push_back(Instruction{JumpIfFalse, Operand{LabelId{4}}});
+
+    BytecodeEmitter emitter{ir};
+    emitter.emit(ir.main);
+    ASSERT_TRUE(emitter.hadError());
+    EXPECT_EQ(emitter.diagnostics[0].message, "Jump to undefined label");
+    EXPECT_EQ(emitter.diagnostics[0].ip, 0u);
+}
+
+TEST(Bytecode_Labels, MaxStackCoversDeepestExpression)
+{
+    Bytecode bytecode = compileToBytecode("say 1 + 2 * (3 - 4);");
+    EXPECT_EQ(bytecode.maxStack, 4u);
+}
+
+TEST(Bytecode_Labels, IfChainKeepsStackBalanced)
+{
+    Bytecode bytecode = compileToBytecode(R"(
+        summon x = 5;
+        should (x > 10) { say "big"; }
+        otherwise { say "small"; }
+    )");
+    EXPECT_EQ(bytecode.maxStack, 2u);
+}
+
+// ==================================================================================
+// 3) LINE TABLE
+// ==================================================================================
+
+TEST(Bytecode_LineTable, LookupFindsEnclosingEntry)
+{
+    LineTable lines;
+    lines.add(0, SourceLoc{1, 1});
+    lines.add(4, SourceLoc{1, 1});
+    lines.add(6, SourceLoc{3, 5});
+    lines.add(300, SourceLoc{2, 9});
+
+    EXPECT_EQ(lines.lookup(0), (SourceLoc{1, 1}));
+    EXPECT_EQ(lines.lookup(5), (SourceLoc{1, 1}));
+    EXPECT_EQ(lines.lookup(6), (SourceLoc{3, 5}));
+    EXPECT_EQ(lines.lookup(299), (SourceLoc{3, 5}));
+    EXPECT_EQ(lines.lookup(1000), (SourceLoc{2, 9}));
+}
+
+TEST(Bytecode_LineTable, RepeatedLocationsCostNothing)
+{
+    LineTable lines;
+    lines.add(0, SourceLoc{7, 3});
+    size_t size = lines.data.size();
+    lines.add(2, SourceLoc{7, 3});
+    lines.add(3, SourceLoc{7, 3});
+    EXPECT_EQ(lines.data.size(), size);
+}
+
+TEST(Bytecode_LineTable, EmitterRecordsStatementLines)
+{
+    Bytecode bytecode = compileToBytecode("say 1;\nsay 2;\nsay 3;");
+
+    // Each `say n;` is PUSH_CONST(2) TO_STRING_I32(1) PRINT_STRING(1).
+    EXPECT_EQ(bytecode.lines.lookup(0).line, 1);
+    EXPECT_EQ(bytecode.lines.lookup(4).line, 2);
+    EXPECT_EQ(bytecode.lines.lookup(8).line, 3);
+}
+
+// ==================================================================================
+// 4) DISASSEMBLER
+// ==================================================================================
+
+TEST(Bytecode_Disassembler, ListsEveryInstruction)
+{
+    Bytecode    bytecode = compileToBytecode(R"(say "hi";)");
+    std::string listing = disassemble(bytecode);
+
+    EXPECT_NE(listing.find("0000  line    1  PRINT_CONST 0  ; \"hi\""), std::string::npos);
+    EXPECT_NE(listing.find("0002  line    1  HALT"), std::string::npos);
+}
+
+TEST(Bytecode_Disassembler, SuperinstructionsListEveryField)
+{
+    Bytecode    bytecode = compileToBytecode(R"(
+        summon a = 1;
+        summon b = 2;
+        summon c = a + 5;
+        should (a < b) { say "lt"; }
+    )");
+    std::string listing = disassemble(bytecode);
+
+    EXPECT_NE(listing.find("ADD_LOCAL_CONST 0 2 2"), std::string::npos) << listing;
+    EXPECT_NE(listing.find("JUMP_IF_NOT_LT_LOCALS 0 1 "), std::string::npos) << listing;
+}
+
+TEST(Bytecode_Disassembler, EveryOpcodeHasAName)
+{
+    for (int op = 0; op < OP_COUNT; op++)
+    {
+        EXPECT_STRNE(opcodeName(static_cast<BytecodeOp>(op)), "<unknown>") << "opcode " << op;
+    }
+}
+
+// ==================================================================================
+// 5) .AMBC IMAGES
+// ==================================================================================
+
+TEST(Bytecode_Image, RoundTripsThroughBytes)
+{
+    Bytecode bytecode = compileToBytecode(R"(
+        summon greeting = "hello";
+        say "{greeting} {42} {affirmative}";
+    )");
+
+    BytecodeImage image;
+    std::string   error;
+    ASSERT_TRUE(image.fromBytes(serializeImage(bytecode), error)) << error;
+
+    EXPECT_EQ(image.header().localCount, bytecode.localCount);
+    EXPECT_EQ(image.header().maxStack, bytecode.maxStack);
+    ASSERT_EQ(image.constantCount(), bytecode.constants.size());
+    ASSERT_EQ(image.codeSize(), bytecode.code.size());
+    EXPECT_EQ(std::memcmp(image.code(), bytecode.code.data(), bytecode.code.size()), 0);
+
+    for (uint32_t i = 0; i < image.constantCount(); i++)
+    {
+        const Constant& expected = bytecode.constants[i];
+        ASSERT_EQ(image.constant(i).type, static_cast<uint32_t>(expected.type));
+        if (expected.type == String32)
+        {
+            EXPECT_EQ(image.stringConstant(i), std::get<std::string>(expected.value));
+        }
+        else if (expected.type == I32)
+        {
+            EXPECT_EQ(static_cast<int>(image.constant(i).value), std::get<int>(expected.value));
+        }
+    }
+
+    EXPECT_EQ(image.lookupLine(0), bytecode.lines.lookup(0));
+}
+
+TEST(Bytecode_Image, SectionsAreAligned)
+{
+    Bytecode             bytecode = compileToBytecode(R"(say "a"; say "bcd"; say 1;)");
+    std::vector<uint8_t> bytes = serializeImage(bytecode);
+
+    AmbcHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    EXPECT_EQ(header.fileSize, bytes.size());
+    for (const AmbcSection& section : {header.constants, header.strings, header.code, header.lines})
+    {
+        EXPECT_EQ(section.offset % AMBC_ALIGN, 0u);
+    }
+}
+
+TEST(Bytecode_Image, EqualStringsShareOneInternedObject)
+{
+    Bytecode bytecode;
+    bytecode.constants = {Constant{String32, ConstId{0}, std::string("dup")},
+                          Constant{I32, ConstId{1}, 7},
+                          Constant{String32, ConstId{2}, std::string("dup")},
+                          Constant{String32, ConstId{3}, std::string("other")}};
+    bytecode.code = {OP_HALT};
+
+    BytecodeImage image;
+    std::string   error;
+    ASSERT_TRUE(image.fromBytes(serializeImage(bytecode), error)) << error;
+
+    EXPECT_EQ(image.constant(0).value, image.constant(2).value);
+    EXPECT_NE(image.constant(0).value, image.constant(3).value);
+    EXPECT_EQ(image.stringObject(0)->flags, AMBC_STRING_INTERNED);
+    EXPECT_EQ(image.stringObject(3)->flags, AMBC_STRING_INTERNED);
+}
+
+TEST(Bytecode_Image, RejectsBadMagic)
+{
+    std::vector<uint8_t> bytes = serializeImage(compileToBytecode("say 1;"));
+    bytes[0] = 'X';
+
+    BytecodeImage image;
+    std::string   error;
+    EXPECT_FALSE(image.fromBytes(bytes, error));
+    EXPECT_EQ(error, "not an Ambra bytecode file");
+    EXPECT_TRUE(image.empty());
+}
+
+TEST(Bytecode_Image, RejectsTruncatedFile)
+{
+    std::vector<uint8_t> bytes = serializeImage(compileToBytecode(R"(say "truncated";)"));
+    bytes.resize(bytes.size() - 8);
+
+    BytecodeImage image;
+    std::string   error;
+    EXPECT_FALSE(image.fromBytes(bytes, error));
+    EXPECT_EQ(error, "truncated or corrupt bytecode file");
+}
+
+TEST(Bytecode_Image, RejectsStringOutsideSection)
+{
+    std::vector<uint8_t> bytes = serializeImage(compileToBytecode(R"(say "x";)"));
+
+    AmbcHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    AmbcConstant bogus{String32, header.strings.size};
+    std::memcpy(bytes.data() + header.constants.offset, &bogus, sizeof(bogus));
+
+    BytecodeImage image;
+    std::string   error;
+    EXPECT_FALSE(image.fromBytes(bytes, error));
+    EXPECT_EQ(error, "invalid constant 0");
+}
+
+TEST(Bytecode_Image, RejectsFrameLargerThanTheCode)
+{
+    std::vector<uint8_t> bytes = serializeImage(compileToBytecode("summon x = 1; say x;"));
+
+    // Both fields size allocations made before any code runs.
+    AmbcHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    EXPECT_EQ(header.localCount, 1u);
+
+    BytecodeImage image;
+    std::string   error;
+    AmbcHeader    patched = header;
+    patched.localCount = 0xFFFFFFF0;
+    std::memcpy(bytes.data(), &patched, sizeof(patched));
+    EXPECT_FALSE(image.fromBytes(bytes, error));
+    EXPECT_EQ(error, "header localCount 4294967280 is more than the code can use");
+
+    patched = header;
+    patched.localCount = 2;
+    std::memcpy(bytes.data(), &patched, sizeof(patched));
+    EXPECT_FALSE(image.fromBytes(bytes, error));
+
+    patched = header;
+    patched.maxStack = 0xFFFFFFF0;
+    std::memcpy(bytes.data(), &patched, sizeof(patched));
+    EXPECT_FALSE(image.fromBytes(bytes, error));
+    EXPECT_EQ(error, "header maxStack 4294967280 is deeper than the code can reach");
+
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    EXPECT_TRUE(image.fromBytes(bytes, error)) << error;
+}
+
+TEST(Bytecode_Image, MapsFileFromDisk)
+{
+    std::vector<uint8_t> bytes = serializeImage(compileToBytecode(R"(say "mapped";)"));
+    std::string          path = testing::TempDir() + "bytecode_tests_map.ambc";
+    {
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(bytes.data()),
+                   static_cast<std::streamsize>(bytes.size()));
+    }
+
+    BytecodeImage image;
+    std::string   error;
+    ASSERT_TRUE(image.mapFile(path, error)) << error;
+    EXPECT_EQ(image.stringConstant(0), "mapped");
+
+    BytecodeImage moved = std::move(image);
+    EXPECT_TRUE(image.empty());
+    EXPECT_EQ(moved.stringConstant(0), "mapped");
+}
+
+TEST(Bytecode_Image, MissingFileIsReported)
+{
+    BytecodeImage image;
+    std::string   error;
+    EXPECT_FALSE(image.mapFile(testing::TempDir() + "does_not_exist.ambc", error));
+    EXPECT_FALSE(error.empty());
+}
+
+/* ============================================================
+ * 6. Image cache
+ * ============================================================ */
+
+/** @brief A fresh, empty cache directory under the test temp dir */
+static std::string freshCacheDir(const std::string& name)
+{
+    std::string dir = testing::TempDir() + name;
+    std::filesystem::remove_all(dir);
+    return dir;
+}
+
+TEST(Bytecode_Cache, KeysDependOnSourceAndCompiler)
+{
+    ImageCache cache(freshCacheDir("cache_keys"), "compiler-a");
+    ImageCache other(freshCacheDir("cache_keys"), "compiler-b");
+
+    EXPECT_EQ(cache.keyFor("say 1;"), cache.keyFor("say 1;"));
+    EXPECT_FALSE(cache.keyFor("say 1;") == cache.keyFor("say 2;"));
+    EXPECT_FALSE(cache.keyFor("say 1;") == other.keyFor("say 1;"));
+    EXPECT_EQ(cache.keyFor("").hex().size(), 32u);
+}
+
+TEST(Bytecode_Cache, HitReturnsTheStoredImage)
+{
+    ImageCache           cache(freshCacheDir("cache_hit"), "test");
+    std::vector<uint8_t> bytes = serializeImage(compileToBytecode(R"(say "cached";)"));
+    ImageCacheKey        key = cache.keyFor(R"(say "cached";)");
+
+    std::vector<uint8_t> found;
+    EXPECT_FALSE(cache.lookup(key, found));
+    ASSERT_TRUE(cache.store(key, bytes));
+    ASSERT_TRUE(cache.lookup(key, found));
+    EXPECT_EQ(found, bytes);
+
+    BytecodeImage image;
+    std::string   error;
+    ASSERT_TRUE(image.fromBytes(found, error)) << error;
+    EXPECT_EQ(image.stringConstant(0), "cached");
+}
+
+TEST(Bytecode_Cache, CorruptEntryIsAMiss)
+{
+    ImageCache           cache(freshCacheDir("cache_corrupt"), "test");
+    std::vector<uint8_t> bytes = serializeImage(compileToBytecode("say 1;"));
+    ImageCacheKey        key = cache.keyFor("say 1;");
+    ASSERT_TRUE(cache.store(key, bytes));
+
+    // Truncate the entry, as if a write had been cut short.
+    std::filesystem::resize_file(cache.entryPath(key), 40);
+
+    std::vector<uint8_t> found;
+    EXPECT_FALSE(cache.lookup(key, found));
+    EXPECT_TRUE(found.empty());
+}
+
+TEST(Bytecode_Cache, EvictionDropsLeastRecentlyUsed)
+{
+    namespace fs = std::filesystem;
+
+    std::vector<uint8_t> bytes = serializeImage(compileToBytecode("say 1;"));
+    uint64_t             entrySize = bytes.size() + 24;
+    ImageCache           cache(freshCacheDir("cache_evict"), "test", 2 * entrySize);
+
+    ImageCacheKey keys[3] = {cache.keyFor("a"), cache.keyFor("b"), cache.keyFor("c")};
+    for (int i = 0; i < 3; i++)
+    {
+        ASSERT_TRUE(cache.store(keys[i], bytes));
+        // Spread the timestamps out; b is then used again and becomes the newest.
+        fs::last_write_time(cache.entryPath(keys[i]),
+                            fs::file_time_type::clock::now() - std::chrono::hours(10 - i));
+    }
+    std::vector<uint8_t> found;
+    ASSERT_TRUE(cache.lookup(keys[1], found));
+    fs::last_write_time(cache.entryPath(keys[0]),
+                        fs::file_time_type::clock::now() - std::chrono::hours(1));
+
+    // Over budget by one entry: c is now the least recently used.
+    EXPECT_EQ(cache.evict(), 1u);
+    EXPECT_TRUE(fs::exists(cache.entryPath(keys[0])));
+    EXPECT_TRUE(fs::exists(cache.entryPath(keys[1])));
+    EXPECT_FALSE(fs::exists(cache.entryPath(keys[2])));
+    EXPECT_EQ(cache.evict(), 0u);
+}
+
+// ==================================================================================
+// 7) VERIFIER
+// ==================================================================================
+
+/**
+ * @brief Verify hand-written code against a constant pool
+ * @param maxStack Header maxStack; by default as deep as the image may declare
+ * @return The verifier's first diagnostic, or "" if the code was accepted
+ */
+static std::string verifyCode(std::vector<uint8_t> code, std::vector<Constant> constants,
+                              uint32_t localCount = 0, uint32_t maxStack = UINT32_MAX)
+{
+    CodeLimits limits = codeLimits(code.data(), static_cast<uint32_t>(code.size()));
+
+    Bytecode bytecode;
+    bytecode.code = std::move(code);
+    bytecode.constants = std::move(constants);
+    bytecode.localCount = localCount;
+    bytecode.maxStack = std::min(maxStack, limits.instructions);
+
+    BytecodeImage image;
+    std::string   error;
+    EXPECT_TRUE(image.fromBytes(serializeImage(bytecode), error)) << error;
+
+    BytecodeVerifier verifier{image};
+    bool             accepted = verifier.verify();
+    EXPECT_EQ(accepted, !verifier.hadError());
+    return accepted ? "" : verifier.diagnostics[0].message;
+}
+
+static std::string verifyBytecode(const Bytecode& bytecode)
+{
+    return verifyCode(bytecode.code, bytecode.constants, bytecode.localCount, bytecode.maxStack);
+}
+
+/** @brief An I32 constant 1 and a Bool32 constant affirmative */
+static std::vector<Constant> intAndBool()
+{
+    return {Constant{I32, ConstId{0}, 1}, Constant{Bool32, ConstId{1}, true}};
+}
+
+TEST(Bytecode_Verifier, AcceptsEmittedPrograms)
+{
+    const char* source = R"(
+        summon a = 1;
+        summon b = a + 2;
+        summon name = "Ambra";
+        say "{name}: {a * b} {a < b} {name == name}";
+        should (a < b) { say "lt"; }
+        otherwise should (b > 0) { say b; }
+        otherwise { say -a; }
+        aslongas (b < a) { say "never"; }
+    )";
+    EXPECT_EQ(verifyBytecode(compileToBytecode(source)), "");
+    EXPECT_EQ(verifyBytecode(compileToBytecode(source, false)), "");
+}
+
+TEST(Bytecode_Verifier, AcceptsLoopThatStoresEveryIteration)
+{
+    // i = 0; while (i < 3) i = i + 1; -- the loop head merges the entry and the back edge.
+    IrProgram ir = programWithConstants(4);
+    ir.main.localTable.locals.push_back(LocalInfo{LocalId{0}, I32, "i", {1, 1}});
+    ir.main.instructions = {
+        {PushConst, ConstId{0}, {1, 1}},  {StoreLocal, LocalId{0}, {1, 1}},
+        {JLabel, LabelId{0}, {2, 1}},     {LoadLocal, LocalId{0}, {2, 1}},
+        {PushConst, ConstId{3}, {2, 1}},  {CmpLtI32, {}, {2, 1}},
+        {JumpIfFalse, LabelId{1}, {2, 1}}, {LoadLocal, LocalId{0}, {3, 1}},
+        {PushConst, ConstId{1}, {3, 1}},  {AddI32, {}, {3, 1}},
+        {StoreLocal, LocalId{0}, {3, 1}}, {Jump, LabelId{0}, {3, 1}},
+        {JLabel, LabelId{1}, {4, 1}},
+    };
+    ir.main.labelTable.position[LabelId{0}] = 2;
+    ir.main.labelTable.position[LabelId{1}] = 12;
+
+    BytecodeEmitter emitter{ir};
+    Bytecode        bytecode = emitter.emit(ir.main);
+    ASSERT_FALSE(emitter.hadError());
+    EXPECT_EQ(verifyBytecode(bytecode), "");
+}
+
+TEST(Bytecode_Verifier, RejectsOperandOfTheWrongType)
+{
+    EXPECT_EQ(verifyCode({OP_PUSH_CONST, 0, OP_PUSH_CONST, 1, OP_ADD_I32, OP_POP, OP_HALT},
+                         intAndBool()),
+              "ADD_I32: expected I32, got Bool32");
+    EXPECT_EQ(verifyCode({OP_PUSH_CONST, 0, OP_TO_STRING_BOOL, OP_POP, OP_HALT}, intAndBool()),
+              "TO_STRING_BOOL: expected Bool32, got I32");
+    EXPECT_EQ(verifyCode({OP_PUSH_CONST, 1, OP_PRINT_I32, OP_HALT}, intAndBool()),
+              "PRINT_I32: expected I32, got Bool32");
+    EXPECT_EQ(verifyCode({OP_PRINT_CONST, 0, OP_HALT}, intAndBool()),
+              "PRINT_CONST of a constant that is not a string");
+}
+
+TEST(Bytecode_Verifier, RejectsBadStackDepth)
+{
+    EXPECT_EQ(verifyCode({OP_POP, OP_HALT}, {}), "POP: stack underflow");
+    EXPECT_EQ(verifyCode({OP_PUSH_CONST, 0, OP_PUSH_CONST, 0, OP_HALT}, intAndBool(), 0, 1),
+              "Stack depth exceeds the header's maxStack");
+}
+
+TEST(Bytecode_Verifier, RejectsMalformedEncoding)
+{
+    EXPECT_EQ(verifyCode({OP_COUNT, OP_HALT}, {}), "Invalid opcode " + std::to_string(OP_COUNT));
+    EXPECT_EQ(verifyCode({OP_NOP, OP_JUMP, 0, OP_HALT}, {}), "Truncated instruction");
+    EXPECT_EQ(verifyCode({OP_PUSH_CONST, 7, OP_POP, OP_HALT}, intAndBool()),
+              "Constant index out of range");
+    EXPECT_EQ(verifyCode({OP_PUSH_CONST, 0, OP_STORE_LOCAL, 1, OP_HALT}, intAndBool(), 1),
+              "Local index out of range");
+}
+
+TEST(Bytecode_Verifier, RejectsJumpIntoAnInstruction)
+{
+    EXPECT_EQ(verifyCode({OP_PUSH_CONST, 0, OP_JUMP, 1, 0, 0, 0, OP_HALT}, intAndBool()),
+              "Jump target is not an instruction");
+}
+
+TEST(Bytecode_Verifier, RejectsStackMismatchAtMerge)
+{
+    // Only the fallthrough path pushes before reaching HALT at offset 9.
+    std::vector<uint8_t> code = {OP_PUSH_CONST, 1, OP_JUMP_IF_FALSE, 9, 0, 0, 0,
+                                 OP_PUSH_CONST, 0, OP_HALT};
+    EXPECT_EQ(verifyCode(code, intAndBool()), "Stack mismatch at control-flow merge");
+}
+
+TEST(Bytecode_Verifier, RejectsLoadOfLocalStoredOnOnePath)
+{
+    // if (affirmative) local0 = 1; say local0;  -- the jump skips the store.
+    std::vector<uint8_t> code = {OP_PUSH_CONST,  1, OP_JUMP_IF_FALSE, 11, 0, 0, 0,
+                                 OP_PUSH_CONST,  0, OP_STORE_LOCAL,   0,  OP_LOAD_LOCAL,
+                                 0,              OP_POP, OP_HALT};
+    EXPECT_EQ(verifyCode(code, intAndBool(), 1), "Load of local 0 before it is stored");
+
+    // Storing on both paths makes the load valid.
+    std::vector<uint8_t> both = {OP_PUSH_CONST, 0, OP_STORE_LOCAL, 0, OP_PUSH_CONST,
+                                 1,             OP_JUMP_IF_FALSE, 15, 0, 0, 0,
+                                 OP_PUSH_CONST, 0, OP_STORE_LOCAL, 0, OP_LOAD_LOCAL, 0,
+                                 OP_POP,        OP_HALT};
+    EXPECT_EQ(verifyCode(both, intAndBool(), 1), "");
+}
@@ -0,0 +1,355 @@
+/**
+ * @file c_emitter_tests.cpp
+ * @brief Test suite for the IR-to-C backend
+ *
+ * The structural tests only inspect the generated text. The end-to-end tests
+ * build it with the system C compiler and compare what it prints with the
+ * VM; they are skipped when no `cc` is installed.
+ *
+ * Test Organization:
+ * 1. Generated code
+ * 2. Building and running against the VM
+ */
+
+#include "backend/c_emitter.h"
+#include "ir/lowering.h"
+#include "ir/validator.h"
+#include "parser/parser.h"
+#include "sema/analyzer.h"
+#include "vm/vm.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Compile source code down to validated IR
+ * @param source Ambra source code string
+ * @return Lowered IR program
+ */
+static IrProgram compileToIr(const std::string& source)
+{
+    Lexer              lexer(source);
+    std::vector<Token> tokenList = lexer.scanTokens();
+
+    Parser  parser(tokenList);
+    Program program = parser.parseProgram();
+    EXPECT_FALSE(program.hadError());
+
+    Resolver       resolver;
+    SemanticResult sema = resolver.resolve(program);
+    EXPECT_FALSE(sema.hadError());
+
+    TypeChecker        tc(sema.resolutionTable, sema.rootScope.get());
+    TypeCheckerResults types = tc.typeCheck(program);
+    EXPECT_FALSE(types.hadError());
+
+    LoweringContext lowerer{nullptr, nullptr, {}, &types.typeTable, &sema.resolutionTable};
+    IrProgram       ir = lowerer.lowerProgram(&program);
+    EXPECT_FALSE(lowerer.hadError);
+
+    IrValidator validator{ir, ir.main};
+    EXPECT_FALSE(validator.validate().hadError());
+
+    return ir;
+}
+
+static std::string emitC(const IrProgram& ir)
+{
+    CEmitter    emitter{ir, "test.ara"};
+    std::string c = emitter.emit(ir.main);
+    EXPECT_FALSE(emitter.hadError());
+    return c;
+}
+
+static bool contains(const std::string& text, const std::string& part)
+{
+    return text.find(part) != std::string::npos;
+}
+
+/**
+ * @brief A loop the language cannot express yet (there is no assignment):
+ *        says "tick" three times, counting in local `i`
+ */
+static IrProgram countingLoop()
+{
+    IrProgram ir;
+    ir.constants.push_back(Constant{I32, ConstId{0}, 0});
+    ir.constants.push_back(Constant{I32, ConstId{1}, 1});
+    ir.constants.push_back(Constant{I32, ConstId{2}, 3});
+    ir.constants.push_back(Constant{String32, ConstId{3}, std::string("tick")});
+    ir.main.localTable.locals.push_back(LocalInfo{LocalId{0}, I32, "i", {1, 1}});
+    ir.main.instructions = {
+        {PushConst, ConstId{0}, {1, 1}},   {StoreLocal, LocalId{0}, {1, 1}},
+        {JLabel, LabelId{0}, {2, 1}},      {LoadLocal, LocalId{0}, {2, 1}},
+        {PushConst, ConstId{2}, {2, 1}},   {CmpLtI32, {}, {2, 1}},
+        {JumpIfFalse, LabelId{1}, {2, 1}}, {PushConst, ConstId{3}, {3, 1}},
+        {PrintString, {}, {3, 1}},         {LoadLocal, LocalId{0}, {4, 1}},
+        {PushConst, ConstId{1}, {4, 1}},   {AddI32, {}, {4, 1}},
+        {StoreLocal, LocalId{0}, {4, 1}},  {Jump, LabelId{0}, {4, 1}},
+        {JLabel, LabelId{1}, {5, 1}},
+    };
+    ir.main.labelTable.position[LabelId{0}] = 2;
+    ir.main.labelTable.position[LabelId{1}] = 14;
+    return ir;
+}
+
+/**
+ * @brief say (flag ? "yes" : "no"), with the chosen string on the stack across the join
+ */
+static IrProgram valueAcrossLabel(bool flag)
+{
+    IrProgram ir;
+    ir.constants.push_back(Constant{Bool32, ConstId{0}, flag});
+    ir.constants.push_back(Constant{String32, ConstId{1}, std::string("yes")});
+    ir.constants.push_back(Constant{String32, ConstId{2}, std::string("no")});
+    ir.main.instructions = {
+        {PushConst, ConstId{0}, {1, 1}},   {JumpIfFalse, LabelId{0}, {1, 1}},
+        {PushConst, ConstId{1}, {1, 1}},   {Jump, LabelId{1}, {1, 1}},
+        {JLabel, LabelId{0}, {1, 1}},      {PushConst, ConstId{2}, {1, 1}},
+        {JLabel, LabelId{1}, {1, 1}},      {PrintString, {}, {1, 1}},
+    };
+    ir.main.labelTable.position[LabelId{0}] = 4;
+    ir.main.labelTable.position[LabelId{1}] = 6;
+    return ir;
+}
+
+/**
+ * @brief Builds "n=<i>" into `s` `count` times, discards a concatenation and a
+ *        comparison with it, copies it into `t` (first "") and stores `t` to
+ *        itself, then says t + "!"
+ */
+static IrProgram stringLoop(int count)
+{
+    IrProgram ir;
+    ir.constants.push_back(Constant{I32, ConstId{0}, 0});
+    ir.constants.push_back(Constant{I32, ConstId{1}, 1});
+    ir.constants.push_back(Constant{I32, ConstId{2}, count});
+    ir.constants.push_back(Constant{String32, ConstId{3}, std::string("n=")});
+    ir.constants.push_back(Constant{String32, ConstId{4}, std::string("!")});
+    ir.constants.push_back(Constant{String32, ConstId{5}, std::string("")});
+    ir.main.localTable.locals.push_back(LocalInfo{LocalId{0}, I32, "i", {1, 1}});
+    ir.main.localTable.locals.push_back(LocalInfo{LocalId{1}, String32, "s", {1, 1}});
+    ir.main.localTable.locals.push_back(LocalInfo{LocalId{2}, String32, "t", {1, 1}});
+    ir.main.instructions = {
+        {PushConst, ConstId{0}, {1, 1}},    {StoreLocal, LocalId{0}, {1, 1}},
+        {PushConst, ConstId{5}, {1, 1}},    {StoreLocal, LocalId{2}, {1, 1}},
+        {JLabel, LabelId{0}, {2, 1}},       {LoadLocal, LocalId{0}, {2, 1}},
+        {PushConst, ConstId{2}, {2, 1}},    {CmpLtI32, {}, {2, 1}},
+        {JumpIfFalse, LabelId{1}, {2, 1}},  {PushConst, ConstId{3}, {3, 1}},
+        {LoadLocal, LocalId{0}, {3, 1}},    {ToString, {}, {3, 1}},
+        {ConcatString, {}, {3, 1}},         {StoreLocal, LocalId{1}, {3, 1}},
+        {LoadLocal, LocalId{1}, {4, 1}},    {PushConst, ConstId{4}, {4, 1}},
+        {ConcatString, {}, {4, 1}},         {Pop, {}, {4, 1}},
+        {LoadLocal, LocalId{1}, {5, 1}},    {LoadLocal, LocalId{2}, {5, 1}},
+        {CmpEqString32, {}, {5, 1}},        {Pop, {}, {5, 1}},
+        {LoadLocal, LocalId{1}, {6, 1}},    {StoreLocal, LocalId{2}, {6, 1}},
+        {LoadLocal, LocalId{2}, {7, 1}},    {StoreLocal, LocalId{2}, {7, 1}},
+        {LoadLocal, LocalId{0}, {8, 1}},    {PushConst, ConstId{1}, {8, 1}},
+        {AddI32, {}, {8, 1}},               {StoreLocal, LocalId{0}, {8, 1}},
+        {Jump, LabelId{0}, {8, 1}},         {JLabel, LabelId{1}, {9, 1}},
+        {LoadLocal, LocalId{2}, {9, 1}},    {PushConst, ConstId{4}, {9, 1}},
+        {ConcatString, {}, {9, 1}},         {PrintString, {}, {9, 1}},
+    };
+    ir.main.labelTable.position[LabelId{0}] = 4;
+    ir.main.labelTable.position[LabelId{1}] = 31;
+    return ir;
+}
+
+// ==================================================================================
+// 1) GENERATED CODE
+// ==================================================================================
+
+TEST(CEmitter, LocalsBecomeVariablesAndSlotsTemporaries)
+{
+    std::string c = emitC(compileToIr("summon count = 2; say count + 40;"));
+
+    EXPECT_TRUE(contains(c, "int main(void)"));
+    EXPECT_TRUE(contains(c, "int32_t v0_count = 0;"));
+    EXPECT_TRUE(contains(c, "v0_count = 2;"));
+    EXPECT_TRUE(contains(c, "int32_t t0 = v0_count;"));
+    EXPECT_TRUE(contains(c, "ambra_say("));
+}
+
+TEST(CEmitter, LabelsBecomeGotos)
+{
+    std::string c = emitC(countingLoop());
+
+    EXPECT_TRUE(contains(c, "L0:;"));
+    EXPECT_TRUE(contains(c, "goto L0;"));
+    EXPECT_TRUE(contains(c, "goto L1;"));
+}
+
+TEST(CEmitter, ConstantsAreEscaped)
+{
+    IrProgram ir;
+    ir.constants.push_back(Constant{String32, ConstId{0}, std::string("say \"hi\"\n??\\")});
+    ir.constants.push_back(Constant{I32, ConstId{1}, INT32_MIN});
+    ir.main.instructions = {
+        {PushConst, ConstId{0}, {1, 1}}, {PrintString, {}, {1, 1}},
+        {PushConst, ConstId{1}, {1, 1}}, {ToString, {}, {1, 1}},
+        {PrintString, {}, {1, 1}},
+    };
+
+    std::string c = emitC(ir);
+    EXPECT_TRUE(contains(c, R"({"say \"hi\"\012\?\?\\", 12})"));
+    EXPECT_TRUE(contains(c, "ambra_from_i32(INT32_MIN)"));
+}
+
+TEST(CEmitter, RuntimeStringsAreReleased)
+{
+    std::string c = emitC(stringLoop(3));
+
+    EXPECT_TRUE(contains(c, "ambra_str t5 = ambra_view(v1_s);"));
+    EXPECT_TRUE(contains(c, "ambra_release(v1_s);"));
+    EXPECT_TRUE(contains(c, "ambra_release(t6);"));
+    EXPECT_TRUE(contains(c, "t10 = ambra_keep(t10);"));
+}
+
+TEST(CEmitter, StackMismatchIsReported)
+{
+    IrProgram ir = valueAcrossLabel(true);
+    ir.main.instructions[5] = {Nop, {}, {1, 1}}; // the else path no longer pushes
+
+    CEmitter emitter{ir, "test.ara"};
+    emitter.emit(ir.main);
+    ASSERT_TRUE(emitter.hadError());
+    EXPECT_EQ(emitter.diagnostics[0].message, "Stack mismatch at control-flow merge");
+}
+
+// ==================================================================================
+// 2) BUILDING AND RUNNING AGAINST THE VM
+// ==================================================================================
+
+static bool haveCompiler()
+{
+    static const bool found = std::system("cc --version > /dev/null 2>&1") == 0;
+    return found;
+}
+
+/**
+ * @brief Build the C for `ir` and run it
+ * @param limits Shell commands run first, e.g. a `ulimit`
+ * @return Its stdout and stderr, then "exit <status>"
+ */
+static std::string buildAndRun(const IrProgram& ir, const std::string& name,
+                               const std::string& limits = "")
+{
+    std::string base = testing::TempDir() + "c_emitter_" + name;
+    {
+        std::ofstream file(base + ".c");
+        file << emitC(ir);
+    }
+    std::string build = "cc -std=c99 -O2 -Wall -Werror -o " + base + " " + base + ".c";
+    EXPECT_EQ(std::system(build.c_str()), 0) << build;
+
+    std::string run = limits + base + " > " + base + ".out 2>&1";
+    int         status = std::system(run.c_str());
+
+    std::ifstream     file(base + ".out");
+    std::stringstream output;
+    output << file.rdbuf() << "exit " << (status == 0 ? 0 : 1);
+    return output.str();
+}
+
+/** @brief The same as buildAndRun(), from the VM */
+static std::string runOnVm(const IrProgram& ir)
+{
+    std::ostringstream out;
+    VM                 vm(out);
+    EXPECT_FALSE(vm.load(ir).hadError());
+    VmResult result = vm.run();
+    for (const VmDiagnostic& d : result.diagnostics)
+    {
+        out << "test.ara:" << d.loc.line << ":" << d.loc.col << ": runtime error: " << d.message
+            << "\n";
+    }
+    out << "exit " << (result.hadError() ? 1 : 0);
+    return out.str();
+}
+
+TEST(CEmitter_Native, MatchesVmOnStraightLineCode)
+{
+    if (!haveCompiler())
+    {
+        GTEST_SKIP() << "no C compiler";
+    }
+
+    IrProgram ir = compileToIr(R"(
+        summon x = 7;
+        summon big = 2147483647;
+        summon name = "Ambra";
+        say x * 3 - 1;
+        say big + x;
+        say -x / 2;
+        say "{name} has {x} and {x > 3}";
+        say name == "Ambra";
+        should (x > 10) { say "big"; }
+        otherwise should (x > 0) { say "small"; }
+        otherwise { say "negative"; }
+        aslongas (x < 3) { say "never"; }
+    )");
+    EXPECT_EQ(buildAndRun(ir, "straight"), runOnVm(ir));
+}
+
+TEST(CEmitter_Native, MatchesVmOnDivisionByZero)
+{
+    if (!haveCompiler())
+    {
+        GTEST_SKIP() << "no C compiler";
+    }
+
+    IrProgram ir = compileToIr("summon x = 7;\nsay \"before\";\nsay 10 / (x - 7);\nsay \"after\";");
+    std::string output = buildAndRun(ir, "divide");
+    EXPECT_EQ(output, runOnVm(ir));
+    EXPECT_TRUE(contains(output, "test.ara:3:"));
+}
+
+TEST(CEmitter_Native, MatchesVmOnShortCircuit)
+{
+    if (!haveCompiler())
+    {
+        GTEST_SKIP() << "no C compiler";
+    }
+
+    IrProgram ir = compileToIr(R"(
+        summon zero = 0;
+        summon x = 5;
+        say zero != 0 and 10 / zero == 1;
+        say "{zero == 0 or 10 / zero == 1}";
+        should (x > 3 and not (x == 6 or x == 7)) { say "in"; }
+        say zero > 0 or 10 / zero > 0;
+    )");
+    std::string output = buildAndRun(ir, "short_circuit");
+    EXPECT_EQ(output, runOnVm(ir));
+    EXPECT_TRUE(contains(output, "test.ara:7:"));
+}
+
+TEST(CEmitter_Native, MatchesVmOnLoopsAndJoins)
+{
+    if (!haveCompiler())
+    {
+        GTEST_SKIP() << "no C compiler";
+    }
+
+    EXPECT_EQ(buildAndRun(countingLoop(), "loop"), "tick\ntick\ntick\nexit 0");
+    EXPECT_EQ(buildAndRun(valueAcrossLabel(true), "join_true"), "yes\nexit 0");
+    EXPECT_EQ(buildAndRun(valueAcrossLabel(false), "join_false"), "no\nexit 0");
+}
+
+TEST(CEmitter_Native, StringLoopRunsInConstantMemory)
+{
+    if (!haveCompiler())
+    {
+        GTEST_SKIP() << "no C compiler";
+    }
+
+    EXPECT_EQ(buildAndRun(stringLoop(3), "strings"), runOnVm(stringLoop(3)));
+
+    // Leaking the three strings built per iteration would need well over 64 MiB.
+    EXPECT_EQ(buildAndRun(stringLoop(2000000), "strings_long", "ulimit -v 65536; "),
+              "n=1999999!\nexit 0");
+}
@@ -1,8 +1,10 @@
 #include "lexer/lexer.h"
+#include "lexer/scan.h"
 
 #include <gtest/gtest.h>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
@@ -384,6 +386,22 @@ TEST(SingleToken, Not)
     ASSERT_TRUE(equalTokenVectors(expected, actual));
 }
 
+TEST(SingleToken, AndOr)
+{
+    std::vector<Token> expected = {
+        Token("and", AND, std::monostate{}, 1, 1),
+        Token("or", OR, std::monostate{}, 1, 5),
+        Token("", EOF_TOKEN, std::monostate{}, 1, 7),
+    };
+
+    std::string source = "and or";
+    Lexer       lexer(source);
+
+    std::vector<Token> actual = lexer.scanTokens();
+
+    ASSERT_TRUE(equalTokenVectors(expected, actual));
+}
+
 TEST(SingleToken, Identifier)
 {
     Token              token("foo", IDENTIFIER, std::monostate{}, 1, 1);
@@ -482,6 +500,22 @@ TEST(SingleToken, BoolNegative)
     ASSERT_TRUE(equalTokenVectors(expected, actual));
 }
 
+TEST(SingleToken, KeywordLookalikesAreIdentifiers)
+{
+    // Same length and first letter as a keyword, or a keyword prefix/extension.
+    for (std::string source : {"sax", "nut", "summit", "shovel", "astonish", "negation",
+                               "otherwisE", "affirmation", "sa", "says", "summoner", "Say",
+                               "an", "ant", "ore", "o", "nor", "And", "oR"})
+    {
+        Lexer              lexer(source);
+        std::vector<Token> actual = lexer.scanTokens();
+
+        ASSERT_EQ(actual.size(), 2) << source;
+        EXPECT_EQ(actual[0].getType(), IDENTIFIER) << source;
+        EXPECT_EQ(actual[0].getLexeme(), source);
+    }
+}
+
 TEST(SingleToken, IntegerSingleDigit)
 {
     Token              token("7", INTEGER, 7, 1, 1);
@@ -1388,4 +1422,227 @@ TEST(Errors_Operator, UnaryBang)
     if (!res)
         printExpectedVsActual(expected, actual);
     ASSERT_TRUE(res);
-}
\ No newline at end of file
+}
+TEST(Errors_Number, IntegerOutOfRange)
+{
+    Token              t1("2147483648", ERROR, std::string("Invalid number"), 1, 1);
+    std::vector<Token> expected = {t1};
+
+    Lexer lexer("2147483648");
+    auto  actual = lexer.scanTokens();
+
+    bool res = equalTokenVectors(expected, actual);
+    if (!res)
+        printExpectedVsActual(expected, actual);
+    ASSERT_TRUE(res);
+}
+
+TEST(Compact_Tokens, LexemesPointIntoTheSource)
+{
+    Lexer              lexer("summon count = 42; say \"n={count}\";");
+    const TokenStream& stream = lexer.scanStream();
+
+    ASSERT_EQ(stream.size(), 13u);
+    std::string_view first = stream.lexeme(stream[0]);
+    std::string_view text = stream.text(stream[6]);
+    EXPECT_EQ(first, "summon");
+    EXPECT_EQ(stream.intValue(stream[3]), 42);
+    EXPECT_EQ(stream[6].getType(), STRING);
+    EXPECT_EQ(text, "n=");
+
+    // Both views share one buffer: the source itself.
+    EXPECT_EQ(text.data(), first.data() + 24);
+}
+
+TEST(Compact_Tokens, IdentifiersAreInterned)
+{
+    Lexer              lexer("summon a = b; summon b = a; say a;");
+    const TokenStream& stream = lexer.scanStream();
+
+    std::vector<IdentifierId> ids;
+    for (size_t i = 0; i < stream.size(); i++)
+    {
+        if (stream[i].getType() == IDENTIFIER)
+            ids.push_back(stream[i].value);
+    }
+    ASSERT_EQ(ids.size(), 5u);
+    EXPECT_EQ(stream.identifierCount(), 2u);
+    EXPECT_EQ(ids[0], ids[3]);
+    EXPECT_EQ(ids[0], ids[4]);
+    EXPECT_EQ(ids[1], ids[2]);
+    EXPECT_EQ(stream.identifierName(ids[1]), "b");
+}
+
+TEST(Compact_Tokens, ExpandMatchesOwningTokens)
+{
+    std::string source = "say \"\"\"a\n{x}b\"\"\"; should (affirmative != negative) { say 7; } @";
+
+    Lexer              owning(source);
+    std::vector<Token> expected = owning.scanTokens();
+
+    Lexer              compact(source);
+    const TokenStream& stream = compact.scanStream();
+    std::vector<Token> actual;
+    for (size_t i = 0; i < stream.size(); i++)
+        actual.push_back(stream.expand(stream[i]));
+
+    bool res = equalTokenVectors(expected, actual);
+    if (!res)
+        printExpectedVsActual(expected, actual);
+    ASSERT_TRUE(res);
+
+    // Owning tokens round-trip through a stream that keeps its own copy.
+    TokenStream        copied = TokenStream::fromTokens(expected);
+    std::vector<Token> roundTrip;
+    for (size_t i = 0; i < copied.size(); i++)
+        roundTrip.push_back(copied.expand(copied[i]));
+    ASSERT_TRUE(equalTokenVectors(expected, roundTrip));
+}
+
+/* ============================================================
+ * Block scanning
+ * ============================================================ */
+
+TEST(Block_Scanning, HelpersMatchAScalarWalk)
+{
+    // Hits before, on and after every 16-byte block boundary, plus the tail.
+    for (size_t at = 0; at < 40; at++)
+    {
+        std::string text(40, 'x');
+        text[at] = '{';
+        EXPECT_EQ(scanFindAny(text.data(), text.size(), '"', '{', '\n'), at);
+
+        std::string spaces(40, ' ');
+        spaces[at] = 'y';
+        EXPECT_EQ(scanSkipWhitespace(spaces.data(), spaces.size()), at);
+    }
+
+    std::string none(37, 'a');
+    EXPECT_EQ(scanFindAny(none.data(), none.size(), '"', '{', '\n'), none.size());
+    std::string blank = "  \t\r\n    \n\n\t           \n    ";
+    EXPECT_EQ(scanSkipWhitespace(blank.data(), blank.size()), blank.size());
+
+    std::string lines = std::string(20, '\n') + "abc\n" + std::string(11, '\n');
+    EXPECT_EQ(scanCountNewlines(lines.data(), lines.size()), 32u);
+}
+
+TEST(Block_Scanning, LocationsAfterLongRuns)
+{
+    std::string source = "say \"" + std::string(50, 'a') + "\";\n" + std::string(30, ' ') + "\n" +
+                         "</ " + std::string(40, 'c') + "\n" + "</\n" + std::string(20, 'd') +
+                         "\n\n" + "/>    say \"\"\"x\n" + std::string(33, 'm') + "\n{n}\"\"\";";
+
+    Lexer              lexer(source);
+    std::vector<Token> tokens = lexer.scanTokens();
+
+    ASSERT_EQ(tokens.size(), 11u);
+    EXPECT_EQ(tokens[1].getType(), STRING);
+    EXPECT_EQ(std::get<std::string>(tokens[1].getValue()), std::string(50, 'a'));
+    EXPECT_EQ(tokens[2].getLocation().column, 57);
+
+    // Second `say`, after the run of spaces and both comments.
+    EXPECT_EQ(tokens[3].getType(), SAY);
+    EXPECT_EQ(tokens[3].getLocation().line, 7);
+    EXPECT_EQ(tokens[3].getLocation().column, 7);
+    EXPECT_EQ(tokens[4].getType(), MULTILINE_STRING);
+    EXPECT_EQ(std::get<std::string>(tokens[4].getValue()), "x\n" + std::string(33, 'm') + "\n");
+
+    // The interpolation sits two lines into the multiline string.
+    EXPECT_EQ(tokens[5].getType(), INTERP_START);
+    EXPECT_EQ(tokens[5].getLocation().line, 9);
+    EXPECT_EQ(tokens[5].getLocation().column, 1);
+}
+
+/* ============================================================
+ * Error limit
+ * ============================================================ */
+
+TEST(Error_Limit, ContinuesAfterErrorsUpToTheLimit)
+{
+    std::string source = "say 1 $ 2; say 8a; say 3 @ 4;";
+
+    Lexer lexer(source);
+    lexer.setErrorLimit(10);
+    const TokenStream& stream = lexer.scanStream();
+
+    std::vector<int> errorColumns;
+    for (size_t i = 0; i < stream.size(); i++)
+    {
+        if (stream[i].type == ERROR)
+        {
+            errorColumns.push_back(stream[i].column);
+        }
+    }
+    EXPECT_EQ(errorColumns, (std::vector<int>{7, 16, 26}));
+    EXPECT_EQ(stream.back().type, EOF_TOKEN);
+
+    // The stream ends at the error that reaches the limit.
+    Lexer limited(source);
+    limited.setErrorLimit(2);
+    const TokenStream& cut = limited.scanStream();
+    EXPECT_EQ(cut.back().type, ERROR);
+    EXPECT_EQ(cut.back().column, 16);
+}
+
+TEST(Error_Limit, LeavesAnUnterminatedInterpolation)
+{
+    // The closing quote ends the string along with the interpolation.
+    std::string source = "say \"a{x\"; say 2;";
+
+    Lexer lexer(source);
+    lexer.setErrorLimit(10);
+    std::vector<Token> tokens = lexer.scanTokens();
+
+    std::vector<TokenType> types;
+    for (const Token& token : tokens)
+    {
+        types.push_back(token.getType());
+    }
+    std::vector<TokenType> expected = {SAY,        STRING, INTERP_START, IDENTIFIER, ERROR,
+                                       SEMI_COLON, SAY,    INTEGER,      SEMI_COLON, EOF_TOKEN};
+    EXPECT_EQ(types, expected);
+}
+
+TEST(Error_Limit, ResumesTheStringAfterABrokenInterpolation)
+{
+    // The rest of the interpolation is skipped; "b" is still string text.
+    for (std::string quote : {"\"", "\"\"\""})
+    {
+        std::string source = "say " + quote + "a{ @ {1} }b" + quote + ";\nsay 1;";
+
+        Lexer lexer(source);
+        lexer.setErrorLimit(10);
+        std::vector<Token> tokens = lexer.scanTokens();
+
+        TokenType              text = quote.size() == 1 ? STRING : MULTILINE_STRING;
+        std::vector<TokenType> types;
+        for (const Token& token : tokens)
+        {
+            types.push_back(token.getType());
+        }
+        std::vector<TokenType> expected = {SAY,        text, INTERP_START, ERROR,
+                                           INTERP_END, text, SEMI_COLON,   SAY,
+                                           INTEGER,    SEMI_COLON, EOF_TOKEN};
+        EXPECT_EQ(types, expected) << source;
+        EXPECT_EQ(std::get<std::string>(tokens[5].getValue()), "b") << source;
+    }
+}
+
+TEST(Error_Limit, PullingMatchesScanning)
+{
+    std::string source = "say \"open\n say 1 $;\n say \"\"\"{2\"\"\";\n say 3;";
+
+    Lexer scanning(source);
+    scanning.setErrorLimit(10);
+    const TokenStream& stream = scanning.scanStream();
+
+    Lexer pulling(source);
+    pulling.setErrorLimit(10);
+    for (size_t i = 0; i < stream.size(); i++)
+    {
+        CompactToken token = pulling.nextToken();
+        EXPECT_EQ(token.type, stream[i].type) << "token " << i;
+        EXPECT_EQ(token.line, stream[i].line) << "token " << i;
+        EXPECT_EQ(token.column, stream[i].column) << "token " << i;
+    }
+}
@@ -18,6 +18,9 @@
  * 9. Block scoping - Nested scopes and shadowing
  * 10. Complex scenarios - Realistic multi-feature programs
  * 11. Edge cases - Boundary conditions and operator coverage
+ * 12. Constant pool - Deduplication of identical literals
+ * 13. Constant conditions - Branches and loops decided while lowering
+ * 14. Logical operators - `and`/`or` as jump chains
  *
  * Each test verifies:
  * - Correct IR instructions are generated
@@ -90,6 +93,8 @@ static const char* getOpcodeName(Opcode op)
         return "Jump";
     case JumpIfFalse:
         return "JumpIfFalse";
+    case JumpIfTrue:
+        return "JumpIfTrue";
     case JLabel:
         return "JLabel";
     case PrintString:
@@ -98,6 +103,8 @@ static const char* getOpcodeName(Opcode op)
         return "ToString";
     case ConcatString:
         return "ConcatString";
+    case ConcatN:
+        return "ConcatN";
     case Nop:
         return "Nop";
     default:
@@ -158,6 +165,10 @@ static void printIrProgram(const IrProgram& ir)
         {
             std::cout << " LabelId=" << std::get<LabelId>(instr.operand).value;
         }
+        else if (std::holds_alternative<Arity>(instr.operand))
+        {
+            std::cout << " Arity=" << std::get<Arity>(instr.operand).value;
+        }
 
         std::cout << "\n";
     }
@@ -196,7 +207,7 @@ static IrProgram lowerFromSource(const std::string& source)
     TypeCheckerResults types = tc.typeCheck(program);
     EXPECT_FALSE(types.hadError());
 
-    LoweringContext lowerer{nullptr, nullptr, {}, types.typeTable, sema.resolutionTable};
+    LoweringContext lowerer{nullptr, nullptr, {}, &types.typeTable, &sema.resolutionTable};
 
     return lowerer.lowerProgram(&program);
 }
@@ -760,13 +771,13 @@ TEST(Lowering_Comparisons, ComparisonWithVariables)
 // ==================================================================================
 // Tests verify string interpolation and concatenation. String interpolation
 // should generate: push literal part, evaluate expression, ToString if needed,
-// ConcatString to combine parts.
+// ConcatString (two parts) or a single ConcatN (more parts) to combine them.
 
 /**
  * Test: Simple string interpolation with literal
  * Verifies:\n * - String parts are pushed as constants
  * - Interpolated expression is evaluated
- * - ConcatString instruction combines parts
+ * - A concatenation instruction combines parts
  */
 TEST(Lowering_Strings, SimpleInterpolation)
 {
@@ -776,7 +787,7 @@ TEST(Lowering_Strings, SimpleInterpolation)
     bool        foundConcat = false, foundTypeConversion = false;
     for (const auto& inst : instrs)
     {
-        if (inst.opcode == ConcatString)
+        if (inst.opcode == ConcatString || inst.opcode == ConcatN)
             foundConcat = true;
         if (inst.opcode == ToString)
             foundTypeConversion = true;
@@ -798,7 +809,7 @@ TEST(Lowering_Strings, InterpolationWithVariable)
     {
         if (inst.opcode == LoadLocal)
             foundLoad = true;
-        if (inst.opcode == ConcatString)
+        if (inst.opcode == ConcatString || inst.opcode == ConcatN)
             foundConcat = true;
     }
     EXPECT_TRUE(foundLoad);
@@ -815,13 +826,22 @@ TEST(Lowering_Strings, MultipleInterpolations)
 
     const auto& instrs = ir.main.instructions;
     int         concatCount = 0;
+    int         concatNCount = 0;
+    uint32_t    arity = 0;
     for (const auto& inst : instrs)
     {
         if (inst.opcode == ConcatString)
             concatCount++;
+        if (inst.opcode == ConcatN)
+        {
+            concatNCount++;
+            arity = std::get<Arity>(inst.operand).value;
+        }
     }
-    // Multiple concatenations for multiple interpolations
-    EXPECT_EQ(concatCount, 4);
+    // All five parts are joined by one ConcatN instead of a chain
+    EXPECT_EQ(concatCount, 0);
+    EXPECT_EQ(concatNCount, 1);
+    EXPECT_EQ(arity, 5u);
 }
 
 TEST(Lowering_Strings, InterpolationWithExpression)
@@ -839,7 +859,10 @@ TEST(Lowering_Strings, InterpolationWithExpression)
             concatCount++;
     }
     EXPECT_TRUE(foundAdd);
-    EXPECT_EQ(concatCount, 2);
+    EXPECT_EQ(concatCount, 0);
+    ASSERT_GE(instrs.size(), 2u);
+    EXPECT_EQ(instrs[instrs.size() - 2].opcode, ConcatN);
+    EXPECT_EQ(std::get<Arity>(instrs[instrs.size() - 2].operand).value, 3u);
 }
 
 // ==================================================================================
@@ -968,7 +991,8 @@ TEST(Lowering_Variables, StringVariable)
 TEST(Lowering_ControlFlow, SimpleIfStatement)
 {
     IrProgram ir = lowerFromSource(R"(
-        should (affirmative) {
+        summon flag = affirmative;
+        should (flag) {
             say 1;
         }
     )");
@@ -1028,7 +1052,8 @@ TEST(Lowering_ControlFlow, IfWithConditionVariable)
 TEST(Lowering_ControlFlow, IfElseStatement)
 {
     IrProgram ir = lowerFromSource(R"(
-        should (affirmative) {
+        summon flag = affirmative;
+        should (flag) {
             say 1;
         } otherwise {
             say 2;
@@ -1058,8 +1083,10 @@ TEST(Lowering_ControlFlow, IfElseStatement)
 TEST(Lowering_ControlFlow, NestedIfStatements)
 {
     IrProgram ir = lowerFromSource(R"(
-        should (affirmative) {
-            should (negative) {
+        summon outer = affirmative;
+        summon inner = negative;
+        should (outer) {
+            should (inner) {
                 say 1;
             }
         }
@@ -1640,4 +1667,403 @@ TEST(Lowering_EdgeCases, AllComparisonOperators)
     EXPECT_TRUE(foundLe);
     EXPECT_TRUE(foundGt);
     EXPECT_TRUE(foundGe);
-}
\ No newline at end of file
+}
+// ==================================================================================
+// 12) CONSTANT POOL TESTS
+// ==================================================================================
+// Tests verify that identical literals are interned: they share one constant
+// pool entry and one ConstId, while literals that differ in type or value
+// keep separate entries.
+
+/**
+ * Test: Repeated literals share a constant
+ * Verifies:
+ * - The same string printed twice produces one constant
+ * - Both PushConst instructions reference it
+ */
+TEST(Lowering_Constants, DuplicateLiteralsShareConstId)
+{
+    IrProgram ir = lowerFromSource(R"(
+        say "label";
+        say "label";
+        say 7;
+        say 7;
+    )");
+
+    ASSERT_EQ(ir.constants.size(), 2u);
+    EXPECT_EQ(std::get<std::string>(ir.constants[0].value), "label");
+    EXPECT_EQ(std::get<int>(ir.constants[1].value), 7);
+
+    std::vector<ConstId> pushed;
+    for (const auto& inst : ir.main.instructions)
+    {
+        if (inst.opcode == PushConst)
+            pushed.push_back(std::get<ConstId>(inst.operand));
+    }
+    ASSERT_EQ(pushed.size(), 4u);
+    EXPECT_EQ(pushed[0], ConstId{0});
+    EXPECT_EQ(pushed[1], ConstId{0});
+    EXPECT_EQ(pushed[2], ConstId{1});
+    EXPECT_EQ(pushed[3], ConstId{1});
+}
+
+/**
+ * Test: Equal-looking literals of different types stay distinct
+ * Verifies:
+ * - 1 and "1" are separate constants
+ * - 0 and negative are separate constants
+ */
+TEST(Lowering_Constants, DifferentTypesAreNotMerged)
+{
+    IrProgram ir = lowerFromSource(R"(
+        say 1;
+        say "1";
+        say 0;
+        say negative;
+    )");
+
+    ASSERT_EQ(ir.constants.size(), 4u);
+    EXPECT_EQ(ir.constants[0].type, I32);
+    EXPECT_EQ(ir.constants[1].type, String32);
+    EXPECT_EQ(ir.constants[2].type, I32);
+    EXPECT_EQ(ir.constants[3].type, Bool32);
+}
+
+/**
+ * Test: Interpolation text segments are interned too
+ * Verifies:
+ * - Repeated text parts inside one string reuse a constant
+ * - ConstIds remain dense and match their pool index
+ */
+TEST(Lowering_Constants, InterpolationTextIsInterned)
+{
+    IrProgram ir = lowerFromSource(R"(
+        summon x = 3;
+        say "-{x}-{x}-";
+    )");
+
+    size_t dashCount = 0;
+    for (size_t i = 0; i < ir.constants.size(); i++)
+    {
+        EXPECT_EQ(ir.constants[i].constId, ConstId{static_cast<uint32_t>(i)});
+        if (ir.constants[i].type == String32 &&
+            std::get<std::string>(ir.constants[i].value) == "-")
+            dashCount++;
+    }
+    EXPECT_EQ(dashCount, 1u);
+}
+
+/**
+ * Test: Lowering twice with the same context starts a fresh pool
+ * Verifies:
+ * - Interned ConstIds from one program do not leak into the next
+ */
+TEST(Lowering_Constants, PoolIsPerProgram)
+{
+    Lexer              lexer(R"(say "again";)");
+    std::vector<Token> tokenList = lexer.scanTokens();
+    Parser             parser(tokenList);
+    Program            program = parser.parseProgram();
+
+    Resolver           resolver;
+    SemanticResult     sema = resolver.resolve(program);
+    TypeChecker        tc(sema.resolutionTable, sema.rootScope.get());
+    TypeCheckerResults types = tc.typeCheck(program);
+
+    LoweringContext lowerer{nullptr, nullptr, {}, &types.typeTable, &sema.resolutionTable};
+    IrProgram       first = lowerer.lowerProgram(&program);
+    IrProgram       second = lowerer.lowerProgram(&program);
+
+    ASSERT_EQ(first.constants.size(), 1u);
+    ASSERT_EQ(second.constants.size(), 1u);
+    EXPECT_EQ(second.constants[0].constId, ConstId{0});
+}
+
+// ==================================================================================
+// 13) CONSTANT CONDITION TESTS
+// ==================================================================================
+// Tests verify that conditions built only from literals are decided during
+// lowering, so the untaken code and its jumps and labels are never emitted.
+
+static int countOpcode(const IrProgram& ir, Opcode op)
+{
+    int count = 0;
+    for (const auto& inst : ir.main.instructions)
+    {
+        if (inst.opcode == op)
+            count++;
+    }
+    return count;
+}
+
+static bool hasStringConstant(const IrProgram& ir, const std::string& text)
+{
+    for (const Constant& c : ir.constants)
+    {
+        if (c.type == String32 && std::get<std::string>(c.value) == text)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Test: A constant false branch disappears
+ * Verifies:
+ * - Only the else block is lowered, with no jumps or labels
+ * - The dead block's literals never reach the constant pool
+ */
+TEST(Lowering_ConstantConditions, FalseBranchIsDropped)
+{
+    IrProgram ir = lowerFromSource(R"(
+        should (negative) { say "dead"; }
+        otherwise { say "live"; }
+    )");
+
+    EXPECT_EQ(countOpcode(ir, JumpIfFalse), 0);
+    EXPECT_EQ(countOpcode(ir, Jump), 0);
+    EXPECT_EQ(countOpcode(ir, JLabel), 0);
+    EXPECT_EQ(countOpcode(ir, PrintString), 1);
+    EXPECT_FALSE(hasStringConstant(ir, "dead"));
+}
+
+/**
+ * Test: A constant true branch ends the chain
+ * Verifies:
+ * - Branches before it keep their tests and jump to the end label
+ * - Later branches and the else are not lowered
+ */
+TEST(Lowering_ConstantConditions, TrueBranchEndsTheChain)
+{
+    IrProgram ir = lowerFromSource(R"(
+        summon x = 1;
+        should (x > 5) { say "a"; }
+        otherwise should (2 * 3 == 6) { say "b"; }
+        otherwise should (x < 0) { say "c"; }
+        otherwise { say "d"; }
+    )");
+
+    EXPECT_EQ(countOpcode(ir, JumpIfFalse), 1);
+    EXPECT_EQ(countOpcode(ir, PrintString), 2);
+    EXPECT_EQ(countOpcode(ir, JLabel), 2); // the first branch's next label, and the end
+    EXPECT_FALSE(hasStringConstant(ir, "c"));
+    EXPECT_FALSE(hasStringConstant(ir, "d"));
+}
+
+/**
+ * Test: A loop whose condition is constant false emits nothing
+ */
+TEST(Lowering_ConstantConditions, FalseLoopEmitsNothing)
+{
+    IrProgram ir = lowerFromSource(R"(
+        aslongas (1 > 2) { say "never"; }
+    )");
+
+    EXPECT_TRUE(ir.main.instructions.empty());
+    EXPECT_TRUE(ir.main.labelTable.position.empty());
+}
+
+/**
+ * Test: A loop whose condition is constant true has no test
+ * Verifies:
+ * - The body is followed by a jump back to the only label
+ */
+TEST(Lowering_ConstantConditions, TrueLoopHasNoTest)
+{
+    IrProgram ir = lowerFromSource(R"(
+        aslongas (not negative) { say "tick"; }
+    )");
+
+    const auto& instrs = ir.main.instructions;
+    EXPECT_EQ(countOpcode(ir, JumpIfFalse), 0);
+    ASSERT_EQ(countOpcode(ir, JLabel), 1);
+    EXPECT_EQ(instrs.front().opcode, JLabel);
+    EXPECT_EQ(instrs.back().opcode, Jump);
+    EXPECT_EQ(std::get<LabelId>(instrs.back().operand), std::get<LabelId>(instrs.front().operand));
+}
+
+/**
+ * Test: Conditions that are not constant keep their tests
+ * Verifies:
+ * - A division by zero is left for the VM to report
+ * - A condition reading a local is not decided
+ */
+TEST(Lowering_ConstantConditions, DivisionAndLocalsAreNotConstant)
+{
+    IrProgram ir = lowerFromSource(R"(
+        summon flag = affirmative;
+        should (1 / 0 == 0) { say "a"; }
+        should (flag) { say "b"; }
+    )");
+
+    EXPECT_EQ(countOpcode(ir, JumpIfFalse), 2);
+    EXPECT_EQ(countOpcode(ir, DivI32), 1);
+}
+
+// ==================================================================================
+// 14) LOGICAL OPERATOR TESTS
+// ==================================================================================
+// `and` and `or` never evaluate their right operand when the left one decides,
+// so they lower to conditional jumps instead of an operator instruction.
+
+/** @brief Number of Bool constants pushed by `ir` */
+static int countBoolPushes(const IrProgram& ir)
+{
+    int count = 0;
+    for (const auto& inst : ir.main.instructions)
+    {
+        if (inst.opcode == PushConst &&
+            ir.constants[std::get<ConstId>(inst.operand).value].type == Bool32)
+            count++;
+    }
+    return count;
+}
+
+/**
+ * Test: An `and` condition is a chain of tests
+ * Verifies:
+ * - Each operand gets its own JumpIfFalse to the next branch
+ * - No Bool is materialized for the whole condition
+ */
+TEST(Lowering_Logical, AndConditionIsJumpChain)
+{
+    IrProgram ir = lowerFromSource(R"(
+        summon a = 1;
+        summon b = 2;
+        should (a < b and b < 3) { say "in"; }
+    )");
+
+    EXPECT_EQ(countOpcode(ir, JumpIfFalse), 2);
+    EXPECT_EQ(countOpcode(ir, JumpIfTrue), 0);
+    EXPECT_EQ(countBoolPushes(ir), 0);
+}
+
+/**
+ * Test: An `or` condition jumps into the body as soon as one operand holds
+ * Verifies:
+ * - The left operand uses JumpIfTrue into the body
+ * - `not flag` becomes JumpIfTrue past the loop instead of NotBool; JumpIfFalse
+ */
+TEST(Lowering_Logical, OrConditionJumpsIntoBody)
+{
+    IrProgram ir = lowerFromSource(R"(
+        summon a = 1;
+        summon flag = affirmative;
+        aslongas (a > 5 or not flag) { say "in"; }
+    )");
+
+    EXPECT_EQ(countOpcode(ir, JumpIfTrue), 2);
+    EXPECT_EQ(countOpcode(ir, JumpIfFalse), 0);
+    EXPECT_EQ(countOpcode(ir, NotBool), 0);
+    EXPECT_EQ(countBoolPushes(ir), 1); // only the initializer of flag
+}
+
+/**
+ * Test: `and` used as a value
+ * Verifies:
+ * - A false left operand jumps past the right one to a pushed `negative`
+ * - Both paths meet before the store
+ */
+TEST(Lowering_Logical, AndValueSkipsRightOperand)
+{
+    IrProgram ir = lowerFromSource(R"(
+        summon a = 1;
+        summon both = a > 0 and 10 / a > 2;
+    )");
+
+    const auto& instrs = ir.main.instructions;
+    EXPECT_EQ(countOpcode(ir, JumpIfFalse), 1);
+    EXPECT_EQ(countOpcode(ir, Jump), 1);
+    EXPECT_EQ(countOpcode(ir, JLabel), 2);
+    ASSERT_EQ(countBoolPushes(ir), 1);
+
+    // ...; JLabel decided; PushConst negative; JLabel end; StoreLocal both
+    size_t n = instrs.size();
+    ASSERT_GE(n, 4u);
+    EXPECT_EQ(instrs[n - 4].opcode, JLabel);
+    EXPECT_EQ(instrs[n - 3].opcode, PushConst);
+    EXPECT_EQ(std::get<bool>(ir.constants[std::get<ConstId>(instrs[n - 3].operand).value].value),
+              false);
+    EXPECT_EQ(instrs[n - 2].opcode, JLabel);
+    EXPECT_EQ(instrs[n - 1].opcode, StoreLocal);
+}
+
+// ==================================================================================
+// 15) REUSED CONTEXT TESTS
+// ==================================================================================
+// A batch compiler keeps one LoweringContext and IrProgram per thread and
+// lowers file after file into them.
+
+/** @brief A program analyzed up to lowering, kept alive for the tables */
+struct Analyzed
+{
+    explicit Analyzed(const std::string& source)
+        : lexer(source), parser(lexer), program(parser.parseProgram()),
+          sema(resolver.resolve(program)), checker(sema.resolutionTable, sema.rootScope.get()),
+          types(checker.typeCheck(program))
+    {
+        EXPECT_FALSE(program.hadError());
+        EXPECT_FALSE(sema.hadError());
+        EXPECT_FALSE(types.hadError());
+    }
+
+    Lexer              lexer;
+    Parser             parser;
+    Program            program;
+    Resolver           resolver;
+    SemanticResult     sema;
+    TypeChecker        checker;
+    TypeCheckerResults types;
+};
+
+/**
+ * Test: Lowering different programs in turn with one context and one IrProgram
+ * Verifies:
+ * - Each result matches lowering with a fresh context
+ * - Nothing of the previous program is left behind
+ * - The instruction storage is reused rather than allocated again
+ */
+TEST(Lowering_Reuse, ContextAndProgramAreReusable)
+{
+    Analyzed big(R"(
+        summon n = 10;
+        aslongas (n > 0 and n < 5) { summon sq = n * n; say "{n}: {sq}"; }
+        should (n == 0) { { summon done = "done"; say done; } }
+    )");
+    Analyzed small(R"(summon x = 2; { summon x = "inner"; say x; } say x + 1;)");
+
+    LoweringContext reused{nullptr, nullptr, {}, nullptr, nullptr};
+    IrProgram       ir;
+    for (const Analyzed* analyzed : {&big, &small, &big})
+    {
+        reused.typeTable = &analyzed->types.typeTable;
+        reused.resolutionTable = &analyzed->sema.resolutionTable;
+        const Instruction* storage = ir.main.instructions.data();
+        size_t             capacity = ir.main.instructions.capacity();
+        reused.lowerProgram(&analyzed->program, ir);
+        EXPECT_FALSE(reused.hadError);
+        if (ir.main.instructions.size() <= capacity)
+        {
+            EXPECT_EQ(ir.main.instructions.data(), storage);
+        }
+
+        LoweringContext fresh{nullptr, nullptr, {}, &analyzed->types.typeTable,
+                              &analyzed->sema.resolutionTable};
+        IrProgram       expected = fresh.lowerProgram(&analyzed->program);
+
+        ASSERT_EQ(ir.main.instructions.size(), expected.main.instructions.size());
+        for (size_t i = 0; i < expected.main.instructions.size(); i++)
+        {
+            EXPECT_EQ(ir.main.instructions[i].opcode, expected.main.instructions[i].opcode);
+            EXPECT_EQ(ir.main.instructions[i].operand, expected.main.instructions[i].operand);
+        }
+        ASSERT_EQ(ir.constants.size(), expected.constants.size());
+        for (size_t i = 0; i < expected.constants.size(); i++)
+        {
+            EXPECT_EQ(ir.constants[i].value, expected.constants[i].value);
+        }
+        EXPECT_EQ(ir.main.localTable.locals.size(), expected.main.localTable.locals.size());
+        EXPECT_EQ(ir.main.labelTable.position.size(), expected.main.labelTable.position.size());
+        EXPECT_EQ(ir.nextConstId, expected.nextConstId);
+        EXPECT_EQ(ir.main.nextLabelId, expected.main.nextLabelId);
+    }
+}
@@ -0,0 +1,655 @@
+/**
+ * @file optimizer_tests.cpp
+ * @brief Test suite for the IR peephole optimizer and the IR validator
+ *
+ * Test Organization:
+ * 1. Constant folding
+ * 2. Redundant conversions and branch inversion
+ * 3. Jumps, labels and Nops
+ * 4. Equivalence with unoptimized programs
+ * 5. Validation of the stack discipline across blocks
+ * 6. Unreachable code
+ * 7. Frame slot allocation
+ */
+
+#include "ir/lowering.h"
+#include "ir/optimizer.h"
+#include "ir/slot_allocator.h"
+#include "ir/validator.h"
+#include "parser/parser.h"
+#include "sema/analyzer.h"
+#include "vm/register_vm.h"
+#include "vm/vm.h"
+
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Compile source code down to unoptimized IR
+ */
+static IrProgram lowerFromSource(const std::string& source)
+{
+    Lexer              lexer(source);
+    std::vector<Token> tokenList = lexer.scanTokens();
+
+    Parser  parser(tokenList);
+    Program program = parser.parseProgram();
+    EXPECT_FALSE(program.hadError());
+
+    Resolver       resolver;
+    SemanticResult sema = resolver.resolve(program);
+    EXPECT_FALSE(sema.hadError());
+
+    TypeChecker        tc(sema.resolutionTable, sema.rootScope.get());
+    TypeCheckerResults types = tc.typeCheck(program);
+    EXPECT_FALSE(types.hadError());
+
+    LoweringContext lowerer{nullptr, nullptr, {}, &types.typeTable, &sema.resolutionTable};
+    IrProgram       ir = lowerer.lowerProgram(&program);
+    EXPECT_FALSE(lowerer.hadError);
+    return ir;
+}
+
+/**
+ * @brief Optimize a program and check that the result still validates
+ */
+static OptimizerStats optimize(IrProgram& ir)
+{
+    IrOptimizer optimizer{ir, ir.main};
+    optimizer.optimize();
+
+    IrValidator validator{ir, ir.main};
+    EXPECT_FALSE(validator.validate().hadError());
+    return optimizer.stats;
+}
+
+/**
+ * @brief Lower and optimize source code
+ */
+static IrProgram optimizeSource(const std::string& source)
+{
+    IrProgram ir = lowerFromSource(source);
+    optimize(ir);
+    return ir;
+}
+
+static int countOpcode(const IrProgram& ir, Opcode op)
+{
+    int count = 0;
+    for (const auto& inst : ir.main.instructions)
+    {
+        if (inst.opcode == op)
+            count++;
+    }
+    return count;
+}
+
+/**
+ * @brief The string pushed by a PushConst instruction
+ */
+static std::string pushedString(const IrProgram& ir, const Instruction& inst)
+{
+    EXPECT_EQ(inst.opcode, PushConst);
+    const Constant& c = ir.constants[std::get<ConstId>(inst.operand).value];
+    EXPECT_EQ(c.type, String32);
+    return std::get<std::string>(c.value);
+}
+
+static std::string run(const IrProgram& ir)
+{
+    std::ostringstream out;
+    VM                 vm(out);
+    EXPECT_FALSE(vm.load(ir).hadError());
+    EXPECT_FALSE(vm.run().hadError());
+    return out.str();
+}
+
+// ==================================================================================
+// 1) CONSTANT FOLDING
+// ==================================================================================
+
+TEST(Optimizer_Folding, ArithmeticOnLiteralsBecomesOneConstant)
+{
+    IrProgram ir = optimizeSource("say 1 + 2 * 3;");
+
+    const auto& instrs = ir.main.instructions;
+    ASSERT_EQ(instrs.size(), 2u);
+    EXPECT_EQ(pushedString(ir, instrs[0]), "7");
+    EXPECT_EQ(instrs[1].opcode, PrintString);
+}
+
+TEST(Optimizer_Folding, ComparisonsAndNegation)
+{
+    IrProgram ir = optimizeSource("say not (-3 < 2);");
+
+    const auto& instrs = ir.main.instructions;
+    ASSERT_EQ(instrs.size(), 2u);
+    EXPECT_EQ(pushedString(ir, instrs[0]), "negative");
+}
+
+TEST(Optimizer_Folding, ArithmeticWrapsLikeTheVm)
+{
+    IrProgram ir = optimizeSource("say 2147483647 + 1;");
+    ASSERT_EQ(ir.main.instructions.size(), 2u);
+    EXPECT_EQ(pushedString(ir, ir.main.instructions[0]), "-2147483648");
+}
+
+TEST(Optimizer_Folding, DivisionByZeroIsLeftForTheVm)
+{
+    IrProgram ir = optimizeSource("say 1 / 0;");
+    EXPECT_EQ(countOpcode(ir, DivI32), 1);
+}
+
+TEST(Optimizer_Folding, ConstantInterpolationIsJoined)
+{
+    IrProgram ir = optimizeSource(R"(say "a{1 + 1}b{affirmative}";)");
+
+    const auto& instrs = ir.main.instructions;
+    ASSERT_EQ(instrs.size(), 2u);
+    EXPECT_EQ(pushedString(ir, instrs[0]), "a2baffirmative");
+}
+
+TEST(Optimizer_Folding, EmptyTrailingPartIsDropped)
+{
+    IrProgram ir = optimizeSource(R"(
+        summon x = 1;
+        say "x={x}";
+    )");
+    EXPECT_EQ(countOpcode(ir, ConcatN), 0);
+    EXPECT_EQ(countOpcode(ir, ConcatString), 1);
+}
+
+TEST(Optimizer_Folding, ResultsReuseExistingConstants)
+{
+    IrProgram ir = optimizeSource(R"(
+        summon a = 3;
+        summon b = 1 + 2;
+    )");
+    ASSERT_EQ(countOpcode(ir, PushConst), 2);
+    EXPECT_EQ(std::get<ConstId>(ir.main.instructions[0].operand).value,
+              std::get<ConstId>(ir.main.instructions[2].operand).value);
+}
+
+TEST(Optimizer_Folding, LabelsStopFolding)
+{
+    IrProgram ir;
+    ir.constants.push_back(Constant{I32, ConstId{0}, 1});
+    ir.nextConstId = ConstId{1};
+    ir.main.instructions = {
+        Instruction{PushConst, Operand{ConstId{0}}},
+        Instruction{JLabel, Operand{LabelId{0}}},
+        Instruction{PushConst, Operand{ConstId{0}}},
+        Instruction{AddI32, Operand{}},
+    };
+    ir.main.nextLabelId = LabelId{1};
+
+    IrOptimizer optimizer{ir, ir.main};
+    optimizer.optimize();
+    EXPECT_EQ(ir.main.instructions.size(), 4u);
+    EXPECT_EQ(optimizer.stats.constantsFolded, 0u);
+}
+
+// ==================================================================================
+// 2) REDUNDANT CONVERSIONS AND BRANCH INVERSION
+// ==================================================================================
+
+TEST(Optimizer_Rewrites, ToStringOfStringIsDropped)
+{
+    IrProgram      ir = lowerFromSource(R"(
+        summon s = "a";
+        summon t = "b";
+        say "{s}-{t}";
+    )");
+    int            before = countOpcode(ir, ToString);
+    OptimizerStats stats = optimize(ir);
+
+    EXPECT_EQ(before, 2);
+    EXPECT_EQ(countOpcode(ir, ToString), 0);
+    EXPECT_EQ(stats.toStringsDropped, 2u);
+}
+
+TEST(Optimizer_Rewrites, NegatedConditionBecomesJumpIfTrue)
+{
+    IrProgram ir = optimizeSource(R"(
+        summon b = affirmative;
+        should (not b) { say "no"; }
+    )");
+    EXPECT_EQ(countOpcode(ir, NotBool), 0);
+    EXPECT_EQ(countOpcode(ir, JumpIfFalse), 0);
+    EXPECT_EQ(countOpcode(ir, JumpIfTrue), 1);
+}
+
+// ==================================================================================
+// 3) JUMPS, LABELS AND NOPS
+// ==================================================================================
+
+TEST(Optimizer_Jumps, JumpToJumpIsThreaded)
+{
+    IrProgram ir;
+    ir.constants.push_back(Constant{Bool32, ConstId{0}, true});
+    ir.constants.push_back(Constant{String32, ConstId{1}, std::string("x")});
+    ir.nextConstId = ConstId{2};
+
+    LabelId first{0}, second{1};
+    ir.main.instructions = {
+        Instruction{PushConst, Operand{ConstId{0}}},
+        Instruction{JumpIfFalse, Operand{first}},
+        Instruction{PushConst, Operand{ConstId{1}}},
+        Instruction{PrintString, Operand{}},
+        Instruction{JLabel, Operand{first}},
+        Instruction{Jump, Operand{second}},
+        Instruction{PushConst, Operand{ConstId{1}}},
+        Instruction{PrintString, Operand{}},
+        Instruction{JLabel, Operand{second}},
+    };
+    ir.main.nextLabelId = LabelId{2};
+
+    OptimizerStats stats = optimize(ir);
+    EXPECT_EQ(stats.jumpsThreaded, 1u);
+    EXPECT_EQ(std::get<LabelId>(ir.main.instructions[1].operand), second);
+    EXPECT_EQ(ir.main.labelTable.position.at(second), ir.main.instructions.size() - 1);
+}
+
+TEST(Optimizer_Jumps, JumpToNextLabelIsRemoved)
+{
+    IrProgram ir;
+    ir.main.instructions = {
+        Instruction{Nop, Operand{}},
+        Instruction{Jump, Operand{LabelId{0}}},
+        Instruction{JLabel, Operand{LabelId{0}}},
+    };
+    ir.main.nextLabelId = LabelId{1};
+
+    OptimizerStats stats = optimize(ir);
+    EXPECT_EQ(stats.jumpsRemoved, 1u);
+    EXPECT_EQ(stats.nopsDropped, 2u);
+    ASSERT_EQ(ir.main.instructions.size(), 1u);
+    EXPECT_EQ(ir.main.instructions[0].opcode, JLabel);
+    EXPECT_EQ(ir.main.labelTable.position.at(LabelId{0}), 0u);
+}
+
+TEST(Optimizer_Jumps, ConditionalJumpToNextLabelPopsItsCondition)
+{
+    IrProgram ir;
+    ir.constants.push_back(Constant{Bool32, ConstId{0}, false});
+    ir.constants.push_back(Constant{String32, ConstId{1}, std::string("done")});
+    ir.nextConstId = ConstId{2};
+    ir.main.instructions = {
+        Instruction{PushConst, Operand{ConstId{0}}},
+        Instruction{JumpIfFalse, Operand{LabelId{0}}},
+        Instruction{JLabel, Operand{LabelId{0}}},
+        Instruction{PushConst, Operand{ConstId{1}}},
+        Instruction{PrintString, Operand{}},
+    };
+    ir.main.nextLabelId = LabelId{1};
+
+    IrOptimizer optimizer{ir, ir.main};
+    optimizer.optimize();
+    EXPECT_EQ(optimizer.stats.jumpsRemoved, 1u);
+    EXPECT_EQ(countOpcode(ir, JumpIfFalse), 0);
+    EXPECT_EQ(countOpcode(ir, Pop), 1);
+
+    IrValidator validator{ir, ir.main};
+    EXPECT_FALSE(validator.validate().hadError());
+    EXPECT_EQ(run(ir), "done\n");
+
+    // An empty then-block lowers to exactly this.
+    IrProgram empty = optimizeSource(R"(summon a = 1; should (a == 2) {} say "done";)");
+    EXPECT_EQ(countOpcode(empty, Pop), 1);
+    EXPECT_EQ(run(empty), "done\n");
+}
+
+TEST(Optimizer_Jumps, CyclicJumpsTerminate)
+{
+    IrProgram ir;
+    LabelId   a{0}, b{1};
+    ir.main.instructions = {
+        Instruction{JLabel, Operand{a}},
+        Instruction{Jump, Operand{b}},
+        Instruction{JLabel, Operand{b}},
+        Instruction{Jump, Operand{a}},
+    };
+    ir.main.nextLabelId = LabelId{2};
+
+    IrOptimizer optimizer{ir, ir.main};
+    optimizer.optimize();
+    EXPECT_FALSE(ir.main.instructions.empty());
+}
+
+// ==================================================================================
+// 4) EQUIVALENCE
+// ==================================================================================
+
+TEST(Optimizer_Equivalence, OutputIsUnchanged)
+{
+    const char* sources[] = {
+        R"(say 1 + 2 * 3 - 4 / 2; say -(5) * 2; say 7 == 7; say "a" != "b";)",
+        R"(
+            summon x = 10;
+            summon name = "Ambra";
+            say "{name}: {x + 1} {x > 5} {not (x < 3)}";
+            should (not (x == 10)) { say "ten"; }
+            otherwise should (x > 1 + 1) { say "big"; }
+            otherwise { say "small"; }
+        )",
+        R"(
+            summon flag = negative;
+            aslongas (flag) { say "never"; }
+            say "{flag}";
+        )",
+    };
+
+    for (const char* source : sources)
+    {
+        IrProgram plain = lowerFromSource(source);
+        IrProgram optimized = optimizeSource(source);
+        EXPECT_EQ(run(optimized), run(plain)) << source;
+        EXPECT_LE(optimized.main.instructions.size(), plain.main.instructions.size());
+    }
+}
+
+// ==================================================================================
+// 5) VALIDATION
+// ==================================================================================
+
+/**
+ * @brief Hand-built IR: constants 0 (I32), 1 (Bool32) and 2 (String32), and
+ * the given instructions in main
+ */
+static IrProgram irWith(std::vector<Instruction> instructions)
+{
+    IrProgram ir;
+    ir.constants.push_back(Constant{I32, ConstId{0}, 1});
+    ir.constants.push_back(Constant{Bool32, ConstId{1}, true});
+    ir.constants.push_back(Constant{String32, ConstId{2}, std::string("s")});
+    ir.main.instructions = std::move(instructions);
+    for (size_t ip = 0; ip < ir.main.instructions.size(); ip++)
+    {
+        const Instruction& inst = ir.main.instructions[ip];
+        if (inst.opcode == JLabel)
+        {
+            ir.main.labelTable.position[std::get<LabelId>(inst.operand)] = ip;
+        }
+    }
+    return ir;
+}
+
+static std::vector<std::string> validationMessages(const IrProgram& ir)
+{
+    IrValidator              validator{ir, ir.main};
+    std::vector<std::string> messages;
+    for (const IrDiagnostic& d : validator.validate().diagnostics)
+    {
+        messages.push_back(d.message + " @" + std::to_string(d.ip));
+    }
+    return messages;
+}
+
+TEST(Ir_Validator, PopDiscardsAValueOfAnyType)
+{
+    IrProgram ir = irWith({
+        {PushConst, ConstId{0}, {1, 1}},
+        {PushConst, ConstId{1}, {1, 1}},
+        {PushConst, ConstId{2}, {1, 1}},
+        {Pop, {}, {1, 1}},
+        {Pop, {}, {1, 1}},
+        {Pop, {}, {1, 1}},
+    });
+    EXPECT_TRUE(validationMessages(ir).empty());
+
+    ir.main.instructions.push_back({Pop, {}, {1, 1}});
+    EXPECT_EQ(validationMessages(ir), (std::vector<std::string>{"Stack underflow @6"}));
+}
+
+TEST(Ir_Validator, BranchesThatMergeWithTheSameStackAreAccepted)
+{
+    // Both arms leave one string for the print after the join.
+    IrProgram ir = irWith({
+        {PushConst, ConstId{1}, {1, 1}},
+        {JumpIfFalse, LabelId{0}, {1, 1}},
+        {PushConst, ConstId{2}, {1, 1}},
+        {Jump, LabelId{1}, {1, 1}},
+        {JLabel, LabelId{0}, {1, 1}},
+        {PushConst, ConstId{0}, {1, 1}},
+        {ToString, {}, {1, 1}},
+        {JLabel, LabelId{1}, {1, 1}},
+        {PrintString, {}, {1, 1}},
+        {Halt, {}, {1, 1}},
+    });
+    EXPECT_TRUE(validationMessages(ir).empty());
+}
+
+TEST(Ir_Validator, MergesNeedEqualHeightsAndTypes)
+{
+    // A skipped push: heights differ at the label.
+    IrProgram height = irWith({
+        {PushConst, ConstId{1}, {1, 1}},
+        {JumpIfFalse, LabelId{0}, {1, 1}},
+        {PushConst, ConstId{0}, {1, 1}},
+        {JLabel, LabelId{0}, {1, 1}},
+        {Halt, {}, {1, 1}},
+    });
+    EXPECT_EQ(validationMessages(height),
+              std::vector<std::string>{"Stack mismatch at control-flow merge @2"});
+
+    // Equal heights, but an I32 on one path and a Bool32 on the other.
+    IrProgram types = irWith({
+        {PushConst, ConstId{1}, {1, 1}},
+        {JumpIfFalse, LabelId{0}, {1, 1}},
+        {PushConst, ConstId{0}, {1, 1}},
+        {Jump, LabelId{1}, {1, 1}},
+        {JLabel, LabelId{0}, {1, 1}},
+        {PushConst, ConstId{1}, {1, 1}},
+        {JLabel, LabelId{1}, {1, 1}},
+        {Halt, {}, {1, 1}},
+    });
+    EXPECT_EQ(validationMessages(types),
+              std::vector<std::string>{"Stack mismatch at control-flow merge @3"});
+}
+
+TEST(Ir_Validator, LoopBackEdgesAreChecked)
+{
+    // The body leaves an extra value behind on every iteration.
+    IrProgram ir = irWith({
+        {JLabel, LabelId{0}, {1, 1}},
+        {PushConst, ConstId{1}, {1, 1}},
+        {JumpIfFalse, LabelId{1}, {1, 1}},
+        {PushConst, ConstId{0}, {1, 1}},
+        {Jump, LabelId{0}, {1, 1}},
+        {JLabel, LabelId{1}, {1, 1}},
+        {Halt, {}, {1, 1}},
+    });
+    EXPECT_EQ(validationMessages(ir),
+              std::vector<std::string>{"Stack mismatch at control-flow merge @4"});
+}
+
+TEST(Ir_Validator, BadJumpsAreReported)
+{
+    IrProgram ir = irWith({
+        {PushConst, ConstId{1}, {1, 1}},
+        {JumpIfTrue, LabelId{7}, {1, 1}},
+        {Jump, ConstId{0}, {1, 1}},
+    });
+    std::vector<std::string> undefined = {"Jump to undefined label @1",
+                                          "Jump missing LabelId operand @2"};
+    EXPECT_EQ(validationMessages(ir), undefined);
+
+    ir.main.labelTable.position[LabelId{7}] = 99;
+    std::vector<std::string> outOfRange = {"Jump target out of range @1",
+                                           "Jump missing LabelId operand @2"};
+    EXPECT_EQ(validationMessages(ir), outOfRange);
+}
+
+TEST(Ir_Validator, LongStraightLineFunction)
+{
+    std::vector<Instruction> instructions;
+    for (int i = 0; i < 100000; i++)
+    {
+        instructions.push_back({PushConst, ConstId{2}, {1, 1}});
+        instructions.push_back({PrintString, {}, {1, 1}});
+    }
+    instructions.push_back({PushConst, ConstId{0}, {1, 1}});
+    instructions.push_back({PrintString, {}, {1, 1}});
+    instructions.push_back({Halt, {}, {1, 1}});
+
+    std::vector<std::string> messages = validationMessages(irWith(std::move(instructions)));
+    ASSERT_EQ(messages.size(), 1u);
+    EXPECT_EQ(messages[0].rfind("type mismatch", 0), 0u) << messages[0];
+}
+
+// ==================================================================================
+// 6) UNREACHABLE CODE
+// ==================================================================================
+
+TEST(Optimizer_Unreachable, CodeAfterAnEndlessLoopIsRemoved)
+{
+    IrProgram ir = optimizeSource(R"(
+        aslongas (affirmative) { say "tick"; }
+        say "after";
+        should (1 < 2) { say "also after"; }
+    )");
+
+    IrValidator validator{ir, ir.main};
+    ASSERT_FALSE(validator.validate().hadError());
+    ASSERT_EQ(validator.reachable.size(), ir.main.instructions.size());
+    EXPECT_FALSE(validator.reachable.back());
+
+    IrOptimizer optimizer{ir, ir.main};
+    optimizer.removeUnreachable(validator.reachable);
+    EXPECT_EQ(optimizer.stats.unreachableRemoved, 4u);
+
+    // JLabel, PushConst "tick", PrintString, Jump
+    ASSERT_EQ(ir.main.instructions.size(), 4u);
+    EXPECT_EQ(ir.main.instructions.back().opcode, Jump);
+    EXPECT_EQ(ir.main.labelTable.position.size(), 1u);
+    EXPECT_TRUE(validationMessages(ir).empty());
+}
+
+TEST(Optimizer_Unreachable, SkippedBlocksAreRemoved)
+{
+    // Jump over a block no other path enters; its label stays because it is jumped to.
+    IrProgram ir = irWith({
+        {Jump, LabelId{0}, {1, 1}},
+        {PushConst, ConstId{2}, {2, 1}},
+        {PrintString, {}, {2, 1}},
+        {JLabel, LabelId{0}, {3, 1}},
+        {PushConst, ConstId{2}, {3, 1}},
+        {PrintString, {}, {3, 1}},
+    });
+
+    IrValidator validator{ir, ir.main};
+    ASSERT_FALSE(validator.validate().hadError());
+    EXPECT_EQ(validator.reachable, (std::vector<bool>{true, false, false, true, true, true}));
+
+    IrOptimizer optimizer{ir, ir.main};
+    optimizer.removeUnreachable(validator.reachable);
+    ASSERT_EQ(ir.main.instructions.size(), 4u);
+    EXPECT_EQ(ir.main.labelTable.position.at(LabelId{0}), 1u);
+}
+
+// ==================================================================================
+// 7) FRAME SLOT ALLOCATION
+// ==================================================================================
+
+/**
+ * @brief Lower, optimize and allocate slots for source code
+ */
+static IrProgram allocateSource(const std::string& source)
+{
+    IrProgram ir = optimizeSource(source);
+    SlotAllocator{ir.main}.allocate();
+    return ir;
+}
+
+static std::string runRegister(const IrProgram& ir)
+{
+    std::ostringstream out;
+    RegisterVM         vm(out);
+    EXPECT_FALSE(vm.load(ir).hadError());
+    EXPECT_FALSE(vm.run().hadError());
+    return out.str();
+}
+
+TEST(SlotAllocator_Frames, UnallocatedFunctionsUseOneSlotPerLocal)
+{
+    IrProgram ir = optimizeSource("summon a = 1; summon b = 2; say a + b;");
+
+    EXPECT_TRUE(ir.main.localTable.slots.empty());
+    EXPECT_EQ(ir.main.frameSlots(), 2u);
+    EXPECT_EQ(ir.main.slotOf(LocalId{1}), 1u);
+}
+
+TEST(SlotAllocator_Frames, SiblingBlocksShareSlots)
+{
+    IrProgram ir = allocateSource(R"(
+        summon flag = affirmative;
+        should (flag) { summon a = 1; say a; }
+        otherwise { summon b = "two"; say b; }
+        should (flag) { summon c = negative; say c; }
+    )");
+
+    // a and b never overlap, and flag is dead once c is stored.
+    ASSERT_EQ(ir.main.localTable.locals.size(), 4u);
+    EXPECT_EQ(ir.main.frameSize, 2u);
+    EXPECT_EQ(ir.main.slotOf(LocalId{0}), 0u);
+    EXPECT_EQ(ir.main.slotOf(LocalId{1}), 1u);
+    EXPECT_EQ(ir.main.slotOf(LocalId{2}), 1u);
+    EXPECT_EQ(ir.main.slotOf(LocalId{3}), 0u);
+    EXPECT_EQ(run(ir), "1\nnegative\n");
+    EXPECT_EQ(runRegister(ir), "1\nnegative\n");
+}
+
+TEST(SlotAllocator_Frames, LocalsReadByTheNextIterationStayLive)
+{
+    // i = 1; limit = 3; while (i < limit) { step = i + 1; say step; i = step; }
+    IrProgram ir = irWith({
+        {PushConst, ConstId{0}, {1, 1}},   {StoreLocal, LocalId{0}, {1, 1}},
+        {PushConst, ConstId{3}, {2, 1}},   {StoreLocal, LocalId{1}, {2, 1}},
+        {JLabel, LabelId{0}, {3, 1}},      {LoadLocal, LocalId{0}, {3, 1}},
+        {LoadLocal, LocalId{1}, {3, 1}},   {CmpLtI32, {}, {3, 1}},
+        {JumpIfFalse, LabelId{1}, {3, 1}}, {LoadLocal, LocalId{0}, {4, 1}},
+        {PushConst, ConstId{0}, {4, 1}},   {AddI32, {}, {4, 1}},
+        {StoreLocal, LocalId{2}, {4, 1}},  {LoadLocal, LocalId{2}, {5, 1}},
+        {ToString, {}, {5, 1}},            {PrintString, {}, {5, 1}},
+        {LoadLocal, LocalId{2}, {6, 1}},   {StoreLocal, LocalId{0}, {6, 1}},
+        {Jump, LabelId{0}, {6, 1}},        {JLabel, LabelId{1}, {7, 1}},
+    });
+    ir.constants.push_back(Constant{I32, ConstId{3}, 3});
+    for (uint32_t id = 0; id < 3; id++)
+    {
+        ir.main.localTable.locals.push_back(LocalInfo{LocalId{id}, I32, "l", {1, 1}});
+    }
+    ASSERT_TRUE(validationMessages(ir).empty());
+
+    SlotAllocator allocator{ir.main};
+    allocator.allocate();
+
+    // limit is last read by the loop test, but the back edge reads it again,
+    // so it stays live through the body and step cannot take its slot.
+    EXPECT_EQ(allocator.ranges[1].last, 18u);
+    EXPECT_EQ(allocator.ranges[2].first, 12u);
+    EXPECT_EQ(allocator.ranges[2].last, 16u);
+    EXPECT_EQ(ir.main.frameSize, 3u);
+    EXPECT_EQ(run(ir), "2\n3\n");
+    EXPECT_EQ(runRegister(ir), "2\n3\n");
+}
+
+TEST(SlotAllocator_Frames, LocalsAfterASkippedLoopReuseItsSlots)
+{
+    IrProgram ir = allocateSource(R"(
+        summon n = 1;
+        aslongas (n > 5) { summon inside = n; say inside; }
+        summon after = "after";
+        say after;
+        say n;
+    )");
+
+    EXPECT_EQ(ir.main.frameSize, 2u);
+    EXPECT_EQ(ir.main.slotOf(LocalId{2}), ir.main.slotOf(LocalId{1}));
+    EXPECT_NE(ir.main.slotOf(LocalId{2}), ir.main.slotOf(LocalId{0}));
+    EXPECT_EQ(run(ir), "after\n1\n");
+    EXPECT_EQ(runRegister(ir), "after\n1\n");
+}
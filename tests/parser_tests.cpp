@@ -4,12 +4,15 @@
 // comparison and equality expressions, string interpolation, and error handling.
 
 #include "ast/expr.h"
+#include "ast/node_table.h"
 #include "ast/stmt.h"
 #include "parser/parser.h"
 
 #include <gtest/gtest.h>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
+#include <type_traits>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -496,6 +499,77 @@ TEST(ExpressionPrecedence, ComparisonBeforeEquality)
     ASSERT_TRUE(isEqualExpression(actual, expected));
 }
 
+// Tests that `and` binds tighter than `or`, and both associate to the left.
+TEST(ExpressionPrecedence, AndBeforeOr)
+{
+    std::vector<Token> tokens = {
+        Token("a", IDENTIFIER, std::monostate{}, 1, 1),
+        Token("or", OR, std::monostate{}, 1, 3),
+        Token("b", IDENTIFIER, std::monostate{}, 1, 6),
+        Token("and", AND, std::monostate{}, 1, 8),
+        Token("c", IDENTIFIER, std::monostate{}, 1, 12),
+        Token("and", AND, std::monostate{}, 1, 14),
+        Token("d", IDENTIFIER, std::monostate{}, 1, 18),
+        Token("", EOF_TOKEN, std::monostate{}, 1, 19),
+    };
+
+    Parser parser(tokens);
+    auto   actual = parser.parseExpression();
+
+    std::unique_ptr<Expr> expected = std::make_unique<BinaryExpr>(
+        std::make_unique<IdentifierExpr>("a", 1, 1), LogicalOr,
+        std::make_unique<BinaryExpr>(
+            std::make_unique<BinaryExpr>(std::make_unique<IdentifierExpr>("b", 1, 6), LogicalAnd,
+                                         std::make_unique<IdentifierExpr>("c", 1, 12), 1, 8),
+            LogicalAnd, std::make_unique<IdentifierExpr>("d", 1, 18), 1, 14),
+        1, 3);
+
+    ASSERT_TRUE(isEqualExpression(actual, expected));
+}
+
+// Tests that equality binds tighter than `and`.
+TEST(ExpressionPrecedence, EqualityBeforeAnd)
+{
+    std::vector<Token> tokens = {
+        Token("1", INTEGER, 1, 1, 1),
+        Token("==", EQUAL_EQUAL, std::monostate{}, 1, 3),
+        Token("2", INTEGER, 2, 1, 6),
+        Token("and", AND, std::monostate{}, 1, 8),
+        Token("not", NOT, std::monostate{}, 1, 12),
+        Token("negative", BOOL, false, 1, 16),
+        Token("", EOF_TOKEN, std::monostate{}, 1, 24),
+    };
+
+    Parser parser(tokens);
+    auto   actual = parser.parseExpression();
+
+    std::unique_ptr<Expr> expected = std::make_unique<BinaryExpr>(
+        std::make_unique<BinaryExpr>(std::make_unique<IntLiteralExpr>(1, 1, 1), EqualEqual,
+                                     std::make_unique<IntLiteralExpr>(2, 1, 6), 1, 3),
+        LogicalAnd,
+        std::make_unique<UnaryExpr>(LogicalNot, std::make_unique<BoolLiteralExpr>(false, 1, 16),
+                                    1, 12),
+        1, 8);
+
+    ASSERT_TRUE(isEqualExpression(actual, expected));
+}
+
+// Tests error detection for `or` without a right-hand operand.
+TEST(ExpressionErrors, OrMissingRightHandOperand)
+{
+    std::vector<Token> tokens = {
+        Token("affirmative", BOOL, true, 1, 1),
+        Token("or", OR, std::monostate{}, 1, 13),
+        Token("", EOF_TOKEN, std::monostate{}, 1, 15),
+    };
+
+    Parser parser(tokens);
+    auto   result = parser.parseExpression();
+
+    ASSERT_TRUE(parser.hadError());
+    ASSERT_EQ(result, nullptr);
+}
+
 // Tests parsing of a string with multiple interpolations.
 TEST(ExpressionString, MultipleInterpolations)
 {
@@ -3628,4 +3702,397 @@ TEST(ParseProgram_Recovery, RecoverFromMissingSemicolonInsideIfBlock)
 
     ASSERT_TRUE(isEqualProgram(actual, expected));
     ASSERT_TRUE(actual.hadError());
-}
\ No newline at end of file
+}
+TEST(ParseProgram_Arena, NodesComeFromTheProgramArena)
+{
+    std::vector<Token> tokens = {
+        Token("summon", SUMMON, std::monostate{}, 1, 1),
+        Token("x", IDENTIFIER, std::monostate{}, 1, 8),
+        Token("=", EQUAL, std::monostate{}, 1, 10),
+        Token("1", INTEGER, 1, 1, 12),
+        Token("+", PLUS, std::monostate{}, 1, 14),
+        Token("2", INTEGER, 2, 1, 16),
+        Token(";", SEMI_COLON, std::monostate{}, 1, 17),
+        Token("", EOF_TOKEN, std::monostate{}, 1, 18),
+    };
+
+    Parser  parser(tokens);
+    Program actual = parser.parseProgram();
+    ASSERT_FALSE(parser.hadError());
+    ASSERT_NE(actual.getArena(), nullptr);
+
+    // Summon, identifier, binary and two literals.
+    EXPECT_GE(actual.getArena()->bytesUsed(),
+              sizeof(SummonStmt) + sizeof(IdentifierExpr) + sizeof(BinaryExpr) +
+                  2 * sizeof(IntLiteralExpr));
+    EXPECT_EQ(actual.getArena()->chunkCount(), 1u);
+
+    // Heap-built trees still compare equal to arena-built ones.
+    std::vector<std::unique_ptr<Stmt>> expectedStatements;
+    expectedStatements.push_back(std::make_unique<SummonStmt>(
+        std::make_unique<IdentifierExpr>("x", 1, 8),
+        std::make_unique<BinaryExpr>(std::make_unique<IntLiteralExpr>(1, 1, 12), Add,
+                                     std::make_unique<IntLiteralExpr>(2, 1, 16), 1, 14),
+        1, 1));
+    Program expected(std::move(expectedStatements), false, {1, 1}, {1, 18});
+    EXPECT_EQ(expected.getArena(), nullptr);
+    ASSERT_TRUE(isEqualProgram(actual, expected));
+
+    // Moving a program keeps its nodes alive with their arena.
+    Program moved = std::move(actual);
+    ASSERT_EQ(moved.size(), 1);
+    EXPECT_EQ(moved.getStatements()[0]->kind, Summon);
+    moved = std::move(expected);
+    EXPECT_EQ(moved.getArena(), nullptr);
+}
+
+TEST(ParseProgram_Arena, AllocationsAreAlignedAndLargeOnesGetTheirOwnChunk)
+{
+    AstArena arena;
+    void*    small = arena.allocate(3, 1);
+    void*    aligned = arena.allocate(8, 16);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(aligned) % 16, 0u);
+    EXPECT_EQ(arena.chunkCount(), 1u);
+
+    arena.allocate(1 << 20, 8);
+    EXPECT_EQ(arena.chunkCount(), 2u);
+
+    // The first chunk still has room for small requests.
+    char* next = static_cast<char*>(arena.allocate(4, 1));
+    EXPECT_EQ(arena.chunkCount(), 2u);
+    EXPECT_EQ(next, static_cast<char*>(aligned) + 8);
+    EXPECT_NE(small, aligned);
+
+    // Nodes created outside any arena scope use the global heap.
+    EXPECT_EQ(AstArena::active(), nullptr);
+    {
+        AstArena::Scope scope(arena);
+        EXPECT_EQ(AstArena::active(), &arena);
+    }
+    EXPECT_EQ(AstArena::active(), nullptr);
+}
+
+TEST(ParseProgram_Arena, NodesAreNumberedDenselyPerProgram)
+{
+    Lexer   lexer("summon x = 1 + 2;\nsay \"x is {x}!\";");
+    Parser  parser(lexer);
+    Program program = parser.parseProgram();
+    ASSERT_FALSE(program.hadError());
+
+    // Summon, identifier, binary, two literals; say, string, identifier.
+    ASSERT_EQ(program.getArena()->nodeCount(), 8u);
+    std::vector<bool> seen(8, false);
+    auto&             summon = static_cast<const SummonStmt&>(*program.getStatements()[0]);
+    auto&             binary = static_cast<const BinaryExpr&>(summon.getInitializer());
+    auto&             say = static_cast<const SayStmt&>(*program.getStatements()[1]);
+    auto&             string = static_cast<const StringExpr&>(say.getExpression());
+    for (NodeId id : {summon.id, summon.getIdentifier().id, binary.id, binary.getLeft().id,
+                      binary.getRight().id, say.id, string.id, string.getParts()[1].expr->id})
+    {
+        ASSERT_LT(id, 8u);
+        EXPECT_FALSE(seen[id]) << id;
+        seen[id] = true;
+    }
+
+    // A side table indexed by those ids.
+    NodeTable<Expr, int> table;
+    table.reserve(program.getArena()->nodeCount());
+    EXPECT_TRUE(table.emplace(&binary, 1));
+    EXPECT_FALSE(table.emplace(&binary, 2));
+    EXPECT_EQ(table.at(&binary), 1);
+    table.assign(&binary, 3);
+    EXPECT_EQ(*table.find(&binary), 3);
+    EXPECT_EQ(table.find(&string), nullptr);
+    EXPECT_EQ(table.size(), 1u);
+    table.erase(&binary);
+    EXPECT_EQ(table.count(&binary), 0u);
+    EXPECT_THROW(table.at(&binary), std::out_of_range);
+
+    // A second program starts again from 0.
+    Lexer   other("say 1;");
+    Parser  otherParser(other);
+    Program second = otherParser.parseProgram();
+    EXPECT_EQ(second.getArena()->nodeCount(), 2u);
+}
+
+TEST(ParseProgram_Arena, NodeTableShardsMerge)
+{
+    Lexer   lexer("say 1; say 2; say 3 + 4;");
+    Parser  parser(lexer);
+    Program program = parser.parseProgram();
+    ASSERT_FALSE(program.hadError());
+
+    std::vector<const Expr*> exprs;
+    for (const auto& stmt : program.getStatements())
+    {
+        exprs.push_back(&static_cast<const SayStmt&>(*stmt).getExpression());
+    }
+    auto& sum = static_cast<const BinaryExpr&>(*exprs[2]);
+
+    // A shard starts its window at the first id stored, and widens both ways.
+    NodeTable<Expr, int> shard;
+    EXPECT_TRUE(shard.emplace(&sum, 7));
+    EXPECT_TRUE(shard.emplace(&sum.getLeft(), 3));
+    EXPECT_TRUE(shard.emplace(exprs[0], 1));
+    EXPECT_EQ(shard.find(exprs[1]), nullptr);
+    EXPECT_EQ(shard.at(&sum.getLeft()), 3);
+    EXPECT_EQ(shard.size(), 3u);
+
+    NodeTable<Expr, int> table;
+    table.reserve(program.getArena()->nodeCount());
+    EXPECT_TRUE(table.emplace(exprs[0], 10));
+    EXPECT_TRUE(table.emplace(exprs[1], 2));
+    table.merge(shard);
+    EXPECT_EQ(table.size(), 4u);
+    EXPECT_EQ(table.at(exprs[0]), 10); // values already present win
+    EXPECT_EQ(table.at(exprs[1]), 2);
+    EXPECT_EQ(table.at(&sum.getLeft()), 3);
+    EXPECT_EQ(table.at(&sum), 7);
+    EXPECT_EQ(table.find(&sum.getRight()), nullptr);
+}
+
+TEST(ParseProgram_Arena, NodesAreCompact)
+{
+    // No vtable: the base is the kind, the id and a 32-bit location.
+    EXPECT_FALSE(std::is_polymorphic<Expr>::value);
+    EXPECT_FALSE(std::is_polymorphic<Stmt>::value);
+    EXPECT_EQ(sizeof(Expr), 12u);
+    EXPECT_EQ(sizeof(Stmt), 12u);
+    EXPECT_EQ(sizeof(IntLiteralExpr), 16u);
+    EXPECT_EQ(sizeof(BinaryExpr), 16 + 2 * sizeof(void*)); // the operator fills the base
+}
+
+TEST(ParseProgram_Arena, NodeLocationsAreOffsetsIntoTheSource)
+{
+    // The identifier sits past any column a location could hold directly.
+    std::string wide(5000, ' ');
+    Lexer       lexer("summon a = 1;\n\n" + wide + "say a;\n{ say a\n  + 2; }");
+    Parser      parser(lexer);
+    Program     program = parser.parseProgram();
+    ASSERT_FALSE(program.hadError());
+    EXPECT_EQ(program.getArena()->getLines().lineCount(), 5u);
+
+    const auto& say = static_cast<const SayStmt&>(*program.getStatements()[1]);
+    EXPECT_EQ(say.getLoc(), (SourceLoc{3, 5001}));
+    EXPECT_EQ(say.getExpression().getLoc(), (SourceLoc{3, 5005}));
+
+    const auto& block = static_cast<const BlockStmt&>(*program.getStatements()[2]);
+    const auto& inner = static_cast<const SayStmt&>(**block.begin());
+    EXPECT_EQ(block.getLoc(), (SourceLoc{4, 1}));
+    EXPECT_EQ(inner.getLoc(), (SourceLoc{4, 3}));
+    EXPECT_EQ(static_cast<const BinaryExpr&>(inner.getExpression()).getRight().getLoc(),
+              (SourceLoc{5, 5}));
+
+    // Trees built by hand still compare equal to parsed ones.
+    auto expected = std::make_unique<SayStmt>(std::make_unique<IdentifierExpr>("a", 3, 5005), 3,
+                                              5001);
+    EXPECT_EQ(expected->getLoc(), (SourceLoc{3, 4095})); // saturated
+    auto first = std::make_unique<SummonStmt>(std::make_unique<IdentifierExpr>("a", 1, 8),
+                                              std::make_unique<IntLiteralExpr>(1, 1, 12), 1, 1);
+    EXPECT_TRUE(*first == *program.getStatements()[0]);
+}
+
+TEST(ParseProgram_Arena, SourceLinesRoundTrip)
+{
+    SourceLines lines("ab\n\ncd");
+    ASSERT_EQ(lines.lineCount(), 3u);
+    EXPECT_EQ(lines.pack(1, 1), 0u);
+    EXPECT_EQ(lines.pack(1, 3), 2u); // the newline
+    EXPECT_EQ(lines.pack(3, 2), 5u);
+    EXPECT_EQ(lines.unpack(lines.pack(2, 1)), (SourceLoc{2, 1}));
+    EXPECT_EQ(lines.unpack(lines.pack(3, 3)), (SourceLoc{3, 3})); // end of input
+
+    // Positions outside every line are kept directly.
+    EXPECT_TRUE(SourceLines::isDirect(lines.pack(1, 4)));
+    EXPECT_EQ(lines.unpack(lines.pack(1, 4)), (SourceLoc{1, 4}));
+    EXPECT_EQ(lines.unpack(lines.pack(9, 1)), (SourceLoc{9, 1}));
+    EXPECT_EQ(SourceLines().unpack(SourceLines().pack(7, 30)), (SourceLoc{7, 30}));
+}
+
+TEST(ParseProgram_Basics, CompactStreamMatchesTokenVector)
+{
+    std::string source = R"(
+        summon name = "Ambra";
+        should (not (1 < 2)) { say "x={name}!"; }
+        otherwise { say -3 * 4; }
+    )";
+
+    Lexer              owning(source);
+    std::vector<Token> tokens = owning.scanTokens();
+    Parser             fromVector(tokens);
+    Program            expected = fromVector.parseProgram();
+
+    Lexer              compact(source);
+    Parser             fromStream(compact.scanStream());
+    Program            actual = fromStream.parseProgram();
+
+    ASSERT_FALSE(actual.hadError());
+    ASSERT_TRUE(isEqualProgram(actual, expected));
+}
+
+TEST(ParseProgram_Basics, PullModeMatchesTokenVector)
+{
+    std::string source = R"(
+        summon n = 3;
+        should (n == 1) { say "one"; }
+        otherwise should (n > 2) { say "big {n + 1}!"; }
+        otherwise { say negative; }
+        aslongas (n < 0) { { say -n; } }
+    )";
+
+    Lexer              owning(source);
+    std::vector<Token> tokens = owning.scanTokens();
+    Parser             fromVector(tokens);
+    Program            expected = fromVector.parseProgram();
+
+    Lexer   pulling(source);
+    Parser  fromLexer(pulling);
+    Program actual = fromLexer.parseProgram();
+
+    ASSERT_FALSE(actual.hadError());
+    ASSERT_TRUE(isEqualProgram(actual, expected));
+}
+
+TEST(ParseProgram_Recovery, PullModeStopsAtLexError)
+{
+    Lexer   lexer("say 1; say @; say 2;");
+    Parser  parser(lexer);
+    Program program = parser.parseProgram();
+
+    EXPECT_TRUE(program.hadError());
+    EXPECT_EQ(program.size(), 1);
+}
+
+/** @brief "line:col: message" of every diagnostic, for compact comparisons */
+static std::vector<std::string> describe(const std::vector<ParseDiagnostic>& diagnostics)
+{
+    std::vector<std::string> lines;
+    for (const auto& d : diagnostics)
+    {
+        lines.push_back(std::to_string(d.loc.line) + ":" + std::to_string(d.loc.col) + ": " +
+                        d.message);
+    }
+    return lines;
+}
+
+TEST(ParseProgram_Recovery, ReportsEveryErrorInOnePass)
+{
+    std::string source = "summon x = 1\n"
+                         "say x;\n"
+                         "say (x + ;\n"
+                         "summon = 2;\n"
+                         "say x;\n";
+
+    Lexer   lexer(source);
+    Parser  parser(lexer.scanStream());
+    Program program = parser.parseProgram();
+
+    EXPECT_TRUE(program.hadError());
+    // Only the first of the errors each mistake causes is reported.
+    std::vector<std::string> expected = {"2:1: Expected ';' after summon statement",
+                                         "3:10: Expected expression",
+                                         "4:8: Expected identifier after 'summon'"};
+    EXPECT_EQ(describe(parser.getDiagnostics()), expected);
+    EXPECT_EQ(program.size(), 2); // both `say x;`
+}
+
+TEST(ParseProgram_Recovery, ResynchronizesInsideBlocks)
+{
+    std::string source = "aslongas (true) {\n"
+                         "    say 1 say 2;\n"
+                         "    { summon = 3; }\n"
+                         "    say 4\n"
+                         "}\n"
+                         "say 5;\n";
+
+    Lexer   lexer(source);
+    Parser  parser(lexer.scanStream());
+    Program program = parser.parseProgram();
+
+    std::vector<std::string> expected = {"2:5: Missing terminating ;",
+                                         "3:14: Expected identifier after 'summon'",
+                                         "4:5: Missing terminating ;"};
+    EXPECT_EQ(describe(parser.getDiagnostics()), expected);
+    // The loop fails as a whole, but what follows its `}` is parsed.
+    EXPECT_EQ(program.size(), 1);
+}
+
+TEST(ParseProgram_Recovery, ReportsLexErrorsWithTheLexerMessage)
+{
+    std::string source = "say 1 $;\nsay \"a{x\";\nsay \"open\nsay 2;";
+
+    Lexer lexer(source);
+    lexer.setErrorLimit(Parser::DEFAULT_ERROR_LIMIT);
+    Parser  parser(lexer.scanStream());
+    Program program = parser.parseProgram();
+
+    std::vector<std::string> expected = {"1:1: Missing terminating ;",
+                                         "1:7: Unexpected character",
+                                         "2:7: Unterminated interpolation",
+                                         "3:5: Unterminated string"};
+    EXPECT_EQ(describe(parser.getDiagnostics()), expected);
+    EXPECT_EQ(program.size(), 1);
+}
+
+TEST(ParseProgram_Recovery, ErrorsAfterABrokenMultilineInterpolation)
+{
+    std::string source = "say \"\"\"a{ @ }b\"\"\";\n"
+                         "say 1;\n"
+                         "summon x = ;\n"
+                         "say \"\"\"c\"\"\";\n"
+                         "summon y = ;\n";
+
+    Lexer lexer(source);
+    lexer.setErrorLimit(Parser::DEFAULT_ERROR_LIMIT);
+    Parser  parser(lexer.scanStream());
+    Program program = parser.parseProgram();
+
+    // The interpolation's error ends at its '}', so the string goes on as a string.
+    std::vector<std::string> expected = {"1:11: Unexpected character",
+                                         "3:12: This token is not allowed here",
+                                         "5:12: This token is not allowed here"};
+    EXPECT_EQ(describe(parser.getDiagnostics()), expected);
+    EXPECT_EQ(program.size(), 2); // `say 1;` and `say """c""";`
+}
+
+TEST(ParseProgram_Recovery, StopsAtTheErrorLimit)
+{
+    std::string source;
+    for (int i = 0; i < 1000; i++)
+    {
+        source += "summon = 1;\n";
+    }
+
+    Lexer  lexer(source);
+    Parser parser(lexer.scanStream());
+    parser.setErrorLimit(5);
+    Program program = parser.parseProgram();
+
+    EXPECT_TRUE(program.hadError());
+    ASSERT_EQ(parser.getDiagnostics().size(), 6u);
+    EXPECT_EQ(parser.getDiagnostics()[4].loc.line, 5);
+    EXPECT_EQ(parser.getDiagnostics().back().message, "Too many errors; stopping");
+}
+
+TEST(ParseProgram_Recovery, PullModeMatchesStreamAfterErrors)
+{
+    std::string source = "summon a = 1 say a;\n"
+                         "should (a) { say @; } otherwise { say a }\n"
+                         "say \"b{a\"; say 08x;\n"
+                         "}} say a;";
+
+    Lexer scanning(source);
+    scanning.setErrorLimit(3);
+    Parser  fromStream(scanning.scanStream());
+    Program expected = fromStream.parseProgram();
+
+    Lexer pulling(source);
+    pulling.setErrorLimit(3);
+    Parser  fromLexer(pulling);
+    Program actual = fromLexer.parseProgram();
+
+    EXPECT_TRUE(actual.hadError());
+    EXPECT_TRUE(isEqualProgram(actual, expected));
+    EXPECT_EQ(describe(fromLexer.getDiagnostics()), describe(fromStream.getDiagnostics()));
+    EXPECT_EQ(fromLexer.getDiagnostics().back().message, "Invalid number");
+}
@@ -0,0 +1,191 @@
+#include "utils/interner.h"
+#include "utils/stats.h"
+#include "utils/thread_pool.h"
+
+#include <atomic>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+TEST(Thread_Pool, RunsEveryTaskOnce)
+{
+    std::vector<int> hits(1000, 0);
+    {
+        ThreadPool pool(4);
+        EXPECT_EQ(pool.size(), 4u);
+        for (size_t i = 0; i < hits.size(); i++)
+        {
+            pool.submit([&hits, i] { hits[i]++; });
+        }
+        pool.wait();
+    }
+    for (int h : hits)
+    {
+        ASSERT_EQ(h, 1);
+    }
+}
+
+TEST(Thread_Pool, TasksCanSubmitMoreTasks)
+{
+    std::atomic<int> leaves{0};
+    ThreadPool       pool(3);
+    for (int i = 0; i < 10; i++)
+    {
+        pool.submit(
+            [&pool, &leaves]
+            {
+                for (int j = 0; j < 10; j++)
+                {
+                    pool.submit([&leaves] { leaves++; });
+                }
+            });
+    }
+    pool.wait();
+    EXPECT_EQ(leaves.load(), 100);
+}
+
+TEST(Thread_Pool, WaitCanBeCalledRepeatedly)
+{
+    ThreadPool       pool(1);
+    std::atomic<int> count{0};
+
+    pool.wait();
+    for (int round = 1; round <= 3; round++)
+    {
+        for (int i = 0; i < 5; i++)
+        {
+            pool.submit([&count] { count++; });
+        }
+        pool.wait();
+        EXPECT_EQ(count.load(), round * 5);
+    }
+}
+
+TEST(Thread_Pool, DefaultSizeFollowsTheHardware)
+{
+    ThreadPool pool;
+    EXPECT_EQ(pool.size(), ThreadPool::defaultThreadCount());
+    EXPECT_GE(pool.size(), 1u);
+}
+
+TEST(Name_Interning, EqualNamesShareAnId)
+{
+    NameId first = internName("interned_name");
+    EXPECT_EQ(internName(std::string("interned_") + "name"), first);
+    EXPECT_NE(internName("interned_other"), first);
+    EXPECT_EQ(nameOf(first), "interned_name");
+}
+
+TEST(Name_Interning, ConcurrentInternsAgree)
+{
+    // Every thread interns the same names, starting at a different one.
+    std::vector<std::vector<NameId>> ids(4, std::vector<NameId>(200));
+    {
+        ThreadPool pool(4);
+        for (size_t t = 0; t < ids.size(); t++)
+        {
+            pool.submit(
+                [&ids, t]
+                {
+                    for (size_t k = 0; k < 200; k++)
+                    {
+                        size_t i = (k + 53 * t) % 200;
+                        ids[t][i] = internName("concurrent_" + std::to_string(i));
+                    }
+                });
+        }
+    }
+    for (size_t i = 0; i < 200; i++)
+    {
+        for (size_t t = 1; t < ids.size(); t++)
+        {
+            EXPECT_EQ(ids[t][i], ids[0][i]);
+        }
+        EXPECT_EQ(nameOf(ids[0][i]), "concurrent_" + std::to_string(i));
+    }
+}
+
+TEST(Stats_Registry, PhasesAndCountersGoToTheActiveRegistry)
+{
+    if (!STATS_ENABLED)
+    {
+        GTEST_SKIP() << "built with AMBRA_NO_STATS";
+    }
+    StatsRegistry stats;
+    {
+        StatsRegistry::Scope scope(stats);
+        EXPECT_EQ(timePhase("parse", [] { return 7; }), 7);
+        timePhase("lower", [] {});
+        timePhase("parse", [] {});
+        AMBRA_COUNT("tokens", 3);
+        AMBRA_COUNT("tokens", 4);
+    }
+    AMBRA_COUNT("tokens", 100);
+    PhaseTimer ignored("unreported");
+
+    ASSERT_EQ(stats.getPhases().size(), 2u);
+    EXPECT_STREQ(stats.getPhases()[0].name, "parse");
+    EXPECT_STREQ(stats.getPhases()[1].name, "lower");
+    EXPECT_GE(stats.getPhases()[0].seconds, 0.0);
+    EXPECT_EQ(stats.counter("tokens"), 7u);
+    EXPECT_EQ(stats.counter("labels"), 0u);
+    EXPECT_EQ(StatsRegistry::active(), nullptr);
+
+    std::ostringstream out;
+    stats.printCounters(out);
+    EXPECT_NE(out.str().find("tokens"), std::string::npos);
+}
+
+TEST(Stats_Registry, NestedPhasesMeasureTheirOwnPeak)
+{
+    if (!STATS_ENABLED)
+    {
+        GTEST_SKIP() << "built with AMBRA_NO_STATS";
+    }
+    StatsRegistry        stats;
+    StatsRegistry::Scope scope(stats);
+    {
+        PhaseTimer outer("outer");
+        statsRecordAllocation(100);
+        {
+            PhaseTimer inner("inner");
+            statsRecordAllocation(50);
+            statsRecordFree(50);
+        }
+        statsRecordFree(100);
+    }
+
+    ASSERT_EQ(stats.getPhases().size(), 2u);
+    const PhaseRecord& inner = stats.getPhases()[0];
+    const PhaseRecord& outer = stats.getPhases()[1];
+    EXPECT_EQ(inner.allocations, 1u);
+    EXPECT_EQ(inner.peakBytes, 50u);
+    EXPECT_EQ(outer.allocations, 2u);
+    EXPECT_EQ(outer.peakBytes, 150u);
+}
+
+TEST(Stats_Registry, ThreadsReportToTheirOwnRegistry)
+{
+    if (!STATS_ENABLED)
+    {
+        GTEST_SKIP() << "built with AMBRA_NO_STATS";
+    }
+    std::vector<StatsRegistry> registries(4);
+    {
+        ThreadPool pool(4);
+        for (size_t t = 0; t < registries.size(); t++)
+        {
+            pool.submit(
+                [&registries, t]
+                {
+                    StatsRegistry::Scope scope(registries[t]);
+                    AMBRA_COUNT("jobs", t + 1);
+                });
+        }
+    }
+    for (size_t t = 0; t < registries.size(); t++)
+    {
+        EXPECT_EQ(registries[t].counter("jobs"), t + 1);
+    }
+}
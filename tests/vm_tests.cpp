@@ -1,9 +1,1375 @@
-#include <iostream>
+/**
+ * @file vm_tests.cpp
+ * @brief Test suite for the Ambra VM
+ *
+ * Programs are compiled through the full frontend pipeline (lexer, parser,
+ * resolver, type checker, lowering, validator) and then executed. Tests
+ * assert on the text the program writes through `say`.
+ *
+ * Test Organization:
+ * 1. Literals and printing
+ * 2. Arithmetic and comparisons
+ * 3. Strings and interpolation
+ * 4. Control flow (conditionals and loops)
+ * 5. Loader and runtime errors
+ * 6. Running from .ambc images
+ * 7. Value encoding, the string heap and the string table
+ * 8. Register engine
+ * 9. Profiling
+ * 10. Loop JIT
+ * 11. Checked engine
+ * 12. Output buffering
+ * 13. Programs shared between VMs
+ * 14. Program cache
+ * 15. Execution budgets
+ */
 
-int main()
+#include "bytecode/emitter.h"
+#include "ir/lowering.h"
+#include "ir/validator.h"
+#include "parser/parser.h"
+#include "runtime/builtins.h"
+#include "runtime/output.h"
+#include "runtime/string_heap.h"
+#include "runtime/string_table.h"
+#include "sema/analyzer.h"
+#include "vm/profile.h"
+#include "vm/program_cache.h"
+#include "vm/register_vm.h"
+#include "vm/vm.h"
+
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Compile source code down to validated IR
+ * @param source Ambra source code string
+ * @return Lowered IR program
+ */
+static IrProgram compileToIr(const std::string& source)
+{
+    Lexer              lexer(source);
+    std::vector<Token> tokenList = lexer.scanTokens();
+
+    Parser  parser(tokenList);
+    Program program = parser.parseProgram();
+    EXPECT_FALSE(program.hadError());
+
+    Resolver       resolver;
+    SemanticResult sema = resolver.resolve(program);
+    EXPECT_FALSE(sema.hadError());
+
+    TypeChecker        tc(sema.resolutionTable, sema.rootScope.get());
+    TypeCheckerResults types = tc.typeCheck(program);
+    EXPECT_FALSE(types.hadError());
+
+    LoweringContext lowerer{nullptr, nullptr, {}, &types.typeTable, &sema.resolutionTable};
+    IrProgram       ir = lowerer.lowerProgram(&program);
+    EXPECT_FALSE(lowerer.hadError);
+
+    IrValidator validator{ir, ir.main};
+    EXPECT_FALSE(validator.validate().hadError());
+
+    return ir;
+}
+
+/**
+ * @brief Compile and run source code, returning everything it printed
+ * @param source Ambra source code string
+ * @return Captured `say` output
+ */
+static std::string runSource(const std::string& source)
+{
+    IrProgram ir = compileToIr(source);
+
+    std::ostringstream out;
+    VM                 vm(out);
+    EXPECT_FALSE(vm.load(ir).hadError());
+    EXPECT_FALSE(vm.run().hadError());
+    return out.str();
+}
+
+// ==================================================================================
+// 1) LITERALS AND PRINTING
+// ==================================================================================
+
+TEST(VM_Basics, EmptyProgram)
+{
+    EXPECT_EQ(runSource(""), "");
+}
+
+TEST(VM_Basics, SayIntLiteral)
+{
+    EXPECT_EQ(runSource("say 5;"), "5\n");
+}
+
+TEST(VM_Basics, SayBoolLiterals)
+{
+    EXPECT_EQ(runSource("say affirmative; say negative;"), "affirmative\nnegative\n");
+}
+
+TEST(VM_Basics, SayStringLiteral)
+{
+    EXPECT_EQ(runSource(R"(say "hello";)"), "hello\n");
+}
+
+TEST(VM_Basics, SayVariable)
+{
+    EXPECT_EQ(runSource(R"(
+        summon x = 42;
+        say x;
+    )"),
+              "42\n");
+}
+
+// ==================================================================================
+// 2) ARITHMETIC AND COMPARISONS
+// ==================================================================================
+
+TEST(VM_Arithmetic, Precedence)
+{
+    EXPECT_EQ(runSource("say 1 + 2 * 3; say (1 + 2) * 3; say 7 / 2; say 2 - 5;"),
+              "7\n9\n3\n-3\n");
+}
+
+TEST(VM_Arithmetic, UnaryOperators)
+{
+    EXPECT_EQ(runSource("say -4; say --4; say not affirmative;"), "-4\n4\nnegative\n");
+}
+
+TEST(VM_Arithmetic, OverflowWraps)
+{
+    EXPECT_EQ(runSource("say 2147483647 + 1;"), "-2147483648\n");
+}
+
+TEST(VM_Arithmetic, SayIntExtremes)
+{
+    const char* source = R"(
+        summon low = -2147483647 - 1;
+        say low; say 2147483647; say -1000000000; say 99; say 100; say 0;
+        say "{low}|{1000000000}|{-10}";
+    )";
+    const char* expected = "-2147483648\n2147483647\n-1000000000\n99\n100\n0\n"
+                           "-2147483648|1000000000|-10\n";
+    EXPECT_EQ(runSource(source), expected);
+
+    std::ostringstream out;
+    RegisterVM         vm(out);
+    ASSERT_FALSE(vm.load(compileToIr(source)).hadError());
+    ASSERT_FALSE(vm.run().hadError());
+    EXPECT_EQ(out.str(), expected);
+}
+
+TEST(VM_Arithmetic, IntComparisons)
+{
+    EXPECT_EQ(runSource("say 1 < 2; say 2 <= 1; say 3 > 3; say 3 >= 3; say 4 == 4; say 4 != 4;"),
+              "affirmative\nnegative\nnegative\naffirmative\naffirmative\nnegative\n");
+}
+
+TEST(VM_Arithmetic, BoolAndStringEquality)
+{
+    EXPECT_EQ(runSource(R"(
+        say affirmative == negative;
+        say "a" == "a";
+        say "a" != "b";
+    )"),
+              "negative\naffirmative\naffirmative\n");
+}
+
+// ==================================================================================
+// 3) STRINGS AND INTERPOLATION
+// ==================================================================================
+
+TEST(VM_Strings, Interpolation)
+{
+    EXPECT_EQ(runSource(R"(
+        summon name = "Ambra";
+        summon n = 3;
+        say "{name} has {n + 1} parts, ok={n == 3}";
+    )"),
+              "Ambra has 4 parts, ok=affirmative\n");
+}
+
+TEST(VM_Strings, ConcatNJoinsManyParts)
+{
+    IrProgram ir;
+    ir.constants.push_back(Constant{String32, ConstId{0}, std::string("ab")});
+    ir.constants.push_back(Constant{I32, ConstId{1}, 7});
+    ir.nextConstId = ConstId{2};
+    for (int i = 0; i < 150; i++)
+    {
+        ir.main.instructions.push_back(Instruction{PushConst, Operand{ConstId{0}}});
+        ir.main.instructions.push_back(Instruction{PushConst, Operand{ConstId{1}}});
+        ir.main.instructions.push_back(Instruction{ToString, Operand{}});
+    }
+    ir.main.instructions.push_back(Instruction{ConcatN, Operand{Arity{300}}});
+    ir.main.instructions.push_back(Instruction{PrintString, Operand{}});
+
+    std::string expected;
+    for (int i = 0; i < 150; i++)
+    {
+        expected += "ab7";
+    }
+
+    std::ostringstream out;
+    VM                 vm(out);
+    ASSERT_FALSE(vm.load(ir).hadError());
+    EXPECT_FALSE(vm.run().hadError());
+    EXPECT_EQ(out.str(), expected + "\n");
+}
+
+TEST(VM_Strings, MultilineString)
+{
+    EXPECT_EQ(runSource("say \"\"\"a\nb\"\"\";"), "a\nb\n");
+}
+
+// ==================================================================================
+// 4) CONTROL FLOW
+// ==================================================================================
+
+TEST(VM_ControlFlow, IfChainTakesFirstTrueBranch)
+{
+    EXPECT_EQ(runSource(R"(
+        summon x = 5;
+        should (x > 10) { say "big"; }
+        otherwise should (x > 0) { say "small"; }
+        otherwise { say "negative"; }
+        say "done";
+    )"),
+              "small\ndone\n");
+}
+
+TEST(VM_ControlFlow, IfChainFallsToElse)
+{
+    EXPECT_EQ(runSource(R"(
+        summon x = -1;
+        should (x > 10) { say "big"; }
+        otherwise should (x > 0) { say "small"; }
+        otherwise { say "negative"; }
+    )"),
+              "negative\n");
+}
+
+TEST(VM_ControlFlow, FalseLoopNeverRuns)
+{
+    EXPECT_EQ(runSource(R"(
+        summon x = 0;
+        aslongas (x > 0) { say "loop"; }
+        say "after";
+    )"),
+              "after\n");
+}
+
+TEST(VM_ControlFlow, FusedCompareAndIncrement)
+{
+    EXPECT_EQ(runSource(R"(
+        summon a = 1;
+        summon b = 2;
+        summon c = a + 2147483647;
+        should (a < b) { say "lt"; }
+        should (b < a) { say "gt"; }
+        should (a < a) { say "eq"; }
+        say c;
+    )"),
+              "lt\n-2147483648\n");
+}
+
+TEST(VM_ControlFlow, NestedScopesShadow)
+{
+    EXPECT_EQ(runSource(R"(
+        summon x = 1;
+        {
+            summon x = 2;
+            should (x == 2) { say "inner {x}"; }
+        }
+        say "outer {x}";
+    )"),
+              "inner 2\nouter 1\n");
+}
+
+TEST(VM_ControlFlow, LogicalOperatorValues)
+{
+    EXPECT_EQ(runSource(R"(
+        summon x = 5;
+        say x > 3 and x < 10;
+        say x > 7 or x == 4;
+        say affirmative or negative and negative;
+        summon both = x == 5 and not (x == 6);
+        say "{both} {x < 0 or x > 0}";
+    )"),
+              "affirmative\nnegative\naffirmative\naffirmative affirmative\n");
+}
+
+TEST(VM_ControlFlow, ShortCircuitSkipsRightOperand)
+{
+    // The right operands divide by zero; reaching one would be a runtime error.
+    EXPECT_EQ(runSource(R"(
+        summon zero = 0;
+        say zero != 0 and 10 / zero == 1;
+        say zero == 0 or 10 / zero == 1;
+        should (zero > 0 and 10 / zero > 0) { say "taken"; } otherwise { say "skipped"; }
+        aslongas (zero == 1 or zero != 0 and 10 / zero > 0) { say "never"; }
+        say "done";
+    )"),
+              "negative\naffirmative\nskipped\ndone\n");
+}
+
+TEST(VM_ControlFlow, LogicalConditions)
+{
+    EXPECT_EQ(runSource(R"(
+        summon x = 5;
+        should (x > 3 and not (x == 6 or x == 7)) { say "a"; }
+        should (not (x > 3 and x < 4)) { say "b"; }
+        should (x < 0 or x > 9) { say "c"; } otherwise should (x == 5 or x < 0) { say "d"; }
+        should ((x == 5 and x > 4) and (x != 1 or x == 1)) { say "e"; }
+    )"),
+              "a\nb\nd\ne\n");
+}
+
+// ==================================================================================
+// 5) LOADER AND RUNTIME ERRORS
+// ==================================================================================
+
+TEST(VM_Errors, DivisionByZero)
+{
+    IrProgram ir = compileToIr(R"(
+        say "before";
+        say 1 / 0;
+        say "after";
+    )");
+
+    std::ostringstream out;
+    VM                 vm(out);
+    ASSERT_FALSE(vm.load(ir).hadError());
+
+    VmResult result = vm.run();
+    ASSERT_TRUE(result.hadError());
+    EXPECT_EQ(result.diagnostics[0].message, "Division by zero");
+    EXPECT_EQ(result.diagnostics[0].loc.line, 3);
+    EXPECT_EQ(out.str(), "before\n");
+}
+
+TEST(VM_Errors, UndefinedLabelIsRejectedAtLoad)
+{
+    IrProgram ir;
+    ir.main.instructions.push_back(Instruction{Jump, Operand{LabelId{7}}});
+
+    std::ostringstream out;
+    VM                 vm(out);
+    VmResult           result = vm.load(ir);
+    ASSERT_TRUE(result.hadError());
+    EXPECT_EQ(result.diagnostics[0].message, "Jump to undefined label");
+}
+
+TEST(VM_Errors, ProgramCanRunTwice)
+{
+    IrProgram ir = compileToIr(R"(say "again";)");
+
+    std::ostringstream out;
+    VM                 vm(out);
+    ASSERT_FALSE(vm.load(ir).hadError());
+    EXPECT_FALSE(vm.run().hadError());
+    EXPECT_FALSE(vm.run().hadError());
+    EXPECT_EQ(out.str(), "again\nagain\n");
+}
+
+// ==================================================================================
+// 6) RUNNING FROM .AMBC IMAGES
+// ==================================================================================
+
+TEST(VM_Image, RunsSerializedImage)
+{
+    IrProgram       ir = compileToIr(R"(
+        summon who = "image";
+        say "hello {who}";
+        should (1 < 2) { say "branch"; }
+    )");
+    BytecodeEmitter emitter{ir};
+    Bytecode        bytecode = emitter.emit(ir.main);
+
+    BytecodeImage image;
+    std::string   error;
+    ASSERT_TRUE(image.fromBytes(serializeImage(bytecode), error)) << error;
+
+    std::ostringstream out;
+    VM                 vm(out);
+    ASSERT_FALSE(vm.load(std::move(image)).hadError());
+    EXPECT_FALSE(vm.run().hadError());
+    EXPECT_EQ(out.str(), "hello image\nbranch\n");
+}
+
+TEST(VM_Image, EmptyImageIsRejected)
+{
+    std::ostringstream out;
+    VM                 vm(out);
+    EXPECT_TRUE(vm.load(BytecodeImage{}).hadError());
+}
+
+TEST(VM_Image, UnverifiableImageIsRejected)
+{
+    Bytecode bytecode;
+    bytecode.constants = {Constant{Bool32, ConstId{0}, true}};
+    bytecode.code = {OP_PUSH_CONST, 0, OP_NEG_I32, OP_POP, OP_HALT};
+    bytecode.maxStack = 1;
+
+    std::ostringstream out;
+    VM                 vm(out);
+    VmResult           result = vm.load(bytecode);
+    ASSERT_TRUE(result.hadError());
+    EXPECT_EQ(result.diagnostics[0].message,
+              "Malformed bytecode: NEG_I32: expected I32, got Bool32");
+    EXPECT_EQ(result.diagnostics[0].ip, 2u);
+    EXPECT_FALSE(vm.run().hadError()); // nothing left loaded
+}
+
+// ==================================================================================
+// 7) VALUE ENCODING, THE STRING HEAP AND THE STRING TABLE
+// ==================================================================================
+
+TEST(VM_Values, IntsAndBoolsAreInline)
+{
+    EXPECT_EQ(sizeof(Value), 8u);
+
+    for (int32_t v : {0, 1, -1, INT32_MAX, INT32_MIN})
+    {
+        Value value = Value::fromI32(v);
+        EXPECT_TRUE(value.isI32());
+        EXPECT_FALSE(value.isBool());
+        EXPECT_FALSE(value.isString());
+        EXPECT_EQ(value.asI32(), v);
+    }
+
+    EXPECT_TRUE(Value::fromBool(true).asBool());
+    EXPECT_FALSE(Value::fromBool(false).asBool());
+    EXPECT_TRUE(Value::fromBool(false).isBool());
+    EXPECT_NE(Value::fromBool(false).raw(), Value::fromI32(0).raw());
+}
+
+TEST(VM_Values, StringsArePointers)
+{
+    StringHeap          heap;
+    const StringObject* s = heap.make("text");
+    Value               value = Value::fromString(s);
+
+    EXPECT_TRUE(value.isString());
+    EXPECT_EQ(value.asString(), s);
+    EXPECT_EQ(value.asString()->view(), "text");
+    EXPECT_EQ(value.asString()->chars()[4], '\0');
+    EXPECT_FALSE(Value{}.isString());
+}
+
+TEST(VM_StringHeap, SweepFreesUnreachableStrings)
+{
+    StringHeap heap;
+    Value      roots[2] = {Value::fromString(heap.make("keep")), Value::fromI32(3)};
+    heap.make("drop");
+    heap.make("drop too");
+    ASSERT_EQ(heap.liveCount(), 3u);
+
+    heap.mark(roots, roots + 2);
+    heap.sweep();
+    EXPECT_EQ(heap.liveCount(), 1u);
+    EXPECT_EQ(roots[0].asString()->view(), "keep");
+
+    // Marks are cleared by the sweep, so an unrooted survivor goes next time.
+    heap.sweep();
+    EXPECT_EQ(heap.liveCount(), 0u);
+}
+
+TEST(VM_StringHeap, PinnedStringsSurviveSweeps)
+{
+    StringHeap          heap;
+    const StringObject* pinned = heap.pin("forever");
+    heap.sweep();
+    heap.clear();
+    EXPECT_EQ(pinned->view(), "forever");
+    EXPECT_EQ(heap.liveCount(), 0u);
+}
+
+TEST(VM_Strings, EmptyPartsAndEquality)
+{
+    EXPECT_EQ(runSource(R"(
+        summon empty = "";
+        summon b = "b";
+        say "{empty}x{empty}";
+        say "ab" == "a{b}";
+        say "{1}" != "1";
+    )"),
+              "x\naffirmative\nnegative\n");
+}
+
+TEST(VM_Builtins, FormatsI32AtEveryWidth)
+{
+    int32_t values[] = {0, 7, -7, 10, 99, -100, 12345, 999999999, 1000000000, 2147483647,
+                        -2147483647 - 1};
+    for (int32_t value : values)
+    {
+        char  text[I32_TEXT_MAX];
+        char* end = formatI32(value, text);
+        EXPECT_EQ(std::string(text, end), std::to_string(value));
+        EXPECT_EQ(i32TextLength(value), static_cast<uint32_t>(end - text));
+    }
+
+    StringHeap heap;
+    EXPECT_EQ(makeI32String(heap, -2147483647 - 1)->view(), "-2147483648");
+    EXPECT_EQ(makeI32String(heap, 5)->chars()[1], '\0');
+}
+
+TEST(VM_StringTable, InternsOneStringPerText)
+{
+    StringTable         table;
+    const StringObject* a = table.intern("status");
+    EXPECT_EQ(table.intern(std::string("stat") + "us"), a);
+    EXPECT_NE(a->flags & STRING_INTERNED, 0u);
+    EXPECT_EQ(table.smallInt(-7)->view(), "-7");
+    EXPECT_EQ(table.smallInt(42), table.intern("42"));
+    EXPECT_EQ(table.size(), 3u);
+
+    // Different interned strings are unequal without comparing characters;
+    // a heap string with the same text still compares by content.
+    StringHeap heap;
+    EXPECT_FALSE(stringEquals(a, table.intern("statuS")));
+    EXPECT_TRUE(stringEquals(a, heap.make("status")));
+
+    table.clear();
+    EXPECT_EQ(table.size(), 0u);
+}
+
+TEST(VM_StringTable, AdoptsImageStrings)
+{
+    alignas(8) unsigned char bytes[16] = {};
+    auto* adopted = reinterpret_cast<StringObject*>(bytes);
+    adopted->length = 2;
+    adopted->flags = STRING_INTERNED;
+    std::memcpy(bytes + sizeof(StringObject), "ok", 3);
+
+    StringTable table;
+    EXPECT_EQ(table.intern(adopted), adopted);
+    EXPECT_EQ(table.intern("ok"), adopted);
+}
+
+TEST(VM_StringTable, ConvertedNumbersMatchConstants)
+{
+    const char* source = R"(
+        summon code = 200;
+        summon big = 100000;
+        say "{code}" == "200";
+        say "{code}" != "404";
+        say "{big}" == "100000";
+        say "{affirmative}" == "affirmative";
+    )";
+    EXPECT_EQ(runSource(source), "affirmative\naffirmative\naffirmative\naffirmative\n");
+
+    std::ostringstream out;
+    RegisterVM         vm(out);
+    ASSERT_FALSE(vm.load(compileToIr(source)).hadError());
+    ASSERT_FALSE(vm.run().hadError());
+    EXPECT_EQ(out.str(), "affirmative\naffirmative\naffirmative\naffirmative\n");
+}
+
+// ==================================================================================
+// 8) REGISTER ENGINE
+// ==================================================================================
+
+/**
+ * @brief Compile and run source code on the register engine
+ */
+static std::string runOnRegisters(const std::string& source)
+{
+    IrProgram ir = compileToIr(source);
+
+    std::ostringstream out;
+    RegisterVM         vm(out);
+    EXPECT_FALSE(vm.load(ir).hadError());
+    EXPECT_FALSE(vm.run().hadError());
+    return out.str();
+}
+
+TEST(VM_Register, MatchesStackEngine)
+{
+    const char* sources[] = {
+        R"(say 1 + 2 * 3 - 4 / 2; say -(5) * 2; say 2147483647 + 1; say not (1 < 2);)",
+        R"(
+            summon x = 10;
+            summon name = "Ambra";
+            say "{name}: {x + 1} {x > 5} {not (x < 3)}";
+            say "a" == "a"; say affirmative != negative;
+        )",
+        R"(
+            summon x = 4;
+            should (x == 1) { say "one"; }
+            otherwise should (x > 3) { summon y = x * x; say "big {y}"; }
+            otherwise { say "small"; }
+        )",
+        R"(
+            summon a = 1;
+            summon b = 2;
+            should (a < b) { say "lt"; }
+            aslongas (b < a) { say "never"; }
+            say "{a}-{b}-{a}-{b}";
+        )",
+        R"(
+            summon a = 1;
+            summon b = a > 0 and a < 2 or a == 7;
+            should (b and not (a == 2 or a == 3)) { say "yes {b}"; }
+            say a > 1 and 10 / (a - 1) > 0;
+        )",
+    };
+
+    for (const char* source : sources)
+    {
+        EXPECT_EQ(runOnRegisters(source), runSource(source)) << source;
+    }
+}
+
+TEST(VM_Register, StoreRetargetsProducer)
+{
+    IrProgram  ir = compileToIr(R"(
+        summon x = 1;
+        summon y = x + 2;
+    )");
+    RegisterVM vm;
+    ASSERT_FALSE(vm.load(ir).hadError());
+
+    // MOVE x <- 1; ADD_I32 y <- x, 2; HALT
+    const RegisterCode& code = vm.loaded();
+    ASSERT_EQ(code.code.size(), 3u);
+    EXPECT_EQ(code.code[0].op, REG_MOVE);
+    EXPECT_EQ(code.code[1].op, REG_ADD_I32);
+    EXPECT_EQ(code.code[1].a, 1u);
+    EXPECT_EQ(code.code[2].op, REG_HALT);
+}
+
+TEST(VM_Register, FewerInstructionsThanIr)
+{
+    IrProgram ir = compileToIr(R"(
+        summon x = 3;
+        summon y = x * 2 + x;
+        should (y > x) { say "{x} {y}"; }
+    )");
+
+    size_t irCount = 0;
+    for (const Instruction& inst : ir.main.instructions)
+    {
+        if (inst.opcode != JLabel)
+            irCount++;
+    }
+
+    RegisterVM vm;
+    ASSERT_FALSE(vm.load(ir).hadError());
+    EXPECT_LT(vm.loaded().code.size(), irCount);
+}
+
+TEST(VM_Register, DivisionByZero)
+{
+    IrProgram ir = compileToIr(R"(
+        say "before";
+        say 1 / 0;
+    )");
+
+    std::ostringstream out;
+    RegisterVM         vm(out);
+    ASSERT_FALSE(vm.load(ir).hadError());
+
+    VmResult result = vm.run();
+    ASSERT_TRUE(result.hadError());
+    EXPECT_EQ(result.diagnostics[0].message, "Division by zero");
+    EXPECT_EQ(result.diagnostics[0].loc.line, 3);
+    EXPECT_EQ(out.str(), "before\n");
+}
+
+TEST(VM_Register, UndefinedLabelIsRejectedAtLoad)
+{
+    IrProgram ir;
+    ir.main.instructions.push_back(Instruction{Jump, Operand{LabelId{7}}});
+
+    RegisterVM vm;
+    VmResult   result = vm.load(ir);
+    ASSERT_TRUE(result.hadError());
+    EXPECT_EQ(result.diagnostics[0].message, "Jump to undefined label");
+}
+
+// ==================================================================================
+// 9) PROFILING
+// ==================================================================================
+
+/**
+ * @brief A loop the language cannot express yet (there is no assignment):
+ *        line 3 says "tick" five times, line 4 counts and jumps back to line 2
+ */
+static IrProgram countingLoop()
+{
+    IrProgram ir;
+    ir.constants.push_back(Constant{I32, ConstId{0}, 0});
+    ir.constants.push_back(Constant{I32, ConstId{1}, 1});
+    ir.constants.push_back(Constant{I32, ConstId{2}, 5});
+    ir.constants.push_back(Constant{String32, ConstId{3}, std::string("tick")});
+    ir.main.localTable.locals.push_back(LocalInfo{LocalId{0}, I32, "i", {1, 1}});
+    ir.main.instructions = {
+        {PushConst, ConstId{0}, {1, 1}},   {StoreLocal, LocalId{0}, {1, 1}},
+        {JLabel, LabelId{0}, {2, 1}},      {LoadLocal, LocalId{0}, {2, 1}},
+        {PushConst, ConstId{2}, {2, 1}},   {CmpLtI32, {}, {2, 1}},
+        {JumpIfFalse, LabelId{1}, {2, 1}}, {PushConst, ConstId{3}, {3, 1}},
+        {PrintString, {}, {3, 1}},         {LoadLocal, LocalId{0}, {4, 1}},
+        {PushConst, ConstId{1}, {4, 1}},   {AddI32, {}, {4, 1}},
+        {StoreLocal, LocalId{0}, {4, 1}},  {Jump, LabelId{0}, {4, 1}},
+        {JLabel, LabelId{1}, {5, 1}},      {Halt, {}, {5, 1}},
+    };
+    ir.main.labelTable.position[LabelId{0}] = 2;
+    ir.main.labelTable.position[LabelId{1}] = 14;
+    return ir;
+}
+
+TEST(VM_Profile, CountsLinesAndBackEdges)
+{
+    IrProgram ir = countingLoop();
+
+    std::ostringstream out;
+    VM                 vm(out);
+    VmProfile          profile;
+    vm.setProfile(&profile);
+    ASSERT_FALSE(vm.load(ir).hadError());
+    ASSERT_FALSE(vm.run().hadError());
+    EXPECT_EQ(out.str(), "tick\ntick\ntick\ntick\ntick\n");
+
+    std::vector<BackEdgeProfile> edges = profile.hotBackEdges(10);
+    ASSERT_EQ(edges.size(), 1u);
+    EXPECT_EQ(edges[0].taken, 5u);
+    EXPECT_EQ(edges[0].fromLoc.line, 4);
+    EXPECT_EQ(edges[0].toLoc.line, 2);
+    EXPECT_LT(edges[0].to, edges[0].from);
+
+    uint64_t printed = 0;
+    for (const LineProfile& line : profile.hotLines(10))
+    {
+        if (line.line == 3)
+        {
+            printed = line.executions;
+        }
+    }
+    // Every instruction on line 3 runs once per iteration.
+    EXPECT_GT(printed, 0u);
+    EXPECT_EQ(printed % 5, 0u);
+
+    uint64_t executions = 0;
+    for (const OpcodeProfile& op : profile.opcodes())
+    {
+        executions += op.executions;
+    }
+    uint64_t perInstruction = 0;
+    for (const InstructionProfile& instruction : profile.hotInstructions(1000))
+    {
+        perInstruction += instruction.executions;
+    }
+    EXPECT_EQ(executions, perInstruction);
+    EXPECT_EQ(profile.hotInstructions(2).size(), 2u);
+}
+
+TEST(VM_Profile, DetachedProfileIsLeftAlone)
+{
+    IrProgram ir = countingLoop();
+
+    std::ostringstream out;
+    VM                 vm(out);
+    VmProfile          profile;
+    vm.setProfile(&profile);
+    ASSERT_FALSE(vm.load(ir).hadError());
+    ASSERT_FALSE(vm.run().hadError());
+    vm.setProfile(nullptr);
+    ASSERT_FALSE(vm.run().hadError());
+
+    EXPECT_EQ(profile.hotBackEdges(10)[0].taken, 5u);
+    EXPECT_EQ(out.str().size(), 2 * std::string("tick\n").size() * 5);
+}
+
+// ==================================================================================
+// 10) LOOP JIT
+// ==================================================================================
+
+/**
+ * @brief Six iterations of line 3 saying "n=" + -((i * 7) / (divisor - i)),
+ *        mixing inline arithmetic with the string helpers
+ */
+static IrProgram arithmeticLoop(int32_t divisor)
+{
+    IrProgram ir;
+    ir.constants.push_back(Constant{I32, ConstId{0}, 0});
+    ir.constants.push_back(Constant{I32, ConstId{1}, 1});
+    ir.constants.push_back(Constant{I32, ConstId{2}, 6});
+    ir.constants.push_back(Constant{I32, ConstId{3}, 7});
+    ir.constants.push_back(Constant{I32, ConstId{4}, divisor});
+    ir.constants.push_back(Constant{String32, ConstId{5}, std::string("n=")});
+    ir.main.localTable.locals.push_back(LocalInfo{LocalId{0}, I32, "i", {1, 1}});
+    ir.main.instructions = {
+        {PushConst, ConstId{0}, {1, 1}},   {StoreLocal, LocalId{0}, {1, 1}},
+        {JLabel, LabelId{0}, {2, 1}},      {LoadLocal, LocalId{0}, {2, 1}},
+        {PushConst, ConstId{2}, {2, 1}},   {CmpLtI32, {}, {2, 1}},
+        {JumpIfFalse, LabelId{1}, {2, 1}}, {PushConst, ConstId{5}, {3, 1}},
+        {LoadLocal, LocalId{0}, {3, 1}},   {PushConst, ConstId{3}, {3, 1}},
+        {MulI32, {}, {3, 1}},              {PushConst, ConstId{4}, {3, 1}},
+        {LoadLocal, LocalId{0}, {3, 1}},   {SubI32, {}, {3, 1}},
+        {DivI32, {}, {3, 1}},              {NegI32, {}, {3, 1}},
+        {ToString, {}, {3, 1}},            {ConcatString, {}, {3, 1}},
+        {PrintString, {}, {3, 1}},         {LoadLocal, LocalId{0}, {4, 1}},
+        {PushConst, ConstId{1}, {4, 1}},   {AddI32, {}, {4, 1}},
+        {StoreLocal, LocalId{0}, {4, 1}},  {Jump, LabelId{0}, {4, 1}},
+        {JLabel, LabelId{1}, {5, 1}},      {Halt, {}, {5, 1}},
+    };
+    ir.main.labelTable.position[LabelId{0}] = 2;
+    ir.main.labelTable.position[LabelId{1}] = 24;
+    return ir;
+}
+
+TEST(VM_Jit, CompiledLoopPrintsTheSame)
+{
+    if (!LoopJit::supported())
+    {
+        GTEST_SKIP() << "no native code generation on this platform";
+    }
+
+    std::ostringstream out;
+    VM                 vm(out);
+    vm.setJitThreshold(1);
+    ASSERT_FALSE(vm.load(countingLoop()).hadError());
+    ASSERT_FALSE(vm.run().hadError());
+    EXPECT_EQ(out.str(), "tick\ntick\ntick\ntick\ntick\n");
+    EXPECT_EQ(vm.jitCompiledLoops(), 1u);
+}
+
+TEST(VM_Jit, ArithmeticAndStringHelpers)
+{
+    if (!LoopJit::supported())
+    {
+        GTEST_SKIP() << "no native code generation on this platform";
+    }
+
+    std::ostringstream out;
+    VM                 vm(out);
+    vm.setJitThreshold(1);
+    ASSERT_FALSE(vm.load(arithmeticLoop(-2)).hadError());
+    ASSERT_FALSE(vm.run().hadError());
+    EXPECT_EQ(out.str(), "n=0\nn=2\nn=3\nn=4\nn=4\nn=5\n");
+    EXPECT_EQ(vm.jitCompiledLoops(), 1u);
+
+    std::ostringstream interpreted;
+    VM                 plain(interpreted);
+    plain.setJit(false);
+    ASSERT_FALSE(plain.load(arithmeticLoop(-2)).hadError());
+    ASSERT_FALSE(plain.run().hadError());
+    EXPECT_EQ(interpreted.str(), out.str());
+    EXPECT_EQ(plain.jitCompiledLoops(), 0u);
+}
+
+TEST(VM_Jit, DivisionByZeroLeavesToTheInterpreter)
+{
+    if (!LoopJit::supported())
+    {
+        GTEST_SKIP() << "no native code generation on this platform";
+    }
+
+    std::ostringstream out;
+    VM                 vm(out);
+    vm.setJitThreshold(1);
+    ASSERT_FALSE(vm.load(arithmeticLoop(3)).hadError());
+    VmResult result = vm.run();
+
+    ASSERT_TRUE(result.hadError());
+    EXPECT_EQ(result.diagnostics[0].message, "Division by zero");
+    EXPECT_EQ(result.diagnostics[0].loc.line, 3);
+    EXPECT_EQ(out.str(), "n=0\nn=-3\nn=-14\n");
+    EXPECT_EQ(vm.jitCompiledLoops(), 1u);
+}
+
+TEST(VM_Jit, ColdLoopsStayInterpreted)
+{
+    std::ostringstream out;
+    VM                 vm(out);
+    vm.setJitThreshold(100);
+    ASSERT_FALSE(vm.load(countingLoop()).hadError());
+    ASSERT_FALSE(vm.run().hadError());
+    EXPECT_EQ(out.str(), "tick\ntick\ntick\ntick\ntick\n");
+    EXPECT_EQ(vm.jitCompiledLoops(), 0u);
+}
+
+// ==================================================================================
+// 11) CHECKED ENGINE
+// ==================================================================================
+
+/**
+ * @brief Run hand-written code on the checked engine, without verification
+ * @param out Receives what the code prints
+ */
+static VmResult runChecked(std::vector<uint8_t> code, std::vector<Constant> constants,
+                           std::ostringstream& out, uint32_t localCount = 0)
+{
+    Bytecode bytecode;
+    bytecode.code = std::move(code);
+    bytecode.constants = std::move(constants);
+    bytecode.localCount = localCount;
+    bytecode.maxStack =
+        codeLimits(bytecode.code.data(), static_cast<uint32_t>(bytecode.code.size())).instructions;
+
+    VM vm(out);
+    vm.setChecked(true);
+    VmResult loaded = vm.load(bytecode);
+    EXPECT_FALSE(loaded.hadError());
+    return loaded.hadError() ? loaded : vm.run();
+}
+
+TEST(VM_Checked, RunsLikeTheFastPath)
+{
+    const char* source = R"(
+        summon n = 6;
+        summon name = "checked";
+        say "{name} {n * 7} {n > 2}";
+        should (n == 6) { say -n; }
+    )";
+    IrProgram ir = compileToIr(source);
+
+    std::ostringstream out;
+    VM                 vm(out);
+    vm.setChecked(true);
+    ASSERT_FALSE(vm.load(ir).hadError());
+    ASSERT_FALSE(vm.run().hadError());
+    EXPECT_EQ(out.str(), runSource(source));
+}
+
+TEST(VM_Checked, StopsAtOperandOfTheWrongType)
+{
+    std::vector<Constant> constants = {Constant{String32, ConstId{0}, std::string("first")},
+                                       Constant{Bool32, ConstId{1}, false}};
+
+    std::ostringstream out;
+    VmResult           result = runChecked(
+        {OP_PRINT_CONST, 0, OP_PUSH_CONST, 1, OP_TO_STRING_I32, OP_PRINT_STRING, OP_HALT},
+        constants, out);
+    ASSERT_TRUE(result.hadError());
+    EXPECT_EQ(result.diagnostics[0].message, "Operand of the wrong type");
+    EXPECT_EQ(result.diagnostics[0].ip, 4u);
+    EXPECT_EQ(out.str(), "first\n");
+}
+
+TEST(VM_Checked, StopsAtLoadBeforeStore)
+{
+    std::ostringstream out;
+    VmResult result = runChecked({OP_LOAD_LOCAL, 0, OP_POP, OP_HALT}, {}, out, 1);
+    ASSERT_TRUE(result.hadError());
+    EXPECT_EQ(result.diagnostics[0].message, "Load of a local before it is stored");
+}
+
+TEST(VM_Checked, RejectsOversizedFrameBeforeAllocating)
 {
-    std::cout << "Running vm tests...\n";
+    Bytecode bytecode;
+    bytecode.code = {OP_NOP, OP_HALT};
+    bytecode.localCount = 0xFFFFFFF0;
+    bytecode.maxStack = 0xFFFFFFF0;
+
+    std::ostringstream out;
+    VM                 vm(out);
+    vm.setChecked(true);
+    VmResult result = vm.load(bytecode);
+    ASSERT_TRUE(result.hadError());
+    EXPECT_EQ(result.diagnostics[0].message,
+              "header localCount 4294967280 is more than the code can use");
+
+    bytecode.localCount = 0;
+    result = vm.load(bytecode);
+    ASSERT_TRUE(result.hadError());
+    EXPECT_EQ(result.diagnostics[0].message,
+              "header maxStack 4294967280 is deeper than the code can reach");
+}
+
+TEST(VM_Checked, StopsAtBadStackAndJumps)
+{
+    std::ostringstream out;
+    VmResult           underflow = runChecked({OP_POP, OP_HALT}, {}, out);
+    ASSERT_TRUE(underflow.hadError());
+    EXPECT_EQ(underflow.diagnostics[0].message, "Operand stack underflow");
+
+    VmResult away = runChecked({OP_JUMP, 0x00, 0x10, 0, 0, OP_HALT}, {}, out);
+    ASSERT_TRUE(away.hadError());
+    EXPECT_EQ(away.diagnostics[0].message, "Jump target outside the code section");
+
+    VmResult opcode = runChecked({OP_JUMP, 6, 0, 0, 0, OP_HALT, OP_COUNT, OP_HALT}, {}, out);
+    ASSERT_TRUE(opcode.hadError());
+    EXPECT_EQ(opcode.diagnostics[0].message, "Invalid opcode");
+    EXPECT_EQ(opcode.diagnostics[0].ip, 6u);
+}
+
+// ==================================================================================
+// 12) OUTPUT BUFFERING
+// ==================================================================================
+
+TEST(VM_Output, LinesWaitForAFullBufferOrFlush)
+{
+    std::ostringstream stream;
+    OutputBuffer       out(stream, 8);
+    out.writeLine("abc", 3);
+    out.writeLine("de", 2);
+    EXPECT_EQ(stream.str(), "");
+
+    // Does not fit behind the pending bytes: both leave together.
+    out.writeLine("fgh", 3);
+    EXPECT_EQ(stream.str(), "abc\nde\nfgh\n");
+
+    char* end = formatI32(-42, out.claim(I32_TEXT_MAX + 1));
+    *end++ = '\n';
+    out.commit(end);
+    out.writeLine("a line longer than the buffer", 29);
+    EXPECT_EQ(stream.str(), "abc\nde\nfgh\n-42\na line longer than the buffer\n");
+    EXPECT_TRUE(out.flush());
+}
+
+TEST(VM_Output, UnbufferedWritesEveryLine)
+{
+    std::ostringstream stream;
+    OutputBuffer       out(stream);
+    out.writeLine("pending", 7);
+    out.setUnbuffered(true);
+    EXPECT_EQ(stream.str(), "pending\n");
+    out.writeLine("now", 3);
+    EXPECT_EQ(stream.str(), "pending\nnow\n");
+}
+
+TEST(VM_Output, RunFlushesAtHaltAndOnError)
+{
+    std::ostringstream stream;
+    VM                 vm(stream);
+    ASSERT_FALSE(vm.load(compileToIr("say 1; say \"two\"; say 3 / 0;")).hadError());
+    VmResult result = vm.run();
+    ASSERT_TRUE(result.hadError());
+    EXPECT_EQ(stream.str(), "1\ntwo\n");
+
+    std::ostringstream registers;
+    RegisterVM         other(registers);
+    ASSERT_FALSE(other.load(compileToIr("say 1; say \"two\";")).hadError());
+    ASSERT_FALSE(other.run().hadError());
+    EXPECT_EQ(registers.str(), "1\ntwo\n");
+}
+
+TEST(VM_Output, WritesToAFileDescriptor)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    int ends[2];
+    ASSERT_EQ(pipe(ends), 0);
+    {
+        OutputBuffer out(ends[1], 4);
+        out.writeLine("ab", 2);
+        out.writeLine("a long line", 11);
+        out.writeLine("c", 1);
+        EXPECT_TRUE(out.flush());
+    }
+    close(ends[1]);
+
+    std::string text;
+    char        chunk[64];
+    ssize_t     n;
+    while ((n = read(ends[0], chunk, sizeof chunk)) > 0)
+    {
+        text.append(chunk, static_cast<size_t>(n));
+    }
+    close(ends[0]);
+    EXPECT_EQ(text, "ab\na long line\nc\n");
+#else
+    GTEST_SKIP() << "no pipes on this platform";
+#endif
+}
+
+// ==================================================================================
+// 13) PROGRAMS SHARED BETWEEN VMS
+// ==================================================================================
+
+TEST(VM_Shared, ConcurrentRunsOfOneProgram)
+{
+    const char* source = R"(
+        summon code = 200;
+        summon big = 123456;
+        summon name = "worker";
+        say "{name} {code} {big}";
+        say "{code}" == "200";
+        say "{big}" == "123456";
+        say "{code > 100}" == "affirmative";
+    )";
+    auto program = std::make_shared<VmProgram>();
+    ASSERT_FALSE(program->load(compileToIr(source)).hadError());
+    EXPECT_TRUE(program->verified());
+
+    constexpr size_t         WORKERS = 8;
+    std::vector<std::string> outputs(WORKERS);
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < WORKERS; w++)
+    {
+        threads.emplace_back(
+            [&, w]
+            {
+                std::ostringstream out;
+                VM                 vm(out);
+                for (int run = 0; run < 50; run++)
+                {
+                    if (vm.load(program).hadError() || vm.run().hadError())
+                        return;
+                }
+                outputs[w] = out.str();
+            });
+    }
+    for (std::thread& t : threads)
+    {
+        t.join();
+    }
+
+    std::string once = runSource(source);
+    std::string expected;
+    for (int run = 0; run < 50; run++)
+    {
+        expected += once;
+    }
+    for (const std::string& output : outputs)
+    {
+        EXPECT_EQ(output, expected);
+    }
+}
+
+TEST(VM_Shared, ProgramOutlivesAndSurvivesItsVms)
+{
+    auto program = std::make_shared<VmProgram>();
+    ASSERT_FALSE(program->load(compileToIr(R"(say "kept"; say 5;)")).hadError());
+    {
+        std::ostringstream out;
+        VM                 vm(out);
+        ASSERT_FALSE(vm.load(program).hadError());
+        ASSERT_FALSE(vm.run().hadError());
+        EXPECT_EQ(out.str(), "kept\n5\n");
+    }
+
+    std::ostringstream out;
+    VM                 vm(out);
+    ASSERT_FALSE(vm.load(program).hadError());
+    ASSERT_FALSE(vm.run().hadError());
+    EXPECT_EQ(out.str(), "kept\n5\n");
+
+    VmResult empty = vm.load(std::make_shared<VmProgram>());
+    ASSERT_TRUE(empty.hadError());
+    EXPECT_EQ(empty.diagnostics[0].message, "No bytecode image to load");
+    EXPECT_FALSE(vm.run().hadError());
+}
+
+// ==================================================================================
+// 14) PROGRAM CACHE
+// ==================================================================================
+
+/**
+ * @brief A loader that compiles `source` and counts its calls
+ */
+static ProgramCache::Loader countingLoader(const std::string& source, std::atomic<int>& calls)
+{
+    return [source, &calls](VmProgram& program)
+    {
+        calls++;
+        return program.load(compileToIr(source));
+    };
+}
+
+TEST(VM_ProgramCache, HitSkipsLoading)
+{
+    ProgramCache     cache;
+    std::atomic<int> calls{0};
+    const char*      source = R"(say "cached {6 * 7}";)";
+    VmResult         result;
+
+    auto first = cache.get(ProgramCache::sourceKey(source), countingLoader(source, calls), result);
+    auto second = cache.get(ProgramCache::sourceKey(source), countingLoader(source, calls), result);
+    ASSERT_NE(first, nullptr);
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(cache.hits(), 1u);
+    EXPECT_EQ(cache.misses(), 1u);
+
+    std::ostringstream out;
+    VM                 vm(out);
+    ASSERT_FALSE(vm.load(second).hadError());
+    ASSERT_FALSE(vm.run().hadError());
+    EXPECT_EQ(out.str(), "cached 42\n");
+
+    EXPECT_FALSE(ProgramCache::sourceKey("say 1;") == ProgramCache::sourceKey("say 2;"));
+    EXPECT_FALSE(ProgramCache::sourceKey("say 1;") == ProgramCache::imageKey("say 1;"));
+}
+
+TEST(VM_ProgramCache, EvictsLeastRecentlyUsed)
+{
+    ProgramCache     cache(2);
+    std::atomic<int> calls{0};
+    VmResult         result;
+    auto load = [&](const std::string& source)
+    { return cache.get(ProgramCache::sourceKey(source), countingLoader(source, calls), result); };
+
+    auto a = load("say 1;");
+    auto b = load("say 2;");
+    load("say 1;"); // a is now more recent than b
+    load("say 3;");
+    EXPECT_EQ(cache.size(), 2u);
+    EXPECT_NE(cache.find(ProgramCache::sourceKey("say 1;")), nullptr);
+    EXPECT_EQ(cache.find(ProgramCache::sourceKey("say 2;")), nullptr);
+
+    // An evicted program lives on while someone still holds it.
+    std::ostringstream out;
+    VM                 vm(out);
+    ASSERT_FALSE(vm.load(b).hadError());
+    ASSERT_FALSE(vm.run().hadError());
+    EXPECT_EQ(out.str(), "2\n");
+
+    cache.clear();
+    EXPECT_EQ(cache.size(), 0u);
+    EXPECT_EQ(calls, 3);
+}
+
+TEST(VM_ProgramCache, FailedLoadsAreNotCached)
+{
+    ProgramCache cache;
+    VmResult     result;
+    int          calls = 0;
+    auto         failing = [&](VmProgram& program)
+    {
+        calls++;
+        return program.load(BytecodeImage{});
+    };
+
+    EXPECT_EQ(cache.get(ProgramCache::imageKey("bad"), failing, result), nullptr);
+    ASSERT_TRUE(result.hadError());
+    EXPECT_EQ(result.diagnostics[0].message, "No bytecode image to load");
+    EXPECT_EQ(cache.get(ProgramCache::imageKey("bad"), failing, result), nullptr);
+    EXPECT_EQ(calls, 2);
+    EXPECT_EQ(cache.size(), 0u);
+}
+
+TEST(VM_ProgramCache, ConcurrentMissesLoadOnce)
+{
+    ProgramCache     cache;
+    std::atomic<int> calls{0};
+    const char*      source = "say 7;";
+    ImageCacheKey    key = ProgramCache::sourceKey(source);
+
+    constexpr size_t                              WORKERS = 8;
+    std::vector<std::shared_ptr<const VmProgram>> programs(WORKERS);
+    std::vector<std::thread>                      threads;
+    for (size_t w = 0; w < WORKERS; w++)
+    {
+        threads.emplace_back(
+            [&, w]
+            {
+                VmResult result;
+                programs[w] = cache.get(key, countingLoader(source, calls), result);
+            });
+    }
+    for (std::thread& t : threads)
+    {
+        t.join();
+    }
+
+    EXPECT_EQ(calls, 1);
+    for (const auto& program : programs)
+    {
+        EXPECT_EQ(program, programs[0]);
+    }
+}
+
+TEST(VM_ProgramCache, ThrowingLoaderReleasesWaiters)
+{
+    ProgramCache     cache;
+    std::atomic<int> calls{0};
+    const char*      source = "say 8;";
+    ImageCacheKey    key = ProgramCache::sourceKey(source);
+    std::atomic<int> entered{0};
+    auto             throwing = [&](VmProgram&) -> VmResult
+    {
+        entered++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        throw std::runtime_error("loader failed");
+    };
+
+    // A second get() arrives while the first is loading and must wake when it throws.
+    auto waiter = std::async(std::launch::async,
+                             [&]
+                             {
+                                 while (entered == 0)
+                                 {
+                                     std::this_thread::yield();
+                                 }
+                                 VmResult result;
+                                 return cache.get(key, countingLoader(source, calls), result);
+                             });
+    VmResult result;
+    EXPECT_THROW(cache.get(key, throwing, result), std::runtime_error);
+    ASSERT_EQ(waiter.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+    EXPECT_NE(waiter.get(), nullptr);
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(cache.size(), 1u);
+}
+
+// ==================================================================================
+// 15) EXECUTION BUDGETS
+// ==================================================================================
+
+TEST(VM_Budget, SuspendsAtBackEdgesAndResumes)
+{
+    for (bool checked : {false, true})
+    {
+        std::ostringstream out;
+        VM                 vm(out);
+        vm.setChecked(checked);
+        vm.setBudget(2);
+        ASSERT_FALSE(vm.load(countingLoop()).hadError());
+
+        // Five iterations close the loop five times: 2 + 2 + 1.
+        ASSERT_FALSE(vm.run().hadError());
+        EXPECT_TRUE(vm.suspended());
+        ASSERT_FALSE(vm.resume().hadError());
+        EXPECT_TRUE(vm.suspended());
+        EXPECT_EQ(out.str(), ""); // still buffered
+        ASSERT_FALSE(vm.resume().hadError());
+        EXPECT_FALSE(vm.suspended());
+        EXPECT_EQ(out.str(), "tick\ntick\ntick\ntick\ntick\n");
+
+        // Nothing is left to resume.
+        ASSERT_FALSE(vm.resume().hadError());
+        EXPECT_EQ(out.str(), "tick\ntick\ntick\ntick\ntick\n");
+    }
+}
+
+TEST(VM_Budget, EndlessLoopStaysSchedulable)
+{
+    std::ostringstream out;
+    VM                 vm(out);
+    vm.setBudget(100);
+    ASSERT_FALSE(vm.load(compileToIr(R"(
+        summon a = 1;
+        summon b = 2;
+        say "start {a}";
+        aslongas (a < b) { say "{a}-{b}"; }
+    )")).hadError());
+
+    ASSERT_FALSE(vm.run().hadError());
+    for (int slice = 0; slice < 10; slice++)
+    {
+        EXPECT_TRUE(vm.suspended());
+        ASSERT_FALSE(vm.resume().hadError());
+    }
+    EXPECT_TRUE(vm.suspended());
 
-    // TODO: Add test assertions
-    return 0;
-}
\ No newline at end of file
+    // Straight-line code never suspends, and run() starts over.
+    ASSERT_FALSE(vm.load(compileToIr("say 1; say 2;")).hadError());
+    ASSERT_FALSE(vm.run().hadError());
+    EXPECT_FALSE(vm.suspended());
+    EXPECT_EQ(out.str().substr(out.str().size() - 4), "1\n2\n");
+}